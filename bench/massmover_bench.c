@@ -0,0 +1,503 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Benchmark
+ *
+ * Drives the unmodified plugin entry points against the SDK stand-in and
+ * reports, per mass move, the wall time spent inside ts3plugin_onMenuItemEvent,
+ * the time until the first move request, the SDK calls made per phase and the
+ * heap allocations performed. The plugin plans and sends on its worker thread,
+ * so after each click the benchmark keeps delivering events until the job has
+ * printed its result. With --hotkey every round presses the gather hotkey
+ * instead, after giving the worker time to plan it ahead. With --connections
+ * several server tabs are connected at once: every round clicks on each of
+ * them back to back and waits until all of their moves settled, or with
+ * --hotkey switches to the next tab and presses there. --preview clicks
+ * "Preview MassMove" instead, which only plans, so the settle time is what
+ * planning costs; --saved previews first, outside the measured phase, and
+ * then clicks "Run saved MassMove", which only sends. --undo moves first,
+ * outside the measured phase, and then clicks "Undo last MassMove", so the
+ * settle time is how long sending everyone back takes. --double-click
+ * clicks every entry twice in a row, the way an impatient admin does;
+ * --coalesce sets coalesce_ms for the run (0 by default, so every round
+ * moves everyone even when the target repeats), which decides whether the
+ * second click joins the first or plans and sends again. --trickle N
+ * gathers one family before the first round and then has N clients from
+ * elsewhere join it every round, after which the round clicks "MassMove
+ * here" again; with --follow the family is gathered with "MassMove here and
+ * follow" instead and nothing is clicked, the round waits for the batched
+ * move of the late joiners, so comparing the two shows what following
+ * saves in move requests.
+ *
+ * Usage: massmover_bench [--shape chain|fan|mix] [--channels N] [--clients N]
+ *                        [--occupied PERCENT] [--rounds N] [--seed N]
+ *                        [--flood BUDGET] [--flood-refill PER_SECOND]
+ *                        [--protected EVERY_NTH_CLIENT] [--scope family|levels|subtree]
+ *                        [--hotkey | --preview | --saved | --undo | --double-click]
+ *                        [--connections N] [--coalesce MS] [--trickle N [--follow]]
+ *
+ * Unless STANDIN_CONFIG_PATH is set, the plugin gets a fresh config path
+ * holding only the massmover.ini written for the run.
+ *
+ * The last line of the output is a single RESULT line meant for scripts
+ * that compare runs across releases.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "teamspeak/public_definitions.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+
+#include "massmover.h"
+#include "platform.h"
+#include "ts3_standin.h"
+
+#define BENCH_MENU_ID_MASSMOVE 1          /* MENU_ID_MASSMOVE in src/massmover.c */
+#define BENCH_MENU_ID_MASSMOVE_SUBTREE 3  /* MENU_ID_MASSMOVE_SUBTREE */
+#define BENCH_MENU_ID_MASSMOVE_LEVELS 4   /* MENU_ID_MASSMOVE_LEVELS */
+#define BENCH_MENU_ID_PREVIEW 5           /* MENU_ID_PREVIEW */
+#define BENCH_MENU_ID_RUN_SAVED 6         /* MENU_ID_RUN_SAVED */
+#define BENCH_MENU_ID_UNDO 7              /* MENU_ID_UNDO */
+#define BENCH_MENU_ID_FOLLOW 8            /* MENU_ID_FOLLOW */
+#define BENCH_TRICKLE_DEFAULT 20          /* Late joiners per round with --follow alone */
+#define BENCH_ANCESTOR_LEVELS 1           /* ANCESTOR_LEVELS_DEFAULT, unless massmover.ini says otherwise */
+#define BENCH_WARM_MS 300                 /* Pause before a hotkey press, above PLAN_WARM_INTERVAL_MS */
+#define BENCH_JOB_TIMEOUT_MS 120000
+
+static const char* shapeNames[] = { "chain", "fan", "mix" };
+
+/* Deliver events until the plugin printed a result for jobs more jobs after printed messages; returns 0 on timeout */
+static int waitForJobs(int printed, int jobs)
+{
+    unsigned long long deadline = standinNow() + BENCH_JOB_TIMEOUT_MS * 1000000ULL;
+
+    while (standinPrintedMessages() < printed + jobs) {
+        if (!standinPump()) {
+            if (standinNow() > deadline) {
+                return 0;
+            }
+            sleepMillis(1);
+        }
+    }
+    standinPump();
+    return 1;
+}
+
+/* Deliver events until a channel holds at least count clients; returns 0 on timeout */
+static int waitForClients(uint64 channelID, int count)
+{
+    unsigned long long deadline = standinNow() + BENCH_JOB_TIMEOUT_MS * 1000000ULL;
+
+    while (standinClientsInChannel(STANDIN_CONNECTION_ID, channelID) < count) {
+        if (!standinPump()) {
+            if (standinNow() > deadline) {
+                return 0;
+            }
+            sleepMillis(1);
+        }
+    }
+    standinPump();
+    return 1;
+}
+
+/* Print the SDK calls of one phase, one line per function that was called */
+static void printPhase(int phase, int rounds)
+{
+    const struct StandinPhase* p = standinPhase(phase);
+    int i;
+
+    printf("  %-10s %10.1f SDK calls/round, %8.1f us in SDK/round, %8.1f allocations/round\n",
+           p->name, (double)standinPhaseCalls(phase) / rounds, standinPhaseNanos(phase) / 1000.0 / rounds,
+           (double)p->allocations / rounds);
+    /* The plugin's log drainer may still be calling in */
+    for (i = 0; i < CALL_COUNT; i++) {
+        unsigned long long calls = __atomic_load_n(&p->calls[i], __ATOMIC_RELAXED);
+        if (calls) {
+            printf("    %-36s %10.1f calls %10.1f us\n", standinCallName((enum StandinCall)i),
+                   (double)calls / rounds, __atomic_load_n(&p->nanos[i], __ATOMIC_RELAXED) / 1000.0 / rounds);
+        }
+    }
+}
+
+/* Channel to gather into for a round; chains and fans use their worst case */
+static uint64 pickTarget(enum StandinShape shape, int round)
+{
+    int channels = standinChannelCount();
+
+    switch (shape) {
+    case SHAPE_CHAIN:
+    case SHAPE_FAN:
+        return standinChannelAt(channels - 1);
+    default:
+        return standinChannelAt((int)((round * 2654435761u) % (unsigned int)channels));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct StandinConfig config;
+    unsigned long long moveNanos = 0;
+    unsigned long long settleNanos = 0;
+    long long expected = 0;
+    long long arrived = 0;
+    unsigned long long worstNanos = 0;
+    unsigned long long firstRequestNanos = 0;
+    int firstRequests = 0;
+    unsigned long long start;
+    int rounds = 20;
+    int clicks = 0;
+    int timeouts = 0;
+    char* info = NULL;
+    int connectPhase, movePhase, eventPhase;
+    int menuID = BENCH_MENU_ID_MASSMOVE;
+    int climbLevels = -1;
+    const char* scopeName = "family";
+    const char* hotkey = "gather_family";
+    int useHotkey = 0;
+    const char* trigger = "menu";
+    int clicksPerJob = 1;
+    int coalesceMs = 0;
+    int trickle = 0;
+    int follow = 0;
+    uint64 gatheredTarget = 0;
+    char directory[] = "/tmp/massmover_bench_XXXXXX";
+    char path[256];
+    int ownConfig = 0;
+    int i;
+
+    config.shape = SHAPE_MIX;
+    config.channelCount = 4000;
+    config.clientCount = 500;
+    config.occupiedPercent = 10;
+    config.seed = 1;
+    config.floodBudget = 0;
+    config.floodRefillPerSecond = 10;
+    config.protectedEvery = 0;
+    config.connections = 1;
+
+    for (i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--shape") == 0) {
+            config.shape = strcmp(value, "chain") == 0 ? SHAPE_CHAIN : strcmp(value, "fan") == 0 ? SHAPE_FAN : SHAPE_MIX;
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            config.channelCount = atoi(value);
+        } else if (strcmp(argv[i], "--clients") == 0) {
+            config.clientCount = atoi(value);
+        } else if (strcmp(argv[i], "--occupied") == 0) {
+            config.occupiedPercent = atoi(value);
+        } else if (strcmp(argv[i], "--rounds") == 0) {
+            rounds = atoi(value);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = (unsigned int)atoi(value);
+        } else if (strcmp(argv[i], "--flood") == 0) {
+            config.floodBudget = atoi(value);
+        } else if (strcmp(argv[i], "--flood-refill") == 0) {
+            config.floodRefillPerSecond = atoi(value);
+        } else if (strcmp(argv[i], "--protected") == 0) {
+            config.protectedEvery = atoi(value);
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            config.connections = atoi(value);
+        } else if (strcmp(argv[i], "--scope") == 0) {
+            if (strcmp(value, "subtree") == 0) {
+                menuID = BENCH_MENU_ID_MASSMOVE_SUBTREE;
+                climbLevels = 0;
+                scopeName = "subtree";
+                hotkey = "gather_subtree";
+            } else if (strcmp(value, "levels") == 0) {
+                menuID = BENCH_MENU_ID_MASSMOVE_LEVELS;
+                climbLevels = BENCH_ANCESTOR_LEVELS;
+                scopeName = "levels";
+                hotkey = "gather_levels";
+            }
+        } else if (strcmp(argv[i], "--hotkey") == 0) {
+            useHotkey = 1;
+            trigger = "hotkey";
+            continue;
+        } else if (strcmp(argv[i], "--preview") == 0 || strcmp(argv[i], "--saved") == 0 || strcmp(argv[i], "--undo") == 0 ||
+                   strcmp(argv[i], "--double-click") == 0) {
+            trigger = argv[i] + 2;
+            continue;
+        } else if (strcmp(argv[i], "--coalesce") == 0) {
+            coalesceMs = atoi(value);
+        } else if (strcmp(argv[i], "--trickle") == 0) {
+            trickle = atoi(value);
+        } else if (strcmp(argv[i], "--follow") == 0) {
+            follow = 1;
+            continue;
+        } else {
+            fprintf(stderr, "Usage: %s [--shape chain|fan|mix] [--channels N] [--clients N] [--occupied PERCENT] [--rounds N] [--seed N] [--flood BUDGET] [--flood-refill PER_SECOND] [--protected N] [--scope family|levels|subtree] [--hotkey | --preview | --saved | --undo | --double-click] [--connections N] [--coalesce MS] [--trickle N [--follow]]\n", argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (config.channelCount < 1 || rounds < 1 || config.connections < 1) {
+        fprintf(stderr, "Need at least one channel, one round and one connection\n");
+        return 2;
+    }
+    if ((strcmp(trigger, "undo") == 0 || strcmp(trigger, "double-click") == 0) && useHotkey) {
+        fprintf(stderr, "--%s clicks the menu entry, it can't be combined with --hotkey\n", trigger);
+        return 2;
+    }
+    if (strcmp(trigger, "double-click") == 0) {
+        clicksPerJob = 2;
+    }
+    if (strcmp(trigger, "saved") == 0 && config.connections > 1) {
+        fprintf(stderr, "--saved needs a single connection: all tabs share the saved plan\n");
+        return 2;
+    }
+    if (follow && trickle < 1) {
+        trickle = BENCH_TRICKLE_DEFAULT;
+    }
+    if (trickle > 0) {
+        if (strcmp(trigger, "menu") != 0 || config.connections > 1) {
+            fprintf(stderr, "--trickle clicks on a single tab, it can't be combined with other triggers or --connections\n");
+            return 2;
+        }
+        trigger = follow ? "follow" : "trickle";
+        menuID = BENCH_MENU_ID_MASSMOVE;
+        climbLevels = -1;
+        scopeName = "family";
+    }
+
+    /* A preview always covers the whole family */
+    if (strcmp(trigger, "preview") == 0 || strcmp(trigger, "saved") == 0) {
+        menuID = strcmp(trigger, "preview") == 0 ? BENCH_MENU_ID_PREVIEW : BENCH_MENU_ID_RUN_SAVED;
+        climbLevels = -1;
+        scopeName = "family";
+    }
+
+    /* The plugin reads massmover.ini from the stand-in's config path */
+    if (!getenv("STANDIN_CONFIG_PATH")) {
+        FILE* file;
+
+        if (!mkdtemp(directory)) {
+            perror("mkdtemp");
+            return 1;
+        }
+        snprintf(path, sizeof(path), "%s/massmover.ini", directory);
+        file = fopen(path, "w");
+        if (!file) {
+            perror(path);
+            return 1;
+        }
+        fprintf(file, "coalesce_ms = %d\n", coalesceMs);
+        fclose(file);
+        snprintf(path, sizeof(path), "%s/", directory);
+        setenv("STANDIN_CONFIG_PATH", path, 1);
+        ownConfig = 1;
+    }
+
+    if (standinCreate(&config) != 0) {
+        fprintf(stderr, "Failed to create synthetic server\n");
+        return 1;
+    }
+
+    ts3plugin_setFunctionPointers(standinFunctions());
+    ts3plugin_registerPluginID("massmover_bench");
+    ts3plugin_init();
+
+    /* Connection setup: initial announcements and cache builds */
+    connectPhase = standinBeginPhase("connect");
+    start = standinNow();
+    standinConnect();
+    printf("Synthetic server: shape=%s channels=%d clients=%d occupied=%d%% connections=%d, connected in %.1f ms\n",
+           shapeNames[config.shape], config.channelCount, config.clientCount, config.occupiedPercent, config.connections,
+           (standinNow() - start) / 1e6);
+
+    movePhase = standinBeginPhase("move");
+    eventPhase = standinBeginPhase("events");
+
+    /* Late joiners trickle into a family gathered once, outside any measured phase */
+    if (trickle > 0) {
+        int printed = standinPrintedMessages();
+
+        standinBeginPhase("gather");
+        gatheredTarget = pickTarget(config.shape, 0);
+        ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID, PLUGIN_MENU_TYPE_CHANNEL, follow ? BENCH_MENU_ID_FOLLOW : BENCH_MENU_ID_MASSMOVE, gatheredTarget);
+        if (!waitForJobs(printed, follow ? 2 : 1)) {     /* Following prints once more, at the click */
+            timeouts++;
+        }
+    }
+
+    for (i = 0; i < rounds; i++) {
+        uint64 tab = useHotkey ? (uint64)(i % config.connections) + STANDIN_CONNECTION_ID : 0;   /* 0 = click on every tab */
+        int jobs = (useHotkey ? 1 : config.connections) * clicksPerJob;    /* Every click prints once, joined or not */
+        uint64 target;
+        unsigned long long clickedAt;
+        int before;
+        int gathered = 0;
+        int joined = 0;
+        int printed;
+        int c;
+
+        if (trickle > 0) {
+            standinBeginPhase("trickle");
+            target = gatheredTarget;
+            before = standinClientsInChannel(STANDIN_CONNECTION_ID, target);
+            joined = standinTrickleClients(STANDIN_CONNECTION_ID, target, trickle);
+            standinPump();
+            printed = standinPrintedMessages();
+            standinResetFirstMove();
+
+            /* The click, unless the plugin follows the family and moves the joiners on its own */
+            standinBeginPhase("move");
+            clickedAt = standinNow();
+            if (!follow) {
+                start = standinNow();
+                ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID, PLUGIN_MENU_TYPE_CHANNEL, menuID, target);
+                moveNanos += standinNow() - start;
+                if (standinNow() - start > worstNanos) {
+                    worstNanos = standinNow() - start;
+                }
+                clicks++;
+            }
+
+            /* The move that brings the joiners in */
+            standinBeginPhase("events");
+            start = standinNow();
+            if (follow ? !waitForClients(target, before + joined) : !waitForJobs(printed, 1)) {
+                timeouts++;
+            }
+            settleNanos += standinNow() - start;
+            if (standinFirstMoveAt()) {
+                firstRequestNanos += standinFirstMoveAt() - clickedAt;
+                firstRequests++;
+            }
+            expected += joined;
+            arrived += standinClientsInChannel(STANDIN_CONNECTION_ID, target) - before;
+            continue;
+        }
+
+        /* A hotkey is pressed some time after the last change or tab switch, which is when the plugin plans it */
+        if (useHotkey) {
+            if (config.connections > 1) {
+                standinSetCurrentConnection(tab);
+            }
+            sleepMillis(BENCH_WARM_MS);
+            standinPump();
+        }
+        target = useHotkey ? standinChannelOfClient(tab, STANDIN_SELF_ID) : pickTarget(config.shape, i);
+        before = standinClientsInChannel(tab, target);
+        /* The plan to run is made and saved before the measured click */
+        if (menuID == BENCH_MENU_ID_RUN_SAVED) {
+            standinBeginPhase("preview");
+            printed = standinPrintedMessages();
+            ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID, PLUGIN_MENU_TYPE_CHANNEL, BENCH_MENU_ID_PREVIEW, target);
+            if (!waitForJobs(printed, 1)) {
+                timeouts++;
+            }
+        }
+        /* The move to undo is made before the measured click */
+        if (strcmp(trigger, "undo") == 0) {
+            standinBeginPhase("gather");
+            printed = standinPrintedMessages();
+            for (c = 0; c < jobs; c++) {
+                ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID + c / clicksPerJob, PLUGIN_MENU_TYPE_CHANNEL, menuID, target);
+            }
+            if (!waitForJobs(printed, jobs)) {
+                timeouts++;
+            }
+            gathered = standinClientsInChannel(tab, target);
+        }
+        printed = standinPrintedMessages();
+        standinResetFirstMove();
+
+        /* The menu clicks or hotkey press themselves */
+        standinBeginPhase("move");
+        clickedAt = standinNow();
+        for (c = 0; c < jobs; c++) {
+            unsigned long long elapsed;
+
+            start = standinNow();
+            if (useHotkey) {
+                ts3plugin_onHotkeyEvent(hotkey);
+            } else if (menuID == BENCH_MENU_ID_RUN_SAVED) {
+                ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID + c, PLUGIN_MENU_TYPE_GLOBAL, menuID, 0);
+            } else if (strcmp(trigger, "undo") == 0) {
+                ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID + c, PLUGIN_MENU_TYPE_GLOBAL, BENCH_MENU_ID_UNDO, 0);
+            } else {
+                ts3plugin_onMenuItemEvent(STANDIN_CONNECTION_ID + c / clicksPerJob, PLUGIN_MENU_TYPE_CHANNEL, menuID, target);
+            }
+            elapsed = standinNow() - start;
+            moveNanos += elapsed;
+            if (elapsed > worstNanos) {
+                worstNanos = elapsed;
+            }
+            clicks++;
+        }
+
+        /* Move confirmations and replies as the client would deliver them, including retries */
+        standinBeginPhase("events");
+        start = standinNow();
+        if (!waitForJobs(printed, jobs)) {
+            timeouts++;
+        }
+        settleNanos += standinNow() - start;
+        if (standinFirstMoveAt()) {
+            firstRequestNanos += standinFirstMoveAt() - clickedAt;
+            firstRequests++;
+        }
+        if (strcmp(trigger, "undo") == 0) {
+            /* Everyone the move brought in went back out */
+            expected += gathered - before;
+            arrived += gathered - standinClientsInChannel(tab, target);
+        } else {
+            expected += menuID == BENCH_MENU_ID_PREVIEW ? 0 : standinScopeClients(tab, target, climbLevels) - before;
+            arrived += standinClientsInChannel(tab, target) - before;
+        }
+
+        /* Spread everybody out again for the next round, outside any measured phase */
+        standinBeginPhase("scatter");
+        standinScatterClients();
+        standinPump();
+    }
+
+    printf("\nPer phase (averaged over %d rounds, connect is one-off):\n", rounds);
+    printPhase(connectPhase, 1);
+    printPhase(movePhase, rounds);
+    printPhase(eventPhase, rounds);
+
+    /* What the client would show in the info panel with the server selected */
+    ts3plugin_infoData(STANDIN_CONNECTION_ID, STANDIN_CONNECTION_ID, PLUGIN_SERVER, &info);
+    if (info) {
+        printf("\n%s panel:\n%s\n", ts3plugin_infoTitle(), info);
+        ts3plugin_freeMemory(info);
+    }
+
+    printf("\nMass move: %.1f us average, %.1f us worst, %.1f us of it in the SDK stand-in\n",
+           clicks ? moveNanos / 1000.0 / clicks : 0.0, worstNanos / 1000.0, clicks ? standinPhaseNanos(movePhase) / 1000.0 / clicks : 0.0);
+    if (trickle > 0) {
+        printf("Late joiners: %d per round, %.1f requestClientsMove calls per round %s\n", trickle,
+               (double)(standinPhase(movePhase)->calls[CALL_requestClientsMove] + standinPhase(eventPhase)->calls[CALL_requestClientsMove]) / rounds,
+               follow ? "while following" : "clicking MassMove every round");
+    }
+
+    printf("First move request: %.1f us average after the %s\n",
+           firstRequests ? firstRequestNanos / 1000.0 / firstRequests : 0.0, useHotkey ? "keypress" : "click");
+    printf("Arrived: %lld of %lld clients, %.1f ms average until settled, %d flood rejections, %d jobs timed out\n",
+           arrived, expected, settleNanos / 1e6 / rounds, standinFloodRejections(), timeouts);
+
+    ts3plugin_shutdown();
+    if (ownConfig) {
+        snprintf(path, sizeof(path), "%s/massmover.ini", directory);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/massmover_plan.bin", directory);
+        unlink(path);
+        if (rmdir(directory) != 0) {
+            printf("Metrics and traces of the run are in %s\n", directory);
+        }
+    }
+
+    printf("RESULT shape=%s scope=%s trigger=%s channels=%d clients=%d connections=%d move_us=%.1f worst_us=%.1f first_request_us=%.1f settle_ms=%.1f sdk_calls=%.1f allocations=%.1f\n",
+           shapeNames[config.shape], scopeName, trigger, config.channelCount, config.clientCount, config.connections,
+           clicks ? moveNanos / 1000.0 / clicks : 0.0, worstNanos / 1000.0,
+           firstRequests ? firstRequestNanos / 1000.0 / firstRequests : 0.0, settleNanos / 1e6 / rounds,
+           (double)standinPhaseCalls(movePhase) / rounds,
+           (double)standinPhase(movePhase)->allocations / rounds);
+
+    standinDestroy();
+    return 0;
+}
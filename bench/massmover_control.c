@@ -0,0 +1,388 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Control Socket Benchmark
+ *
+ * Loads the unmodified plugin against the SDK stand-in with the control
+ * socket turned on and drives it the way match automation would: every
+ * round sends one message moving a scope into a target on every connection
+ * and one undoing all of those moves, each followed by a stats query. The
+ * stand-in delivers its events on the benchmark's thread, so while a reply
+ * is outstanding the benchmark keeps pumping them. Every reply is checked
+ * against the synthetic servers: a move must have brought everyone of the
+ * scope into the target and the undo must have taken them out again.
+ *
+ * Usage: massmover_control [--shape chain|fan|mix] [--channels N] [--clients N]
+ *                          [--occupied PERCENT] [--rounds N] [--seed N]
+ *                          [--connections N] [--scope family|levels|subtree]
+ *                          [--flood BUDGET] [--verbose]
+ *
+ * The last line of the output is a single RESULT line meant for scripts
+ * that compare runs across releases.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "teamspeak/public_definitions.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+
+#include "massmover.h"
+#include "control_socket.h"
+#include "platform.h"
+#include "ts3_standin.h"
+
+#define CONTROL_ANCESTOR_LEVELS 1           /* ANCESTOR_LEVELS_DEFAULT */
+#define CONTROL_REPLY_TIMEOUT_MS 120000
+#define CONTROL_CONNECT_ATTEMPTS 100
+
+static const char* shapeNames[] = { "chain", "fan", "mix" };
+static char reply[CONTROL_MAX_COMMANDS * CONTROL_REPLY_BUFSIZE + 1];
+static int verbose = 0;
+
+/* Connect to the plugin's socket, giving its thread a moment to listen */
+static int connectControl(const char* path)
+{
+    struct sockaddr_un address;
+    int attempt;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    for (attempt = 0; attempt < CONTROL_CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        close(fd);
+        sleepMillis(10);
+    }
+    return -1;
+}
+
+/*
+ * Send one message and deliver events until its reply is complete; returns
+ * the number of reply lines, or -1 on error or timeout.
+ */
+static int exchange(int fd, const char* message)
+{
+    unsigned long long deadline = standinNow() + CONTROL_REPLY_TIMEOUT_MS * 1000000ULL;
+    size_t filled = 0;
+    size_t length = strlen(message);
+    int lines = 0;
+    char* line;
+
+    if (verbose) {
+        fputs(message, stdout);
+    }
+    while (length > 0) {
+        ssize_t written = send(fd, message, length, 0);
+        if (written < 0) {
+            return -1;
+        }
+        message += written;
+        length -= (size_t)written;
+    }
+
+    /* The reply ends with an empty line */
+    while (filled < 2 || reply[filled - 1] != '\n' || reply[filled - 2] != '\n') {
+        ssize_t received = recv(fd, reply + filled, sizeof(reply) - 1 - filled, MSG_DONTWAIT);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return -1;
+        }
+        if (received > 0) {
+            filled += (size_t)received;
+            continue;
+        }
+        if (!standinPump()) {
+            if (standinNow() > deadline || filled == sizeof(reply) - 1) {
+                return -1;
+            }
+            sleepMillis(1);
+        }
+    }
+    reply[filled] = '\0';
+    if (verbose) {
+        fputs(reply, stdout);
+    }
+    for (line = reply; *line && *line != '\n'; line = strchr(line, '\n') + 1) {
+        lines++;
+    }
+    return lines;
+}
+
+/* Value of a field of the index-th reply line, or NULL if it has none */
+static const char* replyValue(int index, const char* key)
+{
+    char pattern[64];
+    const char* line = reply;
+    const char* found;
+
+    while (index-- > 0) {
+        line = strchr(line, '\n') + 1;
+    }
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    found = strstr(line, pattern);
+    if (!found || found > strchr(line, '\n')) {
+        return NULL;
+    }
+    return found + strlen(pattern);
+}
+
+/* Number in a field of the index-th reply line, or -1 if it is missing or null */
+static double replyNumber(int index, const char* key)
+{
+    const char* value = replyValue(index, key);
+    return value && *value != 'n' ? atof(value) : -1;
+}
+
+/* The index-th command succeeded; prints its error otherwise */
+static int replyOk(int index)
+{
+    const char* value = replyValue(index, "ok");
+    const char* error;
+
+    if (value && strncmp(value, "true", 4) == 0) {
+        return 1;
+    }
+    error = replyValue(index, "error");
+    fprintf(stderr, "Command %d failed: %.*s\n", index, error ? (int)strcspn(error, "}") : 7, error ? error : "unknown");
+    return 0;
+}
+
+/* Channel to gather into for a round; chains and fans use their worst case */
+static uint64 pickTarget(enum StandinShape shape, int round)
+{
+    int channels = standinChannelCount();
+
+    switch (shape) {
+    case SHAPE_CHAIN:
+    case SHAPE_FAN:
+        return standinChannelAt(channels - 1);
+    default:
+        return standinChannelAt((int)((round * 2654435761u) % (unsigned int)channels));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct StandinConfig config;
+    char directory[] = "/tmp/massmover_control.XXXXXX";
+    char path[256];
+    char message[CONTROL_MAX_COMMANDS * 64];
+    uint64 targets[CONTROL_MAX_COMMANDS];
+    int before[CONTROL_MAX_COMMANDS];
+    int gathered[CONTROL_MAX_COMMANDS];
+    const char* scopeName = "family";
+    const char* scopeArgument = "";
+    int climbLevels = -1;
+    int rounds = 20;
+    unsigned long long moveNanos = 0, undoNanos = 0, worstNanos = 0;
+    double firstRequestMicros = 0;
+    int firstRequests = 0;
+    long long expected = 0, moved = 0, undoExpected = 0, undone = 0;
+    int commands = 0;
+    int errors = 0;
+    FILE* file;
+    int fd;
+    int i, c;
+
+    config.shape = SHAPE_MIX;
+    config.channelCount = 4000;
+    config.clientCount = 500;
+    config.occupiedPercent = 10;
+    config.seed = 1;
+    config.floodBudget = 0;
+    config.floodRefillPerSecond = 10;
+    config.protectedEvery = 0;
+    config.connections = 1;
+
+    for (i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--shape") == 0) {
+            config.shape = strcmp(value, "chain") == 0 ? SHAPE_CHAIN : strcmp(value, "fan") == 0 ? SHAPE_FAN : SHAPE_MIX;
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            config.channelCount = atoi(value);
+        } else if (strcmp(argv[i], "--clients") == 0) {
+            config.clientCount = atoi(value);
+        } else if (strcmp(argv[i], "--occupied") == 0) {
+            config.occupiedPercent = atoi(value);
+        } else if (strcmp(argv[i], "--rounds") == 0) {
+            rounds = atoi(value);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = (unsigned int)atoi(value);
+        } else if (strcmp(argv[i], "--connections") == 0) {
+            config.connections = atoi(value);
+        } else if (strcmp(argv[i], "--flood") == 0) {
+            config.floodBudget = atoi(value);
+        } else if (strcmp(argv[i], "--scope") == 0) {
+            if (strcmp(value, "subtree") == 0) {
+                scopeName = "subtree";
+                scopeArgument = " subtree";
+                climbLevels = 0;
+            } else if (strcmp(value, "levels") == 0) {
+                scopeName = "levels";
+                scopeArgument = " levels 1";
+                climbLevels = CONTROL_ANCESTOR_LEVELS;
+            }
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+            continue;
+        } else {
+            fprintf(stderr, "Usage: %s [--shape chain|fan|mix] [--channels N] [--clients N] [--occupied PERCENT] [--rounds N] [--seed N] [--connections N] [--scope family|levels|subtree] [--flood BUDGET] [--verbose]\n", argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (config.channelCount < 1 || rounds < 1 || config.connections < 1 || config.connections >= CONTROL_MAX_COMMANDS) {
+        fprintf(stderr, "Need at least one channel and one round, and between 1 and %d connections\n", CONTROL_MAX_COMMANDS - 1);
+        return 2;
+    }
+
+    /* The plugin reads massmover.ini from the stand-in's config path */
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/massmover.ini", directory);
+    file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    fprintf(file, "control_socket = 1\ncoalesce_ms = 0\n");
+    fclose(file);
+    snprintf(path, sizeof(path), "%s/", directory);
+    setenv("STANDIN_CONFIG_PATH", path, 1);
+
+    if (standinCreate(&config) != 0) {
+        fprintf(stderr, "Failed to create synthetic server\n");
+        return 1;
+    }
+    ts3plugin_setFunctionPointers(standinFunctions());
+    ts3plugin_registerPluginID("massmover_control");
+    ts3plugin_init();
+    standinConnect();
+
+    snprintf(path, sizeof(path), "%s/%s", directory, CONTROL_SOCKET_FILENAME);
+    fd = connectControl(path);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to connect to %s\n", path);
+        return 1;
+    }
+    printf("Synthetic server: shape=%s channels=%d clients=%d occupied=%d%% connections=%d, socket %s\n",
+           shapeNames[config.shape], config.channelCount, config.clientCount, config.occupiedPercent, config.connections, path);
+
+    for (i = 0; i < rounds; i++) {
+        unsigned long long start;
+        unsigned long long elapsed;
+        size_t length = 0;
+        int lines;
+
+        /* One message moves on every connection at once, then asks how it went */
+        for (c = 0; c < config.connections; c++) {
+            uint64 tab = STANDIN_CONNECTION_ID + c;
+            targets[c] = pickTarget(config.shape, i * config.connections + c);
+            before[c] = standinClientsInChannel(tab, targets[c]);
+            length += snprintf(message + length, sizeof(message) - length, "move %llu %llu%s\n",
+                               (unsigned long long)tab, (unsigned long long)targets[c], scopeArgument);
+        }
+        length += snprintf(message + length, sizeof(message) - length, "stats %d\n\n", STANDIN_CONNECTION_ID);
+        start = standinNow();
+        lines = exchange(fd, message);
+        elapsed = standinNow() - start;
+        moveNanos += elapsed;
+        if (elapsed > worstNanos) {
+            worstNanos = elapsed;
+        }
+        if (lines != config.connections + 1) {
+            fprintf(stderr, "Round %d: expected %d reply lines to the move, got %d\n", i, config.connections + 1, lines);
+            return 1;
+        }
+        commands += lines;
+        for (c = 0; c < config.connections; c++) {
+            uint64 tab = STANDIN_CONNECTION_ID + c;
+            int scope = standinScopeClients(tab, targets[c], climbLevels);
+            double first = replyNumber(c, "first_request_us");
+
+            gathered[c] = standinClientsInChannel(tab, targets[c]);
+            expected += scope - before[c];
+            moved += gathered[c] - before[c];
+            if (!replyOk(c)) {
+                errors++;
+            }
+            if (gathered[c] != scope) {
+                fprintf(stderr, "Round %d: %d of %d clients in channel %llu on connection %llu\n",
+                        i, gathered[c], scope, (unsigned long long)targets[c], (unsigned long long)tab);
+                errors++;
+            }
+            if (first >= 0) {
+                firstRequestMicros += first;
+                firstRequests++;
+            }
+        }
+
+        /* And a second one sends everyone back where they came from */
+        length = 0;
+        for (c = 0; c < config.connections; c++) {
+            length += snprintf(message + length, sizeof(message) - length, "undo %d\n", STANDIN_CONNECTION_ID + c);
+        }
+        length += snprintf(message + length, sizeof(message) - length, "stats %d\n\n", STANDIN_CONNECTION_ID);
+        start = standinNow();
+        lines = exchange(fd, message);
+        undoNanos += standinNow() - start;
+        if (lines != config.connections + 1) {
+            fprintf(stderr, "Round %d: expected %d reply lines to the undo, got %d\n", i, config.connections + 1, lines);
+            return 1;
+        }
+        commands += lines;
+        for (c = 0; c < config.connections; c++) {
+            uint64 tab = STANDIN_CONNECTION_ID + c;
+            int left = standinClientsInChannel(tab, targets[c]);
+
+            undoExpected += gathered[c] - before[c];
+            undone += gathered[c] - left;
+            if (gathered[c] > before[c] && (!replyOk(c) || replyNumber(c, "moved") != gathered[c] - before[c])) {
+                fprintf(stderr, "Round %d: undo on connection %llu reports %.0f moved, %d brought in\n",
+                        i, (unsigned long long)tab, replyNumber(c, "moved"), gathered[c] - before[c]);
+                errors++;
+            }
+        }
+
+        /* Spread everybody out again for the next round */
+        standinScatterClients();
+        standinPump();
+    }
+
+    printf("\nMove message: %.1f ms average, %.1f ms worst; undo message: %.1f ms average\n",
+           moveNanos / 1e6 / rounds, worstNanos / 1e6, undoNanos / 1e6 / rounds);
+    printf("First move request: %.1f us average after the message arrived\n", firstRequests ? firstRequestMicros / firstRequests : 0.0);
+    printf("Moved: %lld of %lld clients, undone: %lld of %lld, %d commands, %.0f commands/s, %d flood rejections, %d errors\n",
+           moved, expected, undone, undoExpected, commands, commands / ((moveNanos + undoNanos) / 1e9),
+           standinFloodRejections(), errors);
+
+    close(fd);
+    ts3plugin_shutdown();
+    snprintf(path, sizeof(path), "%s/massmover.ini", directory);
+    unlink(path);
+    rmdir(directory);
+
+    printf("RESULT shape=%s scope=%s channels=%d clients=%d connections=%d move_ms=%.2f worst_ms=%.2f undo_ms=%.2f first_request_us=%.1f commands_per_s=%.0f errors=%d\n",
+           shapeNames[config.shape], scopeName, config.channelCount, config.clientCount, config.connections,
+           moveNanos / 1e6 / rounds, worstNanos / 1e6, undoNanos / 1e6 / rounds,
+           firstRequests ? firstRequestMicros / firstRequests : 0.0, commands / ((moveNanos + undoNanos) / 1e9), errors);
+
+    standinDestroy();
+    return errors ? 1 : 0;
+}
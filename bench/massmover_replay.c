@@ -0,0 +1,1410 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Trace Replay
+ *
+ * Replays a trace recorded by a plugin built with -DMASSMOVER_TRACE (see
+ * src/sdk_trace.h) against the unmodified plugin entry points, so a slow
+ * mass move on a production server can be reproduced and measured offline.
+ * The recorded SDK answers rebuild each server as the plugin saw it: a
+ * channel or client is placed where the plugin first found it, unless a
+ * recorded callback announced it before that, and from then on only the
+ * recorded callbacks change the servers. Those callbacks are delivered in
+ * order, menu clicks and hotkey presses included, and the function table
+ * handed to the plugin answers from the rebuilt servers. Move requests are
+ * carried out on them like the stand-in does, so the recorded client moves
+ * and server answers that our own requests caused are left out (a move by
+ * us counts as one only if a request of the plugin asked for it); a client
+ * the server refused to move on its own is refused again. Anti-flood
+ * rejections are not replayed. Channel names and flags are answered with
+ * the first values recorded for each channel, so an edited channel keeps
+ * them when the edit is replayed.
+ *
+ * Before each user action the replay pauses as long as the user did, up to
+ * --max-gap milliseconds, which lets the plugin plan hotkeys ahead as it
+ * did, and then waits until the action printed as many results as it did
+ * when recorded. Every action is reported with its recorded and replayed
+ * time until settled and until the first move request.
+ *
+ * --dump prints the trace one record per line instead of replaying it.
+ *
+ * Usage: massmover_replay [--rounds N] [--max-gap MS] [--quiet] [--dump] TRACE
+ *
+ * The last line of the output is a single RESULT line meant for scripts
+ * that compare runs across releases.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_errors.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+
+#include "massmover.h"
+#include "platform.h"
+#include "sdk_trace.h"
+
+#define REPLAY_MAX_CONNECTIONS 64
+#define REPLAY_CLIENT_SLOTS 65536
+#define REPLAY_MAX_GAP_MS 300           /* Above PLAN_WARM_INTERVAL_MS, so hotkeys find their plan made */
+#define REPLAY_SETTLE_TIMEOUT_MS 10000
+#define REPLAY_SPIN_NANOS 2000000ULL    /* Yield rather than sleep this long after the last event, so settle times stay exact */
+#define REPLAY_DEFAULT_POWER 100        /* i_client_move_power if the trace never asked for it */
+
+struct ReplayChannel {
+    uint64 id;
+    uint64 parent;
+    int present;                        /* Exists on the server right now */
+    int announced;                      /* While seeding: a callback named it already */
+    char* name;                         /* First recorded name, NULL if never asked for */
+    int properties[CHANNEL_ENDMARKER];  /* First recorded integer properties */
+    unsigned int propertiesKnown;       /* Bit per property recorded */
+};
+
+/* One recorded server as the plugin saw it */
+struct ReplayServer {
+    uint64 connection;
+    struct ReplayChannel* channels;     /* In order of first mention */
+    int channelCount;
+    int channelCapacity;
+    int* slots;                         /* Open addressing on channel ID, index + 1, 0 = empty */
+    int slotCount;
+    uint64 clientChannel[REPLAY_CLIENT_SLOTS];      /* 0 = not connected */
+    unsigned char clientProtected[REPLAY_CLIENT_SLOTS];
+    unsigned char clientAnnounced[REPLAY_CLIENT_SLOTS];
+    int highestClient;
+    anyID selfID;
+    int neededPower;
+    int powerKnown;
+    int printed;                        /* Results the plugin printed to this tab */
+    unsigned long long firstMoveAt;     /* First move request since the last user action here, 0 = none */
+};
+
+struct ReplayRecord {
+    struct TraceRecord record;          /* list and text owned by the replay */
+    int ours;                           /* A callback one of the recorded plugin's requests caused */
+};
+
+/* A user action and what it took when recorded */
+struct ReplayAction {
+    int record;
+    uint64 connection;                  /* Tab it acted on */
+    int prints;                         /* Results printed to that tab until its next action */
+    unsigned long long settleNanos;     /* Until the last of them, 0 if none */
+    unsigned long long firstRequestNanos;  /* Until the first move request on that tab, 0 if none */
+    unsigned long long gapNanos;        /* Idle time before it */
+    int pending;                        /* Replayed, results still outstanding */
+    int printTarget;                    /* Results the tab has printed once it settled */
+    unsigned long long clickedAt;
+    unsigned long long replaySettleNanos;
+    unsigned long long replayFirstRequestNanos;
+    int replayFirstRequests;
+};
+
+enum ReplayEventType {
+    REPLAY_CLIENT_MOVED = 0,
+    REPLAY_SERVER_ERROR
+};
+
+struct ReplayEvent {
+    enum ReplayEventType type;
+    uint64 connection;
+    anyID clientID;
+    uint64 oldChannelID;
+    uint64 newChannelID;
+    unsigned int error;
+    char returnCode[64];
+};
+
+static struct ReplayRecord* records = NULL;
+static int recordCount = 0;
+static char** ourReturnCodes = NULL;        /* Return codes the recorded plugin created, sorted */
+static int ourReturnCodeCount = 0;
+static struct ReplayAction* actions = NULL;
+static int actionCount = 0;
+static int pendingActions = 0;              /* Replayed actions that have not settled yet */
+
+static struct ReplayServer* servers[REPLAY_MAX_CONNECTIONS];
+static int serverCount = 0;
+static uint64 currentConnection = 0;
+
+static pthread_mutex_t serverLock = PTHREAD_MUTEX_INITIALIZER;  /* Guards the servers, the events and return codes */
+static struct ReplayEvent* events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+static unsigned int returnCodeCounter = 0;
+
+static unsigned long long recordedCalls[TRACE_KIND_END];
+static unsigned long long recordedNanos[TRACE_KIND_END];
+static unsigned long long replayCalls[TRACE_KIND_END];
+static unsigned long long replayNanos[TRACE_KIND_END];
+
+/*********************************** Rebuilt servers ************************************/
+
+static struct ReplayServer* serverOf(uint64 connection)
+{
+    int i;
+
+    for (i = 0; i < serverCount; i++) {
+        if (servers[i]->connection == connection) {
+            return servers[i];
+        }
+    }
+    return NULL;
+}
+
+/* The server of a connection, created on first mention; NULL for callbacks without one or past the limit */
+static struct ReplayServer* addServer(uint64 connection)
+{
+    struct ReplayServer* server = serverOf(connection);
+
+    if (server || !connection || serverCount == REPLAY_MAX_CONNECTIONS) {
+        return server;
+    }
+    server = (struct ReplayServer*)calloc(1, sizeof(*server));
+    if (!server) {
+        return NULL;
+    }
+    server->connection = connection;
+    server->neededPower = REPLAY_DEFAULT_POWER;
+    servers[serverCount++] = server;
+    return server;
+}
+
+static void freeServers(void)
+{
+    int i;
+
+    for (i = 0; i < serverCount; i++) {
+        int j;
+        for (j = 0; j < servers[i]->channelCount; j++) {
+            free(servers[i]->channels[j].name);
+        }
+        free(servers[i]->channels);
+        free(servers[i]->slots);
+        free(servers[i]);
+    }
+    serverCount = 0;
+}
+
+static unsigned int slotOf(uint64 channelID, int slotCount)
+{
+    return (unsigned int)((channelID * 0x9e3779b97f4a7c15ULL) >> 32) & (unsigned int)(slotCount - 1);
+}
+
+static struct ReplayChannel* findChannel(struct ReplayServer* server, uint64 channelID)
+{
+    unsigned int slot;
+
+    if (!server->slotCount) {
+        return NULL;
+    }
+    for (slot = slotOf(channelID, server->slotCount); server->slots[slot]; slot = (slot + 1) & (unsigned int)(server->slotCount - 1)) {
+        if (server->channels[server->slots[slot] - 1].id == channelID) {
+            return &server->channels[server->slots[slot] - 1];
+        }
+    }
+    return NULL;
+}
+
+/* The channel with this ID, added as absent if it is new; NULL when out of memory */
+static struct ReplayChannel* addChannel(struct ReplayServer* server, uint64 channelID)
+{
+    struct ReplayChannel* channel = findChannel(server, channelID);
+    unsigned int slot;
+    int i;
+
+    if (channel) {
+        return channel;
+    }
+    if (server->channelCount == server->channelCapacity) {
+        int capacity = server->channelCapacity ? server->channelCapacity * 2 : 1024;
+        struct ReplayChannel* channels = (struct ReplayChannel*)realloc(server->channels, capacity * sizeof(*channels));
+        if (!channels) {
+            return NULL;
+        }
+        server->channels = channels;
+        server->channelCapacity = capacity;
+    }
+    /* Keep the table at most half full */
+    if ((server->channelCount + 1) * 2 > server->slotCount) {
+        int slotCount = server->slotCount ? server->slotCount * 2 : 2048;
+        int* slots = (int*)calloc(slotCount, sizeof(int));
+        if (!slots) {
+            return NULL;
+        }
+        for (i = 0; i < server->channelCount; i++) {
+            for (slot = slotOf(server->channels[i].id, slotCount); slots[slot]; slot = (slot + 1) & (unsigned int)(slotCount - 1)) {
+            }
+            slots[slot] = i + 1;
+        }
+        free(server->slots);
+        server->slots = slots;
+        server->slotCount = slotCount;
+    }
+
+    channel = &server->channels[server->channelCount++];
+    memset(channel, 0, sizeof(*channel));
+    channel->id = channelID;
+    for (slot = slotOf(channelID, server->slotCount); server->slots[slot]; slot = (slot + 1) & (unsigned int)(server->slotCount - 1)) {
+    }
+    server->slots[slot] = server->channelCount;
+    return channel;
+}
+
+static void placeClient(struct ReplayServer* server, anyID clientID, uint64 channelID)
+{
+    server->clientChannel[clientID] = channelID;
+    if (channelID && clientID > server->highestClient) {
+        server->highestClient = clientID;
+    }
+}
+
+static int compareStrings(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int isOurReturnCode(const char* returnCode)
+{
+    return returnCode[0] && bsearch(&returnCode, ourReturnCodes, ourReturnCodeCount, sizeof(char*), compareStrings) != NULL;
+}
+
+/* Index of the request that carried a return code, -1 if none */
+static int requestOf(const char* returnCode, int before)
+{
+    int i;
+
+    for (i = before - 1; i >= 0; i--) {
+        const struct TraceRecord* r = &records[i].record;
+        if ((r->kind == TRACE_REQUEST_CLIENT_MOVE || r->kind == TRACE_REQUEST_CLIENTS_MOVE) && strcmp(r->text, returnCode) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Rebuild the servers at the start of the trace: whatever the plugin found
+ * through the SDK before any callback told it about it was there all along.
+ * Clients refused when moved on their own stay refused.
+ */
+static int seedServers(void)
+{
+    int i, j;
+
+    freeServers();
+    currentConnection = 0;
+    for (i = 0; i < recordCount; i++) {
+        const struct TraceRecord* r = &records[i].record;
+        struct ReplayServer* server = addServer(r->serverConnectionHandlerID);
+        struct ReplayChannel* channel;
+
+        if (r->kind == TRACE_GET_CURRENT_CONNECTION) {
+            if (!currentConnection) {
+                currentConnection = r->values[0];
+            }
+            continue;
+        }
+        if (r->kind == TRACE_CURRENT_CONNECTION) {
+            if (!currentConnection) {
+                currentConnection = r->serverConnectionHandlerID;
+            }
+            continue;
+        }
+        if (!server || (!TRACE_IS_CALLBACK(r->kind) && r->result != ERROR_ok)) {
+            continue;
+        }
+
+        switch (r->kind) {
+        case TRACE_NEW_CHANNEL:
+        case TRACE_DEL_CHANNEL:
+        case TRACE_CHANNEL_MOVED:
+            if (!(channel = addChannel(server, r->values[0]))) {
+                return -1;
+            }
+            channel->announced = 1;
+            break;
+        case TRACE_CLIENT_MOVED:
+            server->clientAnnounced[(anyID)r->values[0]] = 1;
+            break;
+        case TRACE_SERVER_ERROR:
+            if (r->result == ERROR_permissions_client_insufficient && (j = requestOf(r->text, i)) != -1 &&
+                records[j].record.listCount == 1) {
+                server->clientProtected[(anyID)records[j].record.list[0]] = 1;
+            }
+            break;
+        case TRACE_GET_CLIENT_ID:
+            if (!server->selfID) {
+                server->selfID = (anyID)r->values[0];
+            }
+            break;
+        case TRACE_GET_NEEDED_PERMISSION:
+            if (!server->powerKnown) {
+                server->neededPower = (int)(long long)r->values[0];
+                server->powerKnown = 1;
+            }
+            break;
+        case TRACE_GET_CHANNEL_LIST:
+            for (j = 0; j < r->listCount; j++) {
+                if (!(channel = addChannel(server, r->list[j]))) {
+                    return -1;
+                }
+                channel->present |= !channel->announced;
+            }
+            break;
+        case TRACE_GET_PARENT_CHANNEL:
+            if (!(channel = addChannel(server, r->values[0]))) {
+                return -1;
+            }
+            if (!channel->announced) {
+                channel->present = 1;
+                channel->parent = r->values[1];
+            }
+            break;
+        case TRACE_GET_CHANNEL_INT:
+            if (!(channel = addChannel(server, r->values[0]))) {
+                return -1;
+            }
+            if (r->values[1] < CHANNEL_ENDMARKER && !(channel->propertiesKnown & (1u << r->values[1]))) {
+                channel->properties[r->values[1]] = (int)(long long)r->values[2];
+                channel->propertiesKnown |= 1u << r->values[1];
+            }
+            break;
+        case TRACE_GET_CHANNEL_STRING:
+            if (!(channel = addChannel(server, r->values[0]))) {
+                return -1;
+            }
+            if (r->values[1] == CHANNEL_NAME && !channel->name && !(channel->name = strdup(r->text))) {
+                return -1;
+            }
+            break;
+        case TRACE_GET_CHANNEL_CLIENT_LIST:
+        case TRACE_GET_CHANNEL_OF_CLIENT:
+            if (!(channel = addChannel(server, r->kind == TRACE_GET_CHANNEL_OF_CLIENT ? r->values[1] : r->values[0]))) {
+                return -1;
+            }
+            channel->present |= !channel->announced;
+            for (j = 0; j < (r->kind == TRACE_GET_CHANNEL_OF_CLIENT ? 1 : r->listCount); j++) {
+                anyID clientID = (anyID)(r->kind == TRACE_GET_CHANNEL_OF_CLIENT ? r->values[0] : r->list[j]);
+                if (!server->clientAnnounced[clientID] && !server->clientChannel[clientID]) {
+                    placeClient(server, clientID, channel->id);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Carry a recorded callback out on the servers before the plugin hears of it */
+static void applyCallback(const struct TraceRecord* r)
+{
+    struct ReplayServer* server = serverOf(r->serverConnectionHandlerID);
+    struct ReplayChannel* channel;
+    int i;
+
+    if (r->kind == TRACE_CURRENT_CONNECTION) {
+        __atomic_store_n(&currentConnection, r->serverConnectionHandlerID, __ATOMIC_RELAXED);
+        return;
+    }
+    if (!server) {
+        return;
+    }
+    switch (r->kind) {
+    case TRACE_CONNECT_STATUS:
+        if (r->values[0] == STATUS_DISCONNECTED) {
+            for (i = 0; i < server->channelCount; i++) {
+                server->channels[i].present = 0;
+            }
+            memset(server->clientChannel, 0, sizeof(server->clientChannel));
+        }
+        break;
+    case TRACE_NEW_CHANNEL:
+    case TRACE_CHANNEL_MOVED:
+        if ((channel = addChannel(server, r->values[0]))) {
+            channel->present = 1;
+            channel->parent = r->values[1];
+        }
+        break;
+    case TRACE_DEL_CHANNEL:
+        if ((channel = findChannel(server, r->values[0]))) {
+            channel->present = 0;
+        }
+        break;
+    case TRACE_CLIENT_MOVED:
+        placeClient(server, (anyID)r->values[0], r->values[1]);
+        break;
+    default:
+        break;
+    }
+}
+
+/*********************************** SDK functions ************************************/
+
+static unsigned long long enterCall(void)
+{
+    return monotonicNanos();
+}
+
+static void leaveCall(enum TraceKind kind, unsigned long long start)
+{
+    __sync_fetch_and_add(&replayCalls[kind], 1);
+    __sync_fetch_and_add(&replayNanos[kind], monotonicNanos() - start);
+}
+
+/* Queue an event for replayPump; serverLock must be held */
+static void queueEvent(const struct ReplayEvent* event)
+{
+    if (eventCount == eventCapacity) {
+        int capacity = eventCapacity ? eventCapacity * 2 : 256;
+        struct ReplayEvent* grown = (struct ReplayEvent*)realloc(events, capacity * sizeof(*grown));
+        if (!grown) {
+            return;
+        }
+        events = grown;
+        eventCapacity = capacity;
+    }
+    events[eventCount++] = *event;
+}
+
+static void queueServerError(uint64 connection, unsigned int error, const char* returnCode)
+{
+    struct ReplayEvent event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = REPLAY_SERVER_ERROR;
+    event.connection = connection;
+    event.error = error;
+    snprintf(event.returnCode, sizeof(event.returnCode), "%s", returnCode ? returnCode : "");
+    queueEvent(&event);
+}
+
+/* Move the clients of one request, or refuse all of them like the server does; serverLock must be held */
+static unsigned int moveClients(struct ReplayServer* server, const anyID* clientIDs, int count, uint64 newChannelID)
+{
+    struct ReplayChannel* target = findChannel(server, newChannelID);
+    struct ReplayEvent event;
+    int i;
+
+    if (!target || !target->present) {
+        return ERROR_channel_invalid_id;
+    }
+    for (i = 0; i < count; i++) {
+        if (server->clientProtected[clientIDs[i]]) {
+            return ERROR_permissions_client_insufficient;
+        }
+    }
+    memset(&event, 0, sizeof(event));
+    event.type = REPLAY_CLIENT_MOVED;
+    event.connection = server->connection;
+    event.newChannelID = newChannelID;
+    for (i = 0; i < count; i++) {
+        if (server->clientChannel[clientIDs[i]] && server->clientChannel[clientIDs[i]] != newChannelID) {
+            event.clientID = clientIDs[i];
+            event.oldChannelID = server->clientChannel[clientIDs[i]];
+            server->clientChannel[clientIDs[i]] = newChannelID;
+            queueEvent(&event);
+        }
+    }
+    return ERROR_ok;
+}
+
+static unsigned int sdkFreeMemory(void* pointer)
+{
+    unsigned long long start = enterCall();
+    free(pointer);
+    leaveCall(TRACE_FREE_MEMORY, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID)
+{
+    unsigned long long start = enterCall();
+    if (getenv("STANDIN_VERBOSE")) {
+        fprintf(stderr, "[log %d] %s\n", (int)severity, logMessage);
+    }
+    leaveCall(TRACE_LOG_MESSAGE, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkGetClientID(uint64 serverConnectionHandlerID, anyID* result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+
+    if (server && server->selfID) {
+        *result = server->selfID;
+    } else {
+        error = ERROR_undefined;
+    }
+    leaveCall(TRACE_GET_CLIENT_ID, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelList(uint64 serverConnectionHandlerID, uint64** result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+    uint64* list = NULL;
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&serverLock);
+    if (server) {
+        list = (uint64*)malloc((server->channelCount + 1) * sizeof(uint64));
+    }
+    if (list) {
+        for (i = 0; i < server->channelCount; i++) {
+            if (server->channels[i].present) {
+                list[count++] = server->channels[i].id;
+            }
+        }
+        list[count] = 0;
+        *result = list;
+    } else {
+        error = server ? ERROR_undefined : ERROR_undefined;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CHANNEL_LIST, start);
+    return error;
+}
+
+static unsigned int sdkGetParentChannelOfChannel(uint64 serverConnectionHandlerID, uint64 channelID, uint64* result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    struct ReplayChannel* channel;
+    unsigned int error = ERROR_ok;
+
+    pthread_mutex_lock(&serverLock);
+    channel = server ? findChannel(server, channelID) : NULL;
+    if (channel && channel->present) {
+        *result = channel->parent;
+    } else {
+        error = ERROR_channel_invalid_id;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_PARENT_CHANNEL, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelVariableAsInt(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, int* result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    struct ReplayChannel* channel;
+    unsigned int error = ERROR_ok;
+
+    pthread_mutex_lock(&serverLock);
+    channel = server ? findChannel(server, channelID) : NULL;
+    if (!channel || !channel->present) {
+        error = ERROR_channel_invalid_id;
+    } else if (flag >= CHANNEL_ENDMARKER || !(channel->propertiesKnown & (1u << flag))) {
+        *result = 0;
+    } else {
+        *result = channel->properties[flag];
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CHANNEL_INT, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelVariableAsString(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, char** result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    struct ReplayChannel* channel;
+    unsigned int error = ERROR_ok;
+
+    pthread_mutex_lock(&serverLock);
+    channel = server ? findChannel(server, channelID) : NULL;
+    if (!channel || !channel->present) {
+        error = ERROR_channel_invalid_id;
+    } else if (!(*result = strdup(flag == CHANNEL_NAME && channel->name ? channel->name : ""))) {
+        error = ERROR_undefined;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CHANNEL_STRING, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelClientList(uint64 serverConnectionHandlerID, uint64 channelID, anyID** result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    struct ReplayChannel* channel;
+    unsigned int error = ERROR_ok;
+    anyID* list;
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&serverLock);
+    channel = server ? findChannel(server, channelID) : NULL;
+    if (!channel || !channel->present) {
+        error = ERROR_channel_invalid_id;
+    } else if (!(list = (anyID*)malloc((server->highestClient + 1) * sizeof(anyID)))) {
+        error = ERROR_undefined;
+    } else {
+        for (i = 1; i <= server->highestClient; i++) {
+            if (server->clientChannel[i] == channelID) {
+                list[count++] = (anyID)i;
+            }
+        }
+        list[count] = 0;
+        *result = list;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CHANNEL_CLIENT_LIST, start);
+    return error;
+}
+
+static unsigned int sdkGetClientList(uint64 serverConnectionHandlerID, anyID** result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+    anyID* list = NULL;
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&serverLock);
+    if (server) {
+        list = (anyID*)malloc((server->highestClient + 1) * sizeof(anyID));
+    }
+    if (list) {
+        for (i = 1; i <= server->highestClient; i++) {
+            if (server->clientChannel[i]) {
+                list[count++] = (anyID)i;
+            }
+        }
+        list[count] = 0;
+        *result = list;
+    } else {
+        error = server ? ERROR_undefined : ERROR_undefined;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CLIENT_LIST, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+
+    pthread_mutex_lock(&serverLock);
+    if (server && server->clientChannel[clientID]) {
+        *result = server->clientChannel[clientID];
+    } else {
+        error = ERROR_client_invalid_id;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_GET_CHANNEL_OF_CLIENT, start);
+    return error;
+}
+
+static unsigned int sdkGetClientNeededPermission(uint64 serverConnectionHandlerID, const char* permissionName, int* result)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+
+    *result = server ? server->neededPower : REPLAY_DEFAULT_POWER;
+    leaveCall(TRACE_GET_NEEDED_PERMISSION, start);
+    return ERROR_ok;
+}
+
+static void sdkCreateReturnCode(const char* pluginID, char* returnCode, size_t maxLen)
+{
+    unsigned long long start = enterCall();
+    snprintf(returnCode, maxLen, "RP:%s:%u", pluginID ? pluginID : "", __sync_add_and_fetch(&returnCodeCounter, 1));
+    leaveCall(TRACE_CREATE_RETURN_CODE, start);
+}
+
+static unsigned int sdkRequestClientMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+
+    if (!server) {
+        leaveCall(TRACE_REQUEST_CLIENT_MOVE, start);
+        return ERROR_undefined;
+    }
+    __sync_bool_compare_and_swap(&server->firstMoveAt, 0, start);
+    pthread_mutex_lock(&serverLock);
+    queueServerError(serverConnectionHandlerID, moveClients(server, &clientID, 1, newChannelID), returnCode);
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_REQUEST_CLIENT_MOVE, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkRequestClientsMove(uint64 serverConnectionHandlerID, const anyID* clientIDArray, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+    int count;
+
+    for (count = 0; clientIDArray[count] != 0; count++) {
+    }
+
+    if (!server) {
+        leaveCall(TRACE_REQUEST_CLIENTS_MOVE, start);
+        return ERROR_undefined;
+    }
+    __sync_bool_compare_and_swap(&server->firstMoveAt, 0, start);
+    pthread_mutex_lock(&serverLock);
+    queueServerError(serverConnectionHandlerID, moveClients(server, clientIDArray, count, newChannelID), returnCode);
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(TRACE_REQUEST_CLIENTS_MOVE, start);
+    return ERROR_ok;
+}
+
+static void sdkGetConfigPath(char* path, size_t maxLen)
+{
+    unsigned long long start = enterCall();
+    const char* dir = getenv("STANDIN_CONFIG_PATH");
+    snprintf(path, maxLen, "%s", dir ? dir : "./");
+    leaveCall(TRACE_GET_CONFIG_PATH, start);
+}
+
+static void sdkPrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget)
+{
+    unsigned long long start = enterCall();
+    struct ReplayServer* server = serverOf(serverConnectionHandlerID);
+
+    if (server) {
+        __sync_fetch_and_add(&server->printed, 1);
+    }
+    if (getenv("STANDIN_VERBOSE")) {
+        fprintf(stderr, "[tab] %s\n", message);
+    }
+    leaveCall(TRACE_PRINT_MESSAGE, start);
+}
+
+static uint64 sdkGetCurrentServerConnectionHandlerID(void)
+{
+    unsigned long long start = enterCall();
+    uint64 connection = __atomic_load_n(&currentConnection, __ATOMIC_RELAXED);
+    leaveCall(TRACE_GET_CURRENT_CONNECTION, start);
+    return connection;
+}
+
+static struct TS3Functions replayFunctions(void)
+{
+    struct TS3Functions funcs;
+
+    memset(&funcs, 0, sizeof(funcs));
+    funcs.freeMemory = sdkFreeMemory;
+    funcs.logMessage = sdkLogMessage;
+    funcs.getClientID = sdkGetClientID;
+    funcs.getChannelList = sdkGetChannelList;
+    funcs.getParentChannelOfChannel = sdkGetParentChannelOfChannel;
+    funcs.getChannelClientList = sdkGetChannelClientList;
+    funcs.getClientList = sdkGetClientList;
+    funcs.getChannelOfClient = sdkGetChannelOfClient;
+    funcs.getClientNeededPermission = sdkGetClientNeededPermission;
+    funcs.createReturnCode = sdkCreateReturnCode;
+    funcs.requestClientMove = sdkRequestClientMove;
+    funcs.requestClientsMove = sdkRequestClientsMove;
+    funcs.getConfigPath = sdkGetConfigPath;
+    funcs.printMessage = sdkPrintMessage;
+    funcs.getCurrentServerConnectionHandlerID = sdkGetCurrentServerConnectionHandlerID;
+    funcs.getChannelVariableAsInt = sdkGetChannelVariableAsInt;
+    funcs.getChannelVariableAsString = sdkGetChannelVariableAsString;
+    return funcs;
+}
+
+/*********************************** Replay ************************************/
+
+/* Deliver the events our requests caused; callbacks may queue further events. Returns the number delivered */
+static int replayPump(void)
+{
+    int delivered = 0;
+
+    while (1) {
+        struct ReplayEvent* pending;
+        int pendingCount;
+        int i;
+
+        pthread_mutex_lock(&serverLock);
+        pending = events;
+        pendingCount = eventCount;
+        events = NULL;
+        eventCount = 0;
+        eventCapacity = 0;
+        pthread_mutex_unlock(&serverLock);
+
+        if (!pendingCount) {
+            free(pending);
+            break;
+        }
+        for (i = 0; i < pendingCount; i++) {
+            const struct ReplayEvent* event = &pending[i];
+            struct ReplayServer* server = serverOf(event->connection);
+
+            if (event->type == REPLAY_CLIENT_MOVED) {
+                ts3plugin_onClientMoveMovedEvent(event->connection, event->clientID, event->oldChannelID, event->newChannelID,
+                                                 RETAIN_VISIBILITY, server ? server->selfID : 0, "replay", "replay=", "");
+            } else {
+                ts3plugin_onServerErrorEvent(event->connection, event->error == ERROR_ok ? "ok" : "error", event->error, event->returnCode, "");
+            }
+        }
+        delivered += pendingCount;
+        free(pending);
+    }
+    return delivered;
+}
+
+/* Raise the callback a record stands for */
+static void deliverCallback(const struct TraceRecord* r, uint64 oldChannelID)
+{
+    uint64 connection = r->serverConnectionHandlerID;
+
+    switch (r->kind) {
+    case TRACE_CONNECT_STATUS:
+        ts3plugin_onConnectStatusChangeEvent(connection, (int)r->values[0], r->result);
+        break;
+    case TRACE_CURRENT_CONNECTION:
+        ts3plugin_currentServerConnectionChanged(connection);
+        break;
+    case TRACE_NEW_CHANNEL:
+        ts3plugin_onNewChannelEvent(connection, r->values[0], r->values[1]);
+        break;
+    case TRACE_DEL_CHANNEL:
+        ts3plugin_onDelChannelEvent(connection, r->values[0], 0, "", "");
+        break;
+    case TRACE_CHANNEL_MOVED:
+        ts3plugin_onChannelMoveEvent(connection, r->values[0], r->values[1], 0, "", "");
+        break;
+    case TRACE_CLIENT_MOVED:
+        ts3plugin_onClientMoveEvent(connection, (anyID)r->values[0], oldChannelID, r->values[1],
+                                    !r->values[1] ? LEAVE_VISIBILITY : oldChannelID ? RETAIN_VISIBILITY : ENTER_VISIBILITY, "");
+        break;
+    case TRACE_SERVER_ERROR:
+        ts3plugin_onServerErrorEvent(connection, "", r->result, r->text, "");
+        break;
+    case TRACE_MENU_ITEM:
+        ts3plugin_onMenuItemEvent(connection, (enum PluginMenuType)r->values[0], (int)r->values[1], r->values[2]);
+        break;
+    case TRACE_HOTKEY:
+        ts3plugin_onHotkeyEvent(r->text);
+        break;
+    case TRACE_GROUP_CHANGED:
+        ts3plugin_onServerGroupClientAddedEvent(connection, (anyID)r->values[0], "", "", 0, 0, "", "");
+        break;
+    case TRACE_CHANNEL_EDITED:
+        ts3plugin_onUpdateChannelEditedEvent(connection, r->values[0], 0, "", "");
+        break;
+    default:
+        break;
+    }
+}
+
+/* Take the time of every pending action whose tab printed all its results */
+static void settleActions(int count)
+{
+    unsigned long long now = monotonicNanos();
+    int i;
+
+    for (i = 0; i < count; i++) {
+        struct ReplayAction* a = &actions[i];
+        struct ReplayServer* server = serverOf(a->connection);
+        unsigned long long firstAt;
+
+        if (!a->pending || (server && __atomic_load_n(&server->printed, __ATOMIC_RELAXED) < a->printTarget)) {
+            continue;
+        }
+        a->pending = 0;
+        pendingActions--;
+        a->replaySettleNanos += now - a->clickedAt;
+        firstAt = server ? __atomic_load_n(&server->firstMoveAt, __ATOMIC_RELAXED) : 0;
+        if (firstAt) {
+            a->replayFirstRequestNanos += firstAt - a->clickedAt;
+            a->replayFirstRequests++;
+        }
+    }
+}
+
+/*
+ * Deliver events until those of the actions before count have settled that
+ * act on connection, if not 0, or had settled by recorded time at when
+ * recorded. Returns the actions given up on.
+ */
+static int waitForActions(int count, uint64 connection, unsigned long long at)
+{
+    unsigned long long deadline = monotonicNanos() + REPLAY_SETTLE_TIMEOUT_MS * 1000000ULL;
+    unsigned long long idleSince = monotonicNanos();
+    int timeouts = 0;
+    int i;
+
+    while (1) {
+        int waiting = 0;
+
+        settleActions(count);
+        for (i = 0; i < count; i++) {
+            const struct ReplayAction* a = &actions[i];
+            waiting += a->pending && ((connection && a->connection == connection) ||
+                                      records[a->record].record.at + a->settleNanos <= at);
+        }
+        if (!waiting) {
+            break;
+        }
+        if (replayPump()) {
+            idleSince = monotonicNanos();
+        } else {
+            if (monotonicNanos() > deadline) {
+                for (i = 0; i < count; i++) {
+                    if (actions[i].pending) {
+                        actions[i].pending = 0;
+                        pendingActions--;
+                        actions[i].replaySettleNanos += monotonicNanos() - actions[i].clickedAt;
+                        timeouts++;
+                    }
+                }
+                break;
+            }
+            if (monotonicNanos() - idleSince < REPLAY_SPIN_NANOS) {
+                sched_yield();
+            } else {
+                sleepMillis(1);
+            }
+        }
+    }
+    replayPump();
+    return timeouts;
+}
+
+/* Replay the whole trace once against a freshly started plugin; returns the actions that timed out */
+static int replayOnce(unsigned long long maxGapNanos)
+{
+    int timeouts = 0;
+    int action = 0;
+    int i;
+
+    if (seedServers() != 0) {
+        fprintf(stderr, "Out of memory rebuilding the servers\n");
+        exit(1);
+    }
+    ts3plugin_setFunctionPointers(replayFunctions());
+    ts3plugin_registerPluginID("massmover_replay");
+    ts3plugin_init();
+
+    for (i = 0; i < recordCount; i++) {
+        const struct TraceRecord* r = &records[i].record;
+        struct ReplayServer* server = serverOf(r->serverConnectionHandlerID);
+        uint64 oldChannelID = 0;
+
+        if (!TRACE_IS_CALLBACK(r->kind) || records[i].ours) {
+            continue;
+        }
+        /* Nothing the user or server did after a mass move settled may reach the plugin before it settles */
+        if (pendingActions) {
+            timeouts += waitForActions(action, 0, r->at);
+        }
+
+        /* Actions still running on other tabs when the user acted keep running, as they did */
+        if (r->kind == TRACE_MENU_ITEM || r->kind == TRACE_HOTKEY) {
+            struct ReplayAction* a = &actions[action];
+            struct ReplayServer* target = serverOf(a->connection);
+            unsigned long long gap = a->gapNanos < maxGapNanos ? a->gapNanos : maxGapNanos;
+
+            timeouts += waitForActions(action, a->connection, r->at);
+            sleepMillis((unsigned int)(gap / 1000000));
+            replayPump();
+
+            if (target) {
+                a->printTarget = __atomic_load_n(&target->printed, __ATOMIC_RELAXED) + a->prints;
+                __atomic_store_n(&target->firstMoveAt, 0, __ATOMIC_RELAXED);
+            }
+            a->pending = 1;
+            pendingActions++;
+            a->clickedAt = monotonicNanos();
+            deliverCallback(r, 0);
+            action++;
+            settleActions(action);
+            continue;
+        }
+
+        pthread_mutex_lock(&serverLock);
+        if (server && r->kind == TRACE_CLIENT_MOVED) {
+            oldChannelID = server->clientChannel[(anyID)r->values[0]];
+        }
+        applyCallback(r);
+        pthread_mutex_unlock(&serverLock);
+        deliverCallback(r, oldChannelID);
+        replayPump();
+    }
+
+    /* Let whatever is still running finish before the plugin stops */
+    timeouts += waitForActions(action, 0, ~0ULL);
+    ts3plugin_shutdown();
+    replayPump();
+    return timeouts;
+}
+
+/*********************************** Trace ************************************/
+
+/*
+ * Find the callbacks the recorded plugin's requests caused, which the replay
+ * makes anew: answers carrying a return code it created, and moves by our
+ * own client of a client into the channel a request of it last asked for.
+ * Returns 0 on success.
+ */
+static int markOurCallbacks(void)
+{
+    struct {
+        uint64 connection;
+        anyID selfID;
+        uint64* requested;              /* Channel each client was last requested into, 0 = none pending */
+    } pending[REPLAY_MAX_CONNECTIONS];
+    int pendingCount = 0;
+    int result = 0;
+    int i, j;
+
+    for (i = 0; i < recordCount && result == 0; i++) {
+        struct ReplayRecord* record = &records[i];
+        const struct TraceRecord* r = &record->record;
+        int p;
+
+        if (r->kind == TRACE_SERVER_ERROR) {
+            record->ours = isOurReturnCode(r->text);
+            continue;
+        }
+        if (r->kind != TRACE_CLIENT_MOVED && r->kind != TRACE_GET_CLIENT_ID &&
+            r->kind != TRACE_REQUEST_CLIENT_MOVE && r->kind != TRACE_REQUEST_CLIENTS_MOVE) {
+            continue;
+        }
+
+        for (p = 0; p < pendingCount && pending[p].connection != r->serverConnectionHandlerID; p++) {
+        }
+        if (p == pendingCount) {
+            if (pendingCount == REPLAY_MAX_CONNECTIONS) {
+                continue;
+            }
+            pending[p].connection = r->serverConnectionHandlerID;
+            pending[p].selfID = 0;
+            pending[p].requested = (uint64*)calloc(REPLAY_CLIENT_SLOTS, sizeof(uint64));
+            if (!pending[p].requested) {
+                result = -1;
+                break;
+            }
+            pendingCount++;
+        }
+
+        switch (r->kind) {
+        case TRACE_GET_CLIENT_ID:
+            if (r->result == ERROR_ok) {
+                pending[p].selfID = (anyID)r->values[0];
+            }
+            break;
+        case TRACE_REQUEST_CLIENT_MOVE:
+        case TRACE_REQUEST_CLIENTS_MOVE:
+            for (j = 0; j < r->listCount; j++) {
+                pending[p].requested[(anyID)r->list[j]] = r->values[0];
+            }
+            break;
+        default:
+            if (r->values[2] && r->values[2] == pending[p].selfID && r->values[1] &&
+                pending[p].requested[(anyID)r->values[0]] == r->values[1]) {
+                pending[p].requested[(anyID)r->values[0]] = 0;
+                record->ours = 1;
+            }
+            break;
+        }
+    }
+
+    for (i = 0; i < pendingCount; i++) {
+        free(pending[i].requested);
+    }
+    return result;
+}
+
+/* Read the whole trace into memory and find its user actions; returns 0 on success */
+static int loadTrace(const char* path)
+{
+    struct TraceReader reader;
+    struct TraceRecord record;
+    uint64 current = 0;
+    int capacity = 0;
+    int codeCapacity = 0;
+    int result;
+    int i;
+
+    if (traceReaderOpen(&reader, path) != 0) {
+        fprintf(stderr, "%s is not a MassMover trace\n", path);
+        return -1;
+    }
+    while ((result = traceReaderNext(&reader, &record)) == 1) {
+        struct ReplayRecord* copy;
+
+        if (recordCount == capacity) {
+            int grownCapacity = capacity ? capacity * 2 : 4096;
+            struct ReplayRecord* grown = (struct ReplayRecord*)realloc(records, grownCapacity * sizeof(*records));
+            if (!grown) {
+                break;
+            }
+            records = grown;
+            capacity = grownCapacity;
+        }
+        copy = &records[recordCount++];
+        copy->record = record;
+        copy->ours = 0;
+        copy->record.list = NULL;
+        if (record.listCount) {
+            uint64* list = (uint64*)malloc(record.listCount * sizeof(uint64));
+            if (!list) {
+                break;
+            }
+            memcpy(list, record.list, record.listCount * sizeof(uint64));
+            copy->record.list = list;
+        }
+        copy->record.text = strdup(record.text);
+        if (!copy->record.text) {
+            break;
+        }
+
+        recordedCalls[record.kind]++;
+        recordedNanos[record.kind] += record.nanos;
+        if (record.kind == TRACE_CREATE_RETURN_CODE) {
+            if (ourReturnCodeCount == codeCapacity) {
+                int grownCapacity = codeCapacity ? codeCapacity * 2 : 256;
+                char** grown = (char**)realloc(ourReturnCodes, grownCapacity * sizeof(char*));
+                if (!grown) {
+                    break;
+                }
+                ourReturnCodes = grown;
+                codeCapacity = grownCapacity;
+            }
+            ourReturnCodes[ourReturnCodeCount++] = (char*)copy->record.text;
+        }
+    }
+    traceReaderClose(&reader);
+    if (result == -1) {
+        /* A trace cut short by a crash ends in a partial record; everything before it is good */
+        fprintf(stderr, "Trace ends in a malformed record after %d records, replaying those\n", recordCount);
+    } else if (result == 1) {
+        fprintf(stderr, "Out of memory reading the trace\n");
+        return -1;
+    }
+    qsort(ourReturnCodes, ourReturnCodeCount, sizeof(char*), compareStrings);
+    if (markOurCallbacks() != 0) {
+        fprintf(stderr, "Out of memory reading the trace\n");
+        return -1;
+    }
+
+    /*
+     * Each user action owns the results printed and the requests made on its
+     * tab until the next action there. Hotkeys act on the tab in front,
+     * which the plugin asks for right after the press.
+     */
+    actions = (struct ReplayAction*)calloc(recordCount + 1, sizeof(*actions));
+    if (!actions) {
+        return -1;
+    }
+    for (i = 0; i < recordCount; i++) {
+        const struct TraceRecord* r = &records[i].record;
+        struct ReplayAction* a = NULL;
+        int k;
+
+        if (r->kind == TRACE_CURRENT_CONNECTION) {
+            current = r->serverConnectionHandlerID;
+        } else if (r->kind == TRACE_GET_CURRENT_CONNECTION) {
+            current = r->values[0];
+        }
+        if (r->kind == TRACE_MENU_ITEM || r->kind == TRACE_HOTKEY) {
+            a = &actions[actionCount++];
+            a->record = i;
+            a->connection = r->serverConnectionHandlerID;
+            a->gapNanos = i ? r->at - records[i - 1].record.at : 0;
+            for (k = i + 1; r->kind == TRACE_HOTKEY && k < recordCount; k++) {
+                if (records[k].record.kind == TRACE_GET_CURRENT_CONNECTION) {
+                    current = records[k].record.values[0];
+                    break;
+                }
+            }
+            if (r->kind == TRACE_HOTKEY) {
+                a->connection = current;
+            }
+            continue;
+        }
+        if (r->kind != TRACE_PRINT_MESSAGE && r->kind != TRACE_REQUEST_CLIENT_MOVE && r->kind != TRACE_REQUEST_CLIENTS_MOVE) {
+            continue;
+        }
+
+        for (k = actionCount - 1; k >= 0 && actions[k].connection != r->serverConnectionHandlerID; k--) {
+        }
+        if (k < 0) {
+            continue;
+        }
+        a = &actions[k];
+        if (r->kind == TRACE_PRINT_MESSAGE) {
+            a->prints++;
+            a->settleNanos = r->at - records[a->record].record.at;
+        } else if (!a->firstRequestNanos) {
+            a->firstRequestNanos = r->at - records[a->record].record.at;
+        }
+    }
+    return 0;
+}
+
+static void freeTrace(void)
+{
+    int i;
+
+    for (i = 0; i < recordCount; i++) {
+        free((void*)records[i].record.list);
+        free((void*)records[i].record.text);
+    }
+    free(records);
+    free(ourReturnCodes);
+    free(actions);
+}
+
+/* Print every record of the trace, one per line */
+static void dumpTrace(void)
+{
+    int i, j;
+
+    for (i = 0; i < recordCount; i++) {
+        const struct TraceRecord* r = &records[i].record;
+
+        printf("%12.3f ms %-36s connection=%llu result=%u values=%llu,%llu,%llu", r->at / 1e6, traceKindName(r->kind),
+               (unsigned long long)r->serverConnectionHandlerID, r->result, (unsigned long long)r->values[0],
+               (unsigned long long)r->values[1], (unsigned long long)r->values[2]);
+        if (r->nanos) {
+            printf(" took=%.1fus", r->nanos / 1e3);
+        }
+        if (r->listCount) {
+            printf(" list[%d]=", r->listCount);
+            for (j = 0; j < r->listCount && j < 16; j++) {
+                printf("%s%llu", j ? "," : "", (unsigned long long)r->list[j]);
+            }
+            printf("%s", r->listCount > 16 ? ",..." : "");
+        }
+        if (r->text[0]) {
+            printf(" \"%s\"", r->text);
+        }
+        printf("\n");
+    }
+}
+
+/* What a user action was, for the report */
+static void describeAction(const struct TraceRecord* r, char* text, size_t size)
+{
+    if (r->kind == TRACE_HOTKEY) {
+        snprintf(text, size, "hotkey %s", r->text);
+    } else {
+        snprintf(text, size, "menu item %d on %llu (connection %llu)", (int)r->values[1], (unsigned long long)r->values[2],
+                 (unsigned long long)r->serverConnectionHandlerID);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = NULL;
+    unsigned long long maxGapNanos = REPLAY_MAX_GAP_MS * 1000000ULL;
+    unsigned long long recordedSettle = 0, replayedSettle = 0, replayedFirst = 0;
+    unsigned long long sdkCalls = 0, sdkNanos = 0, replaySdkCalls = 0;
+    int replayedFirstCount = 0;
+    int rounds = 1;
+    int quiet = 0;
+    int dump = 0;
+    int timeouts = 0;
+    int channels = 0, clients = 0;
+    int i, k;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-gap") == 0 && i + 1 < argc) {
+            maxGapNanos = (unsigned long long)atoi(argv[++i]) * 1000000ULL;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            dump = 1;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path || rounds < 1) {
+        fprintf(stderr, "Usage: %s [--rounds N] [--max-gap MS] [--quiet] [--dump] TRACE\n", argv[0]);
+        return 2;
+    }
+    if (loadTrace(path) != 0) {
+        return 1;
+    }
+    if (dump) {
+        dumpTrace();
+        freeTrace();
+        return 0;
+    }
+
+    if (seedServers() != 0) {
+        fprintf(stderr, "Out of memory rebuilding the servers\n");
+        return 1;
+    }
+    for (i = 0; i < serverCount; i++) {
+        channels += servers[i]->channelCount;
+        for (k = 1; k < REPLAY_CLIENT_SLOTS; k++) {
+            clients += servers[i]->clientChannel[k] || servers[i]->clientAnnounced[k];
+        }
+    }
+    printf("Trace %s: %d records over %.1f s, %d connections, %d channels, %d clients, %d user actions\n", path, recordCount,
+           recordCount ? records[recordCount - 1].record.at / 1e9 : 0.0, serverCount, channels, clients, actionCount);
+
+    for (k = 0; k < rounds; k++) {
+        timeouts += replayOnce(maxGapNanos);
+    }
+
+    if (!quiet) {
+        printf("\nUser actions (replayed times averaged over %d rounds):\n", rounds);
+    }
+    for (i = 0; i < actionCount; i++) {
+        const struct ReplayAction* a = &actions[i];
+        char text[160];
+
+        recordedSettle += a->settleNanos;
+        replayedSettle += a->replaySettleNanos;
+        replayedFirst += a->replayFirstRequestNanos;
+        replayedFirstCount += a->replayFirstRequests;
+        if (quiet) {
+            continue;
+        }
+        describeAction(&records[a->record].record, text, sizeof(text));
+        printf("  %3d %-48s settled %9.2f ms recorded, %9.2f ms replayed; first request %9.1f us recorded, %9.1f us replayed\n",
+               i + 1, text, a->settleNanos / 1e6, a->replaySettleNanos / 1e6 / rounds, a->firstRequestNanos / 1e3,
+               a->replayFirstRequests ? a->replayFirstRequestNanos / 1e3 / a->replayFirstRequests : 0.0);
+    }
+
+    printf("\nSDK calls (replayed averaged over %d rounds):\n", rounds);
+    for (k = TRACE_FREE_MEMORY; k < TRACE_CALL_END; k++) {
+        sdkCalls += recordedCalls[k];
+        sdkNanos += recordedNanos[k];
+        replaySdkCalls += replayCalls[k];
+        if (recordedCalls[k] || replayCalls[k]) {
+            printf("  %-36s %10llu calls %12.1f us recorded, %12.1f calls %12.1f us replayed\n", traceKindName((enum TraceKind)k),
+                   recordedCalls[k], recordedNanos[k] / 1e3, (double)replayCalls[k] / rounds, replayNanos[k] / 1e3 / rounds);
+        }
+    }
+
+    printf("RESULT trace=%s records=%d actions=%d rounds=%d recorded_settle_ms=%.1f settle_ms=%.1f first_request_us=%.1f recorded_sdk_calls=%llu recorded_sdk_ms=%.1f sdk_calls=%.1f timeouts=%d\n",
+           path, recordCount, actionCount, rounds, recordedSettle / 1e6, replayedSettle / 1e6 / rounds,
+           replayedFirstCount ? replayedFirst / 1e3 / replayedFirstCount : 0.0, sdkCalls, sdkNanos / 1e6,
+           (double)replaySdkCalls / rounds, timeouts);
+
+    freeServers();
+    freeTrace();
+    return 0;
+}
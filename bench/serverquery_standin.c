@@ -0,0 +1,555 @@
+/*
+ * TeamSpeak 3 MassMover - ServerQuery Stand-in
+ *
+ * A fake ServerQuery server for testing and benchmarking the headless tool
+ * without a TeamSpeak server. It serves the synthetic server of the SDK
+ * stand-in, so channel trees, clients, anti-flood and protected clients are
+ * the ones the plugin benchmarks see: channellist and clientlist read it
+ * through the SDK functions, and clientmove goes through requestClientsMove
+ * and answers with the error the stand-in raised for it. Each answer is
+ * held back for --latency-ms after its command arrived, as a round trip to
+ * a real server would be, so a client waiting for every answer pays the
+ * latency per batch and a pipelining one about once. Commands are still
+ * carried out the moment they arrive and answered in order.
+ *
+ * Usage: serverquery_standin [--port PORT] [--shape chain|fan|mix] [--channels N]
+ *                            [--clients N] [--occupied PERCENT] [--seed N]
+ *                            [--latency-ms MS] [--flood BUDGET] [--flood-refill PER_SECOND]
+ *                            [--protected EVERY_NTH_CLIENT] [--password TEXT]
+ *                            [--sessions N]
+ *
+ * Sessions are served one after another, --sessions of them (0 = until
+ * killed); with --password every login must give it. Port 0 picks a free
+ * port. Once listening it prints a LISTENING line with the port, and after
+ * each session a RESULT line.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_errors.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+
+#include "massmover.h"
+#include "serverquery.h"
+#include "ts3_standin.h"
+
+#define QUERY_RETURN_CODE "serverquery"
+#define QUERY_BANNER "TS3\n\rWelcome to the TeamSpeak 3 ServerQuery interface, type \"help\" for a list of commands and \"help <command>\" for information on a specific command.\n\r"
+
+/* An answer waiting out the latency */
+struct Answer {
+    unsigned long long due;
+    char* text;
+};
+
+/* One client connection */
+struct Session {
+    int fd;
+    struct ServerQueryReader reader;
+    struct ServerQueryBuffer text;      /* Answer being put together */
+    struct Answer* answers;             /* Oldest first */
+    int answerCount;
+    int answerCapacity;
+    int loggedIn;
+    int serverSelected;
+    int quitting;
+    int commands;
+    int clientMoves;
+};
+
+static struct TS3Functions sdk;
+static const char* password = NULL;
+static int latencyMs = 0;
+static unsigned int lastMoveError = ERROR_ok;    /* Raised by the stand-in for the latest clientmove */
+static int clientsMoved = 0;
+
+/*********************************** Callbacks the stand-in raises ************************************/
+
+void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber)
+{
+}
+
+void ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID)
+{
+}
+
+void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage)
+{
+}
+
+void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID)
+{
+}
+
+void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage)
+{
+    clientsMoved++;
+}
+
+int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage)
+{
+    if (returnCode && strcmp(returnCode, QUERY_RETURN_CODE) == 0) {
+        lastMoveError = error;
+        return 1;
+    }
+    return 0;
+}
+
+/*********************************** Answers ************************************/
+
+/* Queue the text put together so far, followed by the error line, to go out after the latency */
+static void answer(struct Session* session, unsigned int id, const char* message)
+{
+    struct Answer* slot;
+
+    serverQueryAppend(&session->text, "error id=%u msg=", id);
+    serverQueryAppendEscaped(&session->text, message);
+    serverQueryAppend(&session->text, "\n\r");
+
+    if (session->answerCount == session->answerCapacity) {
+        int capacity = session->answerCapacity ? session->answerCapacity * 2 : 64;
+        struct Answer* grown = (struct Answer*)realloc(session->answers, capacity * sizeof(struct Answer));
+        if (!grown) {
+            session->text.length = 0;
+            return;
+        }
+        session->answers = grown;
+        session->answerCapacity = capacity;
+    }
+    slot = &session->answers[session->answerCount++];
+    slot->due = standinNow() + (unsigned long long)latencyMs * 1000000ULL;
+    slot->text = session->text.data;
+    memset(&session->text, 0, sizeof(session->text));
+}
+
+/* Write every answer that is due; returns 0 on success */
+static int sendDueAnswers(struct Session* session)
+{
+    struct ServerQueryBuffer out;
+    unsigned long long now = standinNow();
+    int sent = 0;
+    int result;
+
+    memset(&out, 0, sizeof(out));
+    while (sent < session->answerCount && session->answers[sent].due <= now) {
+        serverQueryAppend(&out, "%s", session->answers[sent].text ? session->answers[sent].text : "");
+        free(session->answers[sent].text);
+        sent++;
+    }
+    memmove(session->answers, session->answers + sent, (session->answerCount - sent) * sizeof(struct Answer));
+    session->answerCount -= sent;
+    result = out.length ? serverQueryFlush(&out, session->fd) : 0;
+    serverQueryBufferFree(&out);
+    return result;
+}
+
+/*********************************** Commands ************************************/
+
+static void listChannels(struct Session* session, int withFlags)
+{
+    int channelCount = standinChannelCount();
+    int* clientsIn = (int*)calloc(channelCount + 1, sizeof(int));
+    anyID* clients;
+    int i;
+
+    /* Channel IDs of the stand-in are 1..channelCount */
+    if (clientsIn && sdk.getClientList(STANDIN_CONNECTION_ID, &clients) == ERROR_ok) {
+        for (i = 0; clients[i]; i++) {
+            uint64 channelID;
+            if (sdk.getChannelOfClient(STANDIN_CONNECTION_ID, clients[i], &channelID) == ERROR_ok && channelID <= (uint64)channelCount) {
+                clientsIn[channelID]++;
+            }
+        }
+        sdk.freeMemory(clients);
+    }
+
+    for (i = 0; i < channelCount; i++) {
+        uint64 channelID = standinChannelAt(i);
+        uint64 parentID = 0;
+        char* name = NULL;
+        int flagPassword = 0, flagPermanent = 0;
+
+        sdk.getParentChannelOfChannel(STANDIN_CONNECTION_ID, channelID, &parentID);
+        serverQueryAppend(&session->text, "%scid=%llu pid=%llu channel_order=0 channel_name=", i ? "|" : "",
+                          (unsigned long long)channelID, (unsigned long long)parentID);
+        if (sdk.getChannelVariableAsString(STANDIN_CONNECTION_ID, channelID, CHANNEL_NAME, &name) == ERROR_ok) {
+            serverQueryAppendEscaped(&session->text, name);
+            sdk.freeMemory(name);
+        }
+        serverQueryAppend(&session->text, " total_clients=%d channel_needed_subscribe_power=0",
+                          clientsIn && channelID <= (uint64)channelCount ? clientsIn[channelID] : 0);
+        if (withFlags) {
+            sdk.getChannelVariableAsInt(STANDIN_CONNECTION_ID, channelID, CHANNEL_FLAG_PASSWORD, &flagPassword);
+            sdk.getChannelVariableAsInt(STANDIN_CONNECTION_ID, channelID, CHANNEL_FLAG_PERMANENT, &flagPermanent);
+            serverQueryAppend(&session->text, " channel_flag_default=%d channel_flag_password=%d channel_flag_permanent=%d channel_flag_semi_permanent=0",
+                              channelID == 1, flagPassword, flagPermanent);
+        }
+    }
+    serverQueryAppend(&session->text, "\n\r");
+    free(clientsIn);
+    answer(session, SERVERQUERY_ERROR_OK, "ok");
+}
+
+static void listClients(struct Session* session)
+{
+    anyID* clients;
+    int i;
+
+    if (sdk.getClientList(STANDIN_CONNECTION_ID, &clients) != ERROR_ok) {
+        answer(session, SERVERQUERY_ERROR_SERVER_INVALID_ID, "invalid serverID");
+        return;
+    }
+    for (i = 0; clients[i]; i++) {
+        uint64 channelID = 0;
+
+        /* Our own client of the stand-in is the query client of this session */
+        sdk.getChannelOfClient(STANDIN_CONNECTION_ID, clients[i], &channelID);
+        serverQueryAppend(&session->text, "%sclid=%u cid=%llu client_database_id=%u client_nickname=%s%u client_type=%d",
+                          i ? "|" : "", (unsigned int)clients[i], (unsigned long long)channelID, (unsigned int)clients[i],
+                          clients[i] == STANDIN_SELF_ID ? "serveradmin\\sfrom\\s127.0.0.1:" : "Client\\s", (unsigned int)clients[i],
+                          clients[i] == STANDIN_SELF_ID);
+    }
+    serverQueryAppend(&session->text, "\n\r");
+    sdk.freeMemory(clients);
+    answer(session, SERVERQUERY_ERROR_OK, "ok");
+}
+
+/* clientmove clid=A|clid=B... cid=C; args holds everything after the command name */
+static void moveClients(struct Session* session, char* args)
+{
+    anyID* clients = NULL;
+    int count = 0;
+    int capacity = 0;
+    int alreadyThere = 0;
+    uint64 targetChannelID = 0;
+    char* cursor = args;
+    char* item;
+    int i;
+
+    session->clientMoves++;
+    while ((item = serverQueryNextItem(&cursor))) {
+        char* key;
+        char* value;
+
+        while (serverQueryNextField(&item, &key, &value)) {
+            if (strcmp(key, "cid") == 0) {
+                targetChannelID = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "clid") == 0) {
+                if (count + 1 >= capacity) {
+                    anyID* grown;
+                    capacity = capacity ? capacity * 2 : 64;
+                    grown = (anyID*)realloc(clients, capacity * sizeof(anyID));
+                    if (!grown) {
+                        free(clients);
+                        answer(session, SERVERQUERY_ERROR_PARAMETER_INVALID, "out of memory");
+                        return;
+                    }
+                    clients = grown;
+                }
+                clients[count++] = (anyID)strtoul(value, NULL, 10);
+            }
+        }
+    }
+    if (!count || !targetChannelID) {
+        free(clients);
+        answer(session, SERVERQUERY_ERROR_PARAMETER_INVALID, "invalid parameter");
+        return;
+    }
+    clients[count] = 0;
+
+    /* A real server refuses unknown clients and a move of nobody but clients already there */
+    for (i = 0; i < count; i++) {
+        uint64 channelID;
+        if (!clients[i] || sdk.getChannelOfClient(STANDIN_CONNECTION_ID, clients[i], &channelID) != ERROR_ok) {
+            free(clients);
+            answer(session, SERVERQUERY_ERROR_CLIENT_INVALID_ID, "invalid clientID");
+            return;
+        }
+        alreadyThere += channelID == targetChannelID;
+    }
+    if (alreadyThere == count) {
+        free(clients);
+        answer(session, SERVERQUERY_ERROR_ALREADY_MEMBER, "already member of channel");
+        return;
+    }
+
+    lastMoveError = ERROR_undefined;
+    sdk.requestClientsMove(STANDIN_CONNECTION_ID, clients, targetChannelID, "", QUERY_RETURN_CODE);
+    standinPump();
+    free(clients);
+
+    switch (lastMoveError) {
+    case ERROR_ok:
+        answer(session, SERVERQUERY_ERROR_OK, "ok");
+        break;
+    case ERROR_client_is_flooding:
+        answer(session, SERVERQUERY_ERROR_FLOODING, "client is flooding");
+        break;
+    case ERROR_channel_invalid_id:
+        answer(session, SERVERQUERY_ERROR_CHANNEL_INVALID_ID, "invalid channelID");
+        break;
+    case ERROR_permissions_client_insufficient:
+        answer(session, SERVERQUERY_ERROR_PERMISSIONS_INSUFFICIENT, "insufficient client permissions");
+        break;
+    default:
+        answer(session, lastMoveError, "error");
+        break;
+    }
+}
+
+static void runCommand(struct Session* session, char* line)
+{
+    char* args = strchr(line, ' ');
+    char* key;
+    char* value;
+
+    if (args) {
+        *args++ = '\0';
+    } else {
+        args = line + strlen(line);
+    }
+    session->commands++;
+
+    if (strcmp(line, "quit") == 0) {
+        session->quitting = 1;
+        answer(session, SERVERQUERY_ERROR_OK, "ok");
+        return;
+    }
+    if (strcmp(line, "login") == 0) {
+        const char* given = NULL;
+
+        while (serverQueryNextField(&args, &key, &value)) {
+            if (strcmp(key, "client_login_password") == 0) {
+                given = value;
+            }
+        }
+        if (password && (!given || strcmp(given, password) != 0)) {
+            answer(session, SERVERQUERY_ERROR_INVALID_LOGIN, "invalid loginname or password");
+            return;
+        }
+        session->loggedIn = 1;
+        answer(session, SERVERQUERY_ERROR_OK, "ok");
+        return;
+    }
+    if (password && !session->loggedIn) {
+        answer(session, SERVERQUERY_ERROR_NOT_LOGGED_IN, "not logged in");
+        return;
+    }
+    if (strcmp(line, "use") == 0) {
+        session->serverSelected = 0;
+        while (serverQueryNextField(&args, &key, &value)) {
+            if ((strcmp(key, "sid") == 0 && strcmp(value, "1") == 0) || (strcmp(key, "port") == 0 && strcmp(value, "9987") == 0)) {
+                session->serverSelected = 1;
+            }
+        }
+        answer(session, session->serverSelected ? SERVERQUERY_ERROR_OK : SERVERQUERY_ERROR_SERVER_INVALID_ID,
+               session->serverSelected ? "ok" : "invalid serverID");
+        return;
+    }
+    if (strcmp(line, "whoami") == 0) {
+        uint64 channelID = 0;
+
+        sdk.getChannelOfClient(STANDIN_CONNECTION_ID, STANDIN_SELF_ID, &channelID);
+        serverQueryAppend(&session->text, "virtualserver_status=%s virtualserver_id=%d virtualserver_port=%d client_id=%u client_channel_id=%llu client_nickname=serveradmin client_database_id=1 client_login_name=serveradmin\n\r",
+                          session->serverSelected ? "online" : "unknown", session->serverSelected, session->serverSelected ? 9987 : 0,
+                          (unsigned int)STANDIN_SELF_ID, (unsigned long long)(session->serverSelected ? channelID : 0));
+        answer(session, SERVERQUERY_ERROR_OK, "ok");
+        return;
+    }
+    if (strcmp(line, "channellist") != 0 && strcmp(line, "clientlist") != 0 && strcmp(line, "clientmove") != 0) {
+        answer(session, SERVERQUERY_ERROR_COMMAND_NOT_FOUND, "command not found");
+        return;
+    }
+    if (!session->serverSelected) {
+        answer(session, SERVERQUERY_ERROR_SERVER_INVALID_ID, "invalid serverID");
+        return;
+    }
+    if (strcmp(line, "channellist") == 0) {
+        int withFlags = 0;
+
+        while (serverQueryNextField(&args, &key, &value)) {
+            withFlags |= strcmp(key, "-flags") == 0;
+        }
+        listChannels(session, withFlags);
+    } else if (strcmp(line, "clientlist") == 0) {
+        listClients(session);
+    } else {
+        moveClients(session, args);
+    }
+}
+
+/*********************************** Sessions ************************************/
+
+/* Serve one connection until it quits or goes away */
+static void serveSession(int fd, int number)
+{
+    struct Session session;
+    unsigned long long start = standinNow();
+    int movedBefore = clientsMoved;
+    int floodBefore = standinFloodRejections();
+    int closed = 0;
+    int i;
+
+    memset(&session, 0, sizeof(session));
+    session.fd = fd;
+    serverQueryReaderInit(&session.reader, fd);
+    serverQueryAppend(&session.text, QUERY_BANNER);
+    serverQueryFlush(&session.text, fd);
+
+    while (!closed || session.answerCount > 0) {
+        struct pollfd pfd;
+        int timeoutMs = -1;
+        char* line;
+
+        if (session.answerCount > 0) {
+            unsigned long long now = standinNow();
+            unsigned long long due = session.answers[0].due;
+            timeoutMs = due > now ? (int)((due - now) / 1000000ULL) + 1 : 0;
+        } else if (session.quitting) {
+            break;
+        }
+        pfd.fd = fd;
+        pfd.events = closed || session.quitting ? 0 : POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeoutMs) < 0 && errno != EINTR) {
+            break;
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (serverQueryFill(&session.reader) <= 0) {
+                closed = 1;
+            }
+            while (!session.quitting && (line = serverQueryTakeLine(&session.reader))) {
+                runCommand(&session, line);
+            }
+        }
+        if (sendDueAnswers(&session) != 0) {
+            break;
+        }
+    }
+
+    printf("RESULT session=%d commands=%d clientmoves=%d moved=%d flood=%d latency_ms=%d seconds=%.3f\n", number,
+           session.commands, session.clientMoves, clientsMoved - movedBefore, standinFloodRejections() - floodBefore,
+           latencyMs, (standinNow() - start) / 1e9);
+    fflush(stdout);
+
+    for (i = 0; i < session.answerCount; i++) {
+        free(session.answers[i].text);
+    }
+    free(session.answers);
+    serverQueryBufferFree(&session.text);
+    serverQueryReaderFree(&session.reader);
+    close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    struct StandinConfig config;
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    int port = SERVERQUERY_PORT_DEFAULT;
+    int sessions = 1;
+    int listener;
+    int on = 1;
+    int served;
+    int i;
+
+    config.shape = SHAPE_MIX;
+    config.channelCount = 4000;
+    config.clientCount = 500;
+    config.occupiedPercent = 10;
+    config.seed = 1;
+    config.floodBudget = 0;
+    config.floodRefillPerSecond = 10;
+    config.protectedEvery = 0;
+    config.connections = 1;
+
+    for (i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--port") == 0) {
+            port = atoi(value);
+        } else if (strcmp(argv[i], "--shape") == 0) {
+            config.shape = strcmp(value, "chain") == 0 ? SHAPE_CHAIN : strcmp(value, "fan") == 0 ? SHAPE_FAN : SHAPE_MIX;
+        } else if (strcmp(argv[i], "--channels") == 0) {
+            config.channelCount = atoi(value);
+        } else if (strcmp(argv[i], "--clients") == 0) {
+            config.clientCount = atoi(value);
+        } else if (strcmp(argv[i], "--occupied") == 0) {
+            config.occupiedPercent = atoi(value);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = (unsigned int)atoi(value);
+        } else if (strcmp(argv[i], "--latency-ms") == 0) {
+            latencyMs = atoi(value);
+        } else if (strcmp(argv[i], "--flood") == 0) {
+            config.floodBudget = atoi(value);
+        } else if (strcmp(argv[i], "--flood-refill") == 0) {
+            config.floodRefillPerSecond = atoi(value);
+        } else if (strcmp(argv[i], "--protected") == 0) {
+            config.protectedEvery = atoi(value);
+        } else if (strcmp(argv[i], "--password") == 0) {
+            password = value;
+        } else if (strcmp(argv[i], "--sessions") == 0) {
+            sessions = atoi(value);
+        } else {
+            fprintf(stderr, "Usage: %s [--port PORT] [--shape chain|fan|mix] [--channels N] [--clients N] [--occupied PERCENT] [--seed N] [--latency-ms MS] [--flood BUDGET] [--flood-refill PER_SECOND] [--protected EVERY_NTH_CLIENT] [--password TEXT] [--sessions N]\n", argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (config.channelCount < 1 || latencyMs < 0) {
+        fprintf(stderr, "Need at least one channel and a latency of 0 ms or more\n");
+        return 1;
+    }
+
+    if (standinCreate(&config) != 0) {
+        fprintf(stderr, "Failed to create synthetic server\n");
+        return 1;
+    }
+    sdk = standinFunctions();
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((unsigned short)port);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (listener == -1 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 4) != 0 ||
+        getsockname(listener, (struct sockaddr*)&address, &addressLength) != 0) {
+        fprintf(stderr, "Failed to listen on port %d: %s\n", port, strerror(errno));
+        standinDestroy();
+        return 1;
+    }
+    printf("LISTENING port=%d channels=%d clients=%d\n", ntohs(address.sin_port), standinChannelCount(), config.clientCount);
+    fflush(stdout);
+
+    for (served = 0; sessions == 0 || served < sessions; served++) {
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd == -1) {
+            if (errno == EINTR) {
+                served--;
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        serveSession(fd, served + 1);
+    }
+
+    close(listener);
+    standinDestroy();
+    return 0;
+}
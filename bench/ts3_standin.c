@@ -0,0 +1,1022 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - SDK Stand-in
+ *
+ * The synthetic server numbers its channels 1..channelCount, so a channel
+ * ID doubles as array index. Clients are 1..clientCount+1 with ourselves as
+ * client 1. With several connections every tab is connected to a server of
+ * its own: all share the channel layout, each has its own clients and
+ * anti-flood budget, and connection c is serverConnectionHandlerID c. Allocation counting relies on linking with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc; allocations made by the
+ * stand-in itself are not counted. The plugin calls in from its worker
+ * thread while the benchmark pumps events on the main thread, so the
+ * synthetic server is guarded by one mutex that is never held while a
+ * plugin callback runs.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_errors.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+
+#include "massmover.h"
+#include "ts3_standin.h"
+
+/* Event types queued for standinPump */
+enum StandinEventType {
+    EVENT_CLIENT_MOVED = 0,    /* onClientMoveMovedEvent */
+    EVENT_SERVER_ERROR         /* onServerErrorEvent for a request with return code */
+};
+
+struct StandinEvent {
+    enum StandinEventType type;
+    uint64 connection;
+    anyID clientID;
+    uint64 oldChannelID;
+    uint64 newChannelID;
+    unsigned int error;
+    char returnCode[64];
+};
+
+/* What differs between the servers of the connections */
+struct StandinServer {
+    uint64 clientChannel[65536];             /* Channel of each client, 0 = not connected */
+    double floodPoints;                      /* Anti-flood points left */
+    unsigned long long floodUpdatedAt;
+};
+
+static struct StandinConfig config;
+static uint64* channelParent = NULL;        /* Parent of channel i at index i, index 0 unused */
+static struct StandinServer* servers = NULL; /* One per connection, connection c at index c - 1 */
+static int clientTotal = 0;                  /* Highest client ID in use */
+static uint64 currentConnection = STANDIN_CONNECTION_ID; /* Tab in front, where hotkeys act */
+
+static struct StandinEvent* events = NULL;
+static int eventCount = 0;
+static int eventCapacity = 0;
+
+static struct StandinPhase phases[STANDIN_MAX_PHASES];
+static int phaseCount = 0;
+static int currentPhase = -1;
+static __thread int inStandin = 0;           /* Depth of stand-in calls on this thread, allocations there are not counted */
+static pthread_mutex_t serverLock = PTHREAD_MUTEX_INITIALIZER;  /* Guards clients, events, flood state and return codes */
+static int printedMessages = 0;              /* Messages printed to a tab */
+static unsigned long long firstMoveAt = 0;   /* Time of the first move request since standinResetFirstMove, 0 = none yet */
+static unsigned int returnCodeCounter = 0;
+static int floodRejections = 0;
+static unsigned int rngState = 1;
+
+static const char* callNames[CALL_COUNT] = {
+    "freeMemory", "logMessage", "getClientID", "getChannelList", "getParentChannelOfChannel",
+    "getChannelClientList", "getClientList", "getChannelOfClient", "getChannelVariableAsInt",
+    "getChannelVariableAsString", "getClientVariableAsInt", "getClientNeededPermission",
+    "createReturnCode", "requestClientMove", "requestClientsMove", "getConfigPath",
+    "printMessage", "printMessageToCurrentTab", "getCurrentServerConnectionHandlerID"
+};
+
+/*********************************** Clock, RNG and accounting ************************************/
+
+unsigned long long standinNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static unsigned int nextRandom(void)
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+/* Count a call and return its start time */
+static unsigned long long enterCall(enum StandinCall call)
+{
+    int phase = __atomic_load_n(&currentPhase, __ATOMIC_RELAXED);
+
+    inStandin++;
+    if (phase >= 0) {
+        __sync_fetch_and_add(&phases[phase].calls[call], 1);
+    }
+    return standinNow();
+}
+
+static void leaveCall(enum StandinCall call, unsigned long long start)
+{
+    int phase = __atomic_load_n(&currentPhase, __ATOMIC_RELAXED);
+
+    if (phase >= 0) {
+        __sync_fetch_and_add(&phases[phase].nanos[call], standinNow() - start);
+    }
+    inStandin--;
+}
+
+extern void* __real_malloc(size_t size);
+extern void* __real_calloc(size_t count, size_t size);
+extern void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    int phase = __atomic_load_n(&currentPhase, __ATOMIC_RELAXED);
+
+    if (!inStandin && phase >= 0) {
+        __sync_fetch_and_add(&phases[phase].allocations, 1);
+    }
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    int phase = __atomic_load_n(&currentPhase, __ATOMIC_RELAXED);
+
+    if (!inStandin && phase >= 0) {
+        __sync_fetch_and_add(&phases[phase].allocations, 1);
+    }
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    int phase = __atomic_load_n(&currentPhase, __ATOMIC_RELAXED);
+
+    if (!inStandin && phase >= 0) {
+        __sync_fetch_and_add(&phases[phase].allocations, 1);
+    }
+    return __real_realloc(ptr, size);
+}
+
+/* Queue an event for standinPump */
+static void queueEvent(const struct StandinEvent* event)
+{
+    if (eventCount >= eventCapacity) {
+        int capacity = eventCapacity ? eventCapacity * 2 : 256;
+        struct StandinEvent* grown = (struct StandinEvent*)realloc(events, capacity * sizeof(struct StandinEvent));
+        if (!grown) {
+            return;
+        }
+        events = grown;
+        eventCapacity = capacity;
+    }
+    events[eventCount++] = *event;
+}
+
+/* Server a connection is connected to, NULL for an unknown connection */
+static struct StandinServer* serverOf(uint64 serverConnectionHandlerID)
+{
+    if (serverConnectionHandlerID < 1 || serverConnectionHandlerID > (uint64)config.connections) {
+        return NULL;
+    }
+    return &servers[serverConnectionHandlerID - 1];
+}
+
+/* Move a client on a connection's server and queue the matching event */
+static void moveClient(uint64 connection, anyID clientID, uint64 newChannelID)
+{
+    struct StandinServer* server = serverOf(connection);
+    struct StandinEvent event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_CLIENT_MOVED;
+    event.connection = connection;
+    event.clientID = clientID;
+    event.oldChannelID = server->clientChannel[clientID];
+    event.newChannelID = newChannelID;
+    server->clientChannel[clientID] = newChannelID;
+    queueEvent(&event);
+}
+
+static void queueServerError(uint64 connection, unsigned int error, const char* returnCode)
+{
+    struct StandinEvent event;
+
+    if (!returnCode || !returnCode[0]) {
+        return;
+    }
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_SERVER_ERROR;
+    event.connection = connection;
+    event.error = error;
+    strncpy(event.returnCode, returnCode, sizeof(event.returnCode) - 1);
+    queueEvent(&event);
+}
+
+/* The client needs more move power than we have */
+static int protectedClient(anyID clientID)
+{
+    return config.protectedEvery > 0 && clientID != STANDIN_SELF_ID && clientID % config.protectedEvery == 0;
+}
+
+/* Charge a request against a server's anti-flood budget; returns 0 if the server would reject it */
+static int chargeFlood(struct StandinServer* server, int clients)
+{
+    unsigned long long now = standinNow();
+    double cost = 1.0 + clients / 10.0;
+
+    if (!config.floodBudget) {
+        return 1;
+    }
+
+    server->floodPoints += (now - server->floodUpdatedAt) / 1e9 * config.floodRefillPerSecond;
+    if (server->floodPoints > config.floodBudget) {
+        server->floodPoints = config.floodBudget;
+    }
+    server->floodUpdatedAt = now;
+
+    if (server->floodPoints < cost) {
+        floodRejections++;
+        return 0;
+    }
+    server->floodPoints -= cost;
+    return 1;
+}
+
+static int validChannel(uint64 channelID)
+{
+    return channelID >= 1 && channelID <= (uint64)config.channelCount;
+}
+
+/*********************************** SDK function implementations ************************************/
+
+static unsigned int sdkFreeMemory(void* pointer)
+{
+    unsigned long long start = enterCall(CALL_freeMemory);
+    free(pointer);
+    leaveCall(CALL_freeMemory, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID)
+{
+    unsigned long long start = enterCall(CALL_logMessage);
+    if (getenv("STANDIN_VERBOSE")) {
+        fprintf(stderr, "[log %d] %s\n", (int)severity, logMessage);
+    }
+    leaveCall(CALL_logMessage, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkGetClientID(uint64 serverConnectionHandlerID, anyID* result)
+{
+    unsigned long long start = enterCall(CALL_getClientID);
+    *result = STANDIN_SELF_ID;
+    leaveCall(CALL_getClientID, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkGetChannelList(uint64 serverConnectionHandlerID, uint64** result)
+{
+    unsigned long long start = enterCall(CALL_getChannelList);
+    unsigned int error = ERROR_ok;
+    uint64* list = (uint64*)malloc((config.channelCount + 1) * sizeof(uint64));
+    int i;
+
+    if (list) {
+        for (i = 0; i < config.channelCount; i++) {
+            list[i] = (uint64)(i + 1);
+        }
+        list[config.channelCount] = 0;
+        *result = list;
+    } else {
+        error = ERROR_undefined;
+    }
+    leaveCall(CALL_getChannelList, start);
+    return error;
+}
+
+static unsigned int sdkGetParentChannelOfChannel(uint64 serverConnectionHandlerID, uint64 channelID, uint64* result)
+{
+    unsigned long long start = enterCall(CALL_getParentChannelOfChannel);
+    unsigned int error = ERROR_ok;
+
+    if (validChannel(channelID)) {
+        *result = channelParent[channelID];
+    } else {
+        error = ERROR_channel_invalid_id;
+    }
+    leaveCall(CALL_getParentChannelOfChannel, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelClientList(uint64 serverConnectionHandlerID, uint64 channelID, anyID** result)
+{
+    unsigned long long start = enterCall(CALL_getChannelClientList);
+    struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+    anyID* list;
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&serverLock);
+    list = (anyID*)malloc((clientTotal + 1) * sizeof(anyID));
+    if (!server || !validChannel(channelID)) {
+        error = ERROR_channel_invalid_id;
+        free(list);
+    } else if (!list) {
+        error = ERROR_undefined;
+    } else {
+        for (i = 1; i <= clientTotal; i++) {
+            if (server->clientChannel[i] == channelID) {
+                list[count++] = (anyID)i;
+            }
+        }
+        list[count] = 0;
+        *result = list;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(CALL_getChannelClientList, start);
+    return error;
+}
+
+static unsigned int sdkGetClientList(uint64 serverConnectionHandlerID, anyID** result)
+{
+    unsigned long long start = enterCall(CALL_getClientList);
+    struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+    anyID* list = (anyID*)malloc((clientTotal + 1) * sizeof(anyID));
+    int count = 0;
+    int i;
+
+    pthread_mutex_lock(&serverLock);
+    if (list && server) {
+        for (i = 1; i <= clientTotal; i++) {
+            if (server->clientChannel[i]) {
+                list[count++] = (anyID)i;
+            }
+        }
+        list[count] = 0;
+        *result = list;
+    } else {
+        free(list);
+        error = ERROR_undefined;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(CALL_getClientList, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result)
+{
+    unsigned long long start = enterCall(CALL_getChannelOfClient);
+    struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+
+    pthread_mutex_lock(&serverLock);
+    if (server && clientID && server->clientChannel[clientID]) {
+        *result = server->clientChannel[clientID];
+    } else {
+        error = ERROR_client_invalid_id;
+    }
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(CALL_getChannelOfClient, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelVariableAsInt(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, int* result)
+{
+    unsigned long long start = enterCall(CALL_getChannelVariableAsInt);
+    unsigned int error = ERROR_ok;
+
+    if (validChannel(channelID)) {
+        /* Every 50th channel is permanent, every 97th has a password */
+        switch (flag) {
+        case CHANNEL_FLAG_PERMANENT:
+            *result = channelID % 50 == 0;
+            break;
+        case CHANNEL_FLAG_PASSWORD:
+            *result = channelID % 97 == 0;
+            break;
+        default:
+            *result = 0;
+            break;
+        }
+    } else {
+        error = ERROR_channel_invalid_id;
+    }
+    leaveCall(CALL_getChannelVariableAsInt, start);
+    return error;
+}
+
+static unsigned int sdkGetChannelVariableAsString(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, char** result)
+{
+    unsigned long long start = enterCall(CALL_getChannelVariableAsString);
+    unsigned int error = ERROR_ok;
+    char* value = (char*)malloc(64);
+
+    if (!validChannel(channelID) || !value) {
+        error = ERROR_channel_invalid_id;
+        free(value);
+    } else {
+        if (flag == CHANNEL_NAME) {
+            /* Every 40th channel is an AFK room */
+            snprintf(value, 64, channelID % 40 == 0 ? "AFK %llu" : "Channel %llu", (unsigned long long)channelID);
+        } else {
+            value[0] = '\0';
+        }
+        *result = value;
+    }
+    leaveCall(CALL_getChannelVariableAsString, start);
+    return error;
+}
+
+static unsigned int sdkGetClientVariableAsInt(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, int* result)
+{
+    unsigned long long start = enterCall(CALL_getClientVariableAsInt);
+    *result = 0;
+    leaveCall(CALL_getClientVariableAsInt, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkGetClientNeededPermission(uint64 serverConnectionHandlerID, const char* permissionName, int* result)
+{
+    unsigned long long start = enterCall(CALL_getClientNeededPermission);
+    *result = 100;
+    leaveCall(CALL_getClientNeededPermission, start);
+    return ERROR_ok;
+}
+
+static void sdkCreateReturnCode(const char* pluginID, char* returnCode, size_t maxLen)
+{
+    unsigned long long start = enterCall(CALL_createReturnCode);
+    snprintf(returnCode, maxLen, "PR:%s:%u", pluginID ? pluginID : "", __sync_add_and_fetch(&returnCodeCounter, 1));
+    leaveCall(CALL_createReturnCode, start);
+}
+
+static unsigned int sdkRequestClientMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = enterCall(CALL_requestClientMove);
+    struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+
+    __sync_bool_compare_and_swap(&firstMoveAt, 0, start);
+    if (!server) {
+        leaveCall(CALL_requestClientMove, start);
+        return ERROR_undefined;
+    }
+    pthread_mutex_lock(&serverLock);
+    if (!validChannel(newChannelID)) {
+        error = ERROR_channel_invalid_id;
+    } else if (!chargeFlood(server, 1)) {
+        error = ERROR_client_is_flooding;
+    } else if (!server->clientChannel[clientID]) {
+        error = ERROR_client_invalid_id;
+    } else if (protectedClient(clientID)) {
+        error = ERROR_permissions_client_insufficient;
+    } else if (server->clientChannel[clientID] != newChannelID) {
+        moveClient(serverConnectionHandlerID, clientID, newChannelID);
+    }
+    queueServerError(serverConnectionHandlerID, error, returnCode);
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(CALL_requestClientMove, start);
+    return ERROR_ok;
+}
+
+static unsigned int sdkRequestClientsMove(uint64 serverConnectionHandlerID, const anyID* clientIDArray, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = enterCall(CALL_requestClientsMove);
+    struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    unsigned int error = ERROR_ok;
+    int count;
+    int i;
+
+    for (count = 0; clientIDArray[count] != 0; count++) {
+    }
+
+    __sync_bool_compare_and_swap(&firstMoveAt, 0, start);
+    if (!server) {
+        leaveCall(CALL_requestClientsMove, start);
+        return ERROR_undefined;
+    }
+    pthread_mutex_lock(&serverLock);
+    if (!validChannel(newChannelID)) {
+        error = ERROR_channel_invalid_id;
+    } else if (!chargeFlood(server, count)) {
+        error = ERROR_client_is_flooding;
+    } else {
+        /* One client we may not move fails the whole request */
+        for (i = 0; clientIDArray[i] != 0; i++) {
+            if (protectedClient(clientIDArray[i])) {
+                error = ERROR_permissions_client_insufficient;
+            }
+        }
+        for (i = 0; error == ERROR_ok && clientIDArray[i] != 0; i++) {
+            if (server->clientChannel[clientIDArray[i]] && server->clientChannel[clientIDArray[i]] != newChannelID) {
+                moveClient(serverConnectionHandlerID, clientIDArray[i], newChannelID);
+            }
+        }
+    }
+    queueServerError(serverConnectionHandlerID, error, returnCode);
+    pthread_mutex_unlock(&serverLock);
+    leaveCall(CALL_requestClientsMove, start);
+    return ERROR_ok;
+}
+
+static void sdkGetConfigPath(char* path, size_t maxLen)
+{
+    unsigned long long start = enterCall(CALL_getConfigPath);
+    const char* dir = getenv("STANDIN_CONFIG_PATH");
+    snprintf(path, maxLen, "%s", dir ? dir : "./");
+    leaveCall(CALL_getConfigPath, start);
+}
+
+static void sdkPrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget)
+{
+    unsigned long long start = enterCall(CALL_printMessage);
+    __sync_fetch_and_add(&printedMessages, 1);
+    if (getenv("STANDIN_VERBOSE")) {
+        fprintf(stderr, "[tab] %s\n", message);
+    }
+    leaveCall(CALL_printMessage, start);
+}
+
+static void sdkPrintMessageToCurrentTab(const char* message)
+{
+    unsigned long long start = enterCall(CALL_printMessageToCurrentTab);
+    if (getenv("STANDIN_VERBOSE")) {
+        fprintf(stderr, "[tab] %s\n", message);
+    }
+    leaveCall(CALL_printMessageToCurrentTab, start);
+}
+
+static uint64 sdkGetCurrentServerConnectionHandlerID(void)
+{
+    unsigned long long start = enterCall(CALL_getCurrentServerConnectionHandlerID);
+    uint64 connection = __atomic_load_n(&currentConnection, __ATOMIC_RELAXED);
+    leaveCall(CALL_getCurrentServerConnectionHandlerID, start);
+    return connection;
+}
+
+struct TS3Functions standinFunctions(void)
+{
+    struct TS3Functions funcs;
+
+    memset(&funcs, 0, sizeof(funcs));
+    funcs.freeMemory = sdkFreeMemory;
+    funcs.logMessage = sdkLogMessage;
+    funcs.getClientID = sdkGetClientID;
+    funcs.getChannelList = sdkGetChannelList;
+    funcs.getParentChannelOfChannel = sdkGetParentChannelOfChannel;
+    funcs.getChannelClientList = sdkGetChannelClientList;
+    funcs.getClientList = sdkGetClientList;
+    funcs.getChannelOfClient = sdkGetChannelOfClient;
+    funcs.getChannelVariableAsInt = sdkGetChannelVariableAsInt;
+    funcs.getChannelVariableAsString = sdkGetChannelVariableAsString;
+    funcs.getClientVariableAsInt = sdkGetClientVariableAsInt;
+    funcs.getClientNeededPermission = sdkGetClientNeededPermission;
+    funcs.createReturnCode = sdkCreateReturnCode;
+    funcs.requestClientMove = sdkRequestClientMove;
+    funcs.requestClientsMove = sdkRequestClientsMove;
+    funcs.getConfigPath = sdkGetConfigPath;
+    funcs.printMessage = sdkPrintMessage;
+    funcs.printMessageToCurrentTab = sdkPrintMessageToCurrentTab;
+    funcs.getCurrentServerConnectionHandlerID = sdkGetCurrentServerConnectionHandlerID;
+    return funcs;
+}
+
+/*********************************** Synthetic server ************************************/
+
+/* Pick a parent for channel id in a realistic layout */
+static uint64 mixParent(uint64 id)
+{
+    unsigned int roll = nextRandom() % 100;
+    uint64 parent;
+
+    /* The first channels and a small share of the rest are top level categories */
+    if (id <= 4 || roll < 3) {
+        return 0;
+    }
+
+    /* Most channels hang below a recent channel, which builds squads and nested rooms */
+    if (roll < 70) {
+        parent = id - 1 - nextRandom() % (id - 1 < 16 ? id - 1 : 16);
+    } else {
+        parent = 1 + nextRandom() % (id - 1);
+    }
+
+    /* Keep nesting at a depth TeamSpeak servers actually use */
+    while (parent && standinDepthOf(parent) >= 7) {
+        parent = channelParent[parent];
+    }
+    return parent;
+}
+
+int standinCreate(const struct StandinConfig* cfg)
+{
+    int c;
+    int i;
+    int occupied;
+    uint64* occupiedChannels;
+
+    inStandin++;
+    config = *cfg;
+    if (config.clientCount > 65534) {
+        config.clientCount = 65534;
+    }
+    if (config.connections < 1) {
+        config.connections = 1;
+    }
+    rngState = config.seed ? config.seed : 1;
+    floodRejections = 0;
+    currentConnection = STANDIN_CONNECTION_ID;
+
+    channelParent = (uint64*)calloc(config.channelCount + 1, sizeof(uint64));
+    servers = (struct StandinServer*)calloc(config.connections, sizeof(struct StandinServer));
+    if (!channelParent || !servers) {
+        free(channelParent);
+        free(servers);
+        channelParent = NULL;
+        servers = NULL;
+        inStandin--;
+        return -1;
+    }
+
+    for (i = 1; i <= config.channelCount; i++) {
+        switch (config.shape) {
+        case SHAPE_CHAIN:
+            channelParent[i] = (uint64)(i - 1);
+            break;
+        case SHAPE_FAN:
+            channelParent[i] = i == 1 ? 0 : 1;
+            break;
+        default:
+            channelParent[i] = mixParent((uint64)i);
+            break;
+        }
+    }
+
+    /* Clients only sit in a share of the channels */
+    occupied = config.channelCount * config.occupiedPercent / 100;
+    if (occupied < 1) {
+        occupied = 1;
+    }
+    occupiedChannels = (uint64*)malloc(occupied * sizeof(uint64));
+    if (!occupiedChannels) {
+        inStandin--;
+        return -1;
+    }
+    for (i = 0; i < occupied; i++) {
+        occupiedChannels[i] = 1 + nextRandom() % config.channelCount;
+    }
+
+    clientTotal = config.clientCount + 1;
+    for (c = 0; c < config.connections; c++) {
+        servers[c].floodPoints = config.floodBudget;
+        servers[c].floodUpdatedAt = standinNow();
+        for (i = 1; i <= clientTotal; i++) {
+            servers[c].clientChannel[i] = occupiedChannels[nextRandom() % occupied];
+        }
+    }
+
+    free(occupiedChannels);
+    inStandin--;
+    return 0;
+}
+
+void standinDestroy(void)
+{
+    free(channelParent);
+    channelParent = NULL;
+    free(servers);
+    servers = NULL;
+    free(events);
+    events = NULL;
+    eventCount = 0;
+    eventCapacity = 0;
+}
+
+void standinConnect(void)
+{
+    uint64 connection;
+    int i;
+
+    for (connection = 1; connection <= (uint64)config.connections; connection++) {
+        const struct StandinServer* server = serverOf(connection);
+
+        ts3plugin_onConnectStatusChangeEvent(connection, STATUS_CONNECTING, ERROR_ok);
+        ts3plugin_onConnectStatusChangeEvent(connection, STATUS_CONNECTED, ERROR_ok);
+        ts3plugin_onConnectStatusChangeEvent(connection, STATUS_CONNECTION_ESTABLISHING, ERROR_ok);
+        for (i = 1; i <= config.channelCount; i++) {
+            ts3plugin_onNewChannelEvent(connection, (uint64)i, channelParent[i]);
+        }
+        for (i = 1; i <= clientTotal; i++) {
+            ts3plugin_onClientMoveEvent(connection, (anyID)i, 0, server->clientChannel[i], ENTER_VISIBILITY, "");
+        }
+        ts3plugin_onConnectStatusChangeEvent(connection, STATUS_CONNECTION_ESTABLISHED, ERROR_ok);
+    }
+}
+
+void standinSetCurrentConnection(uint64 serverConnectionHandlerID)
+{
+    __atomic_store_n(&currentConnection, serverConnectionHandlerID, __ATOMIC_RELAXED);
+    ts3plugin_currentServerConnectionChanged(serverConnectionHandlerID);
+}
+
+/* Raise the callback a queued event stands for */
+static void deliverEvent(const struct StandinEvent* event)
+{
+    switch (event->type) {
+    case EVENT_CLIENT_MOVED:
+        ts3plugin_onClientMoveMovedEvent(event->connection, event->clientID, event->oldChannelID, event->newChannelID,
+                                         RETAIN_VISIBILITY, STANDIN_SELF_ID, "standin", "standin=", "");
+        break;
+    case EVENT_SERVER_ERROR:
+        ts3plugin_onServerErrorEvent(event->connection, event->error == ERROR_ok ? "ok" : "error", event->error, event->returnCode, "");
+        break;
+    }
+}
+
+int standinPump(void)
+{
+    int delivered = 0;
+
+    /* Take the queue out under the lock and deliver without it; callbacks may queue further events */
+    while (1) {
+        struct StandinEvent* pending;
+        int pendingCount;
+        int i;
+
+        pthread_mutex_lock(&serverLock);
+        pending = events;
+        pendingCount = eventCount;
+        events = NULL;
+        eventCount = 0;
+        eventCapacity = 0;
+        pthread_mutex_unlock(&serverLock);
+
+        if (!pendingCount) {
+            free(pending);
+            break;
+        }
+        for (i = 0; i < pendingCount; i++) {
+            deliverEvent(&pending[i]);
+        }
+        delivered += pendingCount;
+        free(pending);
+    }
+    return delivered;
+}
+
+/* Top level ancestor of a channel */
+static uint64 familyRoot(uint64 channelID)
+{
+    while (channelID && channelParent[channelID]) {
+        channelID = channelParent[channelID];
+    }
+    return channelID;
+}
+
+void standinScatterClients(void)
+{
+    uint64 connection;
+    int i;
+
+    inStandin++;
+    pthread_mutex_lock(&serverLock);
+    for (connection = 1; connection <= (uint64)config.connections; connection++) {
+        const struct StandinServer* server = serverOf(connection);
+        for (i = 1; i <= clientTotal; i++) {
+            uint64 channelID = 1 + nextRandom() % config.channelCount;
+            if (server->clientChannel[i] && server->clientChannel[i] != channelID) {
+                moveClient(connection, (anyID)i, channelID);
+            }
+        }
+    }
+    pthread_mutex_unlock(&serverLock);
+    inStandin--;
+}
+
+int standinTrickleClients(uint64 serverConnectionHandlerID, uint64 channelID, int count)
+{
+    struct StandinServer* server;
+    uint64 root = familyRoot(channelID);
+    uint64* family;
+    int familyCount = 0;
+    int moved = 0;
+    int i;
+
+    inStandin++;
+    family = (uint64*)malloc(config.channelCount * sizeof(uint64));
+    pthread_mutex_lock(&serverLock);
+    server = serverOf(serverConnectionHandlerID);
+    if (family && server) {
+        for (i = 1; i <= config.channelCount; i++) {
+            if ((uint64)i != channelID && familyRoot((uint64)i) == root) {
+                family[familyCount++] = (uint64)i;
+            }
+        }
+        for (i = 1; i <= clientTotal && moved < count && familyCount > 0; i++) {
+            if (i != STANDIN_SELF_ID && server->clientChannel[i] && familyRoot(server->clientChannel[i]) != root) {
+                moveClient(serverConnectionHandlerID, (anyID)i, family[nextRandom() % familyCount]);
+                moved++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&serverLock);
+    free(family);
+    inStandin--;
+    return moved;
+}
+
+/*********************************** Phases and accessors ************************************/
+
+int standinBeginPhase(const char* name)
+{
+    int i;
+
+    for (i = 0; i < phaseCount; i++) {
+        if (strcmp(phases[i].name, name) == 0) {
+            __atomic_store_n(&currentPhase, i, __ATOMIC_RELAXED);
+            return i;
+        }
+    }
+    if (phaseCount >= STANDIN_MAX_PHASES) {
+        return currentPhase;
+    }
+
+    memset(&phases[phaseCount], 0, sizeof(phases[phaseCount]));
+    phases[phaseCount].name = name;
+    __atomic_store_n(&currentPhase, phaseCount++, __ATOMIC_RELAXED);
+    return currentPhase;
+}
+
+const struct StandinPhase* standinPhase(int phase)
+{
+    return phase >= 0 && phase < phaseCount ? &phases[phase] : NULL;
+}
+
+int standinPhaseCount(void)
+{
+    return phaseCount;
+}
+
+void standinResetPhases(void)
+{
+    phaseCount = 0;
+    __atomic_store_n(&currentPhase, -1, __ATOMIC_RELAXED);
+}
+
+unsigned long long standinPhaseCalls(int phase)
+{
+    unsigned long long total = 0;
+    int i;
+
+    for (i = 0; i < CALL_COUNT; i++) {
+        total += __atomic_load_n(&phases[phase].calls[i], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+unsigned long long standinPhaseNanos(int phase)
+{
+    unsigned long long total = 0;
+    int i;
+
+    for (i = 0; i < CALL_COUNT; i++) {
+        total += __atomic_load_n(&phases[phase].nanos[i], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+const char* standinCallName(enum StandinCall call)
+{
+    return callNames[call];
+}
+
+int standinChannelCount(void)
+{
+    return config.channelCount;
+}
+
+uint64 standinChannelAt(int index)
+{
+    return (uint64)(index + 1);
+}
+
+uint64 standinChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID)
+{
+    const struct StandinServer* server = serverOf(serverConnectionHandlerID);
+    uint64 channelID;
+
+    pthread_mutex_lock(&serverLock);
+    channelID = server ? server->clientChannel[clientID] : 0;
+    pthread_mutex_unlock(&serverLock);
+    return channelID;
+}
+
+/* Range of servers a count covers: one connection's, or every one for connection 0 */
+static int firstServer(uint64 serverConnectionHandlerID)
+{
+    return serverConnectionHandlerID ? (int)serverConnectionHandlerID - 1 : 0;
+}
+
+static int lastServer(uint64 serverConnectionHandlerID)
+{
+    return serverConnectionHandlerID ? (int)serverConnectionHandlerID : config.connections;
+}
+
+int standinClientsInChannel(uint64 serverConnectionHandlerID, uint64 channelID)
+{
+    int count = 0;
+    int c, i;
+
+    pthread_mutex_lock(&serverLock);
+    for (c = firstServer(serverConnectionHandlerID); c < lastServer(serverConnectionHandlerID); c++) {
+        for (i = 1; i <= clientTotal; i++) {
+            if (servers[c].clientChannel[i] == channelID) {
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&serverLock);
+    return count;
+}
+
+int standinFamilyClients(uint64 serverConnectionHandlerID, uint64 channelID)
+{
+    uint64 root = familyRoot(channelID);
+    int count = 0;
+    int c, i;
+
+    pthread_mutex_lock(&serverLock);
+    for (c = firstServer(serverConnectionHandlerID); c < lastServer(serverConnectionHandlerID); c++) {
+        for (i = 1; i <= clientTotal; i++) {
+            if (servers[c].clientChannel[i] && familyRoot(servers[c].clientChannel[i]) == root) {
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&serverLock);
+    return count;
+}
+
+/* The channel is the ancestor or below it */
+static int inSubtree(uint64 channelID, uint64 ancestorID)
+{
+    while (channelID && channelID != ancestorID) {
+        channelID = channelParent[channelID];
+    }
+    return channelID != 0;
+}
+
+int standinScopeClients(uint64 serverConnectionHandlerID, uint64 channelID, int levels)
+{
+    uint64 root = channelID;
+    int count = 0;
+    int c, i;
+
+    if (levels < 0) {
+        return standinFamilyClients(serverConnectionHandlerID, channelID);
+    }
+    for (i = 0; i < levels && channelParent[root]; i++) {
+        root = channelParent[root];
+    }
+
+    pthread_mutex_lock(&serverLock);
+    for (c = firstServer(serverConnectionHandlerID); c < lastServer(serverConnectionHandlerID); c++) {
+        for (i = 1; i <= clientTotal; i++) {
+            if (servers[c].clientChannel[i] && inSubtree(servers[c].clientChannel[i], root)) {
+                count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&serverLock);
+    return count;
+}
+
+int standinFloodRejections(void)
+{
+    return floodRejections;
+}
+
+int standinPrintedMessages(void)
+{
+    return __sync_fetch_and_add(&printedMessages, 0);
+}
+
+void standinResetFirstMove(void)
+{
+    __atomic_store_n(&firstMoveAt, 0, __ATOMIC_RELAXED);
+}
+
+unsigned long long standinFirstMoveAt(void)
+{
+    return __atomic_load_n(&firstMoveAt, __ATOMIC_RELAXED);
+}
+
+int standinDepthOf(uint64 channelID)
+{
+    int depth = 0;
+
+    while (channelID && channelParent[channelID]) {
+        channelID = channelParent[channelID];
+        depth++;
+    }
+    return depth;
+}
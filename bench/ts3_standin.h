@@ -0,0 +1,137 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - SDK Stand-in
+ *
+ * Fills a struct TS3Functions with functions that serve a synthetic server
+ * held in memory, so the plugin can be driven without a TeamSpeak client.
+ * Every SDK call is counted and timed per function and per phase. Events
+ * the real client would raise in response to requests (client moves) are
+ * queued and delivered to the plugin's callbacks by standinPump. The SDK
+ * functions may be called from any thread. Several server tabs can be
+ * connected at once, each to a server of its own.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef TS3_STANDIN_H
+#define TS3_STANDIN_H
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STANDIN_CONNECTION_ID 1   /* serverConnectionHandlerID of the first synthetic server; the others follow */
+#define STANDIN_SELF_ID 1         /* Our own client ID on the synthetic server */
+#define STANDIN_MAX_PHASES 8
+
+/* SDK functions the stand-in implements */
+enum StandinCall {
+    CALL_freeMemory = 0,
+    CALL_logMessage,
+    CALL_getClientID,
+    CALL_getChannelList,
+    CALL_getParentChannelOfChannel,
+    CALL_getChannelClientList,
+    CALL_getClientList,
+    CALL_getChannelOfClient,
+    CALL_getChannelVariableAsInt,
+    CALL_getChannelVariableAsString,
+    CALL_getClientVariableAsInt,
+    CALL_getClientNeededPermission,
+    CALL_createReturnCode,
+    CALL_requestClientMove,
+    CALL_requestClientsMove,
+    CALL_getConfigPath,
+    CALL_printMessage,
+    CALL_printMessageToCurrentTab,
+    CALL_getCurrentServerConnectionHandlerID,
+    CALL_COUNT
+};
+
+/* Shapes of synthetic channel trees */
+enum StandinShape {
+    SHAPE_CHAIN = 0,   /* One deep chain: every channel is the child of the previous one */
+    SHAPE_FAN,         /* One top level channel with every other channel directly below it */
+    SHAPE_MIX          /* Realistic mix: categories, squads and nested rooms of varying depth */
+};
+
+struct StandinConfig {
+    enum StandinShape shape;
+    int channelCount;          /* Channels on the server, up to 50000 and more */
+    int clientCount;           /* Clients besides ourselves, up to 65534 */
+    int occupiedPercent;       /* Share of channels that get clients at all */
+    unsigned int seed;         /* Seed for the deterministic layout */
+    int floodBudget;           /* Anti-flood points available, 0 disables flood protection */
+    int floodRefillPerSecond;  /* Points regained per second */
+    int protectedEvery;        /* Every Nth client needs more move power than we have, 0 = none */
+    int connections;           /* Server tabs, each connected to a server with this layout, 0 = one */
+};
+
+/* Counters of one phase */
+struct StandinPhase {
+    const char* name;
+    unsigned long long calls[CALL_COUNT];
+    unsigned long long nanos[CALL_COUNT];
+    unsigned long long allocations;     /* malloc/calloc/realloc calls while the phase was active */
+};
+
+/* Build the synthetic server; returns 0 on success */
+int  standinCreate(const struct StandinConfig* config);
+void standinDestroy(void);
+
+/* Function table to pass to ts3plugin_setFunctionPointers */
+struct TS3Functions standinFunctions(void);
+
+/* Announce all channels and clients to the plugin and report every connection as established */
+void standinConnect(void);
+
+/* Bring a tab to the front, as the user clicking it would */
+void standinSetCurrentConnection(uint64 serverConnectionHandlerID);
+
+/* Deliver all queued events to the plugin; returns the number delivered */
+int  standinPump(void);
+
+/* Put every client back to a random channel (with events), e.g. between benchmark rounds */
+void standinScatterClients(void);
+
+/* Move up to count clients from outside the channel's family into random channels of the family other than it (with events); returns the number moved */
+int  standinTrickleClients(uint64 serverConnectionHandlerID, uint64 channelID, int count);
+
+/* Start counting into a named phase; returns its index */
+int  standinBeginPhase(const char* name);
+const struct StandinPhase* standinPhase(int phase);
+int  standinPhaseCount(void);
+void standinResetPhases(void);
+
+/* Total SDK calls and nanoseconds spent in the stand-in during a phase */
+unsigned long long standinPhaseCalls(int phase);
+unsigned long long standinPhaseNanos(int phase);
+
+/* Name of an SDK function for reports */
+const char* standinCallName(enum StandinCall call);
+
+/* Accessors for the synthetic servers; client counts take a connection, or 0 to sum over every one */
+int    standinChannelCount(void);
+uint64 standinChannelAt(int index);
+uint64 standinChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID);
+int    standinClientsInChannel(uint64 serverConnectionHandlerID, uint64 channelID);
+int    standinFamilyClients(uint64 serverConnectionHandlerID, uint64 channelID);   /* Clients anywhere below the channel's top level ancestor */
+int    standinScopeClients(uint64 serverConnectionHandlerID, uint64 channelID, int levels); /* Clients below the ancestor levels up, levels < 0: the top level one */
+int    standinFloodRejections(void);
+int    standinPrintedMessages(void);          /* printMessage calls so far; the plugin prints one per finished job */
+int    standinDepthOf(uint64 channelID);
+
+/* Time of the first requestClientMove or requestClientsMove on any connection since the last reset, 0 if none */
+void   standinResetFirstMove(void);
+unsigned long long standinFirstMoveAt(void);
+
+/* Monotonic clock in nanoseconds */
+unsigned long long standinNow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,13 +7,64 @@ set -e
 
 echo "Building TeamSpeak 3 MassMover Plugin..."
 
+# Extra compiler flags, e.g. CFLAGS="-DMASSMOVER_METRICS" ./build.sh
+CFLAGS="${CFLAGS:-}"
+
+# Plugin sources
+SOURCES="src/massmover.c src/arena.c src/channel_tree.c src/client_index.c src/move_pipeline.c src/move_stats.c src/move_set.c src/plan_cache.c src/plan_format.c src/metrics.c src/sdk_trace.c src/undo_log.c src/control_socket.c src/log_sink.c src/channel_rules.c src/follow_mode.c src/move_planner.c src/platform.c"
+
+# Headless ServerQuery tool: the plugin's planner, exclusion rules and move pipeline, without the plugin
+QUERY_SOURCES="tools/massmover_query.c tools/serverquery.c src/arena.c src/channel_rules.c src/channel_tree.c src/client_index.c src/metrics.c src/move_pipeline.c src/move_planner.c src/move_set.c src/platform.c"
+
+# "./build.sh query" builds the headless ServerQuery tool instead of the plugin (Linux and macOS)
+if [ "$1" = "query" ]; then
+    mkdir -p bin/linux
+    echo "Building ServerQuery tool..."
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc -Itools $QUERY_SOURCES -lpthread -o bin/linux/massmover_query
+    echo "✓ ServerQuery tool build complete: bin/linux/massmover_query"
+    echo "  Run: MASSMOVER_QUERY_PASSWORD=... bin/linux/massmover_query --user serveradmin --target CHANNEL_ID"
+    exit 0
+fi
+
+# "./build.sh test" builds and runs the tests
+if [ "$1" = "test" ]; then
+    mkdir -p bin/linux
+    echo "Building tests..."
+    gcc -O0 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc src/channel_rules.c src/channel_tree.c src/arena.c \
+        tests/channel_rules_test.c -o bin/linux/channel_rules_test
+    bin/linux/channel_rules_test
+    exit 0
+fi
+
+# "./build.sh bench" builds the benchmarks against the SDK stand-in and the trace replay instead of the plugin
+if [ "$1" = "bench" ]; then
+    mkdir -p bin/linux
+    echo "Building benchmark..."
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc $SOURCES bench/ts3_standin.c bench/massmover_bench.c \
+        -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -lpthread -o bin/linux/massmover_bench
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc $SOURCES bench/ts3_standin.c bench/massmover_control.c \
+        -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -lpthread -o bin/linux/massmover_control
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc $SOURCES bench/massmover_replay.c -lpthread -o bin/linux/massmover_replay
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc -Itools bench/ts3_standin.c bench/serverquery_standin.c tools/serverquery.c \
+        -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc -lpthread -o bin/linux/serverquery_standin
+    gcc -O2 -g -Wall -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include -Isrc -Itools $QUERY_SOURCES -lpthread -o bin/linux/massmover_query
+    echo "✓ Benchmark build complete: bin/linux/massmover_bench, bin/linux/massmover_control, bin/linux/massmover_replay, bin/linux/serverquery_standin, bin/linux/massmover_query"
+    echo "  Run: bin/linux/massmover_bench --shape mix --channels 4000 --clients 500"
+    echo "       bin/linux/massmover_control --connections 4"
+    echo "       bin/linux/massmover_replay massmover_trace.bin"
+    echo "       bin/linux/serverquery_standin --port 10011 --latency-ms 20 & bin/linux/massmover_query --target 5 --verify"
+    exit 0
+fi
+
 # Create directories
 mkdir -p build/linux build/windows bin/linux bin/windows
 
 # Build for Linux
 echo "Building for Linux..."
-gcc -c -g -O0 -Wall -fPIC -std=gnu99 -Its3client-pluginsdk-26/include src/massmover.c -o build/linux/massmover.o
-gcc -shared -o bin/linux/massmover.so build/linux/massmover.o
+for src in $SOURCES; do
+    gcc -c -g -O0 -Wall -fPIC -std=gnu99 $CFLAGS -Its3client-pluginsdk-26/include $src -o build/linux/$(basename ${src%.c}).o
+done
+gcc -shared -o bin/linux/massmover.so $(for src in $SOURCES; do echo build/linux/$(basename ${src%.c}).o; done) -lpthread
 echo "✓ Linux build complete: bin/linux/massmover.so"
 
 
@@ -25,13 +76,17 @@ echo "✓ Plugin copied to Flatpak location"
 # Build for Windows (using MinGW cross-compiler if available)
 if command -v x86_64-w64-mingw32-gcc &> /dev/null; then
     echo "Building for Windows (MinGW cross-compiler)..."
-    x86_64-w64-mingw32-gcc -c -O2 -Wall -DWIN32 -Its3client-pluginsdk-26/include src/massmover.c -o build/windows/massmover.o
-    x86_64-w64-mingw32-gcc -shared -o bin/windows/massmover.dll build/windows/massmover.o
+    for src in $SOURCES; do
+        x86_64-w64-mingw32-gcc -c -O2 -Wall -DWIN32 $CFLAGS -Its3client-pluginsdk-26/include $src -o build/windows/$(basename ${src%.c}).o
+    done
+    x86_64-w64-mingw32-gcc -shared -o bin/windows/massmover.dll $(for src in $SOURCES; do echo build/windows/$(basename ${src%.c}).o; done)
     echo "✓ Windows build complete: bin/windows/massmover.dll"
 elif command -v i686-w64-mingw32-gcc &> /dev/null; then
     echo "Building for Windows (32-bit MinGW cross-compiler)..."
-    i686-w64-mingw32-gcc -c -O2 -Wall -DWIN32 -Its3client-pluginsdk-26/include src/massmover.c -o build/windows/massmover.o
-    i686-w64-mingw32-gcc -shared -o bin/windows/massmover.dll build/windows/massmover.o
+    for src in $SOURCES; do
+        i686-w64-mingw32-gcc -c -O2 -Wall -DWIN32 $CFLAGS -Its3client-pluginsdk-26/include $src -o build/windows/$(basename ${src%.c}).o
+    done
+    i686-w64-mingw32-gcc -shared -o bin/windows/massmover.dll $(for src in $SOURCES; do echo build/windows/$(basename ${src%.c}).o; done)
     echo "✓ Windows build complete: bin/windows/massmover.dll"
 else
     echo "⚠️  Windows cross-compiler not found. Install mingw-w64 to build for Windows:"
@@ -1,6 +1,9 @@
 @echo off
 echo Building TeamSpeak 3 MassMover Plugin for Windows...
 
+rem Plugin sources (without extension, relative to src)
+set SOURCES=massmover arena channel_tree client_index move_pipeline move_stats move_set plan_cache plan_format metrics sdk_trace undo_log control_socket log_sink channel_rules follow_mode move_planner platform
+
 rem Create directories
 if not exist "build\windows" mkdir "build\windows"
 if not exist "bin\windows" mkdir "bin\windows"
@@ -25,14 +28,18 @@ pause
 goto :end
 
 :mingw_build
-gcc -c -O2 -Wall -DWIN32 -Its3client-pluginsdk-26/include src/massmover.c -o build/windows/massmover.o
-if %ERRORLEVEL% neq 0 (
-    echo ERROR: Compilation failed
-    pause
-    goto :end
+for %%f in (%SOURCES%) do (
+    gcc -c -O2 -Wall -DWIN32 -Its3client-pluginsdk-26/include src/%%f.c -o build/windows/%%f.o
+    if errorlevel 1 (
+        echo ERROR: Compilation failed
+        pause
+        goto :end
+    )
 )
 
-gcc -shared -o bin/windows/massmover.dll build/windows/massmover.o
+set OBJECTS=
+for %%f in (%SOURCES%) do call set OBJECTS=%%OBJECTS%% build/windows/%%f.o
+gcc -shared -o bin/windows/massmover.dll %OBJECTS%
 if %ERRORLEVEL% neq 0 (
     echo ERROR: Linking failed
     pause
@@ -41,14 +48,18 @@ if %ERRORLEVEL% neq 0 (
 goto :success
 
 :msvc_build
-cl /c /O2 /DWIN32 /I"ts3client-pluginsdk-26/include" src/massmover.c /Fo"build/windows/massmover.obj"
-if %ERRORLEVEL% neq 0 (
-    echo ERROR: Compilation failed
-    pause
-    goto :end
+for %%f in (%SOURCES%) do (
+    cl /c /O2 /DWIN32 /I"ts3client-pluginsdk-26/include" src/%%f.c /Fo"build/windows/%%f.obj"
+    if errorlevel 1 (
+        echo ERROR: Compilation failed
+        pause
+        goto :end
+    )
 )
 
-link /DLL /OUT:"bin/windows/massmover.dll" build/windows/massmover.obj
+set OBJECTS=
+for %%f in (%SOURCES%) do call set OBJECTS=%%OBJECTS%% build/windows/%%f.obj
+link /DLL /OUT:"bin/windows/massmover.dll" %OBJECTS%
 if %ERRORLEVEL% neq 0 (
     echo ERROR: Linking failed
     pause
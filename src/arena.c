@@ -0,0 +1,141 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Arena
+ *
+ * Each block remembers where its newest allocation starts, which is all
+ * arenaGrow needs to tell whether it can extend in place.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;                /* Usable bytes after the header */
+    size_t used;                /* Bytes handed out */
+    size_t last;                /* Offset of the newest allocation */
+};
+
+/* Header size rounded up so block data is aligned like malloc's */
+#define BLOCK_HEADER ((sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define blockData(block) ((unsigned char*)(block) + BLOCK_HEADER)
+#define alignUp(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/* Put a new block of at least size bytes in front */
+static struct ArenaBlock* addBlock(struct Arena* arena, size_t size)
+{
+    struct ArenaBlock* block;
+
+    if (size < arena->blockSize) {
+        size = arena->blockSize;
+    }
+    block = (struct ArenaBlock*)malloc(BLOCK_HEADER + size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = arena->blocks;
+    block->size = size;
+    block->used = 0;
+    block->last = 0;
+    arena->blocks = block;
+    return block;
+}
+
+void arenaInit(struct Arena* arena, size_t blockSize)
+{
+    arena->blocks = NULL;
+    arena->blockSize = blockSize ? alignUp(blockSize) : ARENA_BLOCK_SIZE_DEFAULT;
+}
+
+void arenaFree(struct Arena* arena)
+{
+    while (arena->blocks) {
+        struct ArenaBlock* block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+}
+
+void arenaReset(struct Arena* arena)
+{
+    struct ArenaBlock* block = arena->blocks;
+    size_t total = 0;
+
+    if (!block) {
+        return;
+    }
+    if (block->next) {
+        for (; block; block = block->next) {
+            total += block->size;
+        }
+        arenaFree(arena);
+        if (!addBlock(arena, total)) {
+            return;
+        }
+        block = arena->blocks;
+    }
+    block->used = 0;
+    block->last = 0;
+}
+
+int arenaReserve(struct Arena* arena, size_t size)
+{
+    struct ArenaBlock* block = arena->blocks;
+
+    size = alignUp(size);
+    if (block && block->size - block->used >= size) {
+        return 0;
+    }
+
+    /* An empty block that is too small is replaced rather than kept around */
+    if (block && block->used == 0) {
+        arena->blocks = block->next;
+        free(block);
+    }
+    return addBlock(arena, size) ? 0 : -1;
+}
+
+void* arenaAlloc(struct Arena* arena, size_t size)
+{
+    struct ArenaBlock* block = arena->blocks;
+
+    size = alignUp(size ? size : 1);
+    if (!block || block->size - block->used < size) {
+        if (arenaReserve(arena, size) != 0) {
+            return NULL;
+        }
+        block = arena->blocks;
+    }
+    block->last = block->used;
+    block->used += size;
+    return blockData(block) + block->last;
+}
+
+void* arenaGrow(struct Arena* arena, void* memory, size_t oldSize, size_t newSize)
+{
+    struct ArenaBlock* block = arena->blocks;
+    void* grown;
+
+    if (!memory) {
+        return arenaAlloc(arena, newSize);
+    }
+    if (newSize <= oldSize) {
+        return memory;
+    }
+
+    /* The newest allocation simply takes more of its block */
+    if (block && (unsigned char*)memory == blockData(block) + block->last &&
+        block->size - block->last >= alignUp(newSize)) {
+        block->used = block->last + alignUp(newSize);
+        return memory;
+    }
+
+    grown = arenaAlloc(arena, newSize);
+    if (grown) {
+        memcpy(grown, memory, oldSize);
+    }
+    return grown;
+}
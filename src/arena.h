@@ -0,0 +1,58 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Arena
+ *
+ * Bump allocator for memory that lives exactly as long as one operation.
+ * Allocations are never freed one by one: the whole arena is reset when the
+ * operation ends and its memory is handed out again by the next one, so a
+ * warmed up arena serves a mass move without touching the heap. A growing
+ * allocation extends in place while it is the newest one and moves to a
+ * larger slot of the same arena otherwise.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_BLOCK_SIZE_DEFAULT 4096   /* Smallest block taken from the heap */
+
+struct ArenaBlock;
+
+struct Arena {
+    struct ArenaBlock* blocks;  /* Newest block first; allocations come from the first one */
+    size_t blockSize;           /* Size of blocks added when the current one is full */
+};
+
+/* Prepare an empty arena; no memory is taken until the first allocation */
+void  arenaInit(struct Arena* arena, size_t blockSize);
+
+/* Release every block */
+void  arenaFree(struct Arena* arena);
+
+/*
+ * Forget all allocations but keep the memory. An arena that needed several
+ * blocks is merged into a single one of their combined size, so the next
+ * operation of the same size fits into one block.
+ */
+void  arenaReset(struct Arena* arena);
+
+/* Make sure the next size bytes can be allocated without touching the heap; returns 0 on success */
+int   arenaReserve(struct Arena* arena, size_t size);
+
+/* size bytes aligned for any type, or NULL */
+void* arenaAlloc(struct Arena* arena, size_t size);
+
+/* Resize the arena's newest allocation in place or copy it to a new slot; returns the memory or NULL, leaving the old one intact */
+void* arenaGrow(struct Arena* arena, void* memory, size_t oldSize, size_t newSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
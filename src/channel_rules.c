@@ -0,0 +1,392 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Channel Rules
+ *
+ * Most exclusion patterns are a plain name, a prefix or a suffix, so
+ * compiling them once lets matching a channel name be a compare or a
+ * substring search; only patterns with a wildcard in the middle take the
+ * general matcher. Applying the rules walks the tree through its child and
+ * sibling links without a stack, keeping the depth as it goes.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel_rules.h"
+
+#define RULES_LINE_BUFSIZE 512
+
+enum PatternKind {
+    PATTERN_EXACT,          /* abc */
+    PATTERN_PREFIX,         /* abc* */
+    PATTERN_SUFFIX,         /* *abc */
+    PATTERN_CONTAINS,       /* *abc* */
+    PATTERN_GLOB            /* Anything else */
+};
+
+struct NamePattern {
+    enum PatternKind kind;
+    size_t offset;          /* Of the literal part (the whole pattern for PATTERN_GLOB) in patternText */
+    size_t length;
+};
+
+/* Copy at most size - 1 characters of source into buffer in lower case */
+static size_t lowerCopy(char* buffer, size_t size, const char* source)
+{
+    size_t length = 0;
+
+    while (source[length] && length + 1 < size) {
+        buffer[length] = (char)tolower((unsigned char)source[length]);
+        length++;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/* Match a whole name against a pattern with * and ?, both lowered */
+static int globMatch(const char* pattern, const char* name)
+{
+    const char* starPattern = NULL;
+    const char* starName = NULL;
+
+    while (*name) {
+        if (*pattern == '*') {
+            starPattern = ++pattern;
+            starName = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (starPattern) {
+            pattern = starPattern;
+            name = ++starName;
+        } else {
+            return 0;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+static int compareIDs(const void* a, const void* b)
+{
+    uint64 x = *(const uint64*)a;
+    uint64 y = *(const uint64*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Append one name pattern; returns 0 on success */
+static int addPattern(struct ChannelRules* rules, size_t* textSize, const char* value)
+{
+    char lowered[CHANNEL_RULES_NAME_BUFSIZE];
+    struct NamePattern pattern;
+    struct NamePattern* patterns;
+    const char* literal = lowered;
+    size_t length = lowerCopy(lowered, sizeof(lowered), value);
+    size_t inner;
+    char* text;
+
+    /* Runs of stars match the same as one */
+    for (inner = 0; inner + 1 < length; ) {
+        if (lowered[inner] == '*' && lowered[inner + 1] == '*') {
+            memmove(lowered + inner, lowered + inner + 1, length - inner);
+            length--;
+        } else {
+            inner++;
+        }
+    }
+
+    pattern.kind = PATTERN_EXACT;
+    pattern.length = length;
+    if (length > 0 && lowered[length - 1] == '*') {
+        pattern.kind = PATTERN_PREFIX;
+        pattern.length--;
+    }
+    if (pattern.length > 0 && lowered[0] == '*') {
+        pattern.kind = pattern.kind == PATTERN_PREFIX ? PATTERN_CONTAINS : PATTERN_SUFFIX;
+        literal++;
+        pattern.length--;
+    }
+    if (memchr(literal, '*', pattern.length) || memchr(literal, '?', pattern.length)) {
+        pattern.kind = PATTERN_GLOB;
+        literal = lowered;
+        pattern.length = length;
+    }
+
+    patterns = (struct NamePattern*)realloc(rules->patterns, (rules->patternCount + 1) * sizeof(struct NamePattern));
+    if (!patterns) {
+        return -1;
+    }
+    rules->patterns = patterns;
+    text = (char*)realloc(rules->patternText, *textSize + pattern.length + 1);
+    if (!text) {
+        return -1;
+    }
+    rules->patternText = text;
+    memcpy(text + *textSize, literal, pattern.length);
+    text[*textSize + pattern.length] = '\0';
+    pattern.offset = *textSize;
+    *textSize += pattern.length + 1;
+    patterns[rules->patternCount++] = pattern;
+    return 0;
+}
+
+/* Append a list of IDs separated by commas or blanks; returns 0 on success, 1 if the list was malformed */
+static int addIDs(struct ChannelRules* rules, const char* value)
+{
+    const char* cursor = value;
+
+    for (;;) {
+        uint64* ids;
+        char* end;
+        unsigned long long id;
+
+        while (*cursor == ',' || isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (!*cursor) {
+            return 0;
+        }
+        id = strtoull(cursor, &end, 10);
+        if (end == cursor || id == 0) {
+            return 1;
+        }
+        ids = (uint64*)realloc(rules->ids, (rules->idCount + 1) * sizeof(uint64));
+        if (!ids) {
+            return -1;
+        }
+        rules->ids = ids;
+        ids[rules->idCount++] = (uint64)id;
+        cursor = end;
+    }
+}
+
+int channelRulesLoad(struct ChannelRules* rules, const char* path)
+{
+    static const struct {
+        const char* key;
+        unsigned int trait;
+        unsigned int needs;
+    } traitKeys[] = {
+        { "password", CHANNEL_TRAIT_PASSWORD, CHANNEL_TRAIT_PASSWORD },
+        { "permanent", CHANNEL_TRAIT_PERMANENT, CHANNEL_TRAIT_PERMANENT },
+        { "semi_permanent", CHANNEL_TRAIT_SEMI_PERMANENT, CHANNEL_TRAIT_SEMI_PERMANENT },
+        { "temporary", CHANNEL_TRAIT_TEMPORARY, CHANNEL_TRAIT_PERMANENT | CHANNEL_TRAIT_SEMI_PERMANENT },
+        { "default", CHANNEL_TRAIT_DEFAULT, CHANNEL_TRAIT_DEFAULT }
+    };
+    char line[RULES_LINE_BUFSIZE];
+    size_t textSize = 0;
+    FILE* file;
+    int result = 0;
+
+    memset(rules, 0, sizeof(*rules));
+    file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    while (result == 0 && fgets(line, sizeof(line), file)) {
+        char key[32];
+        char value[RULES_LINE_BUFSIZE];
+        size_t length;
+        size_t i;
+        int handled = 0;
+
+        if (sscanf(line, " %31[a-z_] = %511[^\r\n]", key, value) != 2) {
+            const char* first = line + strspn(line, " \t\r\n");
+            if (*first && *first != '#' && *first != ';') {
+                rules->ignored++;
+            }
+            continue;
+        }
+        length = strlen(value);
+        while (length > 0 && isspace((unsigned char)value[length - 1])) {
+            value[--length] = '\0';
+        }
+
+        if (strcmp(key, "name") == 0) {
+            if (length > 0) {
+                result = addPattern(rules, &textSize, value);
+                rules->needs |= CHANNEL_TRAIT_NAME;
+                rules->traits |= CHANNEL_TRAIT_NAME;
+                handled = 1;
+            }
+        } else if (strcmp(key, "id") == 0) {
+            int status = addIDs(rules, value);
+            result = status < 0 ? status : 0;
+            handled = status == 0;
+        } else if (strcmp(key, "max_depth") == 0) {
+            int depth;
+            if (sscanf(value, "%d", &depth) == 1 && depth >= 0) {
+                rules->maxDepth = depth;
+                handled = 1;
+            }
+        } else {
+            for (i = 0; i < sizeof(traitKeys) / sizeof(traitKeys[0]); i++) {
+                int enabled;
+                if (strcmp(key, traitKeys[i].key) != 0 || sscanf(value, "%d", &enabled) != 1) {
+                    continue;
+                }
+                if (enabled) {
+                    rules->traits |= traitKeys[i].trait;
+                    rules->needs |= traitKeys[i].needs;
+                } else {
+                    rules->traits &= ~traitKeys[i].trait;
+                }
+                handled = 1;
+                break;
+            }
+        }
+        if (!handled) {
+            rules->ignored++;
+        }
+    }
+    fclose(file);
+
+    if (result != 0) {
+        channelRulesFree(rules);
+        return result;
+    }
+    if (rules->idCount > 1) {
+        qsort(rules->ids, rules->idCount, sizeof(uint64), compareIDs);
+    }
+    return 0;
+}
+
+void channelRulesFree(struct ChannelRules* rules)
+{
+    free(rules->patterns);
+    free(rules->patternText);
+    free(rules->ids);
+    memset(rules, 0, sizeof(*rules));
+}
+
+int channelRulesActive(const struct ChannelRules* rules)
+{
+    return rules->traits != 0 || rules->idCount > 0 || rules->maxDepth > 0;
+}
+
+/* Whether a channel name matches any name pattern */
+static int matchName(const struct ChannelRules* rules, const char* name)
+{
+    char lowered[CHANNEL_RULES_NAME_BUFSIZE];
+    size_t length = lowerCopy(lowered, sizeof(lowered), name);
+    int i;
+
+    for (i = 0; i < rules->patternCount; i++) {
+        const struct NamePattern* pattern = &rules->patterns[i];
+        const char* literal = rules->patternText + pattern->offset;
+        int matched;
+
+        switch (pattern->kind) {
+        case PATTERN_EXACT:
+            matched = length == pattern->length && memcmp(lowered, literal, length) == 0;
+            break;
+        case PATTERN_PREFIX:
+            matched = length >= pattern->length && memcmp(lowered, literal, pattern->length) == 0;
+            break;
+        case PATTERN_SUFFIX:
+            matched = length >= pattern->length && memcmp(lowered + length - pattern->length, literal, pattern->length) == 0;
+            break;
+        case PATTERN_CONTAINS:
+            matched = strstr(lowered, literal) != NULL;
+            break;
+        default:
+            matched = globMatch(literal, lowered);
+            break;
+        }
+        if (matched) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+unsigned int channelRulesTraits(const struct ChannelRules* rules, const char* name, int password, int permanent,
+                                int semiPermanent, int isDefault)
+{
+    unsigned int traits = 0;
+
+    if (name && rules->patternCount > 0 && matchName(rules, name)) {
+        traits |= CHANNEL_TRAIT_NAME;
+    }
+    if (password) {
+        traits |= CHANNEL_TRAIT_PASSWORD;
+    }
+    if (permanent) {
+        traits |= CHANNEL_TRAIT_PERMANENT;
+    }
+    if (semiPermanent) {
+        traits |= CHANNEL_TRAIT_SEMI_PERMANENT;
+    }
+    if (!permanent && !semiPermanent) {
+        traits |= CHANNEL_TRAIT_TEMPORARY;
+    }
+    if (isDefault) {
+        traits |= CHANNEL_TRAIT_DEFAULT;
+    }
+    return traits;
+}
+
+unsigned int channelRulesKnown(unsigned int needs)
+{
+    const unsigned int permanence = CHANNEL_TRAIT_PERMANENT | CHANNEL_TRAIT_SEMI_PERMANENT;
+
+    return (needs & permanence) == permanence ? needs | CHANNEL_TRAIT_TEMPORARY : needs;
+}
+
+int channelRulesExcludes(const struct ChannelRules* rules, uint64 channelID, unsigned int traits, int depth)
+{
+    if (traits & rules->traits) {
+        return 1;
+    }
+    if (rules->maxDepth > 0 && depth > rules->maxDepth) {
+        return 1;
+    }
+    return rules->idCount > 0 && bsearch(&channelID, rules->ids, rules->idCount, sizeof(uint64), compareIDs) != NULL;
+}
+
+int channelRulesApply(const struct ChannelRules* rules, struct ChannelTree* tree)
+{
+    int excluded = 0;
+    int visited = 0;
+    int i;
+
+    for (i = 0; i < tree->count; i++) {
+        tree->nodes[i].excluded = 0;
+    }
+
+    for (i = 0; i < tree->count && visited < tree->count; i++) {
+        int current = i;
+        int depth = 1;
+
+        if (tree->nodes[i].parent >= 0) {
+            continue;
+        }
+
+        /* Preorder: down to the first child, else across to the next sibling of the nearest ancestor that has one */
+        while (current >= 0 && visited < tree->count) {
+            struct ChannelNode* node = &tree->nodes[current];
+
+            if (channelRulesExcludes(rules, node->id, node->traits, depth)) {
+                node->excluded = 1;
+                excluded++;
+            }
+            visited++;
+
+            if (node->firstChild >= 0) {
+                current = node->firstChild;
+                depth++;
+                continue;
+            }
+            while (current != i && tree->nodes[current].nextSibling < 0) {
+                current = tree->nodes[current].parent;
+                depth--;
+            }
+            current = current == i ? -1 : tree->nodes[current].nextSibling;
+        }
+    }
+    return excluded;
+}
@@ -0,0 +1,89 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Channel Rules
+ *
+ * Exclusion rules for channels whose occupants a mass move must leave
+ * alone: AFK rooms, music bots, recordings, locked channels. They are read
+ * once from massmover_exclude.ini in the config path, one rule per line:
+ *
+ *   name = AFK*              name pattern, * and ? wildcards, any case
+ *   id = 12, 40, 41          channel IDs
+ *   password = 1             channels with a password
+ *   permanent = 1            permanent channels (also semi_permanent,
+ *   temporary = 1            temporary and default)
+ *   max_depth = 3            channels more than three levels deep
+ *
+ * A channel matching any rule is excluded together with its subchannels,
+ * except when a mass move goes into it or below it: the target's own
+ * subtree is still walked, with the rules applied below the target.
+ * Loading compiles the rules into a matcher: name patterns are lowered and
+ * sorted into exact, prefix, suffix, substring and general patterns, and
+ * IDs into a sorted list. The properties the rules look at are read from
+ * the server once per channel and cached in the channel tree as traits,
+ * so applying the rules to a tree makes no SDK call.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef CHANNEL_RULES_H
+#define CHANNEL_RULES_H
+
+#include "teamspeak/public_definitions.h"
+#include "channel_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHANNEL_RULES_FILENAME "massmover_exclude.ini"
+#define CHANNEL_RULES_NAME_BUFSIZE 256  /* Longer channel names are matched on their start */
+
+/* Channel properties cached in ChannelNode.traits */
+enum ChannelTrait {
+    CHANNEL_TRAIT_NAME = 1 << 0,            /* Name matches a pattern */
+    CHANNEL_TRAIT_PASSWORD = 1 << 1,
+    CHANNEL_TRAIT_PERMANENT = 1 << 2,
+    CHANNEL_TRAIT_SEMI_PERMANENT = 1 << 3,
+    CHANNEL_TRAIT_TEMPORARY = 1 << 4,       /* Neither permanent nor semi-permanent */
+    CHANNEL_TRAIT_DEFAULT = 1 << 5
+};
+
+struct NamePattern;
+
+struct ChannelRules {
+    struct NamePattern* patterns;
+    int patternCount;
+    char* patternText;                  /* Lowered pattern text, zero terminated one after another */
+    uint64* ids;                        /* Ascending */
+    int idCount;
+    unsigned int traits;                /* Channels with any of these traits are excluded */
+    unsigned int needs;                 /* Traits that have to be read from the server */
+    int maxDepth;                       /* Top level channels are at depth 1; 0 = any depth */
+    int ignored;                        /* Lines that were not understood */
+};
+
+/* Read and compile the rules in path; a missing file means no rules. Returns 0 on success */
+int  channelRulesLoad(struct ChannelRules* rules, const char* path);
+
+void channelRulesFree(struct ChannelRules* rules);
+
+/* Whether there is any rule at all */
+int  channelRulesActive(const struct ChannelRules* rules);
+
+/* Traits of a channel from what was read for it; name may be NULL if rules->needs lacks CHANNEL_TRAIT_NAME */
+unsigned int channelRulesTraits(const struct ChannelRules* rules, const char* name, int password, int permanent,
+                                int semiPermanent, int isDefault);
+
+/* Traits that can be told from the properties in needs: those read, and temporary once both permanence flags are */
+unsigned int channelRulesKnown(unsigned int needs);
+
+/* Whether a channel at this depth (1 = top level) with these traits is excluded on its own */
+int  channelRulesExcludes(const struct ChannelRules* rules, uint64 channelID, unsigned int traits, int depth);
+
+/* Set the excluded flag of every channel of a linked tree from its traits and depth; returns the number excluded */
+int  channelRulesApply(const struct ChannelRules* rules, struct ChannelTree* tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
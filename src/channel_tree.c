@@ -0,0 +1,444 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Channel Tree
+ *
+ * Nodes live in one array, the channel ID lookup is a linear probing hash
+ * table and children are kept as singly linked sibling lists. Walks are
+ * iterative and use a per-node epoch mark as visited set, so no per-walk
+ * allocation or clearing is needed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel_tree.h"
+
+/* Mix the channel ID so sequential IDs spread over the table */
+static unsigned int hashChannelID(uint64 channelID)
+{
+    channelID ^= channelID >> 33;
+    channelID *= 0xff51afd7ed558ccdULL;
+    channelID ^= channelID >> 33;
+    return (unsigned int)channelID;
+}
+
+/* Rebuild the lookup table with room for at least minSlots entries */
+static int rehash(struct ChannelTree* tree, int minSlots)
+{
+    int size = 16;
+    int* slots;
+    int i;
+
+    while (size < minSlots * 2) {
+        size *= 2;
+    }
+
+    slots = (int*)malloc(size * sizeof(int));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0xff, size * sizeof(int));
+
+    free(tree->slots);
+    tree->slots = slots;
+    tree->slotMask = size - 1;
+
+    for (i = 0; i < tree->count; i++) {
+        unsigned int slot = hashChannelID(tree->nodes[i].id) & tree->slotMask;
+        while (tree->slots[slot] != -1) {
+            slot = (slot + 1) & tree->slotMask;
+        }
+        tree->slots[slot] = i;
+    }
+    return 0;
+}
+
+/* Grow node storage and walk scratch space to hold at least minNodes */
+static int reserveNodes(struct ChannelTree* tree, int minNodes)
+{
+    struct ChannelNode* nodes;
+    int* stack;
+    int capacity = tree->capacity ? tree->capacity : 16;
+
+    if (minNodes <= tree->capacity) {
+        return 0;
+    }
+    while (capacity < minNodes) {
+        capacity *= 2;
+    }
+
+    nodes = (struct ChannelNode*)realloc(tree->nodes, capacity * sizeof(struct ChannelNode));
+    if (!nodes) {
+        return -1;
+    }
+    tree->nodes = nodes;
+
+    stack = (int*)realloc(tree->walkStack, capacity * sizeof(int));
+    if (!stack) {
+        return -1;
+    }
+    tree->walkStack = stack;
+    tree->capacity = capacity;
+
+    return rehash(tree, capacity);
+}
+
+int channelTreeInit(struct ChannelTree* tree, int expectedChannels)
+{
+    memset(tree, 0, sizeof(*tree));
+    return reserveNodes(tree, expectedChannels > 0 ? expectedChannels : 1);
+}
+
+void channelTreeFree(struct ChannelTree* tree)
+{
+    free(tree->nodes);
+    free(tree->slots);
+    free(tree->walkStack);
+    memset(tree, 0, sizeof(*tree));
+}
+
+int channelTreeFind(const struct ChannelTree* tree, uint64 channelID)
+{
+    unsigned int slot;
+
+    if (!tree->slots) {
+        return -1;
+    }
+
+    slot = hashChannelID(channelID) & tree->slotMask;
+    while (tree->slots[slot] != -1) {
+        if (tree->nodes[tree->slots[slot]].id == channelID) {
+            return tree->slots[slot];
+        }
+        slot = (slot + 1) & tree->slotMask;
+    }
+    return -1;
+}
+
+int channelTreeAdd(struct ChannelTree* tree, uint64 channelID, uint64 parentID)
+{
+    struct ChannelNode* node;
+    unsigned int slot;
+    int index;
+
+    if (channelID == 0) {
+        return -1;
+    }
+
+    /* Known channel: just refresh its parent */
+    index = channelTreeFind(tree, channelID);
+    if (index != -1) {
+        tree->nodes[index].parentID = parentID;
+        return index;
+    }
+
+    if (reserveNodes(tree, tree->count + 1) != 0) {
+        return -1;
+    }
+
+    index = tree->count++;
+    node = &tree->nodes[index];
+    node->id = channelID;
+    node->parentID = parentID;
+    node->parent = -1;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    node->firstClient = 0;
+    node->visitMark = 0;
+    node->traits = 0;
+    node->excluded = 0;
+
+    slot = hashChannelID(channelID) & tree->slotMask;
+    while (tree->slots[slot] != -1) {
+        slot = (slot + 1) & tree->slotMask;
+    }
+    tree->slots[slot] = index;
+
+    return index;
+}
+
+void channelTreeLink(struct ChannelTree* tree)
+{
+    int i;
+
+    for (i = 0; i < tree->count; i++) {
+        tree->nodes[i].parent = -1;
+        tree->nodes[i].firstChild = -1;
+        tree->nodes[i].nextSibling = -1;
+    }
+
+    /* Insert in reverse so each child list keeps the server's channel order */
+    for (i = tree->count - 1; i >= 0; i--) {
+        struct ChannelNode* node = &tree->nodes[i];
+        int parent;
+
+        if (node->parentID == 0) {
+            continue;
+        }
+        parent = channelTreeFind(tree, node->parentID);
+        if (parent == -1 || parent == i) {
+            continue;
+        }
+
+        node->parent = parent;
+        node->nextSibling = tree->nodes[parent].firstChild;
+        tree->nodes[parent].firstChild = i;
+    }
+}
+
+/* Remove a node from its parent's child list */
+static void unlinkNode(struct ChannelTree* tree, int index)
+{
+    int parent = tree->nodes[index].parent;
+    int* link;
+
+    if (parent == -1) {
+        return;
+    }
+
+    for (link = &tree->nodes[parent].firstChild; *link != -1; link = &tree->nodes[*link].nextSibling) {
+        if (*link == index) {
+            *link = tree->nodes[index].nextSibling;
+            break;
+        }
+    }
+    tree->nodes[index].parent = -1;
+    tree->nodes[index].nextSibling = -1;
+}
+
+/* Put a node at the front of its parent's child list, if the parent is known */
+static void linkNode(struct ChannelTree* tree, int index)
+{
+    int parent;
+
+    if (tree->nodes[index].parentID == 0) {
+        return;
+    }
+    parent = channelTreeFind(tree, tree->nodes[index].parentID);
+    if (parent == -1 || parent == index) {
+        return;
+    }
+
+    tree->nodes[index].parent = parent;
+    tree->nodes[index].nextSibling = tree->nodes[parent].firstChild;
+    tree->nodes[parent].firstChild = index;
+}
+
+/* Drop the lookup slot of a channel, shifting later probes back so lookups stay valid */
+static void removeSlot(struct ChannelTree* tree, uint64 channelID)
+{
+    unsigned int hole = hashChannelID(channelID) & tree->slotMask;
+    unsigned int next;
+
+    while (tree->slots[hole] != -1 && tree->nodes[tree->slots[hole]].id != channelID) {
+        hole = (hole + 1) & tree->slotMask;
+    }
+    if (tree->slots[hole] == -1) {
+        return;
+    }
+
+    next = hole;
+    while (1) {
+        unsigned int home;
+
+        next = (next + 1) & tree->slotMask;
+        if (tree->slots[next] == -1) {
+            break;
+        }
+
+        /* Move the entry back unless its home slot lies cyclically in (hole, next] */
+        home = hashChannelID(tree->nodes[tree->slots[next]].id) & tree->slotMask;
+        if (hole <= next ? (home <= hole || home > next) : (home <= hole && home > next)) {
+            tree->slots[hole] = tree->slots[next];
+            hole = next;
+        }
+    }
+    tree->slots[hole] = -1;
+}
+
+/* Delete a childless node, moving the last node into its place */
+static void removeLeaf(struct ChannelTree* tree, int index)
+{
+    int last = tree->count - 1;
+
+    unlinkNode(tree, index);
+    removeSlot(tree, tree->nodes[index].id);
+
+    if (index != last) {
+        struct ChannelNode* moved = &tree->nodes[last];
+        int* link;
+        int child;
+        unsigned int slot;
+
+        /* Redirect whatever pointed at the last node */
+        if (moved->parent != -1) {
+            for (link = &tree->nodes[moved->parent].firstChild; *link != -1; link = &tree->nodes[*link].nextSibling) {
+                if (*link == last) {
+                    *link = index;
+                    break;
+                }
+            }
+        }
+        for (child = moved->firstChild; child != -1; child = tree->nodes[child].nextSibling) {
+            tree->nodes[child].parent = index;
+        }
+        slot = hashChannelID(moved->id) & tree->slotMask;
+        while (tree->slots[slot] != last) {
+            slot = (slot + 1) & tree->slotMask;
+        }
+        tree->slots[slot] = index;
+
+        tree->nodes[index] = *moved;
+    }
+    tree->count--;
+}
+
+int channelTreeInsert(struct ChannelTree* tree, uint64 channelID, uint64 parentID)
+{
+    int index = channelTreeFind(tree, channelID);
+
+    if (index != -1) {
+        return channelTreeMove(tree, channelID, parentID);
+    }
+
+    /* The server announces parents before their children; stragglers are fixed by the next channelTreeLink */
+    index = channelTreeAdd(tree, channelID, parentID);
+    if (index == -1) {
+        return -1;
+    }
+    linkNode(tree, index);
+    return 0;
+}
+
+/* Depth-first walk behind channelTreeCollectSubtree; prune skips excluded subtrees */
+static int collectSubtree(struct ChannelTree* tree, int root, uint64* out, int* outCount, int max, int prune)
+{
+    int* stack = tree->walkStack;
+    int depth = 0;
+    int added = 0;
+
+    /* Nodes are marked when pushed, so each one is expanded at most once per walk */
+    if (!channelTreeMarkVisited(tree, root)) {
+        return 0;
+    }
+    stack[depth++] = root;
+
+    while (depth > 0 && *outCount < max) {
+        int node = stack[--depth];
+        int child;
+
+        out[(*outCount)++] = tree->nodes[node].id;
+        added++;
+
+        for (child = tree->nodes[node].firstChild; child != -1; child = tree->nodes[child].nextSibling) {
+            if (prune && tree->nodes[child].excluded) {
+                tree->walkPruned++;
+            } else if (channelTreeMarkVisited(tree, child)) {
+                stack[depth++] = child;
+            }
+        }
+    }
+
+    return added;
+}
+
+int channelTreeRemove(struct ChannelTree* tree, uint64 channelID)
+{
+    uint64* subtree;
+    int count = 0;
+    int index = channelTreeFind(tree, channelID);
+
+    if (index == -1) {
+        return -1;
+    }
+
+    subtree = (uint64*)malloc(tree->count * sizeof(uint64));
+    if (!subtree) {
+        return -1;
+    }
+
+    /* Excluded channels go with their parent like any other */
+    channelTreeBeginWalk(tree);
+    collectSubtree(tree, index, subtree, &count, tree->count, 0);
+
+    /* Pre-order listing reversed removes every child before its parent */
+    while (count > 0) {
+        int node = channelTreeFind(tree, subtree[--count]);
+        if (node != -1) {
+            removeLeaf(tree, node);
+        }
+    }
+
+    free(subtree);
+    return 0;
+}
+
+int channelTreeMove(struct ChannelTree* tree, uint64 channelID, uint64 newParentID)
+{
+    int index = channelTreeFind(tree, channelID);
+    int ancestor;
+    int steps = 0;
+
+    if (index == -1) {
+        return -1;
+    }
+
+    /* Refuse moves that would put a channel below itself */
+    for (ancestor = channelTreeFind(tree, newParentID); ancestor != -1 && steps <= tree->count; ancestor = tree->nodes[ancestor].parent, steps++) {
+        if (ancestor == index) {
+            return -1;
+        }
+    }
+
+    unlinkNode(tree, index);
+    tree->nodes[index].parentID = newParentID;
+    linkNode(tree, index);
+    return 0;
+}
+
+int channelTreeFamilyRoot(const struct ChannelTree* tree, int node)
+{
+    return channelTreeAncestor(tree, node, -1);
+}
+
+int channelTreeAncestor(const struct ChannelTree* tree, int node, int levels)
+{
+    int steps = 0;
+
+    /* The step bound keeps a corrupt parent cycle from spinning forever */
+    while (tree->nodes[node].parent != -1 && steps < tree->count && (levels < 0 || steps < levels)) {
+        node = tree->nodes[node].parent;
+        steps++;
+    }
+    return node;
+}
+
+void channelTreeBeginWalk(struct ChannelTree* tree)
+{
+    tree->walkEpoch++;
+    tree->walkRevisits = 0;
+    tree->walkPruned = 0;
+
+    /* On wrap-around reset all marks so stale epochs can't collide */
+    if (tree->walkEpoch == 0) {
+        int i;
+        for (i = 0; i < tree->count; i++) {
+            tree->nodes[i].visitMark = 0;
+        }
+        tree->walkEpoch = 1;
+    }
+}
+
+int channelTreeMarkVisited(struct ChannelTree* tree, int node)
+{
+    if (tree->nodes[node].visitMark == tree->walkEpoch) {
+        tree->walkRevisits++;
+        return 0;
+    }
+    tree->nodes[node].visitMark = tree->walkEpoch;
+    return 1;
+}
+
+int channelTreeCollectSubtree(struct ChannelTree* tree, int root, uint64* out, int* outCount, int max)
+{
+    return collectSubtree(tree, root, out, outCount, max, 1);
+}
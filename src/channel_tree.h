@@ -0,0 +1,93 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Channel Tree
+ *
+ * Compact parent/child adjacency of a server's channel tree. The tree is
+ * filled from (channel, parent) pairs and does not talk to the SDK itself,
+ * so one snapshot can answer every family query of a mass move.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef CHANNEL_TREE_H
+#define CHANNEL_TREE_H
+
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One channel of the tree; links are node indices, -1 meaning none */
+struct ChannelNode {
+    uint64 id;                /* Channel ID */
+    uint64 parentID;          /* Parent channel ID as reported by the server (0 = top level) */
+    int parent;               /* Index of the parent node, -1 for top level channels */
+    int firstChild;           /* Index of the first child node */
+    int nextSibling;          /* Index of the next node sharing our parent */
+    anyID firstClient;        /* First client in this channel (see client_index.h), 0 = empty */
+    unsigned int visitMark;   /* Walk epoch this node was last visited in */
+    unsigned char traits;     /* Channel properties cached by the owner (see channel_rules.h), 0 when added */
+    unsigned char excluded;   /* Walks neither list nor descend into this channel unless they start at it */
+};
+
+struct ChannelTree {
+    struct ChannelNode* nodes;  /* Node storage */
+    int count;                  /* Number of nodes in use */
+    int capacity;               /* Allocated nodes */
+    int* slots;                 /* Open addressing table: channel ID -> node index, -1 = empty */
+    int slotMask;               /* Table size - 1 (table size is a power of two) */
+    int* walkStack;             /* Scratch stack for iterative walks, capacity entries */
+    unsigned int walkEpoch;     /* Current visit epoch, bumped once per walk */
+    unsigned int walkRevisits;  /* Already visited nodes reached again in the current walk */
+    unsigned int walkPruned;    /* Excluded nodes the current walk did not descend into */
+};
+
+/* Prepare an empty tree sized for expectedChannels; returns 0 on success */
+int  channelTreeInit(struct ChannelTree* tree, int expectedChannels);
+
+/* Release all memory held by the tree */
+void channelTreeFree(struct ChannelTree* tree);
+
+/* Add a channel; parent links are resolved by channelTreeLink. Returns the node index or -1 */
+int  channelTreeAdd(struct ChannelTree* tree, uint64 channelID, uint64 parentID);
+
+/* Resolve parent indices and build the child lists after all channels were added */
+void channelTreeLink(struct ChannelTree* tree);
+
+/*
+ * Incremental updates for an already linked tree, driven by channel events.
+ * Insert links the channel below its parent right away when the parent is
+ * known; Remove drops the channel together with its whole subtree; Move
+ * relinks the channel below a new parent. All return 0 on success.
+ */
+int  channelTreeInsert(struct ChannelTree* tree, uint64 channelID, uint64 parentID);
+int  channelTreeRemove(struct ChannelTree* tree, uint64 channelID);
+int  channelTreeMove(struct ChannelTree* tree, uint64 channelID, uint64 newParentID);
+
+/* Node index of a channel, or -1 if it is unknown */
+int  channelTreeFind(const struct ChannelTree* tree, uint64 channelID);
+
+/* Climb from a node to its top level ancestor and return that ancestor's index */
+int  channelTreeFamilyRoot(const struct ChannelTree* tree, int node);
+
+/* Climb at most levels parents up from a node (levels < 0: to the top) and return the index reached */
+int  channelTreeAncestor(const struct ChannelTree* tree, int node, int levels);
+
+/*
+ * Iteratively walk the subtree rooted at root and append every channel not
+ * yet visited in the current walk to out (up to max). Start a walk with
+ * channelTreeBeginWalk; marked channels are neither listed nor descended
+ * into, so a channel is never listed twice. Excluded channels below root are
+ * skipped the same way, with their whole subtree. channelTreeMarkVisited
+ * returns 1 if the node was newly marked. channelTreeCollectSubtree returns
+ * the number of channels appended.
+ */
+void channelTreeBeginWalk(struct ChannelTree* tree);
+int  channelTreeMarkVisited(struct ChannelTree* tree, int node);
+int  channelTreeCollectSubtree(struct ChannelTree* tree, int root, uint64* out, int* outCount, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
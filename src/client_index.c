@@ -0,0 +1,123 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Client Location Index
+ *
+ * The per-client arrays cover the whole anyID space, so lookups never hash
+ * and updates are a handful of stores. A client whose channel is not in the
+ * tree keeps its location but is not chained until the next relink.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "client_index.h"
+
+int clientIndexInit(struct ClientIndex* index)
+{
+    index->channelOf = (uint64*)calloc(CLIENT_INDEX_SIZE, sizeof(uint64));
+    index->next = (anyID*)calloc(CLIENT_INDEX_SIZE, sizeof(anyID));
+    index->prev = (anyID*)calloc(CLIENT_INDEX_SIZE, sizeof(anyID));
+    index->clientCount = 0;
+
+    if (!index->channelOf || !index->next || !index->prev) {
+        clientIndexFree(index);
+        return -1;
+    }
+    return 0;
+}
+
+void clientIndexFree(struct ClientIndex* index)
+{
+    free(index->channelOf);
+    free(index->next);
+    free(index->prev);
+    memset(index, 0, sizeof(*index));
+}
+
+/* Take a client out of its channel's chain */
+static void unlinkClient(struct ClientIndex* index, struct ChannelTree* tree, anyID clientID)
+{
+    anyID prev = index->prev[clientID];
+    anyID next = index->next[clientID];
+
+    if (prev) {
+        index->next[prev] = next;
+    } else {
+        int node = channelTreeFind(tree, index->channelOf[clientID]);
+        if (node != -1 && tree->nodes[node].firstClient == clientID) {
+            tree->nodes[node].firstClient = next;
+        }
+    }
+    if (next) {
+        index->prev[next] = prev;
+    }
+
+    index->next[clientID] = 0;
+    index->prev[clientID] = 0;
+}
+
+/* Put a client at the head of its channel's chain, if the channel is known */
+static void linkClient(struct ClientIndex* index, struct ChannelTree* tree, anyID clientID)
+{
+    int node = channelTreeFind(tree, index->channelOf[clientID]);
+    anyID head;
+
+    if (node == -1) {
+        return;
+    }
+
+    head = tree->nodes[node].firstClient;
+    index->next[clientID] = head;
+    index->prev[clientID] = 0;
+    if (head) {
+        index->prev[head] = clientID;
+    }
+    tree->nodes[node].firstClient = clientID;
+}
+
+void clientIndexClear(struct ClientIndex* index, struct ChannelTree* tree)
+{
+    int i;
+
+    for (i = 0; i < tree->count; i++) {
+        tree->nodes[i].firstClient = 0;
+    }
+    memset(index->channelOf, 0, CLIENT_INDEX_SIZE * sizeof(uint64));
+    memset(index->next, 0, CLIENT_INDEX_SIZE * sizeof(anyID));
+    memset(index->prev, 0, CLIENT_INDEX_SIZE * sizeof(anyID));
+    index->clientCount = 0;
+}
+
+void clientIndexSet(struct ClientIndex* index, struct ChannelTree* tree, anyID clientID, uint64 channelID)
+{
+    if (clientID == 0 || index->channelOf[clientID] == channelID) {
+        return;
+    }
+
+    if (index->channelOf[clientID]) {
+        unlinkClient(index, tree, clientID);
+        index->clientCount--;
+    }
+
+    index->channelOf[clientID] = channelID;
+    if (channelID) {
+        linkClient(index, tree, clientID);
+        index->clientCount++;
+    }
+}
+
+void clientIndexRelink(struct ClientIndex* index, struct ChannelTree* tree)
+{
+    int i;
+
+    for (i = 0; i < tree->count; i++) {
+        tree->nodes[i].firstClient = 0;
+    }
+
+    for (i = 1; i < CLIENT_INDEX_SIZE; i++) {
+        index->next[i] = 0;
+        index->prev[i] = 0;
+        if (index->channelOf[i]) {
+            linkClient(index, tree, (anyID)i);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Client Location Index
+ *
+ * Tracks which channel every visible client is in. Members of a channel are
+ * chained through per-client links with the chain head stored in the
+ * channel's tree node, so listing a channel's clients costs O(members) and
+ * an empty channel costs a single read.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef CLIENT_INDEX_H
+#define CLIENT_INDEX_H
+
+#include "teamspeak/public_definitions.h"
+#include "channel_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLIENT_INDEX_SIZE 65536  /* Every possible anyID */
+
+struct ClientIndex {
+    uint64* channelOf;       /* Channel of each client, 0 = not present */
+    anyID* next;             /* Next client in the same channel, 0 = end */
+    anyID* prev;             /* Previous client in the same channel, 0 = chain head */
+    int clientCount;         /* Number of clients present */
+};
+
+/* Allocate an empty index; returns 0 on success */
+int   clientIndexInit(struct ClientIndex* index);
+
+/* Release all memory held by the index */
+void  clientIndexFree(struct ClientIndex* index);
+
+/* Forget every client */
+void  clientIndexClear(struct ClientIndex* index, struct ChannelTree* tree);
+
+/* Record that a client is now in channelID; 0 removes the client */
+void  clientIndexSet(struct ClientIndex* index, struct ChannelTree* tree, anyID clientID, uint64 channelID);
+
+/* Re-attach all clients to the chain heads of a freshly built tree */
+void  clientIndexRelink(struct ClientIndex* index, struct ChannelTree* tree);
+
+/* First client in a channel node, then the following ones; 0 ends the chain */
+#define clientIndexFirst(tree, node) ((tree)->nodes[node].firstClient)
+#define clientIndexNext(index, clientID) ((index)->next[clientID])
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,469 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Control Socket
+ *
+ * One thread serves the socket, one client after the other, and polls with
+ * a short timeout so a stop is noticed without waking it up. A batch is
+ * submitted under the server's lock, so once controlServerStop returns no
+ * command reaches the plugin any more; waiting for the results happens
+ * outside of it, on the batch's own lock, since a command may be done
+ * before its execute call even returns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "control_socket.h"
+
+#define CONTROL_POLL_MS 250             /* Longest a stop goes unnoticed */
+#define ERROR_PREFIX "MassMover: "      /* Plugin messages start with it; replies leave it out */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Commands of the message being answered and their results */
+struct ControlBatch {
+    struct PlatformMutex lock;
+    struct PlatformCondition done;      /* Signalled when the last result is done */
+    int pending;                        /* Results not done yet */
+    unsigned long long receivedAt;
+    struct ControlCommand commands[CONTROL_MAX_COMMANDS];
+    int parsed[CONTROL_MAX_COMMANDS];   /* The line was a command */
+    struct ControlResult results[CONTROL_MAX_COMMANDS];
+    int count;
+    int overflow;                       /* Lines beyond CONTROL_MAX_COMMANDS */
+};
+
+static const char* verbNames[] = { "move", "preview", "undo", "cancel", "stats" };
+
+int controlParseCommand(const char* line, struct ControlCommand* command)
+{
+    char verb[16];
+    char scope[16];
+    unsigned long long connection = 0;
+    unsigned long long channel = 0;
+    int levels = 0;
+    int fields;
+
+    memset(command, 0, sizeof(*command));
+    command->climbLevels = -1;
+    fields = sscanf(line, "%15s %llu %llu %15s %d", verb, &connection, &channel, scope, &levels);
+    if (fields < 2) {
+        return -1;
+    }
+    command->serverConnectionHandlerID = (uint64)connection;
+
+    if (strcmp(verb, "undo") == 0 || strcmp(verb, "cancel") == 0 || strcmp(verb, "stats") == 0) {
+        command->verb = verb[0] == 'u' ? CONTROL_UNDO : verb[0] == 'c' ? CONTROL_CANCEL : CONTROL_STATS;
+        return fields == 2 ? 0 : -1;
+    }
+    if (fields < 3) {
+        return -1;
+    }
+    command->channelID = (uint64)channel;
+    if (strcmp(verb, "preview") == 0) {
+        command->verb = CONTROL_PREVIEW;
+        return fields == 3 ? 0 : -1;
+    }
+    if (strcmp(verb, "move") != 0) {
+        return -1;
+    }
+    command->verb = CONTROL_MOVE;
+    if (fields == 3 || (fields == 4 && strcmp(scope, "family") == 0)) {
+        return 0;
+    }
+    if (fields == 4 && strcmp(scope, "subtree") == 0) {
+        command->climbLevels = 0;
+        return 0;
+    }
+    if (fields == 5 && strcmp(scope, "levels") == 0 && levels > 0) {
+        command->climbLevels = levels;
+        return 0;
+    }
+    return -1;
+}
+
+/* Microseconds from start to at as a JSON value, null if it never happened */
+static void formatMicros(char* buffer, size_t size, unsigned long long start, unsigned long long at)
+{
+    if (!at) {
+        snprintf(buffer, size, "null");
+    } else {
+        snprintf(buffer, size, "%.1f", at > start ? (at - start) / 1000.0 : 0.0);
+    }
+}
+
+size_t controlFormatResult(const struct ControlCommand* command, const struct ControlResult* result,
+                           unsigned long long receivedAt, char* buffer, size_t size)
+{
+    const char* error = result->error;
+    char planned[32], first[32], finished[32];
+    int length;
+
+    if (error && strncmp(error, ERROR_PREFIX, strlen(ERROR_PREFIX)) == 0) {
+        error += strlen(ERROR_PREFIX);
+    }
+    if (!command) {
+        length = snprintf(buffer, size, "{\"command\":null,\"ok\":false,\"error\":\"%s\"}", error ? error : "Unknown command");
+        return length < 0 ? 0 : (size_t)length < size ? (size_t)length : size - 1;
+    }
+
+    formatMicros(planned, sizeof(planned), receivedAt, result->plannedAt);
+    formatMicros(first, sizeof(first), receivedAt, result->firstRequestAt);
+    formatMicros(finished, sizeof(finished), receivedAt, result->finishedAt);
+    if (error) {
+        length = snprintf(buffer, size, "{\"command\":\"%s\",\"connection\":%llu,\"ok\":false,\"error\":\"%s\",\"finished_us\":%s}",
+                          verbNames[command->verb], (unsigned long long)result->serverConnectionHandlerID, error, finished);
+    } else if (command->verb == CONTROL_STATS) {
+        length = snprintf(buffer, size, "{\"command\":\"stats\",\"connection\":%llu,\"ok\":true,\"operations\":%llu,\"missing\":%llu,\"running\":%d,"
+                          "\"last_ms\":[%u,%u,%u],\"first_ms\":[%u,%u,%u],\"finished_us\":%s}",
+                          (unsigned long long)result->serverConnectionHandlerID, result->operations, result->missing, result->running,
+                          result->lastMs[0], result->lastMs[1], result->lastMs[2], result->firstMs[0], result->firstMs[1], result->firstMs[2],
+                          finished);
+    } else if (command->verb == CONTROL_CANCEL) {
+        length = snprintf(buffer, size, "{\"command\":\"cancel\",\"connection\":%llu,\"ok\":true,\"finished_us\":%s}",
+                          (unsigned long long)result->serverConnectionHandlerID, finished);
+    } else {
+        length = snprintf(buffer, size, "{\"command\":\"%s\",\"connection\":%llu,\"channel\":%llu,\"levels\":%d,\"ok\":true,"
+                          "\"channels\":%d,\"clients\":%d,\"moved\":%d,\"failed\":%d,\"cancelled\":%d,\"left_out\":%d,\"batches\":%d,\"retries\":%d,"
+                          "\"coalesced\":%s,\"planned_us\":%s,\"first_request_us\":%s,\"finished_us\":%s}",
+                          verbNames[command->verb], (unsigned long long)result->serverConnectionHandlerID,
+                          (unsigned long long)result->targetChannelID, command->climbLevels,
+                          result->channels, result->clients, result->moved, result->failed, result->cancelled, result->stale,
+                          result->batches, result->retries, result->coalesced ? "true" : "false", planned, first, finished);
+    }
+    return length < 0 ? 0 : (size_t)length < size ? (size_t)length : size - 1;
+}
+
+void controlResultDone(struct ControlResult* result)
+{
+    struct ControlBatch* batch = result->batch;
+
+    mutexLock(&batch->lock);
+    if (!result->finishedAt) {
+        result->finishedAt = monotonicNanos();
+    }
+    result->done = 1;
+    if (--batch->pending == 0) {
+        conditionSignal(&batch->done);
+    }
+    mutexUnlock(&batch->lock);
+}
+
+#ifndef _WIN32
+
+static struct {
+    struct PlatformThread thread;
+    struct PlatformMutex lock;          /* Held while a batch is submitted; guards stopping */
+    int stopping;
+    int started;
+    int listenFd;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    ControlExecute execute;
+} server = { .listenFd = -1 };
+
+static struct ControlBatch batch;
+static char message[CONTROL_MAX_MESSAGE];
+static char reply[(CONTROL_MAX_COMMANDS + 1) * CONTROL_REPLY_BUFSIZE];
+
+/* Whether the server is being stopped */
+static int stopRequested(void)
+{
+    int stopping;
+
+    mutexLock(&server.lock);
+    stopping = server.stopping;
+    mutexUnlock(&server.lock);
+    return stopping;
+}
+
+/* Wait until fd is readable; returns 1 if it is, 0 on timeout, -1 on error */
+static int waitReadable(int fd)
+{
+    struct pollfd entry;
+    int ready;
+
+    entry.fd = fd;
+    entry.events = POLLIN;
+    entry.revents = 0;
+    ready = poll(&entry, 1, CONTROL_POLL_MS);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    return ready;
+}
+
+/* Write all of buffer; returns 0 on success */
+static int writeAll(int fd, const char* buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+/* Run the commands of one message, lines separated by '\n' and zero terminated, and write the reply */
+static int answerMessage(int fd, char* lines)
+{
+    size_t length = 0;
+    char* line;
+    char* next;
+    int i;
+
+    batch.count = 0;
+    batch.overflow = 0;
+    batch.pending = 0;
+    batch.receivedAt = monotonicNanos();
+
+    /* Every command goes out before the first result is waited for */
+    mutexLock(&server.lock);
+    for (line = lines; line && *line; line = next) {
+        struct ControlResult* result;
+
+        next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
+        if (batch.count == CONTROL_MAX_COMMANDS) {
+            batch.overflow++;
+            continue;
+        }
+        i = batch.count++;
+        result = &batch.results[i];
+        memset(result, 0, sizeof(*result));
+        result->batch = &batch;
+        batch.parsed[i] = controlParseCommand(line, &batch.commands[i]) == 0;
+        if (!batch.parsed[i]) {
+            result->error = "Unknown command";
+            result->done = 1;
+            continue;
+        }
+        result->serverConnectionHandlerID = batch.commands[i].serverConnectionHandlerID;
+        if (server.stopping) {
+            result->error = "The plugin is shutting down";
+            result->done = 1;
+            continue;
+        }
+        mutexLock(&batch.lock);
+        batch.pending++;
+        mutexUnlock(&batch.lock);
+        server.execute(&batch.commands[i], result);
+    }
+    mutexUnlock(&server.lock);
+
+    mutexLock(&batch.lock);
+    while (batch.pending > 0) {
+        conditionWaitUntil(&batch.done, &batch.lock, 0);
+    }
+    mutexUnlock(&batch.lock);
+
+    for (i = 0; i < batch.count; i++) {
+        length += controlFormatResult(batch.parsed[i] ? &batch.commands[i] : NULL, &batch.results[i], batch.receivedAt,
+                                      reply + length, CONTROL_REPLY_BUFSIZE);
+        reply[length++] = '\n';
+    }
+    if (batch.overflow) {
+        length += snprintf(reply + length, CONTROL_REPLY_BUFSIZE, "{\"command\":null,\"ok\":false,\"error\":\"%d commands beyond the first %d were not run\"}\n",
+                           batch.overflow, CONTROL_MAX_COMMANDS);
+    }
+    reply[length++] = '\n';
+    return writeAll(fd, reply, length);
+}
+
+/* Bytes of the first complete message in buffer, its empty line included; 0 if there is none yet */
+static size_t messageLength(const char* buffer)
+{
+    const char* end;
+
+    if (buffer[0] == '\n') {
+        return 1;
+    }
+    end = strstr(buffer, "\n\n");
+    return end ? (size_t)(end - buffer) + 2 : 0;
+}
+
+/* Answer the messages of one client until it hangs up or the server stops */
+static void serveClient(int fd)
+{
+    size_t filled = 0;
+
+    while (!stopRequested()) {
+        ssize_t received;
+        size_t used;
+        char* end;
+        int ready = waitReadable(fd);
+
+        if (ready < 0) {
+            return;
+        }
+        if (ready == 0) {
+            continue;
+        }
+        received = recv(fd, message + filled, sizeof(message) - 1 - filled, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return;
+        }
+        filled += (size_t)received;
+        message[filled] = '\0';
+
+        /* Carriage returns are dropped, so both line endings work */
+        for (end = message + filled - received; (end = strchr(end, '\r')) != NULL; ) {
+            memmove(end, end + 1, message + filled - end);
+            filled--;
+        }
+
+        /* Answer every complete message; an empty line ends one */
+        while ((used = messageLength(message)) > 0) {
+            message[used - 1] = '\0';
+            if (answerMessage(fd, message) != 0) {
+                return;
+            }
+            memmove(message, message + used, filled - used + 1);
+            filled -= used;
+        }
+        if (filled == sizeof(message) - 1) {
+            static const char tooLong[] = "{\"command\":null,\"ok\":false,\"error\":\"Message too long\"}\n\n";
+            writeAll(fd, tooLong, sizeof(tooLong) - 1);
+            return;
+        }
+    }
+}
+
+/* Accept clients until stopped */
+static void serverMain(void* argument)
+{
+    while (!stopRequested()) {
+        int fd;
+        int ready = waitReadable(server.listenFd);
+
+        if (ready <= 0) {
+            if (ready < 0) {
+                sleepMillis(CONTROL_POLL_MS);
+            }
+            continue;
+        }
+        fd = accept(server.listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        serveClient(fd);
+        close(fd);
+    }
+}
+
+int controlServerStart(const char* path, ControlExecute execute)
+{
+    struct sockaddr_un address;
+    struct stat existing;
+    int fd;
+
+    if (server.started || strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* A socket left behind by a client that crashed is replaced, anything else stays */
+    if (lstat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+
+    /* Nobody can connect before listen, so tightening the permissions after bind leaves no gap */
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (chmod(path, S_IRUSR | S_IWUSR) != 0 || listen(fd, 4) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    memcpy(server.path, path, strlen(path) + 1);
+    server.listenFd = fd;
+    server.execute = execute;
+    server.stopping = 0;
+    mutexInit(&server.lock);
+    mutexInit(&batch.lock);
+    conditionInit(&batch.done);
+    if (threadStart(&server.thread, serverMain, NULL) != 0) {
+        conditionDestroy(&batch.done);
+        mutexDestroy(&batch.lock);
+        mutexDestroy(&server.lock);
+        close(fd);
+        unlink(path);
+        server.listenFd = -1;
+        return -1;
+    }
+    server.started = 1;
+    return 0;
+}
+
+void controlServerStop(void)
+{
+    if (!server.started) {
+        return;
+    }
+    mutexLock(&server.lock);
+    server.stopping = 1;
+    mutexUnlock(&server.lock);
+}
+
+void controlServerJoin(void)
+{
+    if (!server.started) {
+        return;
+    }
+    controlServerStop();
+    threadJoin(&server.thread);
+    close(server.listenFd);
+    unlink(server.path);
+    conditionDestroy(&batch.done);
+    mutexDestroy(&batch.lock);
+    mutexDestroy(&server.lock);
+    server.listenFd = -1;
+    server.started = 0;
+}
+
+#else
+
+int controlServerStart(const char* path, ControlExecute execute)
+{
+    return -1;
+}
+
+void controlServerStop(void)
+{
+}
+
+void controlServerJoin(void)
+{
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Control Socket
+ *
+ * Lets local scripts drive mass moves without a click. With control_socket
+ * set in massmover.ini the plugin listens on a Unix-domain socket,
+ * massmover.sock in the TeamSpeak config path, readable by the user only.
+ * A message is a batch of commands, one per line, ended by an empty line:
+ *
+ *   move CONNECTION CHANNEL [family | subtree | levels N]
+ *   preview CONNECTION CHANNEL
+ *   undo CONNECTION
+ *   cancel CONNECTION
+ *   stats CONNECTION
+ *
+ * Connection 0 is the tab in front and channel 0 the one we are in. Every
+ * command of a batch is handed to the plugin at once, so moves on different
+ * connections run side by side. Once all of them are done the reply comes
+ * back as one JSON object per command, in command order, again ended by an
+ * empty line. Times in the reply are microseconds since the batch arrived;
+ * a move that joined one already under way says "coalesced" and has none.
+ * Any number of messages may follow on the same connection. Not available
+ * on Windows.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef CONTROL_SOCKET_H
+#define CONTROL_SOCKET_H
+
+#include <stddef.h>
+
+#include "teamspeak/public_definitions.h"
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTROL_SOCKET_FILENAME "massmover.sock"
+#define CONTROL_MAX_COMMANDS 256        /* Commands per message; more are answered with an error */
+#define CONTROL_MAX_MESSAGE 65536       /* Bytes per message */
+#define CONTROL_REPLY_BUFSIZE 512       /* Bytes per reply line */
+
+enum ControlVerb {
+    CONTROL_MOVE = 0,
+    CONTROL_PREVIEW,
+    CONTROL_UNDO,
+    CONTROL_CANCEL,
+    CONTROL_STATS
+};
+
+struct ControlCommand {
+    enum ControlVerb verb;
+    uint64 serverConnectionHandlerID;   /* 0 = the tab in front */
+    uint64 channelID;                   /* Target; 0 = our own channel */
+    int climbLevels;                    /* Scope: ancestor levels climbed, -1 = whole family, 0 = subchannels only */
+};
+
+struct ControlBatch;
+
+/* Outcome of one command, filled in by whoever runs it */
+struct ControlResult {
+    const char* error;                  /* NULL on success */
+    uint64 serverConnectionHandlerID;   /* Connection the command ran on */
+    uint64 targetChannelID;
+    int channels;                       /* Channels of the scope */
+    int clients;                        /* Clients planned to move */
+    int moved;
+    int failed;
+    int cancelled;
+    int batches;
+    int retries;
+    int stale;                          /* Clients left out of an undo */
+    int coalesced;                      /* The move joined one already requested instead of running again */
+    unsigned long long plannedAt;       /* Monotonic nanoseconds; 0 if it never happened */
+    unsigned long long firstRequestAt;
+    unsigned long long finishedAt;
+    unsigned long long operations;      /* Stats: operations measured so far */
+    unsigned long long missing;         /* Stats: clients that never arrived */
+    int running;                        /* Stats: moves still running */
+    unsigned int lastMs[3];             /* Stats: p50, p95 and p99 of the time to the last arrival */
+    unsigned int firstMs[3];            /* Stats: the same for the first arrival */
+    struct ControlBatch* batch;
+    int done;
+};
+
+/*
+ * Run a command for the control socket. It must end in exactly one
+ * controlResultDone call, right away or later from any thread.
+ */
+typedef void (*ControlExecute)(const struct ControlCommand* command, struct ControlResult* result);
+
+/* Start listening on path, replacing a stale socket; returns 0 on success */
+int  controlServerStart(const char* path, ControlExecute execute);
+
+/* Take no more commands; a batch being answered is still answered. Call before the plugin stops running commands */
+void controlServerStop(void);
+
+/* Wait for the server to finish and remove the socket; every result must be done by then */
+void controlServerJoin(void);
+
+/* Hand a result back to the batch waiting for it; safe from any thread */
+void controlResultDone(struct ControlResult* result);
+
+/* Parse one command line; returns 0 on success */
+int  controlParseCommand(const char* line, struct ControlCommand* command);
+
+/* Format a result as one JSON line, without the newline; times relative to receivedAt. command is NULL for a line that didn't parse */
+size_t controlFormatResult(const struct ControlCommand* command, const struct ControlResult* result,
+                           unsigned long long receivedAt, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Follow Mode
+ *
+ * The pending list keeps arrival order and the bitset beside it keeps a
+ * client that hops between watched channels from being listed twice.
+ * Clearing only unsets the bits of the listed clients, so a flush costs as
+ * much as the clients it moves, not the whole client ID space.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "follow_mode.h"
+#include "move_set.h"
+
+#define FOLLOW_PENDING_INITIAL 64
+
+void followInit(struct FollowMode* follow)
+{
+    memset(follow, 0, sizeof(*follow));
+}
+
+void followFree(struct FollowMode* follow)
+{
+    free(follow->watched);
+    free(follow->pending);
+    free(follow->pendingSet);
+    memset(follow, 0, sizeof(*follow));
+}
+
+int followStart(struct FollowMode* follow, uint64 targetChannelID, int climbLevels, unsigned long long until)
+{
+    if (!follow->pendingSet) {
+        follow->pendingSet = (unsigned char*)calloc(1, CLIENT_SET_BYTES);
+        if (!follow->pendingSet) {
+            return -1;
+        }
+    }
+    followStop(follow);
+    follow->targetChannelID = targetChannelID;
+    follow->climbLevels = climbLevels;
+    follow->until = until;
+    follow->nextFlushAt = 0;
+    follow->flushes = 0;
+    follow->moved = 0;
+    return 0;
+}
+
+void followStop(struct FollowMode* follow)
+{
+    followClear(follow);
+    follow->targetChannelID = 0;
+    follow->scopeValid = 0;
+}
+
+void followTreeChanged(struct FollowMode* follow)
+{
+    follow->scopeValid = 0;
+}
+
+int followSetScope(struct FollowMode* follow, const struct ChannelTree* tree, const uint64* channels, int count)
+{
+    int bytes = (tree->count + 7) / 8;
+    int i;
+
+    if (tree->count > follow->watchedNodes) {
+        unsigned char* watched = (unsigned char*)realloc(follow->watched, bytes);
+        if (!watched) {
+            return -1;
+        }
+        follow->watched = watched;
+        follow->watchedNodes = bytes * 8;
+    }
+    if (follow->watched) {
+        memset(follow->watched, 0, follow->watchedNodes / 8);
+    }
+
+    for (i = 0; i < count; i++) {
+        int node = channelTreeFind(tree, channels[i]);
+        if (node != -1) {
+            follow->watched[node >> 3] |= (unsigned char)(1 << (node & 7));
+        }
+    }
+    follow->scopeValid = 1;
+    return 0;
+}
+
+int followWatches(const struct FollowMode* follow, const struct ChannelTree* tree, uint64 channelID)
+{
+    int node;
+
+    if (!follow->scopeValid) {
+        return 1;
+    }
+    node = channelTreeFind(tree, channelID);
+    return node != -1 && node < follow->watchedNodes && (follow->watched[node >> 3] & (1 << (node & 7)));
+}
+
+int followAdd(struct FollowMode* follow, anyID clientID)
+{
+    if (!follow->pendingSet || clientSetHas(follow->pendingSet, clientID)) {
+        return 0;
+    }
+    if (follow->pendingCount == follow->pendingCapacity) {
+        int capacity = follow->pendingCapacity ? follow->pendingCapacity * 2 : FOLLOW_PENDING_INITIAL;
+        anyID* pending = (anyID*)realloc(follow->pending, capacity * sizeof(anyID));
+        if (!pending) {
+            return 0;
+        }
+        follow->pending = pending;
+        follow->pendingCapacity = capacity;
+    }
+    follow->pending[follow->pendingCount++] = clientID;
+    clientSetAdd(follow->pendingSet, clientID);
+    return 1;
+}
+
+void followClear(struct FollowMode* follow)
+{
+    int i;
+
+    for (i = 0; i < follow->pendingCount; i++) {
+        clientSetRemove(follow->pendingSet, follow->pending[i]);
+    }
+    follow->pendingCount = 0;
+}
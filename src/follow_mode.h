@@ -0,0 +1,72 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Follow Mode
+ *
+ * Keeps a family gathered for a while after a mass move. Clients that join
+ * the watched channels later, by switching or connecting, are noted in a
+ * pending set as their events come in, and the owner moves the whole set
+ * with one batched request every flush interval. The watched channels are
+ * a bit per tree node, worked out by one walk and kept until the channel
+ * tree changes, so noting a client is a lookup and a bit test. While the
+ * bits are stale every arrival is noted, and the flush sorts them out.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef FOLLOW_MODE_H
+#define FOLLOW_MODE_H
+
+#include "teamspeak/public_definitions.h"
+#include "channel_tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FOLLOW_SECONDS_DEFAULT 600      /* How long a follow lasts */
+#define FOLLOW_FLUSH_MS_DEFAULT 500     /* Gap between two batched moves of late joiners */
+
+struct FollowMode {
+    uint64 targetChannelID;             /* Channel kept gathered, 0 while not following */
+    int climbLevels;                    /* Scope of the watched channels, as for a mass move */
+    unsigned long long until;           /* Monotonic nanoseconds the follow ends */
+    unsigned long long nextFlushAt;     /* Pending clients are not moved before this time */
+    int scopeValid;                     /* watched matches the channel tree */
+    unsigned char* watched;             /* Bit per tree node inside the scope */
+    int watchedNodes;                   /* Nodes watched has room for */
+    anyID* pending;                     /* Clients noted since the last flush, each once */
+    int pendingCount;
+    int pendingCapacity;
+    unsigned char* pendingSet;          /* The clients in pending, CLIENT_SET_BYTES */
+    int flushes;                        /* Batched moves since the follow began */
+    int moved;                          /* Clients sent in them */
+};
+
+void followInit(struct FollowMode* follow);
+void followFree(struct FollowMode* follow);
+
+/* Follow a target until the given time, dropping an earlier follow; returns 0 on success */
+int  followStart(struct FollowMode* follow, uint64 targetChannelID, int climbLevels, unsigned long long until);
+
+/* Stop following and forget the pending clients; memory is kept for the next follow */
+void followStop(struct FollowMode* follow);
+
+/* The channel tree changed, so the watched channels have to be worked out again */
+void followTreeChanged(struct FollowMode* follow);
+
+/* Watch exactly channels[0..count) of tree; returns 0 on success */
+int  followSetScope(struct FollowMode* follow, const struct ChannelTree* tree, const uint64* channels, int count);
+
+/* Whether a client arriving in channelID may belong to the scope; always 1 while the watched channels are stale */
+int  followWatches(const struct FollowMode* follow, const struct ChannelTree* tree, uint64 channelID);
+
+/* Note a client for the next flush; returns 1 if it was not pending yet */
+int  followAdd(struct FollowMode* follow, anyID clientID);
+
+/* Empty the pending set after the owner took what it needed from pending[0..pendingCount) */
+void followClear(struct FollowMode* follow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
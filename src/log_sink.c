@@ -0,0 +1,197 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Log Sink
+ *
+ * The ring is a bounded queue with a sequence number per slot: a writer
+ * claims the slot at the tail with a compare and swap, fills it and
+ * publishes it by bumping its sequence, so writers never wait for each
+ * other or for the drainer. A slot whose sequence lags behind the tail is
+ * still being drained, which means the ring is full. The drainer is the
+ * only reader and takes published slots in order from the head.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log_sink.h"
+#include "platform.h"
+
+struct LogSlot {
+    volatile unsigned int sequence;     /* Position the slot is free for, or that position + 1 once written */
+    enum LogLevel level;
+    int count;
+    uint64 serverConnectionHandlerID;
+    unsigned long long writtenAt;       /* Monotonic nanoseconds */
+    const char* format;
+    const char* text;
+    long long args[LOG_SINK_MAX_ARGS];
+};
+
+static struct {
+    struct LogSlot slots[LOG_SINK_CAPACITY];
+    volatile unsigned int tail;         /* Next position to write */
+    unsigned int head;                  /* Next position to drain; drainer only */
+    volatile unsigned int running;      /* Records are taken */
+    volatile unsigned int stopping;
+    volatile unsigned int maxRank;      /* Verbosity rank of the most verbose level kept */
+    volatile unsigned int dropped;
+    unsigned int droppedReported;       /* Drainer only */
+    LogForward forward;
+    struct PlatformThread thread;
+} sink = { .maxRank = LogLevel_DEBUG };    /* The rank of LogLevel_INFO */
+
+/* The SDK numbers debug below info; swapping the two ranks levels by how verbose they are */
+static unsigned int verbosityRank(enum LogLevel level)
+{
+    if (level == LogLevel_INFO) {
+        return LogLevel_DEBUG;
+    }
+    if (level == LogLevel_DEBUG) {
+        return LogLevel_INFO;
+    }
+    return (unsigned int)level;
+}
+
+void logSinkWrite(enum LogLevel level, uint64 serverConnectionHandlerID, const char* format, const char* text,
+                  int count, const long long* args)
+{
+    struct LogSlot* slot;
+    unsigned int position;
+
+    if (!logSinkEnabled(level)) {
+        return;
+    }
+    if (!atomicLoad(&sink.running)) {
+        atomicAdd(&sink.dropped, 1);
+        return;
+    }
+
+    position = atomicLoad(&sink.tail);
+    for (;;) {
+        int lag;
+
+        slot = &sink.slots[position & (LOG_SINK_CAPACITY - 1)];
+        lag = (int)(atomicLoad(&slot->sequence) - position);
+        if (lag == 0 && atomicCompareExchange(&sink.tail, position, position + 1)) {
+            break;
+        }
+        if (lag < 0) {
+            atomicAdd(&sink.dropped, 1);
+            return;
+        }
+        position = atomicLoad(&sink.tail);
+    }
+
+    slot->level = level;
+    slot->serverConnectionHandlerID = serverConnectionHandlerID;
+    slot->writtenAt = monotonicNanos();
+    slot->format = format;
+    slot->text = text;
+    slot->count = count < LOG_SINK_MAX_ARGS ? count : LOG_SINK_MAX_ARGS;
+    if (slot->count > 0) {
+        memcpy(slot->args, args, slot->count * sizeof(long long));
+    }
+    atomicStore(&slot->sequence, position + 1);
+}
+
+/* Format and forward every published record; drainer only */
+static void drainRecords(void)
+{
+    char message[LOG_SINK_BUFSIZE];
+    unsigned int dropped;
+
+    for (;;) {
+        struct LogSlot* slot = &sink.slots[sink.head & (LOG_SINK_CAPACITY - 1)];
+        struct LogSlot record;
+        unsigned long long late;
+        long long a[LOG_SINK_MAX_ARGS];
+        int length;
+
+        if ((int)(atomicLoad(&slot->sequence) - (sink.head + 1)) < 0) {
+            break;
+        }
+        record = *slot;
+        atomicStore(&slot->sequence, sink.head + LOG_SINK_CAPACITY);
+        sink.head++;
+
+        /* Arguments the record doesn't have are passed as zeros and ignored by the format */
+        memset(a, 0, sizeof(a));
+        memcpy(a, record.args, record.count * sizeof(long long));
+        if (record.text) {
+            length = snprintf(message, sizeof(message), record.format, record.text, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        } else {
+            length = snprintf(message, sizeof(message), record.format, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        }
+        late = (monotonicNanos() - record.writtenAt) / NANOS_PER_MS;
+        if (late >= LOG_SINK_LATE_MS && length >= 0 && (size_t)length < sizeof(message)) {
+            snprintf(message + length, sizeof(message) - length, " (%llu ms ago)", late);
+        }
+        sink.forward(message, record.level, record.serverConnectionHandlerID);
+    }
+
+    dropped = atomicLoad(&sink.dropped);
+    if (dropped != sink.droppedReported) {
+        snprintf(message, sizeof(message), "MassMover: Log sink full, dropped %u records (%u so far)", dropped - sink.droppedReported, dropped);
+        sink.droppedReported = dropped;
+        sink.forward(message, LogLevel_WARNING, 0);
+    }
+}
+
+/* Drainer thread: drain, sleep, repeat until stopped */
+static void drainerMain(void* argument)
+{
+    while (!atomicLoad(&sink.stopping)) {
+        drainRecords();
+        sleepMillis(LOG_SINK_DRAIN_MS);
+    }
+}
+
+int logSinkStart(LogForward forward, enum LogLevel maxLevel)
+{
+    unsigned int i;
+
+    if (atomicLoad(&sink.running)) {
+        return -1;
+    }
+    for (i = 0; i < LOG_SINK_CAPACITY; i++) {
+        sink.slots[i].sequence = i;
+    }
+    sink.tail = 0;
+    sink.head = 0;
+    sink.forward = forward;
+    sink.droppedReported = atomicLoad(&sink.dropped);
+    atomicStore(&sink.stopping, 0);
+    logSinkSetLevel(maxLevel);
+    if (threadStart(&sink.thread, drainerMain, NULL) != 0) {
+        return -1;
+    }
+    atomicStore(&sink.running, 1);
+    return 0;
+}
+
+void logSinkStop(void)
+{
+    if (!atomicLoad(&sink.running)) {
+        return;
+    }
+    atomicStore(&sink.stopping, 1);
+    threadJoin(&sink.thread);
+    atomicStore(&sink.running, 0);
+
+    /* What was written while the drainer went down */
+    drainRecords();
+}
+
+void logSinkSetLevel(enum LogLevel maxLevel)
+{
+    atomicStore(&sink.maxRank, verbosityRank(maxLevel));
+}
+
+int logSinkEnabled(enum LogLevel level)
+{
+    return verbosityRank(level) <= atomicLoad(&sink.maxRank);
+}
+
+unsigned int logSinkDropped(void)
+{
+    return atomicLoad(&sink.dropped);
+}
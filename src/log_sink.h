@@ -0,0 +1,75 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Log Sink
+ *
+ * Takes logging off the threads that do the work. A log record is a level,
+ * a connection, a static format string identifying the message, up to
+ * LOG_SINK_MAX_ARGS numbers and the time it was made. Writing one copies it
+ * into a bounded ring shared by every thread, without a lock and without
+ * formatting anything, and never waits: if the ring is full the record is
+ * dropped and counted. A drainer thread formats what was written every
+ * LOG_SINK_DRAIN_MS and hands it to the client's log. Records more verbose
+ * than the level filter, which can change at any time and keeps info but
+ * not debug records unless told otherwise, are not written at all.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_SINK_CAPACITY 1024          /* Records the ring holds; a power of two */
+#define LOG_SINK_MAX_ARGS 8             /* Numbers per record */
+#define LOG_SINK_DRAIN_MS 50            /* Gap between two drains */
+#define LOG_SINK_BUFSIZE 512            /* Buffer size for a formatted record */
+#define LOG_SINK_LATE_MS 1000           /* Records forwarded this much later than written say so */
+
+/* Where formatted records go, on the drainer thread */
+typedef void (*LogForward)(const char* message, enum LogLevel level, uint64 serverConnectionHandlerID);
+
+/* Start the drainer, keeping records up to maxLevel; returns 0 on success */
+int  logSinkStart(LogForward forward, enum LogLevel maxLevel);
+
+/* Forward everything written so far and stop the drainer; later records are dropped */
+void logSinkStop(void);
+
+/* Keep records up to maxLevel from now on: critical, error, warning, info, debug and devel, each taking the ones before it along */
+void logSinkSetLevel(enum LogLevel maxLevel);
+
+/* Whether a record of this level would be kept */
+int  logSinkEnabled(enum LogLevel level);
+
+/*
+ * Write a record; safe from any thread and never blocks. format is
+ * printf-style and must outlive the sink: it receives text first if text
+ * is set, then args[0..count) as long long (%lld).
+ */
+void logSinkWrite(enum LogLevel level, uint64 serverConnectionHandlerID, const char* format, const char* text,
+                  int count, const long long* args);
+
+/* Records dropped so far because the ring was full */
+unsigned int logSinkDropped(void);
+
+/* Log a static message */
+#define LOG_TEXT(level, serverConnectionHandlerID, text) \
+    logSinkWrite(level, serverConnectionHandlerID, "%s", text, 0, NULL)
+
+/* Log a format with one to LOG_SINK_MAX_ARGS numbers, each printed with %lld */
+#define LOG_RECORD(level, serverConnectionHandlerID, format, ...) \
+    do { \
+        if (logSinkEnabled(level)) { \
+            const long long logArgs[] = { 0, __VA_ARGS__ }; \
+            logSinkWrite(level, serverConnectionHandlerID, format, NULL, (int)(sizeof(logArgs) / sizeof(logArgs[0])) - 1, logArgs + 1); \
+        } \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,16 +36,174 @@
 #include "plugin_definitions.h"
 
 #include "massmover.h"
+#include "arena.h"
+#include "channel_rules.h"
+#include "channel_tree.h"
+#include "client_index.h"
+#include "control_socket.h"
+#include "follow_mode.h"
+#include "log_sink.h"
+#include "move_pipeline.h"
+#include "move_planner.h"
+#include "move_set.h"
+#include "move_stats.h"
+#include "metrics.h"
+#include "plan_cache.h"
+#include "plan_format.h"
+#include "platform.h"
+#include "sdk_trace.h"
+#include "undo_log.h"
 
 /* Global Variables */
 static struct TS3Functions ts3Functions;  /* TeamSpeak 3 API function pointers */
 static char* pluginID = NULL;            /* Plugin's unique identifier */
 
+/*
+ * Latest mass move requested on a connection. Requests for the same target
+ * and scope are folded into it while it runs and shortly after; a request
+ * for another target replaces it while it is queued, and shortly after even
+ * once it started.
+ */
+struct RecentMove {
+    uint64 targetChannelID;
+    int climbLevels;
+    unsigned long long requestedAt;      /* Monotonic nanoseconds of the request, 0 if there is nothing to fold into */
+    int open;                            /* Queued, being planned or sending */
+    struct MovePipeline* pipeline;       /* Its pipeline while it sends */
+    unsigned long long replacedAt;       /* Request time of the move it replaced, which must not start any more */
+};
+
+/*
+ * Per server connection state kept alive between operations. Every
+ * connection is a shard of its own: its caches, moves and statistics sit
+ * behind its own lock and are served by its own worker thread, so mass
+ * moves on different server tabs run side by side. Planning and sending
+ * happen on the worker so the client UI never waits for them; callbacks only
+ * update the caches and wake it up. No SDK function is called while a
+ * state's lock is held, since the client may be blocked on the lock in a
+ * callback at the same time.
+ *
+ * A state outlives its connection: on disconnect it is emptied and kept,
+ * worker included, for the next connection, and only freed at shutdown.
+ */
+struct ServerState {
+    uint64 serverConnectionHandlerID;    /* Connection this state belongs to, 0 while it waits for one */
+    struct ChannelTree tree;             /* Channel tree, maintained from channel events */
+    int treeValid;                       /* Tree holds a complete snapshot */
+    int rulesApplied;                    /* The excluded flags of the tree are up to date with its traits and shape */
+    struct ClientIndex clients;          /* Client locations, maintained from client move events */
+    int clientsValid;                    /* Index holds a complete snapshot */
+    unsigned int generation;             /* Bumped by stateChanged on every change plans are made from */
+    struct MovePipeline* moves;          /* Move pipelines awaiting server answers */
+    unsigned int cancelEpoch;            /* Bumped by "Cancel MassMove" and on disconnect; jobs queued before are dropped */
+    struct MoveStats stats;              /* Click to arrival latency of the moves on this connection */
+    unsigned char* moveDenied;           /* Clients the server refused to let us move, NULL until the first refusal */
+    int deniedAtPower;                   /* Our move power when those refusals came in */
+    int movePower;                       /* Our i_client_move_power as of the last job, -1 if unknown */
+    anyID selfID;                        /* Our own client ID, 0 until known */
+    struct PlanCache plans;              /* Plans made at the current or earlier generations */
+    unsigned int warmedGeneration;       /* Generation the hotkey plans were last made at */
+    unsigned long long warmedAt;         /* Monotonic nanoseconds of that warm up */
+    int refreshWanted;                   /* The tab became active; the worker completes the caches */
+    struct UndoLog undo;                 /* Where the clients of the latest moves came from */
+    struct RecentMove recent;            /* Latest mass move requested, for coalescing */
+    struct FollowMode follow;            /* Family kept gathered after "MassMove here and follow" */
+    
+    /* The connection's worker */
+    struct PlatformMutex lock;           /* Guards everything in this state */
+    struct PlatformCondition wake;       /* Signalled when there is something new for the worker */
+    struct PlatformThread thread;
+    int stopping;                        /* Set at shutdown */
+    struct MoveJob* jobs;                /* Jobs in the order they were requested */
+    struct MoveJob** jobsTail;
+    struct MoveJob* spareJobs;           /* Jobs done with, for the next clicks */
+    anyID* sendBuffer;                   /* Worker's copy of the batch being sent */
+    char spareReturnCode[MOVE_RETURNCODE_BUFSIZE]; /* Fetched ahead, so sending needs no SDK call under the lock */
+    unsigned char* moveSetSeen;          /* Scratch bitset for deduplicating move sets, all clear between jobs */
+    struct Arena planArena;              /* Scratch lists of the plan being made, reset per plan */
+    struct MovePipeline* sparePipelines; /* Finished pipelines kept with their memory for the next moves; worker only */
+    int sparePipelineCount;
+    unsigned long long nextProgressAt;   /* Next progress report while pipelines are running */
+#ifdef MASSMOVER_METRICS
+    struct MetricsRecord planMetrics;    /* Counters of the job the worker is planning */
+#endif
+    struct ServerState* next;
+};
+static struct ServerState* serverStates = NULL;  /* Every state, in use or waiting for a connection */
+static struct PlatformMutex statesLock;          /* Guards the serverStates list; may be taken before a state's lock, never after */
+
+/* The planner's counters go to the state's record, if there is one */
+#ifdef MASSMOVER_METRICS
+#define PLAN_METRICS(state) (&(state)->planMetrics)
+#else
+#define PLAN_METRICS(state) NULL
+#endif
+
+/* Tunables, read from massmover.ini in the TeamSpeak config path */
+#define ANCESTOR_LEVELS_DEFAULT 1
+#define COALESCE_MS_DEFAULT 1000
+struct Settings {
+    int batchSize;                       /* Clients per requestClientsMove */
+    int maxInFlight;                     /* Batches awaiting an answer at the same time */
+    int ancestorLevels;                  /* Levels the "from N levels up" entry climbs above the target */
+    int controlSocket;                   /* Take commands from scripts on massmover.sock */
+    int coalesceMs;                      /* Window in which repeated mass moves are folded into one, 0 = never */
+    int logLevel;                        /* Most verbose log level written to the client log */
+    int followSeconds;                   /* How long "MassMove here and follow" keeps the family gathered */
+    int followFlushMs;                   /* Least gap between two batched moves of late joiners */
+};
+static struct Settings settings = { MOVE_BATCH_SIZE_DEFAULT, MOVE_MAX_IN_FLIGHT_DEFAULT, ANCESTOR_LEVELS_DEFAULT, 0, COALESCE_MS_DEFAULT, LogLevel_INFO,
+                                    FOLLOW_SECONDS_DEFAULT, FOLLOW_FLUSH_MS_DEFAULT };
+static struct ChannelRules exclusionRules;       /* Channels mass moves leave alone, read from massmover_exclude.ini at init */
+
+/* What a queued job does */
+enum MoveJobKind {
+    JOB_MOVE = 0,                        /* Plan the move and send it */
+    JOB_PREVIEW,                         /* Plan only, report the plan and save it */
+    JOB_RUN_SAVED,                       /* Send the saved plan */
+    JOB_UNDO                             /* Send the clients of the latest move back where they came from */
+};
+
+/* Mass move requested from the menu, waiting for the connection's worker */
+struct MoveJob {
+    enum MoveJobKind kind;
+    uint64 serverConnectionHandlerID;
+    uint64 targetChannelID;
+    anyID selfID;                        /* Our own client ID, captured on the callback thread */
+    int climbLevels;                     /* Ancestor levels above the target to collect from: 0 = subtree only, -1 = whole family */
+    unsigned long long requestedAt;      /* Monotonic nanoseconds of the click */
+    unsigned int cancelEpoch;            /* The connection's cancel epoch when the job was queued */
+    struct ControlResult* result;        /* Control socket command waiting for the outcome, or NULL */
+    struct MoveJob* next;
+};
+
 /* Constants */
 #define PLUGIN_API_VERSION 26            /* TeamSpeak 3 API version we're using */
 #define PATH_BUFSIZE 512                 /* Buffer size for file paths */
 #define RETURNCODE_BUFSIZE 128           /* Buffer size for return codes */
-#define MENU_ID_MASSMOVE 1              /* ID for our context menu item */
+#define MENU_ID_MASSMOVE 1              /* ID for our context menu item: the whole family */
+#define MENU_ID_CANCEL 2                /* ID for the cancel entry in the plugin menu */
+#define MENU_ID_MASSMOVE_SUBTREE 3      /* Context menu item moving the target's subchannels only */
+#define MENU_ID_MASSMOVE_LEVELS 4       /* Context menu item moving everything below an ancestor a few levels up */
+#define MENU_ID_PREVIEW 5               /* Context menu item planning the whole family's move without sending it */
+#define MENU_ID_RUN_SAVED 6             /* Plugin menu entry sending the plan the last preview saved */
+#define MENU_ID_UNDO 7                  /* Plugin menu entry moving the clients of the latest mass move back */
+#define MENU_ID_FOLLOW 8                /* Context menu item moving the whole family and keeping it gathered */
+#define MENU_ID_FOLLOW_STOP 9           /* Plugin menu entry ending the follow */
+#define MENU_ITEM_COUNT 9
+#define HOTKEY_GATHER_FAMILY "gather_family"    /* Hotkey keywords; the client stores bindings under these */
+#define HOTKEY_GATHER_LEVELS "gather_levels"
+#define HOTKEY_GATHER_SUBTREE "gather_subtree"
+#define HOTKEY_CANCEL "cancel"
+#define HOTKEY_UNDO "undo"
+#define HOTKEY_COUNT 5
+#define PLAN_WARM_INTERVAL_MS 250       /* Least gap between two warm ups of the hotkey plans of a connection */
+#define PROGRESS_INTERVAL_MS 1000       /* Gap between progress reports of a running move */
+#define REFRESH_ATTEMPTS 3              /* Snapshots taken before settling for one that may be stale */
+#define INFODATA_BUFSIZE 1024           /* Buffer size for the info panel text */
+#define SPARE_PIPELINES 4               /* Finished pipelines kept for reuse */
+#define SETTINGS_FILENAME "massmover.ini" /* Settings file in the config path */
+#define PLAN_FILENAME "massmover_plan.bin" /* Plan saved by the last preview, in the config path */
 
 /* Platform-specific string handling */
 #ifdef _WIN32
@@ -61,9 +219,64 @@ static char* pluginID = NULL;            /* Plugin's unique identifier */
 
 /* Function Prototypes */
 static struct PluginMenuItem* createMenuItem(enum PluginMenuType type, int id, const char* text, const char* icon);
-static void collectSubchannels(uint64 serverConnectionHandlerID, uint64 parentChannelID, uint64** channels, int* channelCount, int* capacity);
-static void collectParentChannels(uint64 serverConnectionHandlerID, uint64 channelID, uint64** channels, int* channelCount, int* capacity);
-static anyID* collectClientsFromChannels(uint64 serverConnectionHandlerID, uint64* channels, int channelCount, int* clientCount);
+static int snapshotChannelTree(uint64 serverConnectionHandlerID, struct ChannelTree* tree);
+static struct ServerState* lockServerState(uint64 serverConnectionHandlerID, int create);
+static struct ServerState* createServerState(void);
+static int activateServerState(struct ServerState* state, uint64 serverConnectionHandlerID);
+static void releaseServerState(struct ServerState* state);
+static void freeServerState(struct ServerState* state);
+static void installChannelTree(struct ServerState* state, struct ChannelTree* fresh);
+static int snapshotClientLocations(uint64 serverConnectionHandlerID, anyID** clientList, uint64** channelList);
+static void installClientLocations(struct ServerState* state, const anyID* clientList, const uint64* channelList);
+static int refreshServerState(uint64 serverConnectionHandlerID, int force, int create);
+#ifdef MASSMOVER_DEBUG
+static void verifyChannelTreeCache(uint64 serverConnectionHandlerID);
+static void verifyClientIndex(uint64 serverConnectionHandlerID, uint64* channels, int channelCount);
+#endif
+static void updateClientLocation(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID);
+static void loadSettings(void);
+static void loadExclusionRules(void);
+static unsigned char readChannelTraits(uint64 serverConnectionHandlerID, uint64 channelID);
+static void noteChannelTraits(struct ServerState* state, uint64 channelID, unsigned char traits);
+static void forwardLogRecord(const char* message, enum LogLevel level, uint64 serverConnectionHandlerID);
+static void channelsChanged(struct ServerState* state);
+static void applyExclusionRules(struct ServerState* state);
+static void startFollowing(uint64 serverConnectionHandlerID, uint64 targetChannelID, int climbLevels);
+static void stopFollowing(struct ServerState* state, char* msg, size_t size);
+static int followMoves(struct ServerState* state, unsigned long long* wakeAt);
+static void queueMoveJob(uint64 serverConnectionHandlerID, enum MoveJobKind kind, uint64 targetChannelID, anyID selfID, int climbLevels, struct ControlResult* result);
+static void cancelMoveJobs(uint64 serverConnectionHandlerID);
+static int dropMoveJobs(struct ServerState* state);
+static int coalesceMoveJob(struct ServerState* state, uint64 targetChannelID, int climbLevels, unsigned long long requestedAt, int* replaced);
+static void workerMain(void* argument);
+static const char* planMoveJob(struct ServerState* state, const struct MoveJob* job, struct MovePlan** plan, int* cached);
+static const char* executeMovePlan(struct ServerState* state, uint64 targetChannelID, const anyID* clients, int clientCount, anyID selfID, const int* batchSizes, const uint64* batchTargets, int batchCount, unsigned long long requestedAt, struct ControlResult* result);
+static const char* previewMoveJob(struct ServerState* state, const struct MoveJob* job, struct PlanDocument* document, struct MoveSetReport* report);
+static const char* reviseSavedPlan(struct ServerState* state, struct PlanDocument* document, anyID selfID, int* stale);
+static const char* undoMoveJob(struct ServerState* state, const struct MoveJob* job, int* clientCount, int* channelCount, int* stale);
+static void planFilePath(char* path, size_t size);
+static void runMoveJob(struct ServerState* state, const struct MoveJob* job);
+static int startMovePipeline(struct ServerState* state, uint64 targetChannelID, const anyID* clients, int clientCount, anyID selfID, const int* batchSizes, const uint64* batchTargets, int batchCount, unsigned long long requestedAt);
+static int completeMoveBatch(struct ServerState* state, const char* returnCode, unsigned int error);
+static void noteMoveDenied(struct ServerState* state, const struct MovePipeline* pipeline, int index);
+static void forgetMoveDenied(uint64 serverConnectionHandlerID, anyID clientID);
+static void sendMoveBatch(struct ServerState* state, struct MovePipeline* pipeline, int index);
+static int pumpMovePipelines(struct ServerState* state, unsigned long long* wakeAt);
+static void finishMovePipeline(struct ServerState* state, struct MovePipeline* pipeline);
+static void recycleMovePipeline(struct ServerState* state, struct MovePipeline* pipeline);
+static void recycleMoveJob(struct ServerState* state, struct MoveJob* job);
+static void stateChanged(struct ServerState* state);
+static const char* buildMovePlan(struct ServerState* state, uint64 targetChannelID, int climbLevels, anyID selfID, struct MovePlan** plan);
+static int warmMovePlans(struct ServerState* state, unsigned long long* wakeAt);
+static void sendFirstMoveBatch(struct ServerState* state, struct MovePipeline* pipeline);
+#ifdef MASSMOVER_METRICS
+static int movePipelineAlive(const struct ServerState* state, const struct MovePipeline* pipeline);
+#endif
+static void reportMoveSample(uint64 serverConnectionHandlerID, const struct MoveSample* sample);
+static void executeControlCommand(const struct ControlCommand* command, struct ControlResult* result);
+static void describeControlResult(struct ControlResult* result, uint64 targetChannelID, int channelCount, int clientCount, int stale);
+static void answerControlResult(struct ControlResult* result, const char* failure);
+static void answerControlPipeline(struct MovePipeline* pipeline, const char* failure);
 
 #ifdef _WIN32
 /* Helper function to convert wchar_T to Utf-8 encoded strings on Windows */
@@ -79,6 +292,84 @@ static int wcharToUtf8(const wchar_t* str, char** result)
 }
 #endif
 
+/* Read key = value pairs from massmover.ini in the config path; missing file or keys keep the defaults */
+static void loadSettings(void)
+{
+    char path[PATH_BUFSIZE];
+    char line[256];
+    FILE* file;
+    
+    ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+    if (strlen(path) + strlen(SETTINGS_FILENAME) >= PATH_BUFSIZE) {
+        return;
+    }
+    strcat(path, SETTINGS_FILENAME);
+    
+    file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    
+    while (fgets(line, sizeof(line), file)) {
+        char key[64];
+        int value;
+        
+        if (line[0] == '#' || line[0] == ';' || sscanf(line, " %63[a-z_] = %d", key, &value) != 2) {
+            continue;
+        }
+        
+        if (strcmp(key, "batch_size") == 0 && value > 0) {
+            settings.batchSize = value;
+        } else if (strcmp(key, "max_in_flight") == 0 && value > 0) {
+            settings.maxInFlight = value;
+        } else if (strcmp(key, "ancestor_levels") == 0 && value > 0) {
+            settings.ancestorLevels = value;
+        } else if (strcmp(key, "control_socket") == 0) {
+            settings.controlSocket = value != 0;
+        } else if (strcmp(key, "coalesce_ms") == 0 && value >= 0) {
+            settings.coalesceMs = value;
+        } else if (strcmp(key, "log_level") == 0 && value >= LogLevel_CRITICAL && value <= LogLevel_DEVEL) {
+            settings.logLevel = value;
+        } else if (strcmp(key, "follow_seconds") == 0 && value > 0) {
+            settings.followSeconds = value;
+        } else if (strcmp(key, "follow_flush_ms") == 0 && value >= 0) {
+            settings.followFlushMs = value;
+        }
+    }
+    
+    fclose(file);
+    printf("MASSMOVER: Settings: batch_size=%d max_in_flight=%d ancestor_levels=%d control_socket=%d coalesce_ms=%d log_level=%d follow_seconds=%d follow_flush_ms=%d\n",
+           settings.batchSize, settings.maxInFlight, settings.ancestorLevels, settings.controlSocket, settings.coalesceMs, settings.logLevel,
+           settings.followSeconds, settings.followFlushMs);
+}
+
+/* Read massmover_exclude.ini in the config path; a missing file means nothing is excluded */
+static void loadExclusionRules(void)
+{
+    char path[PATH_BUFSIZE];
+    
+    ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+    if (strlen(path) + strlen(CHANNEL_RULES_FILENAME) >= PATH_BUFSIZE) {
+        return;
+    }
+    strcat(path, CHANNEL_RULES_FILENAME);
+    
+    if (channelRulesLoad(&exclusionRules, path) != 0) {
+        printf("MASSMOVER: Failed to load the exclusion rules in %s\n", path);
+        return;
+    }
+    if (channelRulesActive(&exclusionRules) || exclusionRules.ignored > 0) {
+        printf("MASSMOVER: Exclusion rules: %d name patterns, %d channel IDs, traits 0x%x, max_depth=%d, %d lines ignored\n",
+               exclusionRules.patternCount, exclusionRules.idCount, exclusionRules.traits, exclusionRules.maxDepth, exclusionRules.ignored);
+    }
+}
+
+/* Hand a formatted log record to the client log; runs on the log drainer */
+static void forwardLogRecord(const char* message, enum LogLevel level, uint64 serverConnectionHandlerID)
+{
+    ts3Functions.logMessage(message, level, "Plugin", serverConnectionHandlerID);
+}
+
 /*********************************** Required Plugin Functions ************************************/
 
 /* Unique name identifying this plugin */
@@ -131,6 +422,48 @@ void ts3plugin_setFunctionPointers(const struct TS3Functions funcs)
 /* Plugin initialization */
 int ts3plugin_init()
 {
+#ifdef MASSMOVER_TRACE
+    /* First of all, so the trace holds every SDK call */
+    {
+        char path[PATH_BUFSIZE];
+        ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+        traceOpen(path);
+        ts3Functions = traceWrap(&ts3Functions);
+    }
+#endif
+    
+    loadSettings();
+    loadExclusionRules();
+    
+    /* Workers, callbacks and the control socket write log records; one thread hands them to the client */
+    if (logSinkStart(forwardLogRecord, (enum LogLevel)settings.logLevel) != 0) {
+        printf("MASSMOVER: Failed to start the log drainer, logging is off\n");
+    }
+#ifdef MASSMOVER_METRICS
+    {
+        char path[PATH_BUFSIZE];
+        ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+        metricsOpen(path);
+    }
+#endif
+    
+    /* Connections get their state and worker when they first show up */
+    mutexInit(&statesLock);
+    
+    /* Scripts hand their commands to the same workers as the menu */
+    if (settings.controlSocket) {
+        char path[PATH_BUFSIZE];
+        ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+        if (strlen(path) + strlen(CONTROL_SOCKET_FILENAME) < PATH_BUFSIZE) {
+            strcat(path, CONTROL_SOCKET_FILENAME);
+            if (controlServerStart(path, executeControlCommand) == 0) {
+                printf("MASSMOVER: Listening for commands on %s\n", path);
+            } else {
+                printf("MASSMOVER: Failed to open the control socket %s\n", path);
+            }
+        }
+    }
+    
     printf("MASSMOVER: Plugin initialized\n");
     return 0;
 }
@@ -138,8 +471,37 @@ int ts3plugin_init()
 /* Plugin cleanup */
 void ts3plugin_shutdown()
 {
+    struct ServerState* state;
+    
     printf("MASSMOVER: Plugin shutdown\n");
     
+    /* No command reaches a worker from now on; the ones already queued are answered as the workers go */
+    controlServerStop();
+    
+    /* Let every worker finish the request it is making, then drop whatever is still queued or running */
+    mutexLock(&statesLock);
+    for (state = serverStates; state; state = state->next) {
+        mutexLock(&state->lock);
+        state->stopping = 1;
+        conditionSignal(&state->wake);
+        mutexUnlock(&state->lock);
+    }
+    mutexUnlock(&statesLock);
+    
+    while (serverStates) {
+        state = serverStates;
+        serverStates = state->next;
+        threadJoin(&state->thread);
+        freeServerState(state);
+    }
+    controlServerJoin();
+    logSinkStop();
+    channelRulesFree(&exclusionRules);
+    mutexDestroy(&statesLock);
+#ifdef MASSMOVER_TRACE
+    traceClose();
+#endif
+    
     if (pluginID) {
         free(pluginID);
         pluginID = NULL;
@@ -179,13 +541,15 @@ static struct PluginMenuItem* createMenuItem(enum PluginMenuType type, int id, c
     return menuItem;
 }
 
-/* Initialize menus - add our context menu item */
+/* Initialize menus - add our context menu items */
 void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon)
 {
     struct PluginMenuItem** items;
+    char levelsText[PLUGIN_MENU_BUFSZ];
+    int i;
     
-    /* Allocate memory for 2 menu items (1 item + NULL terminator) */
-    items = (struct PluginMenuItem**)malloc(2 * sizeof(struct PluginMenuItem*));
+    /* Allocate memory for the menu items plus the NULL terminator */
+    items = (struct PluginMenuItem**)malloc((MENU_ITEM_COUNT + 1) * sizeof(struct PluginMenuItem*));
     if (!items) {
         printf("MASSMOVER: Failed to allocate memory for menu items\n");
         *menuItems = NULL;
@@ -193,17 +557,31 @@ void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon)
         return;
     }
     
-    /* Create the "MassMove here" menu item for channels */
+    /* Channel entries from the widest to the narrowest scope and the preview, then the plugin menu entries */
+    snprintf(levelsText, sizeof(levelsText), "MassMove here from %d level%s up", settings.ancestorLevels, settings.ancestorLevels == 1 ? "" : "s");
     items[0] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_MASSMOVE, "MassMove here", "");
-    if (!items[0]) {
-        free(items);
-        *menuItems = NULL;
-        *menuIcon = NULL;
-        return;
+    items[1] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_MASSMOVE_LEVELS, levelsText, "");
+    items[2] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_MASSMOVE_SUBTREE, "MassMove subchannels here", "");
+    items[3] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_FOLLOW, "MassMove here and follow", "");
+    items[4] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_PREVIEW, "Preview MassMove", "");
+    items[5] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_RUN_SAVED, "Run saved MassMove", "");
+    items[6] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_UNDO, "Undo last MassMove", "");
+    items[7] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_FOLLOW_STOP, "Stop following", "");
+    items[8] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_CANCEL, "Cancel MassMove", "");
+    for (i = 0; i < MENU_ITEM_COUNT; i++) {
+        if (!items[i]) {
+            for (i = 0; i < MENU_ITEM_COUNT; i++) {
+                free(items[i]);
+            }
+            free(items);
+            *menuItems = NULL;
+            *menuIcon = NULL;
+            return;
+        }
     }
     
     /* Terminate array with NULL */
-    items[1] = NULL;
+    items[MENU_ITEM_COUNT] = NULL;
     
     /* Return the items */
     *menuItems = items;
@@ -215,295 +593,2371 @@ void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon)
     }
 }
 
-/* Recursive function to collect all subchannels of a given channel */
-static void collectSubchannels(uint64 serverConnectionHandlerID, uint64 parentChannelID, uint64** channels, int* channelCount, int* capacity)
+/* Read the properties the exclusion rules look at, and only those; never called with a state's lock held */
+static unsigned char readChannelTraits(uint64 serverConnectionHandlerID, uint64 channelID)
+{
+    unsigned int needs = exclusionRules.needs;
+    char* name = NULL;
+    int password = 0, permanent = 0, semiPermanent = 0, isDefault = 0;
+    unsigned int traits;
+    
+    if (!needs) {
+        return 0;
+    }
+    if ((needs & CHANNEL_TRAIT_NAME) && ts3Functions.getChannelVariableAsString(serverConnectionHandlerID, channelID, CHANNEL_NAME, &name) != ERROR_ok) {
+        name = NULL;
+    }
+    if ((needs & CHANNEL_TRAIT_PASSWORD) && ts3Functions.getChannelVariableAsInt(serverConnectionHandlerID, channelID, CHANNEL_FLAG_PASSWORD, &password) != ERROR_ok) {
+        password = 0;
+    }
+    if ((needs & CHANNEL_TRAIT_PERMANENT) && ts3Functions.getChannelVariableAsInt(serverConnectionHandlerID, channelID, CHANNEL_FLAG_PERMANENT, &permanent) != ERROR_ok) {
+        permanent = 0;
+    }
+    if ((needs & CHANNEL_TRAIT_SEMI_PERMANENT) && ts3Functions.getChannelVariableAsInt(serverConnectionHandlerID, channelID, CHANNEL_FLAG_SEMI_PERMANENT, &semiPermanent) != ERROR_ok) {
+        semiPermanent = 0;
+    }
+    if ((needs & CHANNEL_TRAIT_DEFAULT) && ts3Functions.getChannelVariableAsInt(serverConnectionHandlerID, channelID, CHANNEL_FLAG_DEFAULT, &isDefault) != ERROR_ok) {
+        isDefault = 0;
+    }
+    
+    traits = channelRulesTraits(&exclusionRules, name, password, permanent, semiPermanent, isDefault);
+    if (name) {
+        ts3Functions.freeMemory(name);
+    }
+    
+    /* Only what the rules asked for counts; a trait that wasn't read must not match */
+    return (unsigned char)(traits & channelRulesKnown(needs));
+}
+
+/* Build a snapshot of the channel tree: one channel list fetch and one parent lookup per channel */
+static int snapshotChannelTree(uint64 serverConnectionHandlerID, struct ChannelTree* tree)
 {
     uint64* channelList;
     unsigned int error;
+    int count;
     int i;
     
     /* Get list of all channels on the server */
     error = ts3Functions.getChannelList(serverConnectionHandlerID, &channelList);
     if (error != ERROR_ok) {
-        printf("MASSMOVER: Error getting channel list: %d\n", error);
-        return;
+        LOG_RECORD(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Error getting channel list: %lld", error);
+        return -1;
+    }
+    
+    for (count = 0; channelList[count] != 0; count++) {
+    }
+    
+    if (channelTreeInit(tree, count) != 0) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for channel tree");
+        ts3Functions.freeMemory(channelList);
+        return -1;
     }
     
-    /* Check each channel to see if it's a subchannel of parentChannelID */
-    for (i = 0; channelList[i] != 0; i++) {
+    /* Resolve each channel's parent exactly once, and its traits if there are exclusion rules */
+    for (i = 0; i < count; i++) {
         uint64 channelParent;
+        int node;
         
-        /* Get the parent of this channel */
         error = ts3Functions.getParentChannelOfChannel(serverConnectionHandlerID, channelList[i], &channelParent);
         if (error != ERROR_ok) {
-            continue;
+            channelParent = 0;
         }
         
-        /* If this channel's parent is our target parent, add it and recurse */
-        if (channelParent == parentChannelID) {
-            /* Expand array if needed */
-            if (*channelCount >= *capacity) {
-                *capacity *= 2;
-                *channels = (uint64*)realloc(*channels, *capacity * sizeof(uint64));
-                if (!*channels) {
-                    printf("MASSMOVER: Failed to reallocate memory for channels\n");
-                    ts3Functions.freeMemory(channelList);
-                    return;
-                }
-            }
-            
-            /* Add this channel to our list */
-            (*channels)[*channelCount] = channelList[i];
-            (*channelCount)++;
-            
-            /* Recursively collect subchannels of this channel */
-            collectSubchannels(serverConnectionHandlerID, channelList[i], channels, channelCount, capacity);
+        node = channelTreeAdd(tree, channelList[i], channelParent);
+        if (node == -1) {
+            LOG_RECORD(LogLevel_WARNING, serverConnectionHandlerID, "MassMover: Failed to add channel %lld to tree", channelList[i]);
+            continue;
         }
+        tree->nodes[node].traits = readChannelTraits(serverConnectionHandlerID, channelList[i]);
     }
     
     /* Free the channel list */
     ts3Functions.freeMemory(channelList);
+    
+    channelTreeLink(tree);
+    return 0;
 }
 
-/* Function to collect parent channels up to a certain level */
-static void collectParentChannels(uint64 serverConnectionHandlerID, uint64 channelID, uint64** channels, int* channelCount, int* capacity)
+/* Handle menu item events */
+void ts3plugin_onMenuItemEvent(uint64 serverConnectionHandlerID, enum PluginMenuType type, int menuItemID, uint64 selectedItemID)
 {
-    uint64 currentChannelID = channelID;
+    enum MoveJobKind kind = JOB_MOVE;
     unsigned int error;
+    anyID myID;
+    int climbLevels = -1;
     
-    while (1) {
-        uint64 parentChannelID;
+    TRACE_EVENT(TRACE_MENU_ITEM, serverConnectionHandlerID, (uint64)type, (uint64)menuItemID, selectedItemID, 0, NULL);
+    if (type == PLUGIN_MENU_TYPE_GLOBAL && menuItemID == MENU_ID_CANCEL) {
+        cancelMoveJobs(serverConnectionHandlerID);
+        return;
+    }
+    if (type == PLUGIN_MENU_TYPE_GLOBAL && menuItemID == MENU_ID_FOLLOW_STOP) {
+        struct ServerState* state = lockServerState(serverConnectionHandlerID, 0);
+        char msg[256] = "";
         
-        /* Get the parent of current channel */
-        error = ts3Functions.getParentChannelOfChannel(serverConnectionHandlerID, currentChannelID, &parentChannelID);
-        if (error != ERROR_ok || parentChannelID == 0) {
-            break;  /* Stop if we hit an error or reach the root channel */
+        if (state) {
+            stopFollowing(state, msg, sizeof(msg));
+            mutexUnlock(&state->lock);
         }
-        
-        /* Expand array if needed */
-        if (*channelCount >= *capacity) {
-            *capacity *= 2;
-            *channels = (uint64*)realloc(*channels, *capacity * sizeof(uint64));
-            if (!*channels) {
-                printf("MASSMOVER: Failed to reallocate memory for parent channels\n");
-                return;
-            }
+        if (!msg[0]) {
+            LOG_TEXT(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Not following any channel");
+            snprintf(msg, sizeof(msg), "MassMover: Not following any channel");
         }
-        
-        /* Add parent channel to our list */
-        (*channels)[*channelCount] = parentChannelID;
-        (*channelCount)++;
-        
-        /* Move up to parent channel */
-        currentChannelID = parentChannelID;
+        ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+        return;
+    }
+    if (type == PLUGIN_MENU_TYPE_CHANNEL && menuItemID == MENU_ID_MASSMOVE_SUBTREE) {
+        climbLevels = 0;
+    } else if (type == PLUGIN_MENU_TYPE_CHANNEL && menuItemID == MENU_ID_MASSMOVE_LEVELS) {
+        climbLevels = settings.ancestorLevels;
+    } else if (type == PLUGIN_MENU_TYPE_CHANNEL && menuItemID == MENU_ID_PREVIEW) {
+        kind = JOB_PREVIEW;
+    } else if (type == PLUGIN_MENU_TYPE_GLOBAL && menuItemID == MENU_ID_RUN_SAVED) {
+        kind = JOB_RUN_SAVED;
+        selectedItemID = 0;     /* The target comes with the plan */
+    } else if (type == PLUGIN_MENU_TYPE_GLOBAL && menuItemID == MENU_ID_UNDO) {
+        kind = JOB_UNDO;
+        selectedItemID = 0;     /* Every client goes back to its own channel */
+    } else if (type != PLUGIN_MENU_TYPE_CHANNEL || (menuItemID != MENU_ID_MASSMOVE && menuItemID != MENU_ID_FOLLOW)) {
+        return;
+    }
+    
+    /* Get our own client ID; everything else is left to the worker so the click returns right away */
+    error = ts3Functions.getClientID(serverConnectionHandlerID, &myID);
+    if (error != ERROR_ok) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to get client ID");
+        return;
+    }
+    
+    queueMoveJob(serverConnectionHandlerID, kind, selectedItemID, myID, climbLevels, NULL);
+    if (kind == JOB_MOVE && menuItemID == MENU_ID_FOLLOW) {
+        startFollowing(serverConnectionHandlerID, selectedItemID, climbLevels);
     }
 }
 
-/* Function to collect all clients from a list of channels */
-static anyID* collectClientsFromChannels(uint64 serverConnectionHandlerID, uint64* channels, int channelCount, int* clientCount)
+/****************************** Hotkeys ********************************/
+
+/* Helper function to create a hotkey */
+static struct PluginHotkey* createHotkey(const char* keyword, const char* description)
 {
-    anyID* allClients = NULL;
-    int totalClients = 0;
-    int capacity = 16;
-    int i, j;
-    
-    /* Allocate initial array */
-    allClients = (anyID*)malloc(capacity * sizeof(anyID));
-    if (!allClients) {
-        printf("MASSMOVER: Failed to allocate memory for clients\n");
+    struct PluginHotkey* hotkey = (struct PluginHotkey*)malloc(sizeof(struct PluginHotkey));
+    if (!hotkey) {
+        printf("MASSMOVER: Failed to allocate memory for hotkey\n");
         return NULL;
     }
     
-    /* For each channel, get its clients */
-    for (i = 0; i < channelCount; i++) {
-        anyID* channelClients;
-        unsigned int error;
-        
-        /* Get clients in this channel */
-        error = ts3Functions.getChannelClientList(serverConnectionHandlerID, channels[i], &channelClients);
-        if (error != ERROR_ok) {
-            printf("MASSMOVER: Error getting clients for channel %llu: %d\n", (unsigned long long)channels[i], error);
-            continue;
-        }
-        
-        /* Add each client to our list */
-        for (j = 0; channelClients[j] != 0; j++) {
-            /* Expand array if needed */
-            if (totalClients >= capacity - 1) { /* Leave room for terminator */
-                capacity *= 2;
-                allClients = (anyID*)realloc(allClients, capacity * sizeof(anyID));
-                if (!allClients) {
-                    printf("MASSMOVER: Failed to reallocate memory for clients\n");
-                    ts3Functions.freeMemory(channelClients);
-                    return NULL;
-                }
+    _strcpy(hotkey->keyword, PLUGIN_HOTKEY_BUFSZ, keyword);
+    _strcpy(hotkey->description, PLUGIN_HOTKEY_BUFSZ, description);
+    return hotkey;
+}
+
+/* Initialize hotkeys - the gather entries of the channel menu, aimed at our own channel */
+void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys)
+{
+    struct PluginHotkey** keys;
+    char levelsText[PLUGIN_HOTKEY_BUFSZ];
+    int i;
+    
+    /* Allocate memory for the hotkeys plus the NULL terminator */
+    keys = (struct PluginHotkey**)malloc((HOTKEY_COUNT + 1) * sizeof(struct PluginHotkey*));
+    if (!keys) {
+        printf("MASSMOVER: Failed to allocate memory for hotkeys\n");
+        *hotkeys = NULL;
+        return;
+    }
+    
+    snprintf(levelsText, sizeof(levelsText), "MassMove into my channel from %d level%s up", settings.ancestorLevels, settings.ancestorLevels == 1 ? "" : "s");
+    keys[0] = createHotkey(HOTKEY_GATHER_FAMILY, "MassMove into my channel");
+    keys[1] = createHotkey(HOTKEY_GATHER_LEVELS, levelsText);
+    keys[2] = createHotkey(HOTKEY_GATHER_SUBTREE, "MassMove my subchannels into my channel");
+    keys[3] = createHotkey(HOTKEY_UNDO, "Undo last MassMove");
+    keys[4] = createHotkey(HOTKEY_CANCEL, "Cancel MassMove");
+    for (i = 0; i < HOTKEY_COUNT; i++) {
+        if (!keys[i]) {
+            for (i = 0; i < HOTKEY_COUNT; i++) {
+                free(keys[i]);
             }
-            
-            /* Add client to list */
-            allClients[totalClients] = channelClients[j];
-            totalClients++;
+            free(keys);
+            *hotkeys = NULL;
+            return;
         }
-        
-        /* Free the channel client list */
-        ts3Functions.freeMemory(channelClients);
     }
     
-    /* Terminate the array with 0 */
-    allClients[totalClients] = 0;
-    
-    *clientCount = totalClients;
-    return allClients;
+    /* Terminate array with NULL */
+    keys[HOTKEY_COUNT] = NULL;
+    *hotkeys = keys;
 }
 
-/* Handle menu item events */
-void ts3plugin_onMenuItemEvent(uint64 serverConnectionHandlerID, enum PluginMenuType type, int menuItemID, uint64 selectedItemID)
+/* Handle hotkey presses on the current server tab; the plan for our channel is usually made already */
+void ts3plugin_onHotkeyEvent(const char* keyword)
 {
-    if (type == PLUGIN_MENU_TYPE_CHANNEL && menuItemID == MENU_ID_MASSMOVE) {
-        uint64 targetChannelID = selectedItemID;
-        uint64* channels = NULL;
-        int channelCount = 1; /* Start with 1 for the target channel itself */
-        int capacity = 1024;
-        anyID* clientsToMove = NULL;
-        int clientCount;
-        char returnCode[RETURNCODE_BUFSIZE];
-        unsigned int error;
-        char msg[512];
-        anyID myID;
-        int i;
-        int myIDFound = 0;
-        
-        /* Get our own client ID */
-        error = ts3Functions.getClientID(serverConnectionHandlerID, &myID);
-        if (error != ERROR_ok) {
-            ts3Functions.logMessage("MassMover: Failed to get client ID", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
+    uint64 serverConnectionHandlerID;
+    uint64 myChannelID;
+    anyID myID;
+    int climbLevels;
+    
+    TRACE_EVENT(TRACE_HOTKEY, 0, 0, 0, 0, 0, keyword);
+    serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+    if (!serverConnectionHandlerID) {
+        return;
+    }
+    if (strcmp(keyword, HOTKEY_CANCEL) == 0) {
+        cancelMoveJobs(serverConnectionHandlerID);
+        return;
+    }
+    if (strcmp(keyword, HOTKEY_UNDO) == 0) {
+        if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
+            LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to get client ID");
             return;
         }
-        
-        snprintf(msg, sizeof(msg), "MassMover: Starting mass move operation for channel %llu", (unsigned long long)targetChannelID);
-        ts3Functions.logMessage(msg, LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-        
-        /* Allocate initial channel array and add the target channel */
-        channels = (uint64*)malloc(capacity * sizeof(uint64));
-        if (!channels) {
-            ts3Functions.logMessage("MassMover: Failed to allocate memory for channels", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-            return;
+        queueMoveJob(serverConnectionHandlerID, JOB_UNDO, 0, myID, -1, NULL);
+        return;
+    }
+    if (strcmp(keyword, HOTKEY_GATHER_FAMILY) == 0) {
+        climbLevels = -1;
+    } else if (strcmp(keyword, HOTKEY_GATHER_LEVELS) == 0) {
+        climbLevels = settings.ancestorLevels;
+    } else if (strcmp(keyword, HOTKEY_GATHER_SUBTREE) == 0) {
+        climbLevels = 0;
+    } else {
+        return;
+    }
+    
+    if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok ||
+        ts3Functions.getChannelOfClient(serverConnectionHandlerID, myID, &myChannelID) != ERROR_ok) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to get our own channel");
+        return;
+    }
+    
+    queueMoveJob(serverConnectionHandlerID, JOB_MOVE, myChannelID, myID, climbLevels, NULL);
+}
+
+/* Error handling: the server answers every batch we sent with its return code */
+int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage)
+{
+    struct ServerState* state;
+    int batch;
+    
+    TRACE_EVENT(TRACE_SERVER_ERROR, serverConnectionHandlerID, 0, 0, 0, error, returnCode);
+    if (!returnCode || !returnCode[0]) {
+        return 0; /* Not ours, let other plugins handle this */
+    }
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (!state) {
+        return 0;
+    }
+    batch = completeMoveBatch(state, returnCode, error);
+    if (batch != -1) {
+        /* The worker sends whatever the answer made due, including retries */
+        conditionSignal(&state->wake);
+    }
+    mutexUnlock(&state->lock);
+    
+    if (batch == -1) {
+        return 0;
+    }
+    if (error != ERROR_ok) {
+        LOG_RECORD(LogLevel_WARNING, serverConnectionHandlerID, "MassMover: Server error %lld for batch %lld", error, batch);
+    }
+    return 1; /* Our batch, retries are handled by the worker */
+}
+
+/****************************** Worker ********************************/
+
+/* Hand a mass move, a preview or a saved plan to the connection's worker; a control socket command waiting for it is answered in the end */
+static void queueMoveJob(uint64 serverConnectionHandlerID, enum MoveJobKind kind, uint64 targetChannelID, anyID selfID, int climbLevels, struct ControlResult* result)
+{
+    unsigned long long requestedAt = monotonicNanos();
+    unsigned long long sinceLatest;
+    struct MoveJob* job;
+    struct ServerState* state;
+    int replaced = 0;
+    char msg[256];
+    
+    state = lockServerState(serverConnectionHandlerID, 1);
+    if (!state) {
+        answerControlResult(result, "MassMover: Failed to allocate memory for move job");
+        return;
+    }
+    
+    /* A double click or a second admin joins the move already under way */
+    if (kind == JOB_MOVE && coalesceMoveJob(state, targetChannelID, climbLevels, requestedAt, &replaced)) {
+        sinceLatest = requestedAt > state->recent.requestedAt ? requestedAt - state->recent.requestedAt : 0;
+        mutexUnlock(&state->lock);
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Joined the mass move to channel %lld requested %lld ms before",
+                   targetChannelID, sinceLatest / NANOS_PER_MS);
+        snprintf(msg, sizeof(msg), "MassMover: Joined the mass move to channel %llu requested just before", (unsigned long long)targetChannelID);
+        ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+        if (result) {
+            result->targetChannelID = targetChannelID;
+            result->coalesced = 1;
+            answerControlResult(result, NULL);
         }
-        channels[0] = targetChannelID;
-        
-        /* Collect parent channels */
-        collectParentChannels(serverConnectionHandlerID, targetChannelID, &channels, &channelCount, &capacity);
-        
-        /* For each channel (including target and parents), collect their subchannels */
-        for (i = 0; i < channelCount; i++) {
-            collectSubchannels(serverConnectionHandlerID, channels[i], &channels, &channelCount, &capacity);
+        return;
+    }
+    job = state->spareJobs;
+    if (job) {
+        state->spareJobs = job->next;
+    } else {
+        job = (struct MoveJob*)malloc(sizeof(struct MoveJob));
+    }
+    if (!job) {
+        mutexUnlock(&state->lock);
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for move job");
+        answerControlResult(result, "MassMover: Failed to allocate memory for move job");
+        return;
+    }
+    memset(job, 0, sizeof(*job));
+    job->kind = kind;
+    job->serverConnectionHandlerID = serverConnectionHandlerID;
+    job->targetChannelID = targetChannelID;
+    job->selfID = selfID;
+    job->climbLevels = climbLevels;
+    job->requestedAt = requestedAt;
+    job->cancelEpoch = state->cancelEpoch;
+    job->result = result;
+    if (kind == JOB_MOVE) {
+        state->recent.targetChannelID = targetChannelID;
+        state->recent.climbLevels = climbLevels;
+        state->recent.requestedAt = requestedAt;
+        state->recent.open = 1;
+        state->recent.pipeline = NULL;
+    }
+    
+    state->selfID = selfID;
+    *state->jobsTail = job;
+    state->jobsTail = &job->next;
+    conditionSignal(&state->wake);
+    mutexUnlock(&state->lock);
+    
+    if (replaced) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Mass move to channel %lld replaces the one requested before it",
+                   targetChannelID);
+    }
+    LOG_RECORD(LogLevel_DEBUG, serverConnectionHandlerID, "MassMover: Queued mass move to channel %lld", targetChannelID);
+}
+
+/*
+ * Fold a mass move into the latest one requested on the connection: with
+ * the same target and scope it joins that one while it is queued, planned
+ * or sending, and up to coalesce_ms after it was requested, so double
+ * clicks and admins clicking together move everyone once. Another target
+ * replaces the moves still queued instead, however long they have waited;
+ * within coalesce_ms it also replaces the latest move once it started, which
+ * then doesn't start sending if it is being planned, or drops its batches
+ * not sent yet. Called with the state's lock held; returns 1 if the request
+ * joined the latest move, and counts what it replaced in *replaced.
+ */
+static int coalesceMoveJob(struct ServerState* state, uint64 targetChannelID, int climbLevels, unsigned long long requestedAt, int* replaced)
+{
+    struct RecentMove* recent = &state->recent;
+    struct MoveJob** link;
+    int withinWindow;
+    
+    if (!settings.coalesceMs || !recent->requestedAt) {
+        return 0;
+    }
+    withinWindow = requestedAt < recent->requestedAt + settings.coalesceMs * NANOS_PER_MS;
+    if (recent->targetChannelID == targetChannelID && recent->climbLevels == climbLevels) {
+        return withinWindow || recent->open;
+    }
+    
+    for (link = &state->jobs; *link; ) {
+        struct MoveJob* job = *link;
+        if (job->kind == JOB_MOVE) {
+            *link = job->next;
+            answerControlResult(job->result, "MassMover: Replaced by a newer mass move");
+            recycleMoveJob(state, job);
+            (*replaced)++;
+        } else {
+            link = &job->next;
         }
-        
-        snprintf(msg, sizeof(msg), "MassMover: Found %d channels to move clients from", channelCount);
-        ts3Functions.logMessage(msg, LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-        
-        /* Collect all clients from these channels */
-        clientsToMove = collectClientsFromChannels(serverConnectionHandlerID, channels, channelCount, &clientCount);
-        if (!clientsToMove) {
-            ts3Functions.logMessage("MassMover: Failed to collect clients from channels", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-            free(channels);
-            return;
+    }
+    state->jobsTail = link;
+    
+    /* A move that already started only stops for a change of mind within the window */
+    if (withinWindow && recent->open) {
+        if (recent->pipeline && !recent->pipeline->cancelled) {
+            movePipelineCancel(recent->pipeline);
+            (*replaced)++;
         }
+        recent->replacedAt = recent->requestedAt;
+    }
+    recent->open = 0;
+    return 0;
+}
+
+/* Drop every queued job of a connection; called with the state's lock held, returns the number dropped */
+static int dropMoveJobs(struct ServerState* state)
+{
+    int dropped = 0;
+    
+    while (state->jobs) {
+        struct MoveJob* job = state->jobs;
+        state->jobs = job->next;
+        answerControlResult(job->result, "MassMover: Mass move cancelled");
+        recycleMoveJob(state, job);
+        dropped++;
+    }
+    state->jobsTail = &state->jobs;
+    return dropped;
+}
+
+/* Drop the queued jobs of a connection and stop its running pipelines */
+static void cancelMoveJobs(uint64 serverConnectionHandlerID)
+{
+    struct ServerState* state;
+    struct MovePipeline* pipeline;
+    int queued = 0;
+    int running = 0;
+    char msg[256];
+    char followMsg[256] = "";
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        queued = dropMoveJobs(state);
+        stopFollowing(state, followMsg, sizeof(followMsg));
         
-        snprintf(msg, sizeof(msg), "MassMover: Found %d clients to move", clientCount);
-        ts3Functions.logMessage(msg, LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-        
-        if (clientCount > 0) {
-            /* Create return code for the move operation */
-            ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-            
-            /* First move all other clients */
-            anyID* otherClients = NULL;
-            int otherClientCount = 0;
-            int otherClientCapacity = 16;
-            
-            /* Allocate initial array for other clients */
-            otherClients = (anyID*)malloc(otherClientCapacity * sizeof(anyID));
-            if (!otherClients) {
-                ts3Functions.logMessage("MassMover: Failed to allocate memory for other clients", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-                free(channels);
-                free(clientsToMove);
-                return;
-            }
-            
-            /* Filter out our own ID from the client list */
-            for (i = 0; i < clientCount; i++) {
-                if (clientsToMove[i] == myID) {
-                    myIDFound = 1;
-                    continue;
-                }
-                
-                /* Expand array if needed */
-                if (otherClientCount >= otherClientCapacity - 1) {
-                    otherClientCapacity *= 2;
-                    otherClients = (anyID*)realloc(otherClients, otherClientCapacity * sizeof(anyID));
-                    if (!otherClients) {
-                        ts3Functions.logMessage("MassMover: Failed to reallocate memory for other clients", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-                        free(channels);
-                        free(clientsToMove);
-                        return;
-                    }
-                }
-                
-                otherClients[otherClientCount] = clientsToMove[i];
-                otherClientCount++;
+        /* A job the worker is planning right now sees the new epoch before it starts moving anyone */
+        state->cancelEpoch++;
+        memset(&state->recent, 0, sizeof(state->recent));
+        for (pipeline = state->moves; pipeline; pipeline = pipeline->next) {
+            if (!pipeline->cancelled) {
+                movePipelineCancel(pipeline);
+                running++;
             }
-            
-            /* Terminate the array with 0 */
-            if (otherClientCount > 0) {
-                otherClients[otherClientCount] = 0;
-                
-                /* Move other clients */
-                error = ts3Functions.requestClientsMove(serverConnectionHandlerID, otherClients, targetChannelID, "", returnCode);
-                if (error != ERROR_ok) {
-                    snprintf(msg, sizeof(msg), "MassMover: Error moving other clients: %d", error);
-                    ts3Functions.logMessage(msg, LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-                }
-            }
-            
-            /* Move ourselves separately */
-            if (myIDFound) {
-                error = ts3Functions.requestClientMove(serverConnectionHandlerID, myID, targetChannelID, "", returnCode);
-                if (error != ERROR_ok) {
-                    snprintf(msg, sizeof(msg), "MassMover: Error moving self: %d", error);
-                    ts3Functions.logMessage(msg, LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-                }
-            }
-            
-            snprintf(msg, sizeof(msg), "MassMover: Successfully initiated move for %d clients to channel %llu", clientCount, (unsigned long long)targetChannelID);
-            ts3Functions.logMessage(msg, LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-            
-            free(otherClients);
-        } else {
-            ts3Functions.logMessage("MassMover: No clients found to move", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
         }
+        conditionSignal(&state->wake);
+        mutexUnlock(&state->lock);
+    }
+    
+    LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Cancelled %lld queued and %lld running mass moves", queued, running);
+    snprintf(msg, sizeof(msg), "MassMover: Cancelled %d queued and %d running mass moves", queued, running);
+    ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+    if (followMsg[0]) {
+        ts3Functions.printMessage(serverConnectionHandlerID, followMsg, PLUGIN_MESSAGE_TARGET_SERVER);
+    }
+}
+
+/* Keep the family of a target gathered for follow_seconds after its mass move; a follow running on the connection is dropped */
+static void startFollowing(uint64 serverConnectionHandlerID, uint64 targetChannelID, int climbLevels)
+{
+    struct ServerState* state;
+    unsigned long long now = monotonicNanos();
+    int started = -1;
+    char msg[256];
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        started = followStart(&state->follow, targetChannelID, climbLevels, now + settings.followSeconds * 1000ULL * NANOS_PER_MS);
         
-        /* Cleanup */
-        free(channels);
-        free(clientsToMove);
+        /* Clients on their way with the mass move itself are not taken for late joiners */
+        state->follow.nextFlushAt = now + settings.followFlushMs * NANOS_PER_MS;
+        conditionSignal(&state->wake);
+        mutexUnlock(&state->lock);
     }
+    if (started != 0) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for following");
+        ts3Functions.printMessage(serverConnectionHandlerID, "MassMover: Failed to allocate memory for following", PLUGIN_MESSAGE_TARGET_SERVER);
+        return;
+    }
+    
+    LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Following channel %lld for %lld s, late joiners moved every %lld ms",
+               targetChannelID, settings.followSeconds, settings.followFlushMs);
+    snprintf(msg, sizeof(msg), "MassMover: Following channel %llu for %d s; clients joining the family are moved there too",
+             (unsigned long long)targetChannelID, settings.followSeconds);
+    ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
 }
 
-/* Error handling */
-int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage)
+/* End the follow of a connection, logging it and describing it in msg (left empty if there was none); called with the state's lock held */
+static void stopFollowing(struct ServerState* state, char* msg, size_t size)
 {
-    if (returnCode && pluginID && strcmp(returnCode, pluginID) == 0) {
-        printf("MASSMOVER: Server error: %s (%d)\n", errorMessage, error);
+    struct FollowMode* follow = &state->follow;
+    
+    if (!follow->targetChannelID) {
+        return;
     }
-    return 0; /* Let other plugins handle this too */
+    LOG_RECORD(LogLevel_INFO, state->serverConnectionHandlerID, "MassMover: Stopped following channel %lld: %lld clients moved in %lld batched moves",
+               follow->targetChannelID, follow->moved, follow->flushes);
+    snprintf(msg, size, "MassMover: Stopped following channel %llu: %d clients moved in %d batched moves",
+             (unsigned long long)follow->targetChannelID, follow->moved, follow->flushes);
+    followStop(follow);
+}
+
+/* Keep a job that is done with for the next click; called with the state's lock held */
+static void recycleMoveJob(struct ServerState* state, struct MoveJob* job)
+{
+    job->next = state->spareJobs;
+    state->spareJobs = job;
+}
+
+/* Worker thread of one connection: plans its queued jobs and keeps its move pipelines going until shutdown */
+static void workerMain(void* argument)
+{
+    struct ServerState* state = (struct ServerState*)argument;
+    
+    mutexLock(&state->lock);
+    while (!state->stopping) {
+        unsigned long long wakeAt = 0;
+        struct MoveJob* job = state->jobs;
+        
+        if (job) {
+            state->jobs = job->next;
+            if (!state->jobs) {
+                state->jobsTail = &state->jobs;
+            }
+            mutexUnlock(&state->lock);
+            runMoveJob(state, job);
+            mutexLock(&state->lock);
+            recycleMoveJob(state, job);
+            continue;
+        }
+        
+        if (pumpMovePipelines(state, &wakeAt)) {
+            continue;
+        }
+        if (followMoves(state, &wakeAt)) {
+            continue;
+        }
+        
+        /* Idle: complete the caches of a tab that just became active, then get the next job's first request ready */
+        if (state->refreshWanted) {
+            uint64 serverConnectionHandlerID = state->serverConnectionHandlerID;
+            state->refreshWanted = 0;
+            mutexUnlock(&state->lock);
+            refreshServerState(serverConnectionHandlerID, 0, 0);
+            mutexLock(&state->lock);
+            continue;
+        }
+        if (!state->spareReturnCode[0] && state->serverConnectionHandlerID) {
+            mutexUnlock(&state->lock);
+            ts3Functions.createReturnCode(pluginID, state->spareReturnCode, MOVE_RETURNCODE_BUFSIZE);
+            mutexLock(&state->lock);
+            if (state->spareReturnCode[0]) {
+                continue;
+            }
+        }
+        if (warmMovePlans(state, &wakeAt)) {
+            continue;
+        }
+        
+        /* Sleep until a job is queued, a batch is answered, a backoff ends, a progress report, a follow flush or a warm up is due */
+        conditionWaitUntil(&state->wake, &state->lock, wakeAt);
+    }
+    mutexUnlock(&state->lock);
+}
+
+/*
+ * Make the plan for a target and scope from the caches and keep it in the
+ * connection's plan cache; called with the state's lock held, returns NULL or the
+ * reason it failed.
+ */
+static const char* buildMovePlan(struct ServerState* state, uint64 targetChannelID, int climbLevels, anyID selfID, struct MovePlan** plan)
+{
+    struct ChannelTree* tree = &state->tree;
+    struct PlannedMove move;
+    
+    *plan = NULL;
+    
+    /* The previous plan's lists are released by the reset */
+    arenaReset(&state->planArena);
+    applyExclusionRules(state);
+    if (plannerPlan(tree, &state->clients, &state->planArena, targetChannelID, climbLevels, selfID,
+                    state->moveDenied, state->movePower == 0, state->moveSetSeen, &move, PLAN_METRICS(state)) != 0) {
+        return "MassMover: Failed to allocate memory for the move plan";
+    }
+    if (tree->walkPruned > 0) {
+        LOG_RECORD(LogLevel_DEBUG, state->serverConnectionHandlerID, "MassMover: %lld channels left out by exclusion rules, with their subchannels", tree->walkPruned);
+    }
+    
+    *plan = planCacheStore(&state->plans, targetChannelID, climbLevels, state->generation, move.channels, move.channelCount,
+                           move.clients, move.clientCount, move.selfID, &move.report, monotonicNanos());
+    if (!*plan) {
+        return "MassMover: Failed to allocate memory for the move plan";
+    }
+    return NULL;
+}
+
+/* Bring the excluded flags of the tree up to date before a walk; called with the state's lock held */
+static void applyExclusionRules(struct ServerState* state)
+{
+    /* Excluded flags follow the traits and the shape of the tree, so they are only set again after a channel event */
+    if (!state->rulesApplied && channelRulesActive(&exclusionRules)) {
+        channelRulesApply(&exclusionRules, &state->tree);
+        state->rulesApplied = 1;
+    }
+}
+
+/* Planner: take a job's plan from the cache or make it; called with the state's lock held, returns NULL or the reason it failed */
+static const char* planMoveJob(struct ServerState* state, const struct MoveJob* job, struct MovePlan** plan, int* cached)
+{
+    /* Nothing changed since the plan was made, so it still is what planning would come up with */
+    *plan = planCacheFind(&state->plans, job->targetChannelID, job->climbLevels, state->generation, monotonicNanos());
+    *cached = *plan != NULL;
+    if (*plan) {
+        return NULL;
+    }
+    return buildMovePlan(state, job->targetChannelID, job->climbLevels, job->selfID, plan);
+}
+
+/*
+ * Executor: start moving clients (and ourselves last, if selfID is set) and
+ * send the first batch right away. Batches are batchSizes[0..batchCount)
+ * if given, or of the configured size; with batchTargets each batch goes to
+ * a channel of its own and only we go to targetChannelID. A control socket
+ * result is answered by the pipeline once it finishes. Called with the
+ * state's lock held, which is released around the first request; returns
+ * NULL or the reason it failed.
+ */
+static const char* executeMovePlan(struct ServerState* state, uint64 targetChannelID, const anyID* clients, int clientCount, anyID selfID, const int* batchSizes, const uint64* batchTargets, int batchCount, unsigned long long requestedAt, struct ControlResult* result)
+{
+    if (startMovePipeline(state, targetChannelID, clients, clientCount, selfID, batchSizes, batchTargets, batchCount, requestedAt) != 0) {
+        return "MassMover: Failed to start move pipeline";
+    }
+    state->moves->waiter = result;
+    if (requestedAt == state->recent.requestedAt) {
+        state->recent.pipeline = state->moves;
+    }
+    
+    /* Reporting can wait until the first request is out */
+    sendFirstMoveBatch(state, state->moves);
+    return NULL;
+}
+
+/*
+ * Plan a preview from scratch, so the time it takes is what planning costs,
+ * and take it out of the plugin as a plan document; called with the state's
+ * lock held, returns NULL or the reason it failed.
+ */
+static const char* previewMoveJob(struct ServerState* state, const struct MoveJob* job, struct PlanDocument* document, struct MoveSetReport* report)
+{
+    unsigned long long start = monotonicNanos();
+    struct MovePlan* plan;
+    const char* failure;
+    
+    failure = buildMovePlan(state, job->targetChannelID, job->climbLevels, job->selfID, &plan);
+    if (failure) {
+        return failure;
+    }
+    if (planDocumentFromPlan(document, plan, state->clients.channelOf, settings.batchSize, monotonicNanos() - start) != 0) {
+        return "MassMover: Failed to allocate memory for the plan preview";
+    }
+    *report = plan->report;
+    return NULL;
+}
+
+/*
+ * Split the batches of a saved plan that are larger than batchSize, the
+ * most the send buffer holds; the plan may come from a preview made with a
+ * larger batch size, or from a file edited by hand. Returns 0 on success.
+ */
+static int splitSavedBatches(struct PlanDocument* document, int batchSize)
+{
+    int batchCount = 0;
+    int* batches;
+    int i;
+    
+    for (i = 0; i < document->batchCount; i++) {
+        batchCount += (document->batches[i] + batchSize - 1) / batchSize;
+    }
+    if (batchCount == document->batchCount) {
+        return 0;
+    }
+    batches = (int*)arenaAlloc(&document->arena, batchCount * sizeof(int));
+    if (!batches) {
+        return -1;
+    }
+    
+    batchCount = 0;
+    for (i = 0; i < document->batchCount; i++) {
+        int remaining;
+        
+        for (remaining = document->batches[i]; remaining > 0; remaining -= batchSize) {
+            batches[batchCount++] = remaining < batchSize ? remaining : batchSize;
+        }
+    }
+    document->batches = batches;
+    document->batchCount = batchCount;
+    return 0;
+}
+
+/*
+ * Keep the clients of a saved plan that are still in the channel it found
+ * them in and may still be moved, and shrink its batches to match; empty
+ * batches go, and batches larger than the configured size are split. The
+ * plan's groups no longer match its clients afterwards. Called with the
+ * state's lock held; returns NULL or the reason the plan can't run on this
+ * connection.
+ */
+static const char* reviseSavedPlan(struct ServerState* state, struct PlanDocument* document, anyID selfID, int* stale)
+{
+    uint64 targetChannelID = document->targetChannelID;
+    int group = 0;
+    int batch = 0;
+    int inBatch = 0;
+    int keptInBatch = 0;
+    int batchCount = 0;
+    int kept = 0;
+    int i;
+    
+    *stale = 0;
+    if (channelTreeFind(&state->tree, targetChannelID) == -1) {
+        return "MassMover: The saved plan's target channel doesn't exist here";
+    }
+    
+    for (i = 0; i < document->clientCount; i++) {
+        anyID clientID = document->clients[i];
+        uint64 sourceChannelID;
+        
+        while (i >= document->groups[group].first + document->groups[group].count) {
+            group++;
+        }
+        sourceChannelID = document->groups[group].channelID;
+        
+        if (clientID != selfID && sourceChannelID != targetChannelID && state->clients.channelOf[clientID] == sourceChannelID &&
+            state->movePower != 0 && !(state->moveDenied && clientSetHas(state->moveDenied, clientID))) {
+            document->clients[kept++] = clientID;
+            keptInBatch++;
+        } else {
+            (*stale)++;
+        }
+        
+        /* Batches are rewritten in place, never ahead of the one being read */
+        if (++inBatch == document->batches[batch]) {
+            if (keptInBatch) {
+                document->batches[batchCount++] = keptInBatch;
+            }
+            batch++;
+            inBatch = 0;
+            keptInBatch = 0;
+        }
+    }
+    document->clientCount = kept;
+    document->batchCount = batchCount;
+    if (splitSavedBatches(document, settings.batchSize) != 0) {
+        return "MassMover: Failed to allocate memory for the saved plan";
+    }
+    
+    /* Client IDs are handed out again after a reconnect, so we only follow a plan made for us */
+    if (document->selfID && (document->selfID != selfID || state->clients.channelOf[selfID] == targetChannelID)) {
+        document->selfID = 0;
+    }
+    return NULL;
+}
+
+/*
+ * Send the clients of the latest recorded move back to the channels they
+ * came from, one batch per origin channel unless it holds more clients than
+ * a batch takes. Clients no longer in the target, because they left or
+ * moved on their own, stay where they are, as do clients whose channel is
+ * gone. Called with the state's lock held, which is released around the
+ * first request; returns NULL or the reason there is nothing to undo.
+ */
+static const char* undoMoveJob(struct ServerState* state, const struct MoveJob* job, int* clientCount, int* channelCount, int* stale)
+{
+    const struct UndoSnapshot* snapshot = undoLogNewest(&state->undo);
+    uint64 targetChannelID;
+    uint64 selfOriginID = 0;
+    anyID* clients;
+    int* batchSizes;
+    uint64* batchTargets;
+    int batchCount = 0;
+    int kept = 0;
+    int g, i;
+    
+    *clientCount = 0;
+    *channelCount = 0;
+    *stale = 0;
+    if (!snapshot) {
+        return "MassMover: No mass move to undo";
+    }
+    targetChannelID = snapshot->targetChannelID;
+    
+    /* A batch never holds more clients than the move had, so sizing for the worst case needs no growing */
+    arenaReset(&state->planArena);
+    if (arenaReserve(&state->planArena, snapshot->clientCount * (sizeof(anyID) + sizeof(int) + sizeof(uint64)) + 48) != 0) {
+        return "MassMover: Failed to allocate memory for the undo";
+    }
+    clients = (anyID*)arenaAlloc(&state->planArena, snapshot->clientCount * sizeof(anyID));
+    batchSizes = (int*)arenaAlloc(&state->planArena, snapshot->clientCount * sizeof(int));
+    batchTargets = (uint64*)arenaAlloc(&state->planArena, snapshot->clientCount * sizeof(uint64));
+    
+    for (g = 0; g < snapshot->groupCount; g++) {
+        const struct UndoGroup* group = &snapshot->groups[g];
+        int start = kept;
+        int first;
+        
+        if (channelTreeFind(&state->tree, group->channelID) == -1) {
+            *stale += group->count;
+            continue;
+        }
+        for (i = group->first; i < group->first + group->count; i++) {
+            anyID clientID = snapshot->clients[i];
+            
+            if (state->clients.channelOf[clientID] != targetChannelID) {
+                (*stale)++;
+            } else if (clientID == snapshot->selfID) {
+                /* We go back on our own, after everyone else, as with any move */
+                selfOriginID = clientID == job->selfID ? group->channelID : 0;
+            } else if (state->movePower != 0 && !(state->moveDenied && clientSetHas(state->moveDenied, clientID))) {
+                clients[kept++] = clientID;
+            } else {
+                (*stale)++;
+            }
+        }
+        
+        /* Batches are cut per origin channel, as each one only goes to a single channel */
+        for (first = start; first < kept; ) {
+            int size = kept - first < settings.batchSize ? kept - first : settings.batchSize;
+            batchSizes[batchCount] = size;
+            batchTargets[batchCount++] = group->channelID;
+            first += size;
+        }
+        if (kept > start || selfOriginID == group->channelID) {
+            (*channelCount)++;
+        }
+    }
+    
+    /* Undone once, even if nobody was left to send back */
+    undoLogDrop(&state->undo);
+    *clientCount = kept + (selfOriginID ? 1 : 0);
+    if (!*clientCount) {
+        return NULL;
+    }
+    describeControlResult(job->result, 0, *channelCount, *clientCount, *stale);
+    return executeMovePlan(state, selfOriginID, clients, kept, selfOriginID ? job->selfID : 0, batchSizes, batchTargets, batchCount,
+                           job->requestedAt, job->result);
+}
+
+/* Where previews save their plan */
+static void planFilePath(char* path, size_t size)
+{
+    ts3Functions.getConfigPath(path, size);
+    if (strlen(path) + strlen(PLAN_FILENAME) >= size) {
+        path[0] = '\0';
+        return;
+    }
+    strcat(path, PLAN_FILENAME);
+}
+
+/*
+ * Plan the hotkey scopes for our own channel once the connection's caches
+ * changed, at most once per PLAN_WARM_INTERVAL_MS and not while its
+ * moves are running. Called on the worker with the state's lock held;
+ * returns 1 if it planned anything, otherwise *wakeAt is lowered to the next
+ * warm up due.
+ */
+static int warmMovePlans(struct ServerState* state, unsigned long long* wakeAt)
+{
+    unsigned long long now = monotonicNanos();
+    unsigned long long dueAt;
+    uint64 myChannelID;
+    struct MovePlan* plan;
+    int scopes[3];
+    int i;
+    
+    if (state->generation == state->warmedGeneration || state->moves || !state->selfID || !state->treeValid || !state->clientsValid) {
+        return 0;
+    }
+    dueAt = state->warmedAt + PLAN_WARM_INTERVAL_MS * NANOS_PER_MS;
+    if (now < dueAt) {
+        if (*wakeAt == 0 || dueAt < *wakeAt) {
+            *wakeAt = dueAt;
+        }
+        return 0;
+    }
+    
+    state->warmedGeneration = state->generation;
+    state->warmedAt = now;
+    myChannelID = state->clients.channelOf[state->selfID];
+    if (!myChannelID) {
+        return 0;
+    }
+    scopes[0] = -1;
+    scopes[1] = settings.ancestorLevels;
+    scopes[2] = 0;
+    for (i = 0; i < 3; i++) {
+        if (!planCacheFind(&state->plans, myChannelID, scopes[i], state->generation, now) &&
+            buildMovePlan(state, myChannelID, scopes[i], state->selfID, &plan) != NULL) {
+            break;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Move the late joiners of a followed family to its target with one
+ * pipeline, at most once per follow_flush_ms, and end the follow when its
+ * time is up or the target is gone. The watched channels are worked out
+ * again first if the tree changed. Called on the worker with the state's
+ * lock held, which is released around SDK calls; returns 1 if it did
+ * anything, else merges the time it is next due into *wakeAt.
+ */
+static int followMoves(struct ServerState* state, unsigned long long* wakeAt)
+{
+    struct FollowMode* follow = &state->follow;
+    struct ChannelTree* tree = &state->tree;
+    uint64 serverConnectionHandlerID = state->serverConnectionHandlerID;
+    uint64 targetChannelID = follow->targetChannelID;
+    unsigned long long now;
+    unsigned long long dueAt;
+    struct MoveSetReport report;
+    anyID* clients;
+    int clientCount = 0;
+    int i;
+    char msg[256] = "";
+    
+    if (!targetChannelID) {
+        return 0;
+    }
+    now = monotonicNanos();
+    if (now >= follow->until || (state->treeValid && channelTreeFind(tree, targetChannelID) == -1)) {
+        stopFollowing(state, msg, sizeof(msg));
+        mutexUnlock(&state->lock);
+        ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+        mutexLock(&state->lock);
+        return 1;
+    }
+    
+    dueAt = follow->pendingCount > 0 && follow->nextFlushAt < follow->until ? follow->nextFlushAt : follow->until;
+    if (!follow->pendingCount || now < dueAt) {
+        if (*wakeAt == 0 || dueAt < *wakeAt) {
+            *wakeAt = dueAt;
+        }
+        return 0;
+    }
+    
+    /* Late joiners are checked against the caches, so those have to be complete */
+    if (!state->treeValid || !state->clientsValid) {
+        mutexUnlock(&state->lock);
+        if (refreshServerState(serverConnectionHandlerID, 0, 0) != 0) {
+            LOG_TEXT(LogLevel_WARNING, serverConnectionHandlerID, "MassMover: Failed to read channel tree, late joiners wait for the next flush");
+        }
+        mutexLock(&state->lock);
+        follow->nextFlushAt = now + settings.followFlushMs * NANOS_PER_MS;
+        return 1;
+    }
+    
+    arenaReset(&state->planArena);
+    if (arenaReserve(&state->planArena, (tree->count + 1) * sizeof(uint64) + follow->pendingCount * sizeof(anyID) + 32) != 0) {
+        followClear(follow);
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for late joiners");
+        return 1;
+    }
+    if (!follow->scopeValid) {
+        uint64* channels = (uint64*)arenaAlloc(&state->planArena, (tree->count + 1) * sizeof(uint64));
+        int channelCount;
+        
+        applyExclusionRules(state);
+        channelCount = plannerCollectScope(tree, targetChannelID, follow->climbLevels, channels, PLAN_METRICS(state));
+        if (followSetScope(follow, tree, channels, channelCount) != 0) {
+            followClear(follow);
+            LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for the followed channels");
+            return 1;
+        }
+    }
+    
+    /* Noted clients may have moved on since, or been noted while the watched channels were stale */
+    clients = (anyID*)arenaAlloc(&state->planArena, follow->pendingCount * sizeof(anyID));
+    for (i = 0; i < follow->pendingCount; i++) {
+        anyID clientID = follow->pending[i];
+        uint64 channelID = state->clients.channelOf[clientID];
+        
+        if (clientID != state->selfID && channelID && followWatches(follow, tree, channelID)) {
+            clients[clientCount++] = clientID;
+        }
+    }
+    followClear(follow);
+    clientCount = moveSetMinimize(clients, clientCount, targetChannelID, state->clients.channelOf,
+                                  state->moveDenied, state->movePower == 0, state->selfID, state->moveSetSeen, &report);
+    if (clientCount == 0) {
+        return 1;
+    }
+    
+    /* One pipeline for all of them; its outcome goes to the log only, the tab hears about the follow as a whole */
+    if (startMovePipeline(state, targetChannelID, clients, clientCount, 0, NULL, NULL, 0, now) != 0) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to start move pipeline");
+        return 1;
+    }
+    state->moves->quiet = 1;
+    follow->nextFlushAt = now + settings.followFlushMs * NANOS_PER_MS;
+    follow->flushes++;
+    follow->moved += clientCount;
+    LOG_RECORD(LogLevel_DEBUG, serverConnectionHandlerID, "MassMover: Following channel %lld: moving %lld late joiners", targetChannelID, clientCount);
+    sendFirstMoveBatch(state, state->moves);
+    return 1;
+}
+
+/* Send a new pipeline's first batch at once if a return code is at hand; called with the state's lock held, which is released around the request */
+static void sendFirstMoveBatch(struct ServerState* state, struct MovePipeline* pipeline)
+{
+    unsigned long long dueAt;
+    int batch;
+    
+    if (!state->spareReturnCode[0]) {
+        return;
+    }
+    batch = movePipelineNextBatch(pipeline, monotonicNanos(), &dueAt);
+    if (batch != -1) {
+        sendMoveBatch(state, pipeline, batch);
+    }
+}
+
+/* Plan and start one queued job, or preview it, or send the saved plan; called on the connection's worker without its lock */
+static void runMoveJob(struct ServerState* state, const struct MoveJob* job)
+{
+    uint64 serverConnectionHandlerID = job->serverConnectionHandlerID;
+    uint64 targetChannelID = job->targetChannelID;
+#ifdef MASSMOVER_DEBUG
+    uint64* channels = NULL;            /* Lives in planArena until the next plan */
+#endif
+    int channelCount = 0;
+    int clientCount = 0;
+    struct MoveSetReport report;
+    struct PlanDocument document;
+    struct MovePlan* plan;
+    char path[PATH_BUFSIZE];
+    int cached = 0;
+    int stale = 0;
+    int movePower;
+    const char* failure = NULL;
+    char msg[512];
+    
+    memset(&report, 0, sizeof(report));
+    planDocumentInit(&document);
+    if (job->kind == JOB_RUN_SAVED) {
+        LOG_TEXT(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Starting saved mass move");
+    } else if (job->kind == JOB_UNDO) {
+        LOG_TEXT(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Undoing the last mass move");
+    } else if (job->kind == JOB_PREVIEW) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Previewing mass move operation for channel %lld (whole family)", targetChannelID);
+    } else if (job->climbLevels < 0) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Starting mass move operation for channel %lld (whole family)", targetChannelID);
+    } else if (job->climbLevels == 0) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Starting mass move operation for channel %lld (subchannels only)", targetChannelID);
+    } else {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Starting mass move operation for channel %lld (%lld levels up)", targetChannelID, job->climbLevels);
+    }
+#ifdef MASSMOVER_METRICS
+    memset(&state->planMetrics, 0, sizeof(state->planMetrics));
+#endif
+    
+    /* A saved plan is read before anything else; it says where to move to */
+    planFilePath(path, sizeof(path));
+    if (job->kind == JOB_RUN_SAVED) {
+        if (!path[0] || planLoad(&document, path) != 0) {
+            failure = "MassMover: No saved plan to run, or it is damaged";
+        } else {
+            targetChannelID = document.targetChannelID;
+        }
+    }
+    
+    /* Use the cached channel tree and client index; only snapshot the server if they are incomplete */
+    if (!failure && refreshServerState(serverConnectionHandlerID, 0, 0) != 0) {
+        failure = "MassMover: Failed to read channel tree";
+    }
+#ifdef MASSMOVER_DEBUG
+    if (!failure) {
+        verifyChannelTreeCache(serverConnectionHandlerID);
+    }
+#endif
+    
+    /* Our move power decides which earlier refusals still stand */
+    if (ts3Functions.getClientNeededPermission(serverConnectionHandlerID, "i_client_move_power", &movePower) != ERROR_ok) {
+        movePower = -1;
+    }
+    
+    /* A cancel or a disconnect meanwhile moved the epoch on */
+    mutexLock(&state->lock);
+    if (!failure && state->cancelEpoch != job->cancelEpoch) {
+        failure = "MassMover: Mass move cancelled";
+    }
+    if (!failure && job->kind == JOB_MOVE && state->recent.replacedAt == job->requestedAt) {
+        failure = "MassMover: Replaced by a newer mass move";
+    }
+    if (!failure) {
+        if (state->moveDenied && movePower > state->deniedAtPower) {
+            memset(state->moveDenied, 0, CLIENT_SET_BYTES);
+            stateChanged(state);
+        }
+        /* Plans only depend on whether we may move anyone else at all */
+        if ((state->movePower == 0) != (movePower == 0)) {
+            stateChanged(state);
+        }
+        state->movePower = movePower;
+        
+        if (job->kind == JOB_PREVIEW) {
+            failure = previewMoveJob(state, job, &document, &report);
+            channelCount = document.channelCount;
+            clientCount = document.clientCount + (document.selfID ? 1 : 0);
+        } else if (job->kind == JOB_RUN_SAVED) {
+            failure = reviseSavedPlan(state, &document, job->selfID, &stale);
+            channelCount = document.channelCount;
+            clientCount = document.clientCount + (document.selfID ? 1 : 0);
+            if (!failure && clientCount > 0) {
+                /* Remembered before anyone moves, so an undo knows where they were */
+                if (undoLogRecord(&state->undo, targetChannelID, document.clients, document.clientCount, document.selfID, state->clients.channelOf) != 0) {
+                    LOG_TEXT(LogLevel_WARNING, serverConnectionHandlerID, "MassMover: Failed to allocate memory for the undo log");
+                }
+                describeControlResult(job->result, targetChannelID, channelCount, clientCount, stale);
+                failure = executeMovePlan(state, targetChannelID, document.clients, document.clientCount, document.selfID,
+                                          document.batches, NULL, document.batchCount, job->requestedAt, job->result);
+            }
+        } else if (job->kind == JOB_UNDO) {
+            failure = undoMoveJob(state, job, &clientCount, &channelCount, &stale);
+        } else {
+            failure = planMoveJob(state, job, &plan, &cached);
+            if (!failure) {
+                /* The plan belongs to the cache, which the connection may drop once the lock is released */
+                channelCount = plan->channelCount;
+                clientCount = plan->clientCount + (plan->selfID ? 1 : 0);
+                report = plan->report;
+#ifdef MASSMOVER_DEBUG
+                channels = (uint64*)arenaAlloc(&state->planArena, plan->channelCount * sizeof(uint64));
+                if (channels) {
+                    memcpy(channels, plan->channels, plan->channelCount * sizeof(uint64));
+                }
+#endif
+                if (clientCount > 0) {
+                    if (undoLogRecord(&state->undo, targetChannelID, plan->clients, plan->clientCount, plan->selfID, state->clients.channelOf) != 0) {
+                        LOG_TEXT(LogLevel_WARNING, serverConnectionHandlerID, "MassMover: Failed to allocate memory for the undo log");
+                    }
+                    describeControlResult(job->result, targetChannelID, channelCount, clientCount, 0);
+                    failure = executeMovePlan(state, targetChannelID, plan->clients, plan->clientCount, plan->selfID, NULL, NULL, 0, job->requestedAt, job->result);
+                }
+            }
+        }
+    }
+    if (state->recent.requestedAt == job->requestedAt && !state->recent.pipeline) {
+        state->recent.open = 0;     /* Nothing is sending for it; repeats within the window still join it */
+    }
+    mutexUnlock(&state->lock);
+    
+    /* A command whose move got under way is answered by its pipeline, every other one right here */
+    if (job->result && (failure || clientCount == 0 || job->kind == JOB_PREVIEW)) {
+        describeControlResult(job->result, targetChannelID, channelCount, clientCount, stale);
+        if (job->kind == JOB_PREVIEW) {
+            job->result->batches = document.batchCount + (document.selfID ? 1 : 0);
+        }
+        answerControlResult(job->result, failure);
+    }
+    
+    if (failure) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, failure);
+        ts3Functions.printMessage(serverConnectionHandlerID, failure, PLUGIN_MESSAGE_TARGET_SERVER);
+        planDocumentFree(&document);
+        return;
+    }
+    
+    if (job->kind == JOB_PREVIEW) {
+        /* Nothing was sent; the plan is kept for "Run saved MassMove" */
+        int saved = path[0] && planSave(&document, path) == 0;
+        int batches = document.batchCount + (document.selfID ? 1 : 0);
+        snprintf(msg, sizeof(msg), "MassMover: Preview for channel %llu: %d channels, %d clients in %d batch%s, planned in %.2f ms; nothing moved%s",
+                 (unsigned long long)targetChannelID, channelCount, clientCount, batches, batches == 1 ? "" : "es",
+                 document.planNanos / 1e6, saved ? ", plan saved" : ", failed to save the plan");
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Preview for channel %lld: %lld channels, %lld clients in %lld batches, planned in %lld us; plan saved: %lld",
+                   targetChannelID, channelCount, clientCount, batches, document.planNanos / 1000, saved);
+        if (report.alreadyInTarget || report.duplicates || report.denied) {
+            LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Left out %lld clients already in the target, %lld duplicates and %lld we may not move",
+                       report.alreadyInTarget, report.duplicates, report.denied);
+        }
+        ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+#ifdef MASSMOVER_METRICS
+        snprintf(msg, sizeof(msg), "\"channels\":%d,\"clients\":%d,\"batches\":%d,\"plan_ns\":%llu",
+                 channelCount, clientCount, document.batchCount, document.planNanos);
+        metricsWrite("preview", serverConnectionHandlerID, targetChannelID, &state->planMetrics, msg);
+#endif
+        planDocumentFree(&document);
+        return;
+    }
+    
+    if (job->kind == JOB_RUN_SAVED) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Saved plan for channel %lld: %lld clients still where it found them, %lld left out",
+                   targetChannelID, clientCount, stale);
+    } else if (job->kind == JOB_UNDO) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Undo: %lld clients go back to %lld channels, %lld left out as they moved on, left or may not be moved",
+                   clientCount, channelCount, stale);
+    } else if (cached) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Found %lld channels to move clients from (planned ahead)", channelCount);
+    } else {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Found %lld channels to move clients from", channelCount);
+    }
+    if (report.alreadyInTarget || report.duplicates || report.denied) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Left out %lld clients already in the target, %lld duplicates and %lld we may not move",
+                   report.alreadyInTarget, report.duplicates, report.denied);
+    }
+    LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Found %lld clients to move", clientCount);
+#ifdef MASSMOVER_METRICS
+    snprintf(msg, sizeof(msg), "\"channels\":%d,\"clients\":%d,\"already_in_target\":%d,\"duplicates\":%d,\"denied\":%d,\"cached\":%d,\"saved\":%d,\"undo\":%d",
+             channelCount, clientCount, report.alreadyInTarget, report.duplicates, report.denied, cached, job->kind == JOB_RUN_SAVED, job->kind == JOB_UNDO);
+    metricsWrite("plan", serverConnectionHandlerID, targetChannelID, &state->planMetrics, msg);
+#endif
+#ifdef MASSMOVER_DEBUG
+    if (channels) {
+        verifyClientIndex(serverConnectionHandlerID, channels, channelCount);
+    }
+#endif
+    planDocumentFree(&document);
+    
+    if (clientCount > 0 && job->kind == JOB_UNDO) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Initiated move for %lld clients back to %lld channels", clientCount, channelCount);
+    } else if (clientCount > 0) {
+        LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Initiated move for %lld clients to channel %lld", clientCount, targetChannelID);
+    } else {
+        LOG_TEXT(LogLevel_INFO, serverConnectionHandlerID, "MassMover: No clients found to move");
+        ts3Functions.printMessage(serverConnectionHandlerID, "MassMover: No clients found to move", PLUGIN_MESSAGE_TARGET_SERVER);
+    }
+}
+
+/****************************** Move Pipeline ********************************/
+
+/*
+ * Start moving clients (and ourselves, if selfID is set) to the target in
+ * batches, of the given sizes if any, each to its own target if batchTargets
+ * are given; the worker sends them.
+ */
+static int startMovePipeline(struct ServerState* state, uint64 targetChannelID, const anyID* clients, int clientCount, anyID selfID, const int* batchSizes, const uint64* batchTargets, int batchCount, unsigned long long requestedAt)
+{
+    int result;
+    struct MovePipeline* pipeline = state->sparePipelines;
+    
+    /* A finished pipeline brings memory sized for an earlier move along */
+    if (pipeline) {
+        state->sparePipelines = pipeline->next;
+        state->sparePipelineCount--;
+    } else {
+        pipeline = (struct MovePipeline*)calloc(1, sizeof(struct MovePipeline));
+        if (!pipeline) {
+            return -1;
+        }
+    }
+    if (batchTargets) {
+        result = movePipelineInitTargets(pipeline, state->serverConnectionHandlerID, clients, clientCount, selfID, targetChannelID,
+                                         batchSizes, batchTargets, batchCount, settings.maxInFlight, monotonicNanos());
+    } else if (batchSizes) {
+        result = movePipelineInitBatches(pipeline, state->serverConnectionHandlerID, targetChannelID, clients, clientCount, selfID,
+                                         batchSizes, batchCount, settings.maxInFlight, monotonicNanos());
+    } else {
+        result = movePipelineInit(pipeline, state->serverConnectionHandlerID, targetChannelID, clients, clientCount, selfID,
+                                  settings.batchSize, settings.maxInFlight, monotonicNanos());
+    }
+    if (result != 0) {
+        movePipelineFree(pipeline);
+        free(pipeline);
+        return -1;
+    }
+    
+    /* Await every client's arrival; without a tracker the move still runs, it just goes unmeasured, as do moves to several channels */
+    if (!batchTargets &&
+        moveStatsTrack(&state->stats, pipeline, targetChannelID, requestedAt, pipeline->clients, pipeline->clientCount, state->clients.channelOf) != 0) {
+        LOG_TEXT(LogLevel_WARNING, state->serverConnectionHandlerID, "MassMover: Failed to allocate memory for move tracking");
+    }
+    
+    pipeline->next = state->moves;
+    state->moves = pipeline;
+    return 0;
+}
+
+/* Record the answer to one of our batches; called with the state's lock held, returns the batch index or -1 if the return code isn't ours */
+static int completeMoveBatch(struct ServerState* state, const char* returnCode, unsigned int error)
+{
+    struct MovePipeline* pipeline;
+    
+    for (pipeline = state->moves; pipeline; pipeline = pipeline->next) {
+        int batch = movePipelineFindBatch(pipeline, returnCode);
+        if (batch != -1) {
+            movePipelineComplete(pipeline, batch, error, monotonicNanos());
+            noteMoveDenied(state, pipeline, batch);
+            return batch;
+        }
+    }
+    return -1;
+}
+
+/* Remember a client the server refused to let us move, once bisection has isolated it; called with the state's lock held */
+static void noteMoveDenied(struct ServerState* state, const struct MovePipeline* pipeline, int index)
+{
+    const struct MoveBatch* batch = &pipeline->batches[index];
+    
+    if (batch->state != BATCH_FAILED || batch->error != ERROR_permissions_client_insufficient || batch->count != 1 || batch->isSelf) {
+        return;
+    }
+    if (!state->moveDenied) {
+        state->moveDenied = (unsigned char*)calloc(CLIENT_SET_BYTES, 1);
+        if (!state->moveDenied) {
+            return;
+        }
+    }
+    clientSetAdd(state->moveDenied, pipeline->clients[batch->first]);
+    state->deniedAtPower = state->movePower;
+    stateChanged(state);
+}
+
+/* Send one batch with its own return code; called with the state's lock held, which is released around the request */
+static void sendMoveBatch(struct ServerState* state, struct MovePipeline* pipeline, int index)
+{
+    struct MoveBatch* batch = &pipeline->batches[index];
+    uint64 serverConnectionHandlerID = pipeline->serverConnectionHandlerID;
+    uint64 targetChannelID = batch->targetChannelID;
+    int isSelf = batch->isSelf;
+    char returnCode[MOVE_RETURNCODE_BUFSIZE];
+    unsigned int error;
+    METRICS_START(start);
+    
+    /* Copy what the request needs: the pipeline may be gone once the lock is released */
+    memcpy(state->sendBuffer, pipeline->clients + batch->first, batch->count * sizeof(anyID));
+    state->sendBuffer[batch->count] = 0;
+    memcpy(batch->returnCode, state->spareReturnCode, MOVE_RETURNCODE_BUFSIZE);
+    memcpy(returnCode, state->spareReturnCode, MOVE_RETURNCODE_BUFSIZE);
+    state->spareReturnCode[0] = '\0';
+    movePipelineSent(pipeline, index, monotonicNanos());
+    
+    mutexUnlock(&state->lock);
+    if (isSelf) {
+        error = ts3Functions.requestClientMove(serverConnectionHandlerID, state->sendBuffer[0], targetChannelID, "", returnCode);
+    } else {
+        error = ts3Functions.requestClientsMove(serverConnectionHandlerID, state->sendBuffer, targetChannelID, "", returnCode);
+    }
+    mutexLock(&state->lock);
+    
+#ifdef MASSMOVER_METRICS
+    /* One request plus the return code fetched for it */
+    if (movePipelineAlive(state, pipeline)) {
+        METRICS_STOP(&pipeline->metrics, METRICS_SEND, start);
+        METRICS_ADD(&pipeline->metrics, METRICS_SEND, sdkCalls, 2);
+    }
+#endif
+    
+    /* Rejected locally: there will be no server answer for this return code */
+    if (error != ERROR_ok) {
+        completeMoveBatch(state, returnCode, error);
+    }
+}
+
+/*
+ * Do the next piece of a connection's pipeline work: send a due batch,
+ * finish a pipeline or report progress. Called on its worker with the
+ * state's lock held, which may be released meanwhile. Returns 1 if something
+ * was done; otherwise *wakeAt receives the time the next piece becomes due
+ * (0 = only an event will).
+ */
+static int pumpMovePipelines(struct ServerState* state, unsigned long long* wakeAt)
+{
+    unsigned long long now = monotonicNanos();
+    uint64 serverConnectionHandlerID = state->serverConnectionHandlerID;
+    struct MovePipeline* pipeline;
+    struct MoveSample sample;
+    unsigned long long closesAt;
+    int running = 0;
+    
+    *wakeAt = 0;
+    
+    /* Clients that haven't shown up by the end of the grace period never will */
+    if (moveStatsExpire(&state->stats, now, &sample, &closesAt)) {
+        mutexUnlock(&state->lock);
+        reportMoveSample(serverConnectionHandlerID, &sample);
+        mutexLock(&state->lock);
+        return 1;
+    }
+    if (closesAt) {
+        *wakeAt = closesAt;
+    }
+    
+    for (pipeline = state->moves; pipeline; pipeline = pipeline->next) {
+        unsigned long long dueAt;
+        int batch;
+        
+        if (movePipelineFinished(pipeline)) {
+            struct MovePipeline** link;
+            for (link = &state->moves; *link != pipeline; link = &(*link)->next) {
+            }
+            *link = pipeline->next;
+            if (pipeline == state->recent.pipeline) {
+                state->recent.pipeline = NULL;
+                state->recent.open = 0;
+            }
+            moveStatsOwnerDone(&state->stats, pipeline, now);
+            mutexUnlock(&state->lock);
+            finishMovePipeline(state, pipeline);
+            mutexLock(&state->lock);
+            return 1;
+        }
+        
+        running++;
+        batch = movePipelineNextBatch(pipeline, now, &dueAt);
+        if (batch != -1) {
+            if (!state->spareReturnCode[0]) {
+                /* Return codes come from the SDK, so fetch one without the lock and look again */
+                mutexUnlock(&state->lock);
+                ts3Functions.createReturnCode(pluginID, state->spareReturnCode, MOVE_RETURNCODE_BUFSIZE);
+                mutexLock(&state->lock);
+                return 1;
+            }
+            sendMoveBatch(state, pipeline, batch);
+            return 1;
+        }
+        if (dueAt && (*wakeAt == 0 || dueAt < *wakeAt)) {
+            *wakeAt = dueAt;
+        }
+    }
+    
+    if (!running) {
+        state->nextProgressAt = 0;
+        return 0;
+    }
+    if (!state->nextProgressAt) {
+        state->nextProgressAt = now + PROGRESS_INTERVAL_MS * NANOS_PER_MS;
+    }
+    if (now < state->nextProgressAt) {
+        if (*wakeAt == 0 || state->nextProgressAt < *wakeAt) {
+            *wakeAt = state->nextProgressAt;
+        }
+        return 0;
+    }
+    
+    /* Long moves report how far they got every now and then; log records don't call the SDK, so the lock stays */
+    state->nextProgressAt = now + PROGRESS_INTERVAL_MS * NANOS_PER_MS;
+    if (*wakeAt == 0 || state->nextProgressAt < *wakeAt) {
+        *wakeAt = state->nextProgressAt;
+    }
+    for (pipeline = state->moves; pipeline; pipeline = pipeline->next) {
+        if (pipeline->targetChannelID) {
+            LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Moving to channel %lld: %lld of %lld clients moved, %lld failed",
+                       pipeline->targetChannelID, pipeline->movedClients, pipeline->clientCount, pipeline->failedClients);
+        } else {
+            LOG_RECORD(LogLevel_INFO, serverConnectionHandlerID, "MassMover: Moving back: %lld of %lld clients moved, %lld failed",
+                       pipeline->movedClients, pipeline->clientCount, pipeline->failedClients);
+        }
+    }
+    return 0;
+}
+
+#ifdef MASSMOVER_METRICS
+/* The pipeline is still linked to its connection; called with the state's lock held */
+static int movePipelineAlive(const struct ServerState* state, const struct MovePipeline* pipeline)
+{
+    struct MovePipeline* candidate;
+    
+    for (candidate = state->moves; candidate; candidate = candidate->next) {
+        if (candidate == pipeline) {
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Report the outcome of a pipeline already unlinked from its connection and release it */
+static void finishMovePipeline(struct ServerState* state, struct MovePipeline* pipeline)
+{
+    char what[64];
+    char msg[256];
+    
+    if (pipeline->targetChannelID) {
+        snprintf(what, sizeof(what), "Move to channel %llu", (unsigned long long)pipeline->targetChannelID);
+    } else {
+        snprintf(what, sizeof(what), "Undo");
+    }
+    snprintf(msg, sizeof(msg), "MassMover: %s finished: %d moved, %d failed, %d cancelled, %d batches, %d retries, %d flood errors, %.1f ms",
+             what, pipeline->movedClients, pipeline->failedClients, pipeline->cancelledClients,
+             pipeline->batchCount, pipeline->retries, pipeline->floodErrors,
+             (monotonicNanos() - pipeline->startedAt) / 1e6);
+    if (pipeline->targetChannelID) {
+        LOG_RECORD(pipeline->failedClients ? LogLevel_WARNING : LogLevel_INFO, pipeline->serverConnectionHandlerID,
+                   "MassMover: Move to channel %lld finished: %lld moved, %lld failed, %lld cancelled, %lld batches, %lld retries, %lld flood errors, %lld us",
+                   pipeline->targetChannelID, pipeline->movedClients, pipeline->failedClients, pipeline->cancelledClients,
+                   pipeline->batchCount, pipeline->retries, pipeline->floodErrors, (monotonicNanos() - pipeline->startedAt) / 1000);
+    } else {
+        LOG_RECORD(pipeline->failedClients ? LogLevel_WARNING : LogLevel_INFO, pipeline->serverConnectionHandlerID,
+                   "MassMover: Undo finished: %lld moved, %lld failed, %lld cancelled, %lld batches, %lld retries, %lld flood errors, %lld us",
+                   pipeline->movedClients, pipeline->failedClients, pipeline->cancelledClients,
+                   pipeline->batchCount, pipeline->retries, pipeline->floodErrors, (monotonicNanos() - pipeline->startedAt) / 1000);
+    }
+    if (!pipeline->quiet) {
+        ts3Functions.printMessage(pipeline->serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+    }
+    
+#ifdef MASSMOVER_METRICS
+    snprintf(msg, sizeof(msg), "\"moved\":%d,\"failed\":%d,\"cancelled\":%d,\"batches\":%d,\"retries\":%d,\"flood_errors\":%d",
+             pipeline->movedClients, pipeline->failedClients, pipeline->cancelledClients,
+             pipeline->batchCount, pipeline->retries, pipeline->floodErrors);
+    metricsWrite("send", pipeline->serverConnectionHandlerID, pipeline->targetChannelID, &pipeline->metrics, msg);
+#endif
+    
+    answerControlPipeline(pipeline, NULL);
+    recycleMovePipeline(state, pipeline);
+}
+
+/* Keep a finished pipeline for the next move, or release it if there are enough spares; worker only */
+static void recycleMovePipeline(struct ServerState* state, struct MovePipeline* pipeline)
+{
+    if (state->sparePipelineCount >= SPARE_PIPELINES) {
+        movePipelineFree(pipeline);
+        free(pipeline);
+        return;
+    }
+    pipeline->next = state->sparePipelines;
+    state->sparePipelines = pipeline;
+    state->sparePipelineCount++;
+}
+
+/* Log how long an operation took from the click until its clients arrived */
+static void reportMoveSample(uint64 serverConnectionHandlerID, const struct MoveSample* sample)
+{
+    LOG_RECORD(sample->arrived < sample->expected ? LogLevel_WARNING : LogLevel_INFO, serverConnectionHandlerID,
+               "MassMover: Move to channel %lld confirmed: %lld of %lld clients arrived, first after %lld ms, last after %lld ms",
+               sample->targetChannelID, sample->arrived, sample->expected, sample->firstMs, sample->lastMs);
+}
+
+/****************************** Control Socket ********************************/
+
+/* Run a command from the control socket the way the menu would; called on the socket's thread */
+static void executeControlCommand(const struct ControlCommand* command, struct ControlResult* result)
+{
+    uint64 serverConnectionHandlerID = command->serverConnectionHandlerID;
+    uint64 targetChannelID = command->channelID;
+    enum MoveJobKind kind = JOB_MOVE;
+    int climbLevels = command->climbLevels;
+    struct ServerState* state;
+    struct MovePipeline* pipeline;
+    anyID myID;
+    
+    if (!serverConnectionHandlerID) {
+        serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+    }
+    result->serverConnectionHandlerID = serverConnectionHandlerID;
+    if (!serverConnectionHandlerID) {
+        answerControlResult(result, "MassMover: No server tab");
+        return;
+    }
+    
+    if (command->verb == CONTROL_STATS) {
+        /* A tab that never saw a callback has no state yet, and nothing to report */
+        state = lockServerState(serverConnectionHandlerID, 0);
+        if (state) {
+            result->operations = state->stats.operations;
+            result->missing = state->stats.missing;
+            for (pipeline = state->moves; pipeline; pipeline = pipeline->next) {
+                result->running++;
+            }
+            result->lastMs[0] = moveStatsPercentile(&state->stats, 0, 50);
+            result->lastMs[1] = moveStatsPercentile(&state->stats, 0, 95);
+            result->lastMs[2] = moveStatsPercentile(&state->stats, 0, 99);
+            result->firstMs[0] = moveStatsPercentile(&state->stats, 1, 50);
+            result->firstMs[1] = moveStatsPercentile(&state->stats, 1, 95);
+            result->firstMs[2] = moveStatsPercentile(&state->stats, 1, 99);
+            mutexUnlock(&state->lock);
+        }
+        answerControlResult(result, NULL);
+        return;
+    }
+    if (command->verb == CONTROL_CANCEL) {
+        cancelMoveJobs(serverConnectionHandlerID);
+        answerControlResult(result, NULL);
+        return;
+    }
+    
+    if (command->verb == CONTROL_PREVIEW) {
+        kind = JOB_PREVIEW;
+        climbLevels = -1;
+    } else if (command->verb == CONTROL_UNDO) {
+        kind = JOB_UNDO;
+        targetChannelID = 0;
+        climbLevels = -1;
+    }
+    if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
+        answerControlResult(result, "MassMover: Failed to get client ID");
+        return;
+    }
+    if (kind != JOB_UNDO && !targetChannelID &&
+        ts3Functions.getChannelOfClient(serverConnectionHandlerID, myID, &targetChannelID) != ERROR_ok) {
+        answerControlResult(result, "MassMover: Failed to get our own channel");
+        return;
+    }
+    queueMoveJob(serverConnectionHandlerID, kind, targetChannelID, myID, climbLevels, result);
+}
+
+/* Fill in what a command is about to move, before a pipeline can answer it; called with the state's lock held if there is one */
+static void describeControlResult(struct ControlResult* result, uint64 targetChannelID, int channelCount, int clientCount, int stale)
+{
+    if (!result) {
+        return;
+    }
+    result->targetChannelID = targetChannelID;
+    result->channels = channelCount;
+    result->clients = clientCount;
+    result->stale = stale;
+    if (!result->plannedAt) {
+        result->plannedAt = monotonicNanos();
+    }
+}
+
+/* Answer a control socket command, if the job came from one */
+static void answerControlResult(struct ControlResult* result, const char* failure)
+{
+    if (!result) {
+        return;
+    }
+    result->error = failure;
+    controlResultDone(result);
+}
+
+/* Answer the command a pipeline moved for with its outcome, if it came from the control socket */
+static void answerControlPipeline(struct MovePipeline* pipeline, const char* failure)
+{
+    struct ControlResult* result = (struct ControlResult*)pipeline->waiter;
+    
+    if (!result) {
+        return;
+    }
+    pipeline->waiter = NULL;
+    result->moved = pipeline->movedClients;
+    result->failed = pipeline->failedClients;
+    result->cancelled = pipeline->cancelledClients;
+    result->batches = pipeline->batchCount;
+    result->retries = pipeline->retries;
+    result->firstRequestAt = pipeline->firstSentAt;
+    answerControlResult(result, failure);
+}
+
+/****************************** Channel Tree Cache ********************************/
+
+/* Note a change to the tree, the index or the refusals, which outdates every plan; called with the state's lock held */
+static void stateChanged(struct ServerState* state)
+{
+    /* The first change after a warm up wakes the worker to plan the hotkeys again */
+    if (state->generation == state->warmedGeneration) {
+        conditionSignal(&state->wake);
+    }
+    state->generation++;
+}
+
+/*
+ * Look up the state of a connection and lock it. With create set, a
+ * connection seen for the first time takes over an idle state or gets a new
+ * one, worker included. Returns NULL if there is none; the state's lock is
+ * held otherwise.
+ */
+static struct ServerState* lockServerState(uint64 serverConnectionHandlerID, int create)
+{
+    struct ServerState* state;
+    
+    for (;;) {
+        struct ServerState* idle = NULL;
+        
+        mutexLock(&statesLock);
+        for (state = serverStates; state; state = state->next) {
+            if (state->serverConnectionHandlerID == serverConnectionHandlerID) {
+                break;
+            }
+            if (!idle && !state->serverConnectionHandlerID) {
+                idle = state;
+            }
+        }
+        if (!state && create) {
+            state = idle ? idle : createServerState();
+            if (state && activateServerState(state, serverConnectionHandlerID) != 0) {
+                state = NULL;
+            }
+        }
+        mutexUnlock(&statesLock);
+        
+        if (!state) {
+            return NULL;
+        }
+        
+        /* States are never freed before shutdown, but a disconnect may hand this one to another connection meanwhile */
+        mutexLock(&state->lock);
+        if (state->serverConnectionHandlerID == serverConnectionHandlerID) {
+            return state;
+        }
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Allocate an idle state, start its worker and link it; called with statesLock held */
+static struct ServerState* createServerState(void)
+{
+    struct ServerState* state = (struct ServerState*)calloc(1, sizeof(struct ServerState));
+    
+    if (!state) {
+        printf("MASSMOVER: Failed to allocate memory for server state\n");
+        return NULL;
+    }
+    mutexInit(&state->lock);
+    conditionInit(&state->wake);
+    arenaInit(&state->planArena, 0);
+    undoLogInit(&state->undo);
+    followInit(&state->follow);
+    state->jobsTail = &state->jobs;
+    state->movePower = -1;
+    state->sendBuffer = (anyID*)malloc((settings.batchSize + 1) * sizeof(anyID));
+    state->moveSetSeen = (unsigned char*)calloc(1, CLIENT_SET_BYTES);
+    if (!state->sendBuffer || !state->moveSetSeen) {
+        printf("MASSMOVER: Failed to allocate memory for server state\n");
+        freeServerState(state);
+        return NULL;
+    }
+    if (threadStart(&state->thread, workerMain, state) != 0) {
+        printf("MASSMOVER: Failed to start worker thread\n");
+        freeServerState(state);
+        return NULL;
+    }
+    
+    state->next = serverStates;
+    serverStates = state;
+    return state;
+}
+
+/* Hand an idle state to a connection with empty caches; called with statesLock held, returns 0 on success */
+static int activateServerState(struct ServerState* state, uint64 serverConnectionHandlerID)
+{
+    int result = 0;
+    
+    mutexLock(&state->lock);
+    if (channelTreeInit(&state->tree, 0) != 0) {
+        result = -1;
+    } else if (clientIndexInit(&state->clients) != 0) {
+        channelTreeFree(&state->tree);
+        result = -1;
+    } else {
+        moveStatsInit(&state->stats);
+        planCacheInit(&state->plans);
+        state->movePower = -1;
+        state->serverConnectionHandlerID = serverConnectionHandlerID;
+    }
+    mutexUnlock(&state->lock);
+    return result;
+}
+
+/*
+ * Drop all state of a connection and leave the state idle for the next one;
+ * called with the state's lock held. The cancel epoch moves on, so a job
+ * the worker is planning right now never starts.
+ */
+static void releaseServerState(struct ServerState* state)
+{
+    dropMoveJobs(state);
+    while (state->moves) {
+        struct MovePipeline* pipeline = state->moves;
+        state->moves = pipeline->next;
+        answerControlPipeline(pipeline, "MassMover: Disconnected before the move finished");
+        movePipelineFree(pipeline);
+        free(pipeline);
+    }
+    moveStatsFree(&state->stats);
+    planCacheFree(&state->plans);
+    free(state->moveDenied);
+    state->moveDenied = NULL;
+    undoLogClear(&state->undo);
+    followStop(&state->follow);
+    memset(&state->recent, 0, sizeof(state->recent));
+    clientIndexFree(&state->clients);
+    channelTreeFree(&state->tree);
+    state->treeValid = 0;
+    state->clientsValid = 0;
+    state->selfID = 0;
+    state->refreshWanted = 0;
+    state->nextProgressAt = 0;
+    state->cancelEpoch++;
+    stateChanged(state);
+    state->serverConnectionHandlerID = 0;
+}
+
+/* Free an unlinked state whose worker has stopped, or never started */
+static void freeServerState(struct ServerState* state)
+{
+    if (state->serverConnectionHandlerID) {
+        releaseServerState(state);
+    }
+    dropMoveJobs(state);
+    while (state->spareJobs) {
+        struct MoveJob* job = state->spareJobs;
+        state->spareJobs = job->next;
+        free(job);
+    }
+    while (state->sparePipelines) {
+        struct MovePipeline* pipeline = state->sparePipelines;
+        state->sparePipelines = pipeline->next;
+        movePipelineFree(pipeline);
+        free(pipeline);
+    }
+    planCacheFree(&state->plans);
+    arenaFree(&state->planArena);
+    undoLogFree(&state->undo);
+    followFree(&state->follow);
+    free(state->sendBuffer);
+    free(state->moveSetSeen);
+    conditionDestroy(&state->wake);
+    mutexDestroy(&state->lock);
+    free(state);
+}
+
+/* Replace the cached tree with a fresh snapshot; called with the state's lock held */
+static void installChannelTree(struct ServerState* state, struct ChannelTree* fresh)
+{
+    channelTreeFree(&state->tree);
+    state->tree = *fresh;
+    state->treeValid = 1;
+    channelsChanged(state);
+    stateChanged(state);
+    
+    /* Chain heads live in the tree nodes, so hook the known clients into the new tree */
+    clientIndexRelink(&state->clients, &state->tree);
+}
+
+/* Fetch every client's location: one client list fetch and one location lookup per client */
+static int snapshotClientLocations(uint64 serverConnectionHandlerID, anyID** clientList, uint64** channelList)
+{
+    unsigned int error;
+    int count;
+    int i;
+    
+    error = ts3Functions.getClientList(serverConnectionHandlerID, clientList);
+    if (error != ERROR_ok) {
+        LOG_RECORD(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Error getting client list: %lld", error);
+        return -1;
+    }
+    
+    for (count = 0; (*clientList)[count] != 0; count++) {
+    }
+    *channelList = (uint64*)malloc((count + 1) * sizeof(uint64));
+    if (!*channelList) {
+        LOG_TEXT(LogLevel_ERROR, serverConnectionHandlerID, "MassMover: Failed to allocate memory for client locations");
+        ts3Functions.freeMemory(*clientList);
+        return -1;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, (*clientList)[i], &(*channelList)[i]) != ERROR_ok) {
+            (*channelList)[i] = 0;
+        }
+    }
+    return 0;
+}
+
+/* Replace the client index with a snapshot of client locations; called with the state's lock held */
+static void installClientLocations(struct ServerState* state, const anyID* clientList, const uint64* channelList)
+{
+    int i;
+    
+    clientIndexClear(&state->clients, &state->tree);
+    for (i = 0; clientList[i] != 0; i++) {
+        if (channelList[i]) {
+            clientIndexSet(&state->clients, &state->tree, clientList[i], channelList[i]);
+        }
+    }
+    
+    state->clientsValid = 1;
+    stateChanged(state);
+}
+
+/*
+ * Make sure a connection's caches hold complete snapshots, taking fresh ones
+ * from the server where needed (all of them if force is set). The snapshots
+ * are taken without the state's lock; if an event changes the caches meanwhile the
+ * snapshot may have missed it, so it is taken again. Returns 0 on success.
+ */
+static int refreshServerState(uint64 serverConnectionHandlerID, int force, int create)
+{
+    int attempt;
+    
+    for (attempt = 1; attempt <= REFRESH_ATTEMPTS; attempt++) {
+        struct ServerState* state;
+        struct ChannelTree fresh;
+        anyID* clientList = NULL;
+        uint64* channelList = NULL;
+        unsigned int generation;
+        int needTree = 0, needClients = 0;
+        int installed = 0;
+        
+        state = lockServerState(serverConnectionHandlerID, create);
+        if (!state) {
+            return -1;
+        }
+        needTree = force || !state->treeValid;
+        needClients = force || !state->clientsValid;
+        generation = state->generation;
+        mutexUnlock(&state->lock);
+        
+        if (!needTree && !needClients) {
+            return 0;
+        }
+        
+        if (needTree && snapshotChannelTree(serverConnectionHandlerID, &fresh) != 0) {
+            return -1;
+        }
+        if (needClients && snapshotClientLocations(serverConnectionHandlerID, &clientList, &channelList) != 0) {
+            if (needTree) {
+                channelTreeFree(&fresh);
+            }
+            return -1;
+        }
+        
+        /* Out of attempts, a snapshot that may miss a move beats none at all */
+        state = lockServerState(serverConnectionHandlerID, 0);
+        if (state) {
+            if (state->generation == generation || attempt == REFRESH_ATTEMPTS) {
+                if (needTree) {
+                    installChannelTree(state, &fresh);
+                }
+                if (needClients) {
+                    installClientLocations(state, clientList, channelList);
+                }
+                installed = 1;
+            }
+            mutexUnlock(&state->lock);
+        }
+        
+        if (!installed && needTree) {
+            channelTreeFree(&fresh);
+        }
+        if (needClients) {
+            ts3Functions.freeMemory(clientList);
+            free(channelList);
+        }
+        if (installed) {
+            return 0;
+        }
+        if (!state) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/* Record a client's new location; channel 0 means the client is gone from view */
+static void updateClientLocation(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID)
+{
+    struct ServerState* state;
+    struct MoveSample sample;
+    int completed = 0;
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        clientIndexSet(&state->clients, &state->tree, clientID, newChannelID);
+        stateChanged(state);
+        
+        /* Client IDs are reused, so a refusal doesn't outlive the client */
+        if (!newChannelID && state->moveDenied) {
+            clientSetRemove(state->moveDenied, clientID);
+        }
+        
+        /* A client turning up in a followed family waits for the next batched move; the first one wakes the worker */
+        if (state->follow.targetChannelID && newChannelID && newChannelID != state->follow.targetChannelID && clientID != state->selfID &&
+            followWatches(&state->follow, &state->tree, newChannelID) && followAdd(&state->follow, clientID) && state->follow.pendingCount == 1) {
+            conditionSignal(&state->wake);
+        }
+        
+        /* A move we asked for is confirmed once the client shows up in the target */
+        if (state->stats.open && newChannelID) {
+            completed = moveStatsArrived(&state->stats, clientID, newChannelID, monotonicNanos(), &sample);
+        }
+        mutexUnlock(&state->lock);
+    }
+    
+    if (completed) {
+        reportMoveSample(serverConnectionHandlerID, &sample);
+    }
+}
+
+#ifdef MASSMOVER_DEBUG
+/* Compare the event maintained tree against a fresh snapshot and print every difference */
+static void verifyChannelTreeCache(uint64 serverConnectionHandlerID)
+{
+    struct ServerState* state;
+    struct ChannelTree fresh;
+    unsigned int generation = 0;
+    int mismatches = 0;
+    int i;
+    
+    if (snapshotChannelTree(serverConnectionHandlerID, &fresh) != 0) {
+        return;
+    }
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    for (i = 0; state && i < fresh.count; i++) {
+        int cached = channelTreeFind(&state->tree, fresh.nodes[i].id);
+        int freshParent = fresh.nodes[i].parent;
+        uint64 freshParentID = freshParent == -1 ? 0 : fresh.nodes[freshParent].id;
+        uint64 cachedParentID;
+        
+        if (cached == -1) {
+            printf("MASSMOVER: Tree cache is missing channel %llu\n", (unsigned long long)fresh.nodes[i].id);
+            mismatches++;
+            continue;
+        }
+        
+        cachedParentID = state->tree.nodes[cached].parent == -1 ? 0 : state->tree.nodes[state->tree.nodes[cached].parent].id;
+        if (cachedParentID != freshParentID) {
+            printf("MASSMOVER: Tree cache has parent %llu for channel %llu, server has %llu\n",
+                   (unsigned long long)cachedParentID, (unsigned long long)fresh.nodes[i].id, (unsigned long long)freshParentID);
+            mismatches++;
+        }
+    }
+    
+    if (state && state->tree.count != fresh.count) {
+        printf("MASSMOVER: Tree cache holds %d channels, server has %d\n", state->tree.count, fresh.count);
+        mismatches++;
+    }
+    if (state) {
+        generation = state->generation;
+        mutexUnlock(&state->lock);
+    }
+    
+    LOG_RECORD(mismatches ? LogLevel_WARNING : LogLevel_DEBUG, serverConnectionHandlerID,
+               "MassMover: Tree cache check (generation %lld): %lld mismatches", generation, mismatches);
+    
+    channelTreeFree(&fresh);
+}
+
+/* Compare the indexed members of each channel against getChannelClientList */
+static void verifyClientIndex(uint64 serverConnectionHandlerID, uint64* channels, int channelCount)
+{
+    int mismatches = 0;
+    int i, j;
+    
+    for (i = 0; i < channelCount; i++) {
+        struct ServerState* state;
+        anyID* channelClients;
+        int sdkCount = 0;
+        int indexCount = 0;
+        anyID clientID;
+        
+        if (ts3Functions.getChannelClientList(serverConnectionHandlerID, channels[i], &channelClients) != ERROR_ok) {
+            continue;
+        }
+        
+        state = lockServerState(serverConnectionHandlerID, 0);
+        for (j = 0; state && channelClients[j] != 0; j++) {
+            sdkCount++;
+            if (state->clients.channelOf[channelClients[j]] != channels[i]) {
+                printf("MASSMOVER: Client index has client %u in channel %llu, server has %llu\n",
+                       channelClients[j], (unsigned long long)state->clients.channelOf[channelClients[j]], (unsigned long long)channels[i]);
+                mismatches++;
+            }
+        }
+        
+        if (state) {
+            int node = channelTreeFind(&state->tree, channels[i]);
+            if (node != -1) {
+                for (clientID = clientIndexFirst(&state->tree, node); clientID; clientID = clientIndexNext(&state->clients, clientID)) {
+                    indexCount++;
+                }
+            }
+            if (indexCount != sdkCount) {
+                printf("MASSMOVER: Client index lists %d clients in channel %llu, server has %d\n",
+                       indexCount, (unsigned long long)channels[i], sdkCount);
+                mismatches++;
+            }
+            mutexUnlock(&state->lock);
+        }
+        
+        ts3Functions.freeMemory(channelClients);
+    }
+    
+    LOG_RECORD(mismatches ? LogLevel_WARNING : LogLevel_DEBUG, serverConnectionHandlerID,
+               "MassMover: Client index check over %lld channels: %lld mismatches", channelCount, mismatches);
+}
+#endif
+
+/* Build the cache once the connection is fully established, drop it on disconnect */
+void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber)
+{
+    TRACE_EVENT(TRACE_CONNECT_STATUS, serverConnectionHandlerID, (uint64)newStatus, 0, 0, errorNumber, NULL);
+    if (newStatus == STATUS_CONNECTION_ESTABLISHED) {
+        struct ServerState* state;
+        anyID myID;
+        
+        /* All channels have been announced at this point */
+        if (refreshServerState(serverConnectionHandlerID, 1, 1) != 0) {
+            printf("MASSMOVER: Failed to snapshot connection %llu, retrying on first use\n", (unsigned long long)serverConnectionHandlerID);
+        }
+        
+        /* Knowing who we are lets the worker plan the hotkeys before the first press */
+        if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok) {
+            state = lockServerState(serverConnectionHandlerID, 0);
+            if (state) {
+                state->selfID = myID;
+                conditionSignal(&state->wake);
+                mutexUnlock(&state->lock);
+            }
+        }
+    } else if (newStatus == STATUS_DISCONNECTED) {
+        struct ServerState* state = lockServerState(serverConnectionHandlerID, 0);
+        
+        /* The worker stays, idle, for the next connection */
+        if (state) {
+            releaseServerState(state);
+            mutexUnlock(&state->lock);
+        }
+    }
+}
+
+/*
+ * The user switched to another server tab, where hotkeys act from now on:
+ * have its worker complete the caches and plan the hotkeys right away
+ * rather than on the first press.
+ */
+void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID)
+{
+    struct ServerState* state;
+    anyID myID;
+    
+    TRACE_EVENT(TRACE_CURRENT_CONNECTION, serverConnectionHandlerID, 0, 0, 0, 0, NULL);
+    
+    /* Tabs that aren't connected yet are taken care of once they are */
+    if (!serverConnectionHandlerID || ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok || !myID) {
+        return;
+    }
+    
+    state = lockServerState(serverConnectionHandlerID, 1);
+    if (!state) {
+        return;
+    }
+    state->selfID = myID;
+    state->refreshWanted = 1;
+    state->warmedAt = 0;
+    conditionSignal(&state->wake);
+    mutexUnlock(&state->lock);
+}
+
+/* Channel announced while the initial channel list is being received */
+void ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID)
+{
+    struct ServerState* state;
+    unsigned char traits;
+    
+    TRACE_EVENT(TRACE_NEW_CHANNEL, serverConnectionHandlerID, channelID, channelParentID, 0, 0, NULL);
+    traits = readChannelTraits(serverConnectionHandlerID, channelID);
+    state = lockServerState(serverConnectionHandlerID, 1);
+    if (state) {
+        channelTreeInsert(&state->tree, channelID, channelParentID);
+        noteChannelTraits(state, channelID, traits);
+        channelsChanged(state);
+        stateChanged(state);
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Channel created while connected */
+void ts3plugin_onNewChannelCreatedEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier)
+{
+    struct ServerState* state;
+    unsigned char traits;
+    
+    TRACE_EVENT(TRACE_NEW_CHANNEL, serverConnectionHandlerID, channelID, channelParentID, 0, 0, NULL);
+    traits = readChannelTraits(serverConnectionHandlerID, channelID);
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        channelTreeInsert(&state->tree, channelID, channelParentID);
+        noteChannelTraits(state, channelID, traits);
+        channelsChanged(state);
+        stateChanged(state);
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Channel deleted; its subchannels go with it */
+void ts3plugin_onDelChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier)
+{
+    struct ServerState* state;
+    
+    TRACE_EVENT(TRACE_DEL_CHANNEL, serverConnectionHandlerID, channelID, 0, 0, 0, NULL);
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        channelTreeRemove(&state->tree, channelID);
+        channelsChanged(state);
+        stateChanged(state);
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Channel moved below a new parent */
+void ts3plugin_onChannelMoveEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 newChannelParentID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier)
+{
+    struct ServerState* state;
+    
+    TRACE_EVENT(TRACE_CHANNEL_MOVED, serverConnectionHandlerID, channelID, newChannelParentID, 0, 0, NULL);
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        if (channelTreeMove(&state->tree, channelID, newChannelParentID) != 0) {
+            /* Unknown channel or impossible move: fall back to a fresh snapshot on next use */
+            state->treeValid = 0;
+        }
+        
+        /* Depth rules may see the moved channels differently now, and a followed scope may have changed shape */
+        channelsChanged(state);
+        stateChanged(state);
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Channel edited: name, password or flags may have changed what the exclusion rules make of it */
+void ts3plugin_onUpdateChannelEditedEvent(uint64 serverConnectionHandlerID, uint64 channelID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier)
+{
+    struct ServerState* state;
+    unsigned char traits;
+    
+    TRACE_EVENT(TRACE_CHANNEL_EDITED, serverConnectionHandlerID, channelID, 0, 0, 0, NULL);
+    if (!exclusionRules.needs) {
+        return;
+    }
+    traits = readChannelTraits(serverConnectionHandlerID, channelID);
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        noteChannelTraits(state, channelID, traits);
+        stateChanged(state);
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Store the traits read for a channel in the tree; called with the state's lock held */
+static void noteChannelTraits(struct ServerState* state, uint64 channelID, unsigned char traits)
+{
+    int node = channelTreeFind(&state->tree, channelID);
+    
+    if (node != -1 && state->tree.nodes[node].traits != traits) {
+        state->tree.nodes[node].traits = traits;
+        channelsChanged(state);
+    }
+}
+
+/* The shape of the tree or the traits of a channel changed; called with the state's lock held */
+static void channelsChanged(struct ServerState* state)
+{
+    state->rulesApplied = 0;
+    followTreeChanged(&state->follow);
+}
+
+/****************************** Client Location Index ********************************/
+
+/* Client switched channels, connected (old channel 0) or disconnected (new channel 0) */
+void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID, 0, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID);
+}
+
+/* Client came into or went out of view because we (un)subscribed a channel */
+void ts3plugin_onClientMoveSubscriptionEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID, 0, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID);
+}
+
+/* Client timed out */
+void ts3plugin_onClientMoveTimeoutEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* timeoutMessage)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, 0, 0, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, 0);
+}
+
+/* Client was moved by someone */
+void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID, moverID, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID);
+}
+
+/* Client was kicked into the default channel */
+void ts3plugin_onClientKickFromChannelEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID, 0, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, visibility == LEAVE_VISIBILITY ? 0 : newChannelID);
+}
+
+/* Client was kicked from the server */
+void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage)
+{
+    TRACE_EVENT(TRACE_CLIENT_MOVED, serverConnectionHandlerID, clientID, 0, 0, 0, NULL);
+    updateClientLocation(serverConnectionHandlerID, clientID, 0);
+}
+
+/****************************** Permission Events ********************************/
+
+/* A client's groups decide the move power it needs, so a refusal may no longer hold */
+static void forgetMoveDenied(uint64 serverConnectionHandlerID, anyID clientID)
+{
+    struct ServerState* state;
+    
+    TRACE_EVENT(TRACE_GROUP_CHANGED, serverConnectionHandlerID, clientID, 0, 0, 0, NULL);
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (!state) {
+        return;
+    }
+    if (state->moveDenied && clientSetHas(state->moveDenied, clientID)) {
+        clientSetRemove(state->moveDenied, clientID);
+        stateChanged(state);
+    }
+    mutexUnlock(&state->lock);
+}
+
+void ts3plugin_onServerGroupClientAddedEvent(uint64 serverConnectionHandlerID, anyID clientID, const char* clientName, const char* clientUniqueIdentity, uint64 serverGroupID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity)
+{
+    forgetMoveDenied(serverConnectionHandlerID, clientID);
+}
+
+void ts3plugin_onServerGroupClientDeletedEvent(uint64 serverConnectionHandlerID, anyID clientID, const char* clientName, const char* clientUniqueIdentity, uint64 serverGroupID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity)
+{
+    forgetMoveDenied(serverConnectionHandlerID, clientID);
+}
+
+void ts3plugin_onClientChannelGroupChangedEvent(uint64 serverConnectionHandlerID, uint64 channelGroupID, uint64 channelID, anyID clientID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity)
+{
+    forgetMoveDenied(serverConnectionHandlerID, clientID);
+}
+
+/****************************** Statistics Panel ********************************/
+
+/* Title of our section in the info panel */
+const char* ts3plugin_infoTitle()
+{
+    return "MassMover";
+}
+
+/* Move latency statistics, shown when the server is selected */
+void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data)
+{
+    struct ServerState* state;
+    
+    *data = NULL;
+    if (type != PLUGIN_SERVER) {
+        return;
+    }
+    
+    state = lockServerState(serverConnectionHandlerID, 0);
+    if (state) {
+        *data = (char*)malloc(INFODATA_BUFSIZE * sizeof(char));
+        if (*data) {
+            unsigned int dropped = logSinkDropped();
+            size_t length;
+            
+            moveStatsFormat(&state->stats, *data, INFODATA_BUFSIZE);
+            length = strlen(*data);
+            if (dropped && length < INFODATA_BUFSIZE) {
+                snprintf(*data + length, INFODATA_BUFSIZE - length, "%sLog records dropped: %u", length ? "\n" : "", dropped);
+                length = strlen(*data);
+            }
+            if (state->follow.targetChannelID && length < INFODATA_BUFSIZE) {
+                snprintf(*data + length, INFODATA_BUFSIZE - length, "%sFollowing channel %llu: %d clients moved in %d batched moves",
+                         length ? "\n" : "", (unsigned long long)state->follow.targetChannelID, state->follow.moved, state->follow.flushes);
+            }
+        }
+        mutexUnlock(&state->lock);
+    }
+}
+
+/* Free the info panel text */
+void ts3plugin_freeMemory(void* data)
+{
+    free(data);
 }
 
 /****************************** Unused Plugin Callbacks ********************************/
 
 /* All the remaining callback functions that we don't need */
-void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID) {}
-const char* ts3plugin_infoTitle() { return NULL; }
-void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data) { *data = NULL; }
-void ts3plugin_freeMemory(void* data) { free(data); }
 int ts3plugin_requestAutoload() { return 0; }
-void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys) { *hotkeys = NULL; }
 
@@ -0,0 +1,85 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Metrics
+ *
+ * The file is opened per record so it can be rotated or truncated while
+ * the client runs; records are rare next to the work they describe. Each
+ * record is built in memory and appended with a single write, so records of
+ * workers running side by side never interleave.
+ */
+
+#ifdef MASSMOVER_METRICS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+#define METRICS_PATH_BUFSIZE 512
+#define METRICS_LINE_BUFSIZE 4096
+
+static char metricsPath[METRICS_PATH_BUFSIZE];
+
+static const char* phaseNames[METRICS_PHASE_COUNT] = {
+    "parents", "subchannels", "clients", "minimize", "self_filter", "send"
+};
+
+void metricsOpen(const char* directory)
+{
+    if (strlen(directory) + strlen(METRICS_FILENAME) >= METRICS_PATH_BUFSIZE) {
+        metricsPath[0] = '\0';
+        return;
+    }
+    strcpy(metricsPath, directory);
+    strcat(metricsPath, METRICS_FILENAME);
+}
+
+void metricsWrite(const char* event, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                  const struct MetricsRecord* record, const char* extra)
+{
+    char line[METRICS_LINE_BUFSIZE];
+    size_t length;
+    FILE* file;
+    int first = 1;
+    int i;
+
+    if (!metricsPath[0]) {
+        return;
+    }
+
+    length = (size_t)snprintf(line, sizeof(line), "{\"time\":%lld,\"event\":\"%s\",\"connection\":%llu,\"target\":%llu",
+                              (long long)time(NULL), event, (unsigned long long)serverConnectionHandlerID, (unsigned long long)targetChannelID);
+    if (extra && extra[0] && length < sizeof(line)) {
+        length += (size_t)snprintf(line + length, sizeof(line) - length, ",%s", extra);
+    }
+
+    /* Phases that never ran in this record are left out */
+    if (length < sizeof(line)) {
+        length += (size_t)snprintf(line + length, sizeof(line) - length, ",\"phases\":{");
+    }
+    for (i = 0; i < METRICS_PHASE_COUNT && length < sizeof(line); i++) {
+        const struct MetricsCounters* c = &record->phases[i];
+        if (!c->runs) {
+            continue;
+        }
+        length += (size_t)snprintf(line + length, sizeof(line) - length,
+                                   "%s\"%s\":{\"runs\":%llu,\"ns\":%llu,\"sdk_calls\":%llu,\"channels_visited\":%llu,\"duplicates\":%llu,\"reallocs\":%llu}",
+                                   first ? "" : ",", phaseNames[i], c->runs, c->nanos, c->sdkCalls, c->channelsVisited, c->duplicates, c->reallocs);
+        first = 0;
+    }
+    if (length < sizeof(line)) {
+        length += (size_t)snprintf(line + length, sizeof(line) - length, "}}\n");
+    }
+    if (length >= sizeof(line)) {
+        return;
+    }
+
+    file = fopen(metricsPath, "a");
+    if (!file) {
+        return;
+    }
+    fwrite(line, 1, length, file);
+    fclose(file);
+}
+
+#endif
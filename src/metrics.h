@@ -0,0 +1,77 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Metrics
+ *
+ * Per-phase counters and timers for the mass move hot path, compiled in
+ * only with -DMASSMOVER_METRICS. Without it the METRICS_* macros expand to
+ * nothing, their arguments are never evaluated and no counter exists.
+ * Records are appended as JSON lines to massmover_metrics.jsonl in the
+ * TeamSpeak config path.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MASSMOVER_METRICS
+
+#define METRICS_FILENAME "massmover_metrics.jsonl"
+
+enum MetricsPhase {
+    METRICS_PARENTS = 0,        /* plannerScopeRoot */
+    METRICS_SUBCHANNELS,        /* plannerCollectSubchannels */
+    METRICS_CLIENTS,            /* plannerCollectClients */
+    METRICS_MINIMIZE,           /* Dropping clients already in the target, duplicates and refused clients */
+    METRICS_SELF_FILTER,        /* Dropping our own client from the move set */
+    METRICS_SEND,               /* requestClientsMove and requestClientMove, with their return codes */
+    METRICS_PHASE_COUNT
+};
+
+struct MetricsCounters {
+    unsigned long long runs;             /* Times the phase ran */
+    unsigned long long nanos;            /* Time spent in it */
+    unsigned long long sdkCalls;         /* SDK functions called */
+    unsigned long long channelsVisited;  /* Channels looked at */
+    unsigned long long duplicates;       /* Channels or clients reached a second time and skipped */
+    unsigned long long reallocs;         /* Buffers grown */
+};
+
+struct MetricsRecord {
+    struct MetricsCounters phases[METRICS_PHASE_COUNT];
+};
+
+/* Append records to METRICS_FILENAME in directory from now on */
+void metricsOpen(const char* directory);
+
+/*
+ * Append one record as a JSON line. extra holds further "key":value pairs
+ * without braces, or is NULL. Records that don't fit a line buffer are
+ * dropped. Safe to call from several workers at once.
+ */
+void metricsWrite(const char* event, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                  const struct MetricsRecord* record, const char* extra);
+
+#define METRICS_START(start) unsigned long long start = monotonicNanos()
+#define METRICS_STOP(record, phase, start) \
+    ((record)->phases[phase].runs++, (record)->phases[phase].nanos += monotonicNanos() - (start))
+#define METRICS_ADD(record, phase, field, amount) ((record)->phases[phase].field += (amount))
+
+#else
+
+#define METRICS_START(start)
+#define METRICS_STOP(record, phase, start) ((void)0)
+#define METRICS_ADD(record, phase, field, amount) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
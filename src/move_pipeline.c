@@ -0,0 +1,401 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Pipeline
+ *
+ * Batches are ranges of one client array. A retry never edits a batch in
+ * place: the failed batch is marked as retried and new batches covering the
+ * same range are appended, so every return code ever handed out keeps
+ * pointing at the batch it was sent for. Batch size follows an additive
+ * increase / multiplicative decrease scheme driven by flood errors. The
+ * client array and the batches share one arena sized for the first round
+ * of batches, so setting up a reused pipeline takes no heap call.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "teamspeak/public_errors.h"
+#include "move_pipeline.h"
+
+#define NANOS_PER_MS 1000000ULL
+
+/* Append a pending batch; returns its index or -1 */
+static int addBatch(struct MovePipeline* pipeline, int first, int count, int isSelf, uint64 targetChannelID, int attempts,
+                    unsigned long long notBefore)
+{
+    struct MoveBatch* batch;
+
+    if (pipeline->batchCount >= pipeline->batchCapacity) {
+        int capacity = pipeline->batchCapacity ? pipeline->batchCapacity * 2 : 8;
+        struct MoveBatch* grown = (struct MoveBatch*)arenaGrow(&pipeline->arena, pipeline->batches,
+                                                               pipeline->batchCapacity * sizeof(struct MoveBatch),
+                                                               capacity * sizeof(struct MoveBatch));
+        if (!grown) {
+            return -1;
+        }
+        pipeline->batches = grown;
+        pipeline->batchCapacity = capacity;
+    }
+
+    batch = &pipeline->batches[pipeline->batchCount];
+    memset(batch, 0, sizeof(*batch));
+    batch->first = first;
+    batch->count = count;
+    batch->isSelf = isSelf;
+    batch->targetChannelID = targetChannelID;
+    batch->state = BATCH_PENDING;
+    batch->attempts = attempts;
+    batch->notBefore = notBefore;
+    return pipeline->batchCount++;
+}
+
+/* Cover clients[first..first+count) with batches of at most size clients */
+static int addBatches(struct MovePipeline* pipeline, int first, int count, int size, uint64 targetChannelID, int attempts,
+                      unsigned long long notBefore)
+{
+    while (count > 0) {
+        int chunk = count < size ? count : size;
+        if (addBatch(pipeline, first, chunk, 0, targetChannelID, attempts, notBefore) == -1) {
+            return -1;
+        }
+        first += chunk;
+        count -= chunk;
+    }
+    return 0;
+}
+
+/* Whether an error is down to one client of a batch, so bisecting it still gets the others moved */
+static int blamesOneClient(unsigned int error)
+{
+    return error == ERROR_client_invalid_id || error == ERROR_channel_already_in || error == ERROR_permissions_client_insufficient;
+}
+
+/* A retry of a batch could not be added: drop the part that was, and give up on the batch's clients so they are still accounted for */
+static void failRetry(struct MovePipeline* pipeline, int index, int batchCount)
+{
+    struct MoveBatch* batch = &pipeline->batches[index];
+
+    pipeline->batchCount = batchCount;
+    batch->state = BATCH_FAILED;
+    pipeline->retries--;
+    pipeline->failedClients += batch->count;
+}
+
+/*
+ * Set up a pipeline whose first round of batches has the given sizes, or
+ * batches of batchSize if batchSizes is NULL, moving to targetChannelID or
+ * to their own batchTargets if those are given.
+ */
+static int initPipeline(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                        const anyID* clients, int count, anyID selfID, uint64 selfTargetID, int batchSize,
+                        const int* batchSizes, const uint64* batchTargets, int batchCount, int maxInFlight,
+                        unsigned long long now)
+{
+    struct Arena arena = pipeline->arena;
+    int batchCapacity;
+    int first;
+    int i;
+
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->arena = arena;
+    if (!pipeline->arena.blockSize) {
+        arenaInit(&pipeline->arena, 0);
+    }
+    arenaReset(&pipeline->arena);
+    pipeline->serverConnectionHandlerID = serverConnectionHandlerID;
+    pipeline->targetChannelID = targetChannelID;
+    pipeline->maxBatchSize = batchSize > 0 ? batchSize : MOVE_BATCH_SIZE_DEFAULT;
+    pipeline->batchSize = pipeline->maxBatchSize;
+    pipeline->maxInFlight = maxInFlight > 0 ? maxInFlight : MOVE_MAX_IN_FLIGHT_DEFAULT;
+    pipeline->startedAt = now;
+
+    /*
+     * One block for everything: the clients with a spare slot for our own
+     * client, room for twice the initial batches before the array has to grow,
+     * and the alignment padding of both.
+     */
+    batchCapacity = 2 * ((batchSizes ? batchCount : count / pipeline->batchSize) + 2);
+    if (arenaReserve(&pipeline->arena, (count + 1) * sizeof(anyID) + batchCapacity * sizeof(struct MoveBatch) + 32) != 0) {
+        return -1;
+    }
+    pipeline->clients = (anyID*)arenaAlloc(&pipeline->arena, (count + 1) * sizeof(anyID));
+    pipeline->batches = (struct MoveBatch*)arenaAlloc(&pipeline->arena, batchCapacity * sizeof(struct MoveBatch));
+    pipeline->batchCapacity = batchCapacity;
+    memcpy(pipeline->clients, clients, count * sizeof(anyID));
+    pipeline->clientCount = count;
+
+    if (selfID) {
+        pipeline->clients[count] = selfID;
+        pipeline->clientCount++;
+    }
+
+    if (batchSizes) {
+        for (i = 0, first = 0; i < batchCount; first += batchSizes[i], i++) {
+            if (addBatch(pipeline, first, batchSizes[i], 0, batchTargets ? batchTargets[i] : targetChannelID, 0, now) == -1) {
+                movePipelineFree(pipeline);
+                return -1;
+            }
+        }
+    } else if (addBatches(pipeline, 0, count, pipeline->batchSize, targetChannelID, 0, now) != 0) {
+        movePipelineFree(pipeline);
+        return -1;
+    }
+    if (selfID && addBatch(pipeline, count, 1, 1, selfTargetID, 0, now) == -1) {
+        movePipelineFree(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+int movePipelineInit(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                     const anyID* clients, int count, anyID selfID, int batchSize, int maxInFlight,
+                     unsigned long long now)
+{
+    return initPipeline(pipeline, serverConnectionHandlerID, targetChannelID, clients, count, selfID, targetChannelID, batchSize,
+                        NULL, NULL, 0, maxInFlight, now);
+}
+
+/* Largest of the batch sizes, which must all be positive and cover count clients; -1 otherwise */
+static int largestBatch(const int* batchSizes, int batchCount, int count)
+{
+    int largest = 1;
+    int covered = 0;
+    int i;
+
+    for (i = 0; i < batchCount; i++) {
+        if (batchSizes[i] < 1) {
+            return -1;
+        }
+        if (batchSizes[i] > largest) {
+            largest = batchSizes[i];
+        }
+        covered += batchSizes[i];
+    }
+    return covered == count ? largest : -1;
+}
+
+int movePipelineInitBatches(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                            const anyID* clients, int count, anyID selfID, const int* batchSizes, int batchCount,
+                            int maxInFlight, unsigned long long now)
+{
+    int largest = largestBatch(batchSizes, batchCount, count);
+
+    if (largest == -1) {
+        return -1;
+    }
+    return initPipeline(pipeline, serverConnectionHandlerID, targetChannelID, clients, count, selfID, targetChannelID, largest,
+                        batchSizes, NULL, batchCount, maxInFlight, now);
+}
+
+int movePipelineInitTargets(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, const anyID* clients, int count,
+                            anyID selfID, uint64 selfTargetID, const int* batchSizes, const uint64* batchTargets,
+                            int batchCount, int maxInFlight, unsigned long long now)
+{
+    int largest = largestBatch(batchSizes, batchCount, count);
+
+    if (largest == -1) {
+        return -1;
+    }
+    return initPipeline(pipeline, serverConnectionHandlerID, 0, clients, count, selfID, selfTargetID, largest,
+                        batchSizes, batchTargets, batchCount, maxInFlight, now);
+}
+
+void movePipelineFree(struct MovePipeline* pipeline)
+{
+    arenaFree(&pipeline->arena);
+    pipeline->clients = NULL;
+    pipeline->batches = NULL;
+    pipeline->batchCount = 0;
+    pipeline->batchCapacity = 0;
+}
+
+int movePipelineNextBatch(struct MovePipeline* pipeline, unsigned long long now, unsigned long long* wakeAt)
+{
+    unsigned long long resumeAt;
+    int i;
+
+    *wakeAt = 0;
+    if (pipeline->inFlight >= pipeline->maxInFlight) {
+        return -1;
+    }
+
+    /* After a flood error the server wants silence, not just for the rejected batch, and a slower pace after it */
+    resumeAt = pipeline->resumeAt;
+    if (pipeline->paceMs && pipeline->lastSentAt + pipeline->paceMs * NANOS_PER_MS > resumeAt) {
+        resumeAt = pipeline->lastSentAt + pipeline->paceMs * NANOS_PER_MS;
+    }
+    if (now < resumeAt) {
+        for (i = 0; i < pipeline->batchCount; i++) {
+            if (pipeline->batches[i].state == BATCH_PENDING) {
+                *wakeAt = resumeAt;
+                break;
+            }
+        }
+        return -1;
+    }
+
+    for (i = 0; i < pipeline->batchCount; i++) {
+        struct MoveBatch* batch = &pipeline->batches[i];
+
+        if (batch->state != BATCH_PENDING) {
+            continue;
+        }
+        if (batch->notBefore <= now) {
+            return i;
+        }
+        if (*wakeAt == 0 || batch->notBefore < *wakeAt) {
+            *wakeAt = batch->notBefore;
+        }
+    }
+    return -1;
+}
+
+void movePipelineSent(struct MovePipeline* pipeline, int batch, unsigned long long now)
+{
+    if (!pipeline->firstSentAt) {
+        pipeline->firstSentAt = now;
+    }
+    pipeline->lastSentAt = now;
+    pipeline->batches[batch].state = BATCH_IN_FLIGHT;
+    pipeline->batches[batch].attempts++;
+    pipeline->inFlight++;
+}
+
+int movePipelineFindBatch(const struct MovePipeline* pipeline, const char* returnCode)
+{
+    int i;
+
+    if (!returnCode || !returnCode[0]) {
+        return -1;
+    }
+    for (i = 0; i < pipeline->batchCount; i++) {
+        if (pipeline->batches[i].state == BATCH_IN_FLIGHT && strcmp(pipeline->batches[i].returnCode, returnCode) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void movePipelineComplete(struct MovePipeline* pipeline, int index, unsigned int error, unsigned long long now)
+{
+    struct MoveBatch* batch = &pipeline->batches[index];
+    int first = batch->first;
+    int count = batch->count;
+    int attempts = batch->attempts;
+    int isSelf = batch->isSelf;
+    uint64 targetChannelID = batch->targetChannelID;
+    int batchCount = pipeline->batchCount;
+
+    if (batch->state != BATCH_IN_FLIGHT) {
+        return;
+    }
+    pipeline->inFlight--;
+    batch->error = error;
+
+    if (error == ERROR_ok) {
+        batch->state = BATCH_DONE;
+        pipeline->movedClients += count;
+
+        /* Recover slowly: shorter backoff, faster pace and a slightly larger batch after each success */
+        pipeline->backoffMs /= 2;
+        pipeline->paceMs -= pipeline->paceMs / 8 + (pipeline->paceMs ? 1 : 0);
+        if (pipeline->batchSize < pipeline->maxBatchSize) {
+            pipeline->batchSize += pipeline->batchSize / 4 + 1;
+            if (pipeline->batchSize > pipeline->maxBatchSize) {
+                pipeline->batchSize = pipeline->maxBatchSize;
+            }
+        }
+        return;
+    }
+
+    if (pipeline->cancelled) {
+        batch->state = BATCH_CANCELLED;
+        pipeline->cancelledClients += count;
+        return;
+    }
+
+    if (error == ERROR_client_is_flooding) {
+        pipeline->floodErrors++;
+        if (now - pipeline->startedAt > MOVE_GIVE_UP_MS * NANOS_PER_MS) {
+            batch->state = BATCH_FAILED;
+            pipeline->failedClients += count;
+            return;
+        }
+
+        /* Back off exponentially and resend the same clients in smaller batches; floods cost no attempt */
+        batch->state = BATCH_RETRIED;
+        pipeline->retries++;
+        if (now >= pipeline->resumeAt) {
+            pipeline->backoffMs = pipeline->backoffMs ? pipeline->backoffMs * 2 : MOVE_BACKOFF_BASE_MS;
+            if (pipeline->backoffMs > MOVE_BACKOFF_MAX_MS) {
+                pipeline->backoffMs = MOVE_BACKOFF_MAX_MS;
+            }
+            pipeline->paceMs = pipeline->paceMs ? pipeline->paceMs * 2 : MOVE_PACE_BASE_MS;
+            if (pipeline->paceMs > MOVE_PACE_MAX_MS) {
+                pipeline->paceMs = MOVE_PACE_MAX_MS;
+            }
+            pipeline->batchSize = pipeline->batchSize > 1 ? pipeline->batchSize / 2 : 1;
+            pipeline->resumeAt = now + pipeline->backoffMs * NANOS_PER_MS;
+        }
+
+        if (isSelf) {
+            if (addBatch(pipeline, first, 1, 1, targetChannelID, attempts - 1, now) == -1) {
+                failRetry(pipeline, index, batchCount);
+            }
+        } else if (addBatches(pipeline, first, count, pipeline->batchSize, targetChannelID, attempts - 1, now) != 0) {
+            failRetry(pipeline, index, batchCount);
+        }
+        return;
+    }
+
+    /* A gone target or a server refusing us fails every part of the batch alike */
+    if (!blamesOneClient(error) || attempts >= MOVE_MAX_ATTEMPTS) {
+        batch->state = BATCH_FAILED;
+        pipeline->failedClients += count;
+        return;
+    }
+
+    batch->state = BATCH_RETRIED;
+    pipeline->retries++;
+
+    if (count > 1) {
+        /* Some client in the batch can't be moved: bisect so the others still arrive; splitting costs no attempt */
+        if (addBatch(pipeline, first, count / 2, 0, targetChannelID, attempts - 1, now) == -1 ||
+            addBatch(pipeline, first + count / 2, count - count / 2, 0, targetChannelID, attempts - 1, now) == -1) {
+            failRetry(pipeline, index, batchCount);
+        }
+        return;
+    }
+
+    /* A single client failing for a reason other than flooding won't succeed on retry */
+    batch->state = BATCH_FAILED;
+    pipeline->retries--;
+    pipeline->failedClients += count;
+}
+
+void movePipelineCancel(struct MovePipeline* pipeline)
+{
+    int i;
+
+    pipeline->cancelled = 1;
+    for (i = 0; i < pipeline->batchCount; i++) {
+        if (pipeline->batches[i].state == BATCH_PENDING) {
+            pipeline->batches[i].state = BATCH_CANCELLED;
+            pipeline->cancelledClients += pipeline->batches[i].count;
+        }
+    }
+}
+
+int movePipelineFinished(const struct MovePipeline* pipeline)
+{
+    int i;
+
+    if (pipeline->inFlight > 0) {
+        return 0;
+    }
+    for (i = 0; i < pipeline->batchCount; i++) {
+        if (pipeline->batches[i].state == BATCH_PENDING) {
+            return 0;
+        }
+    }
+    return 1;
+}
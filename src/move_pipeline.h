@@ -0,0 +1,148 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Pipeline
+ *
+ * Splits a move set into batches that each carry their own return code, so
+ * the server's answer to every batch can be correlated. A flood rejection
+ * pauses the whole pipeline with exponential backoff, spaces out the
+ * following sends and shrinks the batch size; batches failing because of a
+ * client, one that is gone, already there or protected, are bisected until
+ * the offending client is isolated, and any other failure fails the whole
+ * batch at once. The pipeline
+ * only keeps the schedule; sending the requests is up to the caller.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef MOVE_PIPELINE_H
+#define MOVE_PIPELINE_H
+
+#include "teamspeak/public_definitions.h"
+#include "arena.h"
+#include "metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOVE_RETURNCODE_BUFSIZE 128     /* Buffer size for a batch's return code */
+#define MOVE_BATCH_SIZE_DEFAULT 50      /* Clients per requestClientsMove */
+#define MOVE_MAX_IN_FLIGHT_DEFAULT 2    /* Batches awaiting an answer at the same time */
+#define MOVE_MAX_ATTEMPTS 6             /* Sends of the same clients failing for other reasons than flooding */
+#define MOVE_GIVE_UP_MS 30000           /* Stop retrying flood rejections this long after the start */
+#define MOVE_BACKOFF_BASE_MS 250        /* First delay after a flood error */
+#define MOVE_BACKOFF_MAX_MS 4000        /* Upper bound of the delay */
+#define MOVE_PACE_BASE_MS 50            /* Gap between sends after the first flood error */
+#define MOVE_PACE_MAX_MS 1000           /* Upper bound of the gap */
+
+enum MoveBatchState {
+    BATCH_PENDING = 0,    /* Waiting to be sent */
+    BATCH_IN_FLIGHT,      /* Sent, no answer yet */
+    BATCH_DONE,           /* Server confirmed the move */
+    BATCH_RETRIED,        /* Failed and replaced by new batches covering its clients */
+    BATCH_FAILED,         /* Gave up */
+    BATCH_CANCELLED       /* Dropped by a cancel before it was sent */
+};
+
+struct MoveBatch {
+    int first;                                  /* Offset of the first client in the pipeline's client array */
+    int count;                                  /* Number of clients */
+    int isSelf;                                 /* Moves our own client (sent with requestClientMove) */
+    uint64 targetChannelID;                     /* Channel the batch moves its clients to */
+    enum MoveBatchState state;
+    int attempts;                               /* Sends of these clients so far */
+    unsigned long long notBefore;               /* Earliest send time, monotonic nanoseconds */
+    unsigned int error;                         /* Last error reported for this batch */
+    char returnCode[MOVE_RETURNCODE_BUFSIZE];   /* Return code the batch was sent with */
+};
+
+struct MovePipeline {
+    uint64 serverConnectionHandlerID;
+    uint64 targetChannelID;         /* Target of every batch, 0 if each batch has a target of its own */
+    struct Arena arena;             /* Holds the client array and the batches, kept across reuses */
+    anyID* clients;                 /* Clients to move; our own client, if moved, is last */
+    int clientCount;
+    struct MoveBatch* batches;      /* Grows within the arena as retries add batches */
+    int batchCount;
+    int batchCapacity;
+    int batchSize;                  /* Current batch size, shrinks on flood errors */
+    int maxBatchSize;               /* Configured batch size */
+    int maxInFlight;                /* Batches allowed to await an answer at once */
+    int inFlight;                   /* Batches currently awaiting an answer */
+    unsigned int backoffMs;         /* Current flood backoff, 0 when not flooding */
+    unsigned long long resumeAt;    /* No batch is sent before this time after a flood error */
+    unsigned int paceMs;            /* Minimum gap between two sends, 0 when not flooding */
+    unsigned long long firstSentAt; /* Time of the first send, 0 until then */
+    unsigned long long lastSentAt;  /* Time of the latest send */
+    int movedClients;               /* Clients in confirmed batches */
+    int failedClients;              /* Clients we gave up on */
+    int retries;                    /* Batches sent again */
+    int floodErrors;                /* Flood errors received */
+    int cancelled;                  /* No batch is sent or retried any more */
+    int cancelledClients;           /* Clients in batches dropped by the cancel */
+    unsigned long long startedAt;   /* Monotonic nanoseconds when the pipeline was created */
+    void* waiter;                   /* Whoever waits for the outcome, up to the caller; NULL if nobody */
+    int quiet;                      /* Outcome is logged but not reported to the user, up to the caller */
+#ifdef MASSMOVER_METRICS
+    struct MetricsRecord metrics;   /* Send phase counters, filled in by the caller */
+#endif
+    struct MovePipeline* next;
+};
+
+/*
+ * Prepare a pipeline moving clients[0..count) to targetChannelID. If selfID
+ * is non-zero our own client is moved last, on its own. The pipeline must be
+ * zeroed or have been set up before, in which case the memory of its earlier
+ * move is reused. Returns 0 on success.
+ */
+int  movePipelineInit(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                      const anyID* clients, int count, anyID selfID, int batchSize, int maxInFlight,
+                      unsigned long long now);
+
+/*
+ * Like movePipelineInit, but the first round sends batches of exactly the
+ * given sizes in order, which must cover all count clients; retries after a
+ * flood error shrink from the largest of them. Returns 0 on success.
+ */
+int  movePipelineInitBatches(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, uint64 targetChannelID,
+                             const anyID* clients, int count, anyID selfID, const int* batchSizes, int batchCount,
+                             int maxInFlight, unsigned long long now);
+
+/*
+ * Like movePipelineInitBatches, but each batch moves its clients to the
+ * channel of its own in batchTargets and our client goes to selfTargetID;
+ * the pipeline's targetChannelID is 0. Returns 0 on success.
+ */
+int  movePipelineInitTargets(struct MovePipeline* pipeline, uint64 serverConnectionHandlerID, const anyID* clients, int count,
+                             anyID selfID, uint64 selfTargetID, const int* batchSizes, const uint64* batchTargets,
+                             int batchCount, int maxInFlight, unsigned long long now);
+
+/* Release all memory of the pipeline */
+void movePipelineFree(struct MovePipeline* pipeline);
+
+/*
+ * Batch to send now, or -1 if none may be sent yet. When -1 is returned and
+ * a batch is waiting for its backoff, *wakeAt receives the time it becomes
+ * due (0 otherwise).
+ */
+int  movePipelineNextBatch(struct MovePipeline* pipeline, unsigned long long now, unsigned long long* wakeAt);
+
+/* Mark a batch as sent with the return code already stored in it */
+void movePipelineSent(struct MovePipeline* pipeline, int batch, unsigned long long now);
+
+/* Batch sent with the given return code, or -1 */
+int  movePipelineFindBatch(const struct MovePipeline* pipeline, const char* returnCode);
+
+/* Record the server's answer to a batch, scheduling retries as needed */
+void movePipelineComplete(struct MovePipeline* pipeline, int batch, unsigned int error, unsigned long long now);
+
+/* Drop every batch not sent yet; batches in flight are still answered but never retried */
+void movePipelineCancel(struct MovePipeline* pipeline);
+
+/* Nothing pending and nothing in flight */
+int  movePipelineFinished(const struct MovePipeline* pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Planner
+ *
+ * All lists of a plan come from one arena block reserved up front: a scope
+ * can never hold more channels than the tree, nor more clients than the
+ * index, so planning never grows a buffer.
+ */
+
+#include <string.h>
+
+#include "move_planner.h"
+#include "platform.h"
+
+int plannerScopeRoot(const struct ChannelTree* tree, uint64 channelID, int levels, struct MetricsRecord* metrics)
+{
+    int node;
+    int root;
+    METRICS_START(start);
+
+    node = channelTreeFind(tree, channelID);
+    if (node == -1) {
+        METRICS_STOP(metrics, METRICS_PARENTS, start);
+        return -1;
+    }
+    root = channelTreeAncestor(tree, node, levels);
+
+#ifdef MASSMOVER_METRICS
+    /* Count the ancestors passed on the way up */
+    for (; node != root; node = tree->nodes[node].parent) {
+        METRICS_ADD(metrics, METRICS_PARENTS, channelsVisited, 1);
+    }
+    METRICS_ADD(metrics, METRICS_PARENTS, channelsVisited, 1);
+#endif
+    METRICS_STOP(metrics, METRICS_PARENTS, start);
+    return root;
+}
+
+int plannerCollectSubchannels(struct ChannelTree* tree, int rootNode, uint64* channels, int* channelCount, int capacity,
+                              struct MetricsRecord* metrics)
+{
+    int added;
+    METRICS_START(start);
+
+    added = channelTreeCollectSubtree(tree, rootNode, channels, channelCount, capacity);
+    METRICS_ADD(metrics, METRICS_SUBCHANNELS, channelsVisited, added + tree->walkRevisits);
+    METRICS_ADD(metrics, METRICS_SUBCHANNELS, duplicates, tree->walkRevisits);
+    METRICS_STOP(metrics, METRICS_SUBCHANNELS, start);
+    return added;
+}
+
+int plannerCollectScope(struct ChannelTree* tree, uint64 targetChannelID, int climbLevels, uint64* channels,
+                        struct MetricsRecord* metrics)
+{
+    int channelCount = 0;
+    int rootNode;
+    int i;
+
+    /* Climb only as far as the scope reaches, then down through every subchannel below that point */
+    channelTreeBeginWalk(tree);
+    rootNode = plannerScopeRoot(tree, targetChannelID, climbLevels, metrics);
+    if (rootNode != -1) {
+        int targetNode = channelTreeFind(tree, targetChannelID);
+
+        /* An excluded root other than the target stays put with all its subchannels */
+        if (tree->nodes[rootNode].excluded && rootNode != targetNode) {
+            tree->walkPruned++;
+        } else {
+            plannerCollectSubchannels(tree, rootNode, channels, &channelCount, tree->count, metrics);
+        }
+
+        /* Moving into an excluded channel still takes its own subtree along; nothing if the walk already listed it */
+        plannerCollectSubchannels(tree, targetNode, channels, &channelCount, tree->count, metrics);
+    }
+
+    /* Keep the target channel first in the list */
+    for (i = 0; i < channelCount; i++) {
+        if (channels[i] == targetChannelID) {
+            channels[i] = channels[0];
+            channels[0] = targetChannelID;
+            break;
+        }
+    }
+    if (i == channelCount) {
+        memmove(channels + 1, channels, channelCount * sizeof(uint64));
+        channels[0] = targetChannelID;
+        channelCount++;
+    }
+    return channelCount;
+}
+
+anyID* plannerCollectClients(const struct ChannelTree* tree, const struct ClientIndex* index, struct Arena* arena,
+                             const uint64* channels, int channelCount, int* clientCount, struct MetricsRecord* metrics)
+{
+    anyID* allClients;
+    int totalClients = 0;
+    int i;
+    METRICS_START(start);
+
+    /* Count first so the result is allocated exactly once; empty channels cost a single read */
+    for (i = 0; i < channelCount; i++) {
+        int node = channelTreeFind(tree, channels[i]);
+        anyID clientID;
+
+        if (node == -1) {
+            continue;
+        }
+        for (clientID = clientIndexFirst(tree, node); clientID; clientID = clientIndexNext(index, clientID)) {
+            totalClients++;
+        }
+    }
+    METRICS_ADD(metrics, METRICS_CLIENTS, channelsVisited, channelCount);
+
+    allClients = (anyID*)arenaAlloc(arena, (totalClients + 1) * sizeof(anyID));
+    if (!allClients) {
+        METRICS_STOP(metrics, METRICS_CLIENTS, start);
+        return NULL;
+    }
+
+    totalClients = 0;
+    for (i = 0; i < channelCount; i++) {
+        int node = channelTreeFind(tree, channels[i]);
+        anyID clientID;
+
+        if (node == -1) {
+            continue;
+        }
+        for (clientID = clientIndexFirst(tree, node); clientID; clientID = clientIndexNext(index, clientID)) {
+            allClients[totalClients++] = clientID;
+        }
+    }
+    allClients[totalClients] = 0;
+    METRICS_STOP(metrics, METRICS_CLIENTS, start);
+
+    *clientCount = totalClients;
+    return allClients;
+}
+
+int plannerPlan(struct ChannelTree* tree, const struct ClientIndex* index, struct Arena* arena, uint64 targetChannelID,
+                int climbLevels, anyID selfID, const unsigned char* denied, int denyOthers, unsigned char* seen,
+                struct PlannedMove* move, struct MetricsRecord* metrics)
+{
+    anyID* clientsToMove;
+    int clientCount = 0;
+    int kept = 0;
+    int i;
+
+    memset(move, 0, sizeof(*move));
+    if (arenaReserve(arena, (tree->count + 1) * sizeof(uint64) + 2 * (index->clientCount + 1) * sizeof(anyID) + 48) != 0) {
+        return -1;
+    }
+    move->channels = (uint64*)arenaAlloc(arena, (tree->count + 1) * sizeof(uint64));
+    move->channelCount = plannerCollectScope(tree, targetChannelID, climbLevels, move->channels, metrics);
+
+    clientsToMove = plannerCollectClients(tree, index, arena, move->channels, move->channelCount, &clientCount, metrics);
+    if (!clientsToMove) {
+        return -1;
+    }
+
+    /* Only send what the server will act on: nobody already in the target, nobody twice, nobody it refused before */
+    METRICS_START(minimizeStart);
+    clientCount = moveSetMinimize(clientsToMove, clientCount, targetChannelID, index->channelOf,
+                                  denied, denyOthers, selfID, seen, &move->report);
+    METRICS_STOP(metrics, METRICS_MINIMIZE, minimizeStart);
+    METRICS_ADD(metrics, METRICS_MINIMIZE, duplicates, move->report.duplicates);
+
+    /* Everyone but us fits, so the array never has to grow */
+    move->clients = (anyID*)arenaAlloc(arena, (clientCount + 1) * sizeof(anyID));
+    if (!move->clients) {
+        return -1;
+    }
+    METRICS_START(filterStart);
+    for (i = 0; i < clientCount; i++) {
+        if (selfID && clientsToMove[i] == selfID) {
+            move->selfID = selfID;
+            continue;
+        }
+        move->clients[kept++] = clientsToMove[i];
+    }
+    move->clientCount = kept;
+    METRICS_STOP(metrics, METRICS_SELF_FILTER, filterStart);
+    return 0;
+}
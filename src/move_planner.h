@@ -0,0 +1,83 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Planner
+ *
+ * Works out what a mass move has to send from a channel tree and a client
+ * index alone: the channels of the scope, target first, and the clients in
+ * them the server will act on, our own client apart. It makes no SDK call
+ * and keeps no state, so the plugin plans from the caches it maintains from
+ * events and the ServerQuery tool from one channellist and one clientlist.
+ * Exclusion rules act through the excluded flags of the tree, which are up
+ * to the caller. Every list it returns lives in the caller's arena.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef MOVE_PLANNER_H
+#define MOVE_PLANNER_H
+
+#include "teamspeak/public_definitions.h"
+#include "arena.h"
+#include "channel_tree.h"
+#include "client_index.h"
+#include "metrics.h"
+#include "move_set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct MetricsRecord;
+
+/* What a mass move sends */
+struct PlannedMove {
+    uint64* channels;               /* Channels of the scope, target first */
+    int channelCount;
+    anyID* clients;                 /* Clients to move, without our own */
+    int clientCount;
+    anyID selfID;                   /* Our own client if it has to move as well, 0 otherwise */
+    struct MoveSetReport report;    /* Clients left out by move set minimization */
+};
+
+/*
+ * Every function takes a metrics record for the phase counters of builds
+ * with MASSMOVER_METRICS; it may be NULL in builds without.
+ */
+
+/* Find the ancestor levels above a channel (levels < 0: the top level one); returns its node index or -1 if the channel is unknown */
+int    plannerScopeRoot(const struct ChannelTree* tree, uint64 channelID, int levels, struct MetricsRecord* metrics);
+
+/* Collect every channel below rootNode (inclusive) that was not visited yet in this walk; returns the number collected */
+int    plannerCollectSubchannels(struct ChannelTree* tree, int rootNode, uint64* channels, int* channelCount, int capacity,
+                                 struct MetricsRecord* metrics);
+
+/*
+ * Walk the scope of a target once into channels, which has room for every
+ * channel of the tree plus one: climb levels up (0 = subtree only, -1 =
+ * whole family), then down through every subchannel that isn't excluded.
+ * An excluded channel is left out with its whole subtree, except for the
+ * target's own subtree. The target comes first, even if it is unknown.
+ * Returns the number of channels.
+ */
+int    plannerCollectScope(struct ChannelTree* tree, uint64 targetChannelID, int climbLevels, uint64* channels,
+                           struct MetricsRecord* metrics);
+
+/* Collect the clients of channels[0..channelCount) into a zero terminated array from arena; returns it or NULL */
+anyID* plannerCollectClients(const struct ChannelTree* tree, const struct ClientIndex* index, struct Arena* arena,
+                             const uint64* channels, int channelCount, int* clientCount, struct MetricsRecord* metrics);
+
+/*
+ * Plan a move to targetChannelID from climbLevels above it into move,
+ * leaving out clients already there, clients listed twice and clients in
+ * denied (may be NULL), or everyone but selfID if denyOthers is set. seen
+ * is scratch space of CLIENT_SET_BYTES that must be all clear and is left
+ * all clear. Returns 0 on success.
+ */
+int    plannerPlan(struct ChannelTree* tree, const struct ClientIndex* index, struct Arena* arena, uint64 targetChannelID,
+                   int climbLevels, anyID selfID, const unsigned char* denied, int denyOthers, unsigned char* seen,
+                   struct PlannedMove* move, struct MetricsRecord* metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
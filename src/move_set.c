@@ -0,0 +1,44 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Set Minimization
+ *
+ * The scratch bitset is cleared by walking the kept clients again instead
+ * of wiping all 8 KB, so a small move stays cheap.
+ */
+
+#include <string.h>
+
+#include "move_set.h"
+
+int moveSetMinimize(anyID* clients, int count, uint64 targetChannelID, const uint64* channelOf,
+                    const unsigned char* denied, int denyOthers, anyID selfID,
+                    unsigned char* seen, struct MoveSetReport* report)
+{
+    int kept = 0;
+    int i;
+
+    memset(report, 0, sizeof(*report));
+
+    for (i = 0; i < count; i++) {
+        anyID clientID = clients[i];
+
+        if (channelOf[clientID] == targetChannelID) {
+            report->alreadyInTarget++;
+            continue;
+        }
+        if (clientSetHas(seen, clientID)) {
+            report->duplicates++;
+            continue;
+        }
+        if (clientID != selfID && (denyOthers || (denied && clientSetHas(denied, clientID)))) {
+            report->denied++;
+            continue;
+        }
+        clientSetAdd(seen, clientID);
+        clients[kept++] = clientID;
+    }
+
+    for (i = 0; i < kept; i++) {
+        clientSetRemove(seen, clients[i]);
+    }
+    return kept;
+}
@@ -0,0 +1,50 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Set Minimization
+ *
+ * Shrinks a collected move set to the clients the server will actually
+ * move: clients already in the target are dropped, every client is kept
+ * once, and clients the server refused to let us move before are left out.
+ * Client sets are dense bitsets over the whole anyID space.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef MOVE_SET_H
+#define MOVE_SET_H
+
+#include "teamspeak/public_definitions.h"
+#include "client_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLIENT_SET_BYTES (CLIENT_INDEX_SIZE / 8)
+
+#define clientSetHas(set, clientID) ((set)[(clientID) >> 3] & (1 << ((clientID) & 7)))
+#define clientSetAdd(set, clientID) ((set)[(clientID) >> 3] |= (unsigned char)(1 << ((clientID) & 7)))
+#define clientSetRemove(set, clientID) ((set)[(clientID) >> 3] &= (unsigned char)~(1 << ((clientID) & 7)))
+
+/* Entries each step removed */
+struct MoveSetReport {
+    int alreadyInTarget;
+    int duplicates;
+    int denied;
+};
+
+/*
+ * Remove from clients[0..count) in place, keeping the order: clients whose
+ * channelOf entry is the target, repeated clients, and clients in denied
+ * (may be NULL). If denyOthers is set every client but selfID is treated as
+ * denied. seen is scratch space of CLIENT_SET_BYTES that must be all clear
+ * and is left all clear. Returns the new count.
+ */
+int moveSetMinimize(anyID* clients, int count, uint64 targetChannelID, const uint64* channelOf,
+                    const unsigned char* denied, int denyOthers, anyID selfID,
+                    unsigned char* seen, struct MoveSetReport* report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Statistics
+ *
+ * Only a handful of operations are open at a time, so every move event
+ * checks each open tracker's bitmap; a miss costs one bit test per tracker.
+ * Closed trackers are kept with their bitmaps and handed to the next
+ * operations, so tracking a move normally takes no heap call.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "move_stats.h"
+
+#define NANOS_PER_MS 1000000ULL
+#define AWAITING_BYTES (65536 / 8)
+
+void moveStatsInit(struct MoveStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* Release a list of trackers */
+static void freeTrackers(struct MoveTracker* tracker)
+{
+    while (tracker) {
+        struct MoveTracker* next = tracker->next;
+        free(tracker->awaiting);
+        free(tracker);
+        tracker = next;
+    }
+}
+
+void moveStatsFree(struct MoveStats* stats)
+{
+    freeTrackers(stats->open);
+    freeTrackers(stats->spare);
+    stats->open = NULL;
+    stats->spare = NULL;
+}
+
+int moveStatsTrack(struct MoveStats* stats, const void* owner, uint64 targetChannelID, unsigned long long requestedAt,
+                   const anyID* clients, int count, const uint64* channelOf)
+{
+    struct MoveTracker* tracker = stats->spare;
+    unsigned char* awaiting;
+    int i;
+
+    if (tracker) {
+        /* Clients that never arrived are still marked */
+        stats->spare = tracker->next;
+        awaiting = tracker->awaiting;
+        memset(awaiting, 0, AWAITING_BYTES);
+    } else {
+        tracker = (struct MoveTracker*)malloc(sizeof(struct MoveTracker));
+        if (!tracker) {
+            return -1;
+        }
+        awaiting = (unsigned char*)calloc(AWAITING_BYTES, 1);
+        if (!awaiting) {
+            free(tracker);
+            return -1;
+        }
+    }
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->awaiting = awaiting;
+    tracker->targetChannelID = targetChannelID;
+    tracker->owner = owner;
+    tracker->requestedAt = requestedAt;
+
+    for (i = 0; i < count; i++) {
+        anyID clientID = clients[i];
+        if (channelOf[clientID] == targetChannelID || (tracker->awaiting[clientID >> 3] & (1 << (clientID & 7)))) {
+            continue;
+        }
+        tracker->awaiting[clientID >> 3] |= (unsigned char)(1 << (clientID & 7));
+        tracker->expected++;
+    }
+
+    tracker->next = stats->open;
+    stats->open = tracker;
+    return 0;
+}
+
+/* Turn a tracker into a history sample and put it aside for reuse */
+static void closeTracker(struct MoveStats* stats, struct MoveTracker** link, struct MoveSample* closed)
+{
+    struct MoveTracker* tracker = *link;
+
+    closed->targetChannelID = tracker->targetChannelID;
+    closed->expected = tracker->expected;
+    closed->arrived = tracker->arrived;
+    closed->firstMs = tracker->arrived ? (unsigned int)((tracker->firstArrivalAt - tracker->requestedAt) / NANOS_PER_MS) : 0;
+    closed->lastMs = tracker->arrived ? (unsigned int)((tracker->lastArrivalAt - tracker->requestedAt) / NANOS_PER_MS) : 0;
+
+    stats->history[stats->historyNext] = *closed;
+    stats->historyNext = (stats->historyNext + 1) % MOVE_STATS_HISTORY;
+    if (stats->historyCount < MOVE_STATS_HISTORY) {
+        stats->historyCount++;
+    }
+    stats->operations++;
+    stats->missing += tracker->expected - tracker->arrived;
+
+    *link = tracker->next;
+    tracker->next = stats->spare;
+    stats->spare = tracker;
+}
+
+void moveStatsOwnerDone(struct MoveStats* stats, const void* owner, unsigned long long now)
+{
+    struct MoveTracker* tracker;
+
+    for (tracker = stats->open; tracker; tracker = tracker->next) {
+        if (tracker->owner == owner) {
+            tracker->owner = NULL;
+            tracker->closesAt = now + MOVE_ARRIVAL_GRACE_MS * NANOS_PER_MS;
+        }
+    }
+}
+
+int moveStatsArrived(struct MoveStats* stats, anyID clientID, uint64 channelID, unsigned long long now, struct MoveSample* closed)
+{
+    struct MoveTracker** link;
+
+    for (link = &stats->open; *link; link = &(*link)->next) {
+        struct MoveTracker* tracker = *link;
+
+        if (tracker->targetChannelID != channelID || !(tracker->awaiting[clientID >> 3] & (1 << (clientID & 7)))) {
+            continue;
+        }
+        tracker->awaiting[clientID >> 3] &= (unsigned char)~(1 << (clientID & 7));
+        if (!tracker->arrived++) {
+            tracker->firstArrivalAt = now;
+        }
+        tracker->lastArrivalAt = now;
+
+        if (tracker->arrived == tracker->expected) {
+            closeTracker(stats, link, closed);
+            return 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+int moveStatsExpire(struct MoveStats* stats, unsigned long long now, struct MoveSample* closed, unsigned long long* wakeAt)
+{
+    struct MoveTracker** link;
+
+    *wakeAt = 0;
+    for (link = &stats->open; *link; link = &(*link)->next) {
+        struct MoveTracker* tracker = *link;
+
+        if (!tracker->closesAt) {
+            continue;
+        }
+        if (tracker->closesAt <= now || tracker->arrived == tracker->expected) {
+            closeTracker(stats, link, closed);
+            return 1;
+        }
+        if (*wakeAt == 0 || tracker->closesAt < *wakeAt) {
+            *wakeAt = tracker->closesAt;
+        }
+    }
+    return 0;
+}
+
+unsigned int moveStatsPercentile(const struct MoveStats* stats, int first, int percent)
+{
+    unsigned int values[MOVE_STATS_HISTORY];
+    int count = 0;
+    int rank;
+    int i, j;
+
+    /* Insertion sort: the history is tiny */
+    for (i = 0; i < stats->historyCount; i++) {
+        const struct MoveSample* sample = &stats->history[i];
+        unsigned int value = first ? sample->firstMs : sample->lastMs;
+
+        if (!sample->arrived) {
+            continue;
+        }
+        for (j = count; j > 0 && values[j - 1] > value; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+        count++;
+    }
+    if (!count) {
+        return 0;
+    }
+
+    rank = (percent * count + 99) / 100;
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+void moveStatsFormat(const struct MoveStats* stats, char* buffer, size_t size)
+{
+    const struct MoveSample* last;
+    struct MoveTracker* tracker;
+    int running = 0;
+    int length;
+
+    for (tracker = stats->open; tracker; tracker = tracker->next) {
+        running++;
+    }
+
+    if (!stats->historyCount) {
+        snprintf(buffer, size, "Mass moves: none finished yet, %d running", running);
+        return;
+    }
+
+    last = &stats->history[(stats->historyNext + MOVE_STATS_HISTORY - 1) % MOVE_STATS_HISTORY];
+    length = snprintf(buffer, size,
+                      "Mass moves: %llu finished, %d running, %llu clients never arrived\n"
+                      "Last move: %d of %d clients arrived in channel %llu, first after %u ms, last after %u ms\n"
+                      "Time to last arrival (last %d moves): p50 %u ms, p95 %u ms, p99 %u ms\n"
+                      "Time to first arrival: p50 %u ms, p95 %u ms, p99 %u ms",
+                      stats->operations, running, stats->missing,
+                      last->arrived, last->expected, (unsigned long long)last->targetChannelID, last->firstMs, last->lastMs,
+                      stats->historyCount,
+                      moveStatsPercentile(stats, 0, 50), moveStatsPercentile(stats, 0, 95), moveStatsPercentile(stats, 0, 99),
+                      moveStatsPercentile(stats, 1, 50), moveStatsPercentile(stats, 1, 95), moveStatsPercentile(stats, 1, 99));
+    if (length < 0 || (size_t)length >= size) {
+        buffer[size - 1] = '\0';
+    }
+}
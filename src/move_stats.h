@@ -0,0 +1,94 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Move Statistics
+ *
+ * Follows every mass move from the click until the clients show up in the
+ * target channel. A tracker awaits each moved client's move event; it closes
+ * when all of them arrived or a grace period after the last batch was
+ * answered, and leaves a sample with the time to the first and the last
+ * arrival behind. The latest samples feed rolling percentiles.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef MOVE_STATS_H
+#define MOVE_STATS_H
+
+#include <stddef.h>
+
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOVE_STATS_HISTORY 64           /* Operations the percentiles are taken over */
+#define MOVE_ARRIVAL_GRACE_MS 5000      /* Wait this long for move events after the last batch was answered */
+
+/* Outcome of one operation */
+struct MoveSample {
+    uint64 targetChannelID;
+    int expected;                   /* Clients awaited in the target */
+    int arrived;                    /* Clients seen arriving there */
+    unsigned int firstMs;           /* Click to the first arrival, valid if arrived > 0 */
+    unsigned int lastMs;            /* Click to the last arrival, valid if arrived > 0 */
+};
+
+/* Operation still waiting for move events */
+struct MoveTracker {
+    uint64 targetChannelID;
+    const void* owner;                  /* Pipeline still sending for this operation, NULL once it finished */
+    unsigned long long requestedAt;     /* Monotonic nanoseconds of the click */
+    unsigned long long firstArrivalAt;
+    unsigned long long lastArrivalAt;
+    unsigned long long closesAt;        /* Stop waiting at this time, 0 while the pipeline runs */
+    int expected;
+    int arrived;
+    unsigned char* awaiting;            /* One bit per anyID */
+    struct MoveTracker* next;
+};
+
+struct MoveStats {
+    struct MoveTracker* open;
+    struct MoveTracker* spare;          /* Closed trackers kept for the next operations */
+    struct MoveSample history[MOVE_STATS_HISTORY];  /* Ring of the latest samples */
+    int historyCount;
+    int historyNext;
+    unsigned long long operations;      /* Operations closed so far */
+    unsigned long long missing;         /* Clients that never arrived, over all operations */
+};
+
+void moveStatsInit(struct MoveStats* stats);
+void moveStatsFree(struct MoveStats* stats);
+
+/*
+ * Start awaiting clients[0..count) in targetChannelID on behalf of owner.
+ * channelOf holds every client's current channel; clients already in the
+ * target are not awaited. Returns 0 on success.
+ */
+int  moveStatsTrack(struct MoveStats* stats, const void* owner, uint64 targetChannelID, unsigned long long requestedAt,
+                    const anyID* clients, int count, const uint64* channelOf);
+
+/* The owner got answers to all its batches; its tracker closes after the grace period */
+void moveStatsOwnerDone(struct MoveStats* stats, const void* owner, unsigned long long now);
+
+/* A client showed up in a channel; returns 1 and fills *closed if that completed an operation */
+int  moveStatsArrived(struct MoveStats* stats, anyID clientID, uint64 channelID, unsigned long long now, struct MoveSample* closed);
+
+/*
+ * Close one tracker whose grace period ran out; returns 1 and fills *closed
+ * if there was one. Otherwise *wakeAt receives the earliest closing time
+ * (0 = none scheduled).
+ */
+int  moveStatsExpire(struct MoveStats* stats, unsigned long long now, struct MoveSample* closed, unsigned long long* wakeAt);
+
+/* Nearest-rank percentile of the time to the last (or first) arrival over the history, in ms; 0 without samples */
+unsigned int moveStatsPercentile(const struct MoveStats* stats, int first, int percent);
+
+/* Human readable summary for the info panel */
+void moveStatsFormat(const struct MoveStats* stats, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
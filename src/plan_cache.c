@@ -0,0 +1,88 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Plan Cache
+ *
+ * The cache is tiny, so lookups scan every entry.
+ */
+
+#include <string.h>
+
+#include "plan_cache.h"
+
+void planCacheInit(struct PlanCache* cache)
+{
+    int i;
+
+    memset(cache, 0, sizeof(*cache));
+    for (i = 0; i < PLAN_CACHE_SIZE; i++) {
+        arenaInit(&cache->plans[i].arena, 0);
+    }
+}
+
+void planCacheFree(struct PlanCache* cache)
+{
+    int i;
+
+    for (i = 0; i < PLAN_CACHE_SIZE; i++) {
+        arenaFree(&cache->plans[i].arena);
+        cache->plans[i].valid = 0;
+    }
+}
+
+struct MovePlan* planCacheFind(struct PlanCache* cache, uint64 targetChannelID, int climbLevels, unsigned int generation,
+                               unsigned long long now)
+{
+    int i;
+
+    for (i = 0; i < PLAN_CACHE_SIZE; i++) {
+        struct MovePlan* plan = &cache->plans[i];
+        if (plan->valid && plan->targetChannelID == targetChannelID && plan->climbLevels == climbLevels &&
+            plan->generation == generation) {
+            plan->usedAt = now;
+            return plan;
+        }
+    }
+    return NULL;
+}
+
+struct MovePlan* planCacheStore(struct PlanCache* cache, uint64 targetChannelID, int climbLevels, unsigned int generation,
+                                const uint64* channels, int channelCount, const anyID* clients, int clientCount,
+                                anyID selfID, const struct MoveSetReport* report, unsigned long long now)
+{
+    struct MovePlan* plan = NULL;
+    int i;
+
+    /* The same key is replanned in place, otherwise an empty or the least recently used entry goes */
+    for (i = 0; i < PLAN_CACHE_SIZE; i++) {
+        struct MovePlan* candidate = &cache->plans[i];
+        if (candidate->valid && candidate->targetChannelID == targetChannelID && candidate->climbLevels == climbLevels) {
+            plan = candidate;
+            break;
+        }
+        if (!plan || (plan->valid && (!candidate->valid || candidate->usedAt < plan->usedAt))) {
+            plan = candidate;
+        }
+    }
+
+    plan->valid = 0;
+    arenaReset(&plan->arena);
+    if (arenaReserve(&plan->arena, channelCount * sizeof(uint64) + clientCount * sizeof(anyID) + 32) != 0) {
+        return NULL;
+    }
+    plan->channels = (uint64*)arenaAlloc(&plan->arena, channelCount * sizeof(uint64));
+    plan->clients = (anyID*)arenaAlloc(&plan->arena, clientCount * sizeof(anyID));
+    memcpy(plan->channels, channels, channelCount * sizeof(uint64));
+    if (clientCount) {
+        memcpy(plan->clients, clients, clientCount * sizeof(anyID));
+    }
+
+    plan->targetChannelID = targetChannelID;
+    plan->climbLevels = climbLevels;
+    plan->generation = generation;
+    plan->selfID = selfID;
+    plan->channelCount = channelCount;
+    plan->clientCount = clientCount;
+    plan->report = *report;
+    plan->usedAt = now;
+    plan->valid = 1;
+    return plan;
+}
@@ -0,0 +1,65 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Plan Cache
+ *
+ * Keeps the outcome of planning a mass move, the family's channels and the
+ * minimized move set, for a few (target, scope) pairs of a connection. A
+ * plan is only good for the cache generation it was made at; any channel or
+ * client event moves the generation on and the plan is made again. Each
+ * entry owns an arena that is reused whenever the entry is replanned.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include "teamspeak/public_definitions.h"
+#include "arena.h"
+#include "move_set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLAN_CACHE_SIZE 4   /* Plans kept per connection: one per hotkey scope and one for the menu */
+
+struct MovePlan {
+    int valid;
+    uint64 targetChannelID;
+    int climbLevels;                /* Scope: ancestor levels climbed, -1 = whole family */
+    unsigned int generation;        /* Cache generation the plan was made at */
+    anyID selfID;                   /* Our client, if it has to be moved as well; 0 otherwise */
+    uint64* channels;               /* Channels of the scope, target first */
+    int channelCount;
+    anyID* clients;                 /* Minimized move set without our own client */
+    int clientCount;
+    struct MoveSetReport report;    /* What minimizing removed */
+    unsigned long long usedAt;      /* Monotonic nanoseconds of the last lookup or store */
+    struct Arena arena;             /* Holds channels and clients */
+};
+
+struct PlanCache {
+    struct MovePlan plans[PLAN_CACHE_SIZE];
+};
+
+void planCacheInit(struct PlanCache* cache);
+void planCacheFree(struct PlanCache* cache);
+
+/* Plan for target and scope made at generation, or NULL */
+struct MovePlan* planCacheFind(struct PlanCache* cache, uint64 targetChannelID, int climbLevels, unsigned int generation,
+                               unsigned long long now);
+
+/*
+ * Store a plan, replacing the one for the same target and scope or the
+ * least recently used one. The lists are copied. Returns the stored plan or
+ * NULL if out of memory.
+ */
+struct MovePlan* planCacheStore(struct PlanCache* cache, uint64 targetChannelID, int climbLevels, unsigned int generation,
+                                const uint64* channels, int channelCount, const anyID* clients, int clientCount,
+                                anyID selfID, const struct MoveSetReport* report, unsigned long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Plan Format
+ *
+ * Integers are written byte by byte, so the encoding is the same on every
+ * platform. Decoding checks every count against the size of the input
+ * before anything is allocated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan_format.h"
+
+#define PLAN_HEADER_SIZE 48
+#define PLAN_GROUP_SIZE 12
+#define PLAN_FILE_MAX_BYTES (64L * 1024 * 1024)    /* Far above any server's plan; larger files are refused unread */
+
+static unsigned char* put16(unsigned char* out, unsigned int value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    return out + 2;
+}
+
+static unsigned char* put32(unsigned char* out, unsigned int value)
+{
+    out = put16(out, value & 0xffff);
+    return put16(out, value >> 16);
+}
+
+static unsigned char* put64(unsigned char* out, unsigned long long value)
+{
+    out = put32(out, (unsigned int)(value & 0xffffffffu));
+    return put32(out, (unsigned int)(value >> 32));
+}
+
+static unsigned int get16(const unsigned char* in)
+{
+    return (unsigned int)in[0] | (unsigned int)in[1] << 8;
+}
+
+static unsigned int get32(const unsigned char* in)
+{
+    return get16(in) | get16(in + 2) << 16;
+}
+
+static unsigned long long get64(const unsigned char* in)
+{
+    return (unsigned long long)get32(in) | (unsigned long long)get32(in + 4) << 32;
+}
+
+void planDocumentInit(struct PlanDocument* document)
+{
+    memset(document, 0, sizeof(*document));
+    arenaInit(&document->arena, 0);
+}
+
+void planDocumentFree(struct PlanDocument* document)
+{
+    arenaFree(&document->arena);
+    document->channels = NULL;
+    document->groups = NULL;
+    document->clients = NULL;
+    document->batches = NULL;
+}
+
+/* Take the lists of a document of the given shape from its arena; returns 0 on success */
+static int allocateLists(struct PlanDocument* document, int channelCount, int groupCount, int clientCount, int batchCount)
+{
+    arenaReset(&document->arena);
+    if (arenaReserve(&document->arena, channelCount * sizeof(uint64) + groupCount * sizeof(struct PlanGroup) +
+                                           clientCount * sizeof(anyID) + batchCount * sizeof(int) + 64) != 0) {
+        return -1;
+    }
+    document->channels = (uint64*)arenaAlloc(&document->arena, channelCount * sizeof(uint64));
+    document->groups = (struct PlanGroup*)arenaAlloc(&document->arena, groupCount * sizeof(struct PlanGroup));
+    document->clients = (anyID*)arenaAlloc(&document->arena, clientCount * sizeof(anyID));
+    document->batches = (int*)arenaAlloc(&document->arena, batchCount * sizeof(int));
+    document->channelCount = channelCount;
+    document->groupCount = groupCount;
+    document->clientCount = clientCount;
+    document->batchCount = batchCount;
+    return 0;
+}
+
+int planDocumentFromPlan(struct PlanDocument* document, const struct MovePlan* plan, const uint64* channelOf,
+                         int batchSize, unsigned long long planNanos)
+{
+    int batchCount;
+    int i;
+
+    if (batchSize < 1) {
+        return -1;
+    }
+    batchCount = (plan->clientCount + batchSize - 1) / batchSize;
+
+    /* Every client may start a group of its own */
+    if (allocateLists(document, plan->channelCount, plan->clientCount, plan->clientCount, batchCount) != 0) {
+        return -1;
+    }
+    document->targetChannelID = plan->targetChannelID;
+    document->climbLevels = plan->climbLevels;
+    document->selfID = plan->selfID;
+    document->planNanos = planNanos;
+    memcpy(document->channels, plan->channels, plan->channelCount * sizeof(uint64));
+    memcpy(document->clients, plan->clients, plan->clientCount * sizeof(anyID));
+
+    /* Clients were collected channel by channel, so each channel's clients form one run */
+    document->groupCount = 0;
+    for (i = 0; i < plan->clientCount; i++) {
+        uint64 channelID = channelOf[plan->clients[i]];
+        struct PlanGroup* group = document->groupCount ? &document->groups[document->groupCount - 1] : NULL;
+
+        if (group && group->channelID == channelID) {
+            group->count++;
+            continue;
+        }
+        group = &document->groups[document->groupCount++];
+        group->channelID = channelID;
+        group->first = i;
+        group->count = 1;
+    }
+
+    for (i = 0; i < batchCount; i++) {
+        int remaining = plan->clientCount - i * batchSize;
+        document->batches[i] = remaining < batchSize ? remaining : batchSize;
+    }
+    return 0;
+}
+
+size_t planEncodedSize(const struct PlanDocument* document)
+{
+    return PLAN_HEADER_SIZE + (size_t)document->channelCount * 8 + (size_t)document->groupCount * PLAN_GROUP_SIZE +
+           (size_t)document->clientCount * 2 + (size_t)document->batchCount * 4;
+}
+
+size_t planEncode(const struct PlanDocument* document, unsigned char* buffer)
+{
+    unsigned char* out = buffer;
+    int i;
+
+    memcpy(out, PLAN_FORMAT_MAGIC, 6);
+    out = put16(out + 6, PLAN_FORMAT_VERSION);
+    out = put64(out, document->targetChannelID);
+    out = put32(out, (unsigned int)document->climbLevels);
+    out = put16(out, document->selfID);
+    out = put16(out, 0);
+    out = put64(out, document->planNanos);
+    out = put32(out, (unsigned int)document->channelCount);
+    out = put32(out, (unsigned int)document->groupCount);
+    out = put32(out, (unsigned int)document->clientCount);
+    out = put32(out, (unsigned int)document->batchCount);
+
+    for (i = 0; i < document->channelCount; i++) {
+        out = put64(out, document->channels[i]);
+    }
+    for (i = 0; i < document->groupCount; i++) {
+        out = put64(out, document->groups[i].channelID);
+        out = put32(out, (unsigned int)document->groups[i].count);
+    }
+    for (i = 0; i < document->clientCount; i++) {
+        out = put16(out, document->clients[i]);
+    }
+    for (i = 0; i < document->batchCount; i++) {
+        out = put32(out, (unsigned int)document->batches[i]);
+    }
+    return (size_t)(out - buffer);
+}
+
+int planDecode(struct PlanDocument* document, const unsigned char* buffer, size_t size)
+{
+    const unsigned char* in = buffer + PLAN_HEADER_SIZE;
+    unsigned long long expected;
+    unsigned int channelCount, groupCount, clientCount, batchCount;
+    int covered;
+    int i;
+
+    if (size < PLAN_HEADER_SIZE || memcmp(buffer, PLAN_FORMAT_MAGIC, 6) != 0 || get16(buffer + 6) != PLAN_FORMAT_VERSION) {
+        return -1;
+    }
+    channelCount = get32(buffer + 32);
+    groupCount = get32(buffer + 36);
+    clientCount = get32(buffer + 40);
+    batchCount = get32(buffer + 44);
+
+    /* Each list is bounded by the clients a server can hold or by the input itself */
+    if (clientCount > PLAN_FORMAT_MAX_CLIENTS || groupCount > clientCount || batchCount > clientCount || channelCount < 1) {
+        return -1;
+    }
+    expected = PLAN_HEADER_SIZE + (unsigned long long)channelCount * 8 + (unsigned long long)groupCount * PLAN_GROUP_SIZE +
+               (unsigned long long)clientCount * 2 + (unsigned long long)batchCount * 4;
+    if (expected != size) {
+        return -1;
+    }
+    if (allocateLists(document, (int)channelCount, (int)groupCount, (int)clientCount, (int)batchCount) != 0) {
+        return -1;
+    }
+
+    document->targetChannelID = get64(buffer + 8);
+    document->climbLevels = (int)get32(buffer + 16);
+    document->selfID = (anyID)get16(buffer + 20);
+    document->planNanos = get64(buffer + 24);
+
+    for (i = 0; i < (int)channelCount; i++, in += 8) {
+        document->channels[i] = get64(in);
+    }
+    covered = 0;
+    for (i = 0; i < (int)groupCount; i++, in += PLAN_GROUP_SIZE) {
+        unsigned int count = get32(in + 8);
+        if (count < 1 || count > clientCount - (unsigned int)covered) {
+            return -1;
+        }
+        document->groups[i].channelID = get64(in);
+        document->groups[i].first = covered;
+        document->groups[i].count = (int)count;
+        covered += (int)count;
+    }
+    if (covered != (int)clientCount) {
+        return -1;
+    }
+    for (i = 0; i < (int)clientCount; i++, in += 2) {
+        document->clients[i] = (anyID)get16(in);
+        if (!document->clients[i]) {
+            return -1;
+        }
+    }
+    covered = 0;
+    for (i = 0; i < (int)batchCount; i++, in += 4) {
+        unsigned int count = get32(in);
+        if (count < 1 || count > clientCount - (unsigned int)covered) {
+            return -1;
+        }
+        document->batches[i] = (int)count;
+        covered += (int)count;
+    }
+    return covered == (int)clientCount ? 0 : -1;
+}
+
+int planSave(const struct PlanDocument* document, const char* path)
+{
+    size_t size = planEncodedSize(document);
+    unsigned char* buffer = (unsigned char*)malloc(size);
+    FILE* file;
+    int result = -1;
+
+    if (!buffer) {
+        return -1;
+    }
+    planEncode(document, buffer);
+
+    file = fopen(path, "wb");
+    if (file) {
+        if (fwrite(buffer, 1, size, file) == size) {
+            result = 0;
+        }
+        if (fclose(file) != 0) {
+            result = -1;
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+int planLoad(struct PlanDocument* document, const char* path)
+{
+    unsigned char* buffer;
+    FILE* file;
+    long size;
+    int result = -1;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < PLAN_HEADER_SIZE || size > PLAN_FILE_MAX_BYTES || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    buffer = (unsigned char*)malloc((size_t)size);
+    if (buffer) {
+        if (fread(buffer, 1, (size_t)size, file) == (size_t)size) {
+            result = planDecode(document, buffer, (size_t)size);
+        }
+        free(buffer);
+    }
+    fclose(file);
+    return result;
+}
@@ -0,0 +1,94 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Plan Format
+ *
+ * A move plan taken out of the plugin: the target, the channels of the
+ * scope, the clients to move grouped by the channel they were found in, and
+ * the batches they are sent in. Plans are encoded in a compact binary form,
+ * all integers little endian, so they can be saved by a preview and run
+ * later, or handed to another process:
+ *
+ *   "MMPLAN" u16 version
+ *   u64 target, i32 climbLevels, u16 selfID, u16 reserved, u64 planNanos
+ *   u32 channelCount, u32 groupCount, u32 clientCount, u32 batchCount
+ *   channelCount x u64 channel               (target first)
+ *   groupCount x (u64 channel, u32 count)    (clients in group order)
+ *   clientCount x u16 client
+ *   batchCount x u32 clients per batch       (in send order, covering all clients)
+ *
+ * Client IDs are only good for the connection and session they were
+ * planned on.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef PLAN_FORMAT_H
+#define PLAN_FORMAT_H
+
+#include <stddef.h>
+
+#include "teamspeak/public_definitions.h"
+#include "arena.h"
+#include "plan_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLAN_FORMAT_MAGIC "MMPLAN"
+#define PLAN_FORMAT_VERSION 1
+#define PLAN_FORMAT_MAX_CLIENTS 65536
+
+/* Clients [first, first + count) of a plan were found in channelID */
+struct PlanGroup {
+    uint64 channelID;
+    int first;
+    int count;
+};
+
+struct PlanDocument {
+    uint64 targetChannelID;
+    int climbLevels;                /* Scope: ancestor levels climbed, -1 = whole family */
+    anyID selfID;                   /* Our client, moved last on its own; 0 if not moved */
+    unsigned long long planNanos;   /* Time planning took */
+    uint64* channels;               /* Channels of the scope, target first */
+    int channelCount;
+    struct PlanGroup* groups;
+    int groupCount;
+    anyID* clients;                 /* Clients to move without our own one, grouped by source channel */
+    int clientCount;
+    int* batches;                   /* Clients per batch, in send order */
+    int batchCount;
+    struct Arena arena;             /* Holds every list */
+};
+
+void planDocumentInit(struct PlanDocument* document);
+void planDocumentFree(struct PlanDocument* document);
+
+/*
+ * Fill a document from a plan: clients are grouped by their channel in
+ * channelOf, which must be the index the plan was made from, and split into
+ * batches of batchSize. Returns 0 on success.
+ */
+int  planDocumentFromPlan(struct PlanDocument* document, const struct MovePlan* plan, const uint64* channelOf,
+                          int batchSize, unsigned long long planNanos);
+
+/* Bytes planEncode writes for a document */
+size_t planEncodedSize(const struct PlanDocument* document);
+
+/* Encode a document into buffer, which holds planEncodedSize bytes; returns the bytes written */
+size_t planEncode(const struct PlanDocument* document, unsigned char* buffer);
+
+/* Decode and check an encoded plan into a document; returns 0 on success, -1 if malformed or out of memory */
+int  planDecode(struct PlanDocument* document, const unsigned char* buffer, size_t size);
+
+/* Write a document to a file, replacing it; returns 0 on success */
+int  planSave(const struct PlanDocument* document, const char* path);
+
+/* Read a document from a file; returns 0 on success */
+int  planLoad(struct PlanDocument* document, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Platform
+ *
+ * POSIX condition variables wait on CLOCK_MONOTONIC so a wall clock change
+ * can't stretch or cut short a backoff.
+ */
+
+#include <time.h>
+
+#include "platform.h"
+
+unsigned long long monotonicNanos(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (!frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+void sleepMillis(unsigned int milliseconds)
+{
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    struct timespec ts;
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/****************************** Threads ********************************/
+
+#ifdef _WIN32
+static DWORD WINAPI threadEntry(LPVOID parameter)
+{
+    struct PlatformThread* thread = (struct PlatformThread*)parameter;
+    thread->function(thread->argument);
+    return 0;
+}
+#else
+static void* threadEntry(void* parameter)
+{
+    struct PlatformThread* thread = (struct PlatformThread*)parameter;
+    thread->function(thread->argument);
+    return NULL;
+}
+#endif
+
+int threadStart(struct PlatformThread* thread, ThreadFunction function, void* argument)
+{
+    thread->function = function;
+    thread->argument = argument;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, threadEntry, thread, 0, NULL);
+    return thread->handle ? 0 : -1;
+#else
+    return pthread_create(&thread->handle, NULL, threadEntry, thread) == 0 ? 0 : -1;
+#endif
+}
+
+void threadJoin(struct PlatformThread* thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+/****************************** Mutex and condition ********************************/
+
+void mutexInit(struct PlatformMutex* mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->section);
+#else
+    pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+}
+
+void mutexDestroy(struct PlatformMutex* mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->section);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+}
+
+void mutexLock(struct PlatformMutex* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->section);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void mutexUnlock(struct PlatformMutex* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->section);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void conditionInit(struct PlatformCondition* condition)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(&condition->variable);
+#else
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&condition->cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+#endif
+}
+
+void conditionDestroy(struct PlatformCondition* condition)
+{
+#ifndef _WIN32
+    pthread_cond_destroy(&condition->cond);
+#endif
+}
+
+void conditionSignal(struct PlatformCondition* condition)
+{
+#ifdef _WIN32
+    WakeConditionVariable(&condition->variable);
+#else
+    pthread_cond_signal(&condition->cond);
+#endif
+}
+
+void conditionWaitUntil(struct PlatformCondition* condition, struct PlatformMutex* mutex, unsigned long long deadline)
+{
+#ifdef _WIN32
+    DWORD timeout = INFINITE;
+    if (deadline) {
+        unsigned long long now = monotonicNanos();
+        timeout = deadline > now ? (DWORD)((deadline - now + NANOS_PER_MS - 1) / NANOS_PER_MS) : 0;
+    }
+    SleepConditionVariableCS(&condition->variable, &mutex->section, timeout);
+#else
+    if (deadline) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)(deadline / 1000000000ULL);
+        ts.tv_nsec = (long)(deadline % 1000000000ULL);
+        pthread_cond_timedwait(&condition->cond, &mutex->mutex, &ts);
+    } else {
+        pthread_cond_wait(&condition->cond, &mutex->mutex);
+    }
+#endif
+}
+
+/****************************** Atomics ********************************/
+
+unsigned int atomicLoad(volatile unsigned int* value)
+{
+#ifdef _WIN32
+    return (unsigned int)InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void atomicStore(volatile unsigned int* value, unsigned int desired)
+{
+#ifdef _WIN32
+    InterlockedExchange((volatile LONG*)value, (LONG)desired);
+#else
+    __atomic_store_n(value, desired, __ATOMIC_RELEASE);
+#endif
+}
+
+int atomicCompareExchange(volatile unsigned int* value, unsigned int expected, unsigned int desired)
+{
+#ifdef _WIN32
+    return (unsigned int)InterlockedCompareExchange((volatile LONG*)value, (LONG)desired, (LONG)expected) == expected;
+#else
+    return __atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+unsigned int atomicAdd(volatile unsigned int* value, unsigned int delta)
+{
+#ifdef _WIN32
+    return (unsigned int)InterlockedExchangeAdd((volatile LONG*)value, (LONG)delta) + delta;
+#else
+    return __atomic_add_fetch(value, delta, __ATOMIC_SEQ_CST);
+#endif
+}
@@ -0,0 +1,92 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Platform
+ *
+ * The little the plugin needs from the operating system beyond the C
+ * library: a monotonic clock, sleeping, threads, mutexes, condition
+ * variables with a deadline on the monotonic clock and a few atomic
+ * operations. Win32 primitives on Windows, POSIX threads and the compiler's
+ * atomic builtins everywhere else.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#if defined(WIN32) || defined(__WIN32__) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NANOS_PER_MS 1000000ULL
+
+typedef void (*ThreadFunction)(void* argument);
+
+struct PlatformThread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadFunction function;
+    void* argument;
+};
+
+struct PlatformMutex {
+#ifdef _WIN32
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct PlatformCondition {
+#ifdef _WIN32
+    CONDITION_VARIABLE variable;
+#else
+    pthread_cond_t cond;
+#endif
+};
+
+/* Monotonic clock in nanoseconds */
+unsigned long long monotonicNanos(void);
+
+/* Block the calling thread for a while */
+void sleepMillis(unsigned int milliseconds);
+
+/* Run function(argument) on a new thread; returns 0 on success */
+int  threadStart(struct PlatformThread* thread, ThreadFunction function, void* argument);
+void threadJoin(struct PlatformThread* thread);
+
+void mutexInit(struct PlatformMutex* mutex);
+void mutexDestroy(struct PlatformMutex* mutex);
+void mutexLock(struct PlatformMutex* mutex);
+void mutexUnlock(struct PlatformMutex* mutex);
+
+void conditionInit(struct PlatformCondition* condition);
+void conditionDestroy(struct PlatformCondition* condition);
+void conditionSignal(struct PlatformCondition* condition);
+
+/*
+ * Release the locked mutex and wait for a signal or until the monotonic
+ * deadline (nanoseconds, 0 = no deadline) passes; the mutex is held again
+ * on return. Spurious wakeups are possible.
+ */
+void conditionWaitUntil(struct PlatformCondition* condition, struct PlatformMutex* mutex, unsigned long long deadline);
+
+/* Atomic operations on a 32 bit word shared between threads; loads acquire, stores release, the rest is sequentially consistent */
+unsigned int atomicLoad(volatile unsigned int* value);
+void atomicStore(volatile unsigned int* value, unsigned int desired);
+int  atomicCompareExchange(volatile unsigned int* value, unsigned int expected, unsigned int desired);   /* 1 if it swapped */
+unsigned int atomicAdd(volatile unsigned int* value, unsigned int delta);                               /* Returns the new value */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,482 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - SDK Trace
+ *
+ * Records are encoded under one lock into a buffer that grows to the
+ * largest record seen and go through a large stdio buffer, so recording
+ * costs the plugin a few hundred nanoseconds per call. Record times are
+ * taken under the lock, so they never run backwards even when calls from
+ * several workers finish out of order. The file is flushed after each user
+ * action and each finished job, which keeps the interesting part of a trace
+ * when the client is killed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "teamspeak/public_errors.h"
+
+#include "sdk_trace.h"
+#include "platform.h"
+
+/*********************************** Reader ************************************/
+
+static const char* callNames[] = {
+    "?", "freeMemory", "logMessage", "getClientID", "getChannelList", "getParentChannelOfChannel",
+    "getChannelClientList", "getClientList", "getChannelOfClient", "getClientNeededPermission",
+    "createReturnCode", "requestClientMove", "requestClientsMove", "getConfigPath", "printMessage",
+    "getCurrentServerConnectionHandlerID", "getChannelVariableAsInt", "getChannelVariableAsString"
+};
+
+static const char* callbackNames[] = {
+    "onConnectStatusChangeEvent", "currentServerConnectionChanged", "onNewChannelEvent", "onDelChannelEvent",
+    "onChannelMoveEvent", "onClientMoveEvent", "onServerErrorEvent", "onMenuItemEvent", "onHotkeyEvent",
+    "onServerGroupClientAddedEvent", "onUpdateChannelEditedEvent"
+};
+
+const char* traceKindName(enum TraceKind kind)
+{
+    if (kind >= TRACE_FREE_MEMORY && kind < TRACE_CALL_END) {
+        return callNames[kind];
+    }
+    if (kind >= TRACE_CONNECT_STATUS && kind < TRACE_KIND_END) {
+        return callbackNames[kind - TRACE_CONNECT_STATUS];
+    }
+    return "?";
+}
+
+/* Read one varint; returns 0 on success */
+static int readVarint(FILE* file, unsigned long long* value)
+{
+    unsigned long long result = 0;
+    int shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        int byte = getc(file);
+
+        if (byte == EOF) {
+            return -1;
+        }
+        result |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int traceReaderOpen(struct TraceReader* reader, const char* path)
+{
+    char magic[8];
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    if (fread(magic, 1, sizeof(magic), reader->file) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, 7) != 0 ||
+        magic[7] != TRACE_VERSION) {
+        traceReaderClose(reader);
+        return -1;
+    }
+    reader->text = (char*)malloc(TRACE_MAX_TEXT);
+    if (!reader->text) {
+        traceReaderClose(reader);
+        return -1;
+    }
+    return 0;
+}
+
+int traceReaderNext(struct TraceReader* reader, struct TraceRecord* record)
+{
+    unsigned long long fields[10];
+    unsigned long long length;
+    int first;
+    int i;
+
+    first = getc(reader->file);
+    if (first == EOF) {
+        return 0;
+    }
+    ungetc(first, reader->file);
+
+    /* kind, connection, delta, nanos, result, three values and the list length */
+    for (i = 0; i < 9; i++) {
+        if (readVarint(reader->file, &fields[i]) != 0) {
+            return -1;
+        }
+    }
+    if (fields[0] < TRACE_FREE_MEMORY || fields[0] >= TRACE_KIND_END || fields[4] > 0xffffffffu || fields[8] > TRACE_MAX_LIST) {
+        return -1;
+    }
+
+    if ((int)fields[8] > reader->listCapacity) {
+        uint64* list = (uint64*)realloc(reader->list, (size_t)fields[8] * sizeof(uint64));
+        if (!list) {
+            return -1;
+        }
+        reader->list = list;
+        reader->listCapacity = (int)fields[8];
+    }
+    for (i = 0; i < (int)fields[8]; i++) {
+        if (readVarint(reader->file, &fields[9]) != 0) {
+            return -1;
+        }
+        reader->list[i] = fields[9];
+    }
+
+    if (readVarint(reader->file, &length) != 0 || length >= TRACE_MAX_TEXT ||
+        fread(reader->text, 1, (size_t)length, reader->file) != (size_t)length) {
+        return -1;
+    }
+    reader->text[length] = '\0';
+
+    reader->at += fields[2];
+    record->kind = (enum TraceKind)fields[0];
+    record->serverConnectionHandlerID = fields[1];
+    record->at = reader->at;
+    record->nanos = fields[3];
+    record->result = (unsigned int)fields[4];
+    record->values[0] = fields[5];
+    record->values[1] = fields[6];
+    record->values[2] = fields[7];
+    record->list = reader->list;
+    record->listCount = (int)fields[8];
+    record->text = reader->text;
+    return 1;
+}
+
+void traceReaderClose(struct TraceReader* reader)
+{
+    if (reader->file) {
+        fclose(reader->file);
+    }
+    free(reader->list);
+    free(reader->text);
+    memset(reader, 0, sizeof(*reader));
+}
+
+#ifdef MASSMOVER_TRACE
+
+/*********************************** Recorder ************************************/
+
+#define TRACE_PATH_BUFSIZE 512
+#define TRACE_STDIO_BUFSIZE (256 * 1024)
+#define TRACE_VARINT_MAX 10
+
+static struct TS3Functions sdk;                 /* The functions calls are passed on to */
+static struct PlatformMutex traceLock;          /* Guards everything below; outlives traceClose, wrapped calls may still come in */
+static int traceLockReady = 0;
+static FILE* traceFile = NULL;
+static unsigned long long lastRecordAt = 0;
+static unsigned char* encodeBuffer = NULL;
+static size_t encodeCapacity = 0;
+
+static unsigned char* putVarint(unsigned char* out, unsigned long long value)
+{
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+/*
+ * Append one record. The list is taken from channels if given, else from
+ * clients; count is its length. startedAt is when the call began, 0 for
+ * callbacks.
+ */
+static void writeRecord(enum TraceKind kind, uint64 serverConnectionHandlerID, unsigned long long startedAt, unsigned int result,
+                        uint64 value0, uint64 value1, uint64 value2, const uint64* channels, const anyID* clients, int count,
+                        const char* text)
+{
+    size_t textLength = text ? strlen(text) : 0;
+    unsigned long long now;
+    unsigned char* out;
+    size_t needed;
+    int i;
+
+    if (textLength >= TRACE_MAX_TEXT) {
+        textLength = TRACE_MAX_TEXT - 1;
+    }
+    needed = (size_t)(11 + count) * TRACE_VARINT_MAX + textLength;
+
+    mutexLock(&traceLock);
+    if (!traceFile) {
+        mutexUnlock(&traceLock);
+        return;
+    }
+    if (needed > encodeCapacity) {
+        unsigned char* buffer = (unsigned char*)realloc(encodeBuffer, needed);
+        if (!buffer) {
+            mutexUnlock(&traceLock);
+            return;
+        }
+        encodeBuffer = buffer;
+        encodeCapacity = needed;
+    }
+
+    now = monotonicNanos();
+    out = putVarint(encodeBuffer, (unsigned long long)kind);
+    out = putVarint(out, serverConnectionHandlerID);
+    out = putVarint(out, now - lastRecordAt);
+    out = putVarint(out, startedAt ? now - startedAt : 0);
+    out = putVarint(out, result);
+    out = putVarint(out, value0);
+    out = putVarint(out, value1);
+    out = putVarint(out, value2);
+    out = putVarint(out, (unsigned long long)count);
+    for (i = 0; i < count; i++) {
+        out = putVarint(out, channels ? channels[i] : (uint64)clients[i]);
+    }
+    out = putVarint(out, textLength);
+    memcpy(out, text ? text : "", textLength);
+    out += textLength;
+    lastRecordAt = now;
+
+    fwrite(encodeBuffer, 1, (size_t)(out - encodeBuffer), traceFile);
+    if (kind == TRACE_MENU_ITEM || kind == TRACE_HOTKEY || kind == TRACE_PRINT_MESSAGE) {
+        fflush(traceFile);
+    }
+    mutexUnlock(&traceLock);
+}
+
+static int channelListLength(const uint64* list)
+{
+    int count = 0;
+    while (list[count]) {
+        count++;
+    }
+    return count;
+}
+
+static int clientListLength(const anyID* list)
+{
+    int count = 0;
+    while (list[count]) {
+        count++;
+    }
+    return count;
+}
+
+static unsigned int traceFreeMemory(void* pointer)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.freeMemory(pointer);
+    writeRecord(TRACE_FREE_MEMORY, 0, start, error, 0, 0, 0, NULL, NULL, 0, NULL);
+    return error;
+}
+
+static unsigned int traceLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.logMessage(logMessage, severity, channel, logID);
+    writeRecord(TRACE_LOG_MESSAGE, logID, start, error, (uint64)severity, 0, 0, NULL, NULL, 0, logMessage);
+    return error;
+}
+
+static unsigned int traceGetClientID(uint64 serverConnectionHandlerID, anyID* result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getClientID(serverConnectionHandlerID, result);
+    writeRecord(TRACE_GET_CLIENT_ID, serverConnectionHandlerID, start, error, error == ERROR_ok ? *result : 0, 0, 0, NULL, NULL, 0, NULL);
+    return error;
+}
+
+static unsigned int traceGetChannelList(uint64 serverConnectionHandlerID, uint64** result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getChannelList(serverConnectionHandlerID, result);
+    int count = error == ERROR_ok ? channelListLength(*result) : 0;
+    writeRecord(TRACE_GET_CHANNEL_LIST, serverConnectionHandlerID, start, error, 0, 0, 0, count ? *result : NULL, NULL, count, NULL);
+    return error;
+}
+
+static unsigned int traceGetParentChannelOfChannel(uint64 serverConnectionHandlerID, uint64 channelID, uint64* result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getParentChannelOfChannel(serverConnectionHandlerID, channelID, result);
+    writeRecord(TRACE_GET_PARENT_CHANNEL, serverConnectionHandlerID, start, error, channelID, error == ERROR_ok ? *result : 0, 0,
+                NULL, NULL, 0, NULL);
+    return error;
+}
+
+static unsigned int traceGetChannelClientList(uint64 serverConnectionHandlerID, uint64 channelID, anyID** result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getChannelClientList(serverConnectionHandlerID, channelID, result);
+    int count = error == ERROR_ok ? clientListLength(*result) : 0;
+    writeRecord(TRACE_GET_CHANNEL_CLIENT_LIST, serverConnectionHandlerID, start, error, channelID, 0, 0, NULL,
+                count ? *result : NULL, count, NULL);
+    return error;
+}
+
+static unsigned int traceGetClientList(uint64 serverConnectionHandlerID, anyID** result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getClientList(serverConnectionHandlerID, result);
+    int count = error == ERROR_ok ? clientListLength(*result) : 0;
+    writeRecord(TRACE_GET_CLIENT_LIST, serverConnectionHandlerID, start, error, 0, 0, 0, NULL, count ? *result : NULL, count, NULL);
+    return error;
+}
+
+static unsigned int traceGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getChannelOfClient(serverConnectionHandlerID, clientID, result);
+    writeRecord(TRACE_GET_CHANNEL_OF_CLIENT, serverConnectionHandlerID, start, error, clientID, error == ERROR_ok ? *result : 0, 0,
+                NULL, NULL, 0, NULL);
+    return error;
+}
+
+static unsigned int traceGetClientNeededPermission(uint64 serverConnectionHandlerID, const char* permissionName, int* result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getClientNeededPermission(serverConnectionHandlerID, permissionName, result);
+    writeRecord(TRACE_GET_NEEDED_PERMISSION, serverConnectionHandlerID, start, error, error == ERROR_ok ? (uint64)(long long)*result : 0,
+                0, 0, NULL, NULL, 0, permissionName);
+    return error;
+}
+
+static void traceCreateReturnCode(const char* pluginID, char* returnCode, size_t maxLen)
+{
+    unsigned long long start = monotonicNanos();
+    sdk.createReturnCode(pluginID, returnCode, maxLen);
+    writeRecord(TRACE_CREATE_RETURN_CODE, 0, start, ERROR_ok, 0, 0, 0, NULL, NULL, 0, returnCode);
+}
+
+static unsigned int traceRequestClientMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.requestClientMove(serverConnectionHandlerID, clientID, newChannelID, password, returnCode);
+    writeRecord(TRACE_REQUEST_CLIENT_MOVE, serverConnectionHandlerID, start, error, newChannelID, 0, 0, NULL, &clientID, 1, returnCode);
+    return error;
+}
+
+static unsigned int traceRequestClientsMove(uint64 serverConnectionHandlerID, const anyID* clientIDArray, uint64 newChannelID, const char* password, const char* returnCode)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.requestClientsMove(serverConnectionHandlerID, clientIDArray, newChannelID, password, returnCode);
+    writeRecord(TRACE_REQUEST_CLIENTS_MOVE, serverConnectionHandlerID, start, error, newChannelID, 0, 0, NULL, clientIDArray,
+                clientListLength(clientIDArray), returnCode);
+    return error;
+}
+
+static void traceGetConfigPath(char* path, size_t maxLen)
+{
+    unsigned long long start = monotonicNanos();
+    sdk.getConfigPath(path, maxLen);
+    writeRecord(TRACE_GET_CONFIG_PATH, 0, start, ERROR_ok, 0, 0, 0, NULL, NULL, 0, path);
+}
+
+static void tracePrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget)
+{
+    unsigned long long start = monotonicNanos();
+    sdk.printMessage(serverConnectionHandlerID, message, messageTarget);
+    writeRecord(TRACE_PRINT_MESSAGE, serverConnectionHandlerID, start, ERROR_ok, (uint64)messageTarget, 0, 0, NULL, NULL, 0, message);
+}
+
+static uint64 traceGetCurrentServerConnectionHandlerID(void)
+{
+    unsigned long long start = monotonicNanos();
+    uint64 connection = sdk.getCurrentServerConnectionHandlerID();
+    writeRecord(TRACE_GET_CURRENT_CONNECTION, 0, start, ERROR_ok, connection, 0, 0, NULL, NULL, 0, NULL);
+    return connection;
+}
+
+static unsigned int traceGetChannelVariableAsInt(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, int* result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getChannelVariableAsInt(serverConnectionHandlerID, channelID, flag, result);
+    writeRecord(TRACE_GET_CHANNEL_INT, serverConnectionHandlerID, start, error, channelID, (uint64)flag,
+                error == ERROR_ok ? (uint64)(long long)*result : 0, NULL, NULL, 0, NULL);
+    return error;
+}
+
+static unsigned int traceGetChannelVariableAsString(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, char** result)
+{
+    unsigned long long start = monotonicNanos();
+    unsigned int error = sdk.getChannelVariableAsString(serverConnectionHandlerID, channelID, flag, result);
+    writeRecord(TRACE_GET_CHANNEL_STRING, serverConnectionHandlerID, start, error, channelID, (uint64)flag, 0, NULL, NULL, 0,
+                error == ERROR_ok ? *result : NULL);
+    return error;
+}
+
+void traceOpen(const char* directory)
+{
+    char path[TRACE_PATH_BUFSIZE];
+    FILE* file;
+
+    if (!traceLockReady) {
+        mutexInit(&traceLock);
+        traceLockReady = 1;
+    }
+    if (strlen(directory) + strlen(TRACE_FILENAME) >= TRACE_PATH_BUFSIZE) {
+        return;
+    }
+    strcpy(path, directory);
+    strcat(path, TRACE_FILENAME);
+
+    file = fopen(path, "wb");
+    if (!file) {
+        printf("MASSMOVER: Failed to open trace %s\n", path);
+        return;
+    }
+    setvbuf(file, NULL, _IOFBF, TRACE_STDIO_BUFSIZE);
+    fwrite(TRACE_MAGIC, 1, 7, file);
+    putc(TRACE_VERSION, file);
+
+    mutexLock(&traceLock);
+    traceFile = file;
+    lastRecordAt = monotonicNanos();
+    mutexUnlock(&traceLock);
+    printf("MASSMOVER: Recording SDK calls to %s\n", path);
+}
+
+struct TS3Functions traceWrap(const struct TS3Functions* functions)
+{
+    struct TS3Functions wrapped = *functions;
+
+    sdk = *functions;
+    wrapped.freeMemory = traceFreeMemory;
+    wrapped.logMessage = traceLogMessage;
+    wrapped.getClientID = traceGetClientID;
+    wrapped.getChannelList = traceGetChannelList;
+    wrapped.getParentChannelOfChannel = traceGetParentChannelOfChannel;
+    wrapped.getChannelClientList = traceGetChannelClientList;
+    wrapped.getClientList = traceGetClientList;
+    wrapped.getChannelOfClient = traceGetChannelOfClient;
+    wrapped.getClientNeededPermission = traceGetClientNeededPermission;
+    wrapped.createReturnCode = traceCreateReturnCode;
+    wrapped.requestClientMove = traceRequestClientMove;
+    wrapped.requestClientsMove = traceRequestClientsMove;
+    wrapped.getConfigPath = traceGetConfigPath;
+    wrapped.printMessage = tracePrintMessage;
+    wrapped.getCurrentServerConnectionHandlerID = traceGetCurrentServerConnectionHandlerID;
+    wrapped.getChannelVariableAsInt = traceGetChannelVariableAsInt;
+    wrapped.getChannelVariableAsString = traceGetChannelVariableAsString;
+    return wrapped;
+}
+
+void traceEvent(enum TraceKind kind, uint64 serverConnectionHandlerID, uint64 value0, uint64 value1, uint64 value2,
+                unsigned int result, const char* text)
+{
+    writeRecord(kind, serverConnectionHandlerID, 0, result, value0, value1, value2, NULL, NULL, 0, text);
+}
+
+void traceClose(void)
+{
+    mutexLock(&traceLock);
+    if (traceFile) {
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+    free(encodeBuffer);
+    encodeBuffer = NULL;
+    encodeCapacity = 0;
+    mutexUnlock(&traceLock);
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - SDK Trace
+ *
+ * Records every SDK call the plugin makes, with its arguments, results and
+ * the time it took, and every callback the client makes into the plugin,
+ * into a compact trace file that bench/massmover_replay serves back to the
+ * plugin offline. Recording is compiled in only with -DMASSMOVER_TRACE:
+ * traceWrap then puts a recording function in front of each SDK function
+ * the plugin uses, and the TRACE_EVENT macro records callbacks. Without the
+ * flag TRACE_EVENT expands to nothing; the reader is always there.
+ *
+ * The file is "MMTRACE" u8 version, then one record after another. Every
+ * field of a record is an unsigned LEB128 varint, so a typical record takes
+ * a dozen bytes:
+ *
+ *   kind, connection, nanoseconds since the previous record, nanoseconds
+ *   the call took, result, value0, value1, value2,
+ *   listCount, listCount x list entry, textLength, textLength x byte
+ *
+ * What the values, the list and the text hold depends on the kind, as
+ * listed below. Client IDs in lists are stored like channel IDs.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef SDK_TRACE_H
+#define SDK_TRACE_H
+
+#include <stdio.h>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_FILENAME "massmover_trace.bin"
+#define TRACE_MAGIC "MMTRACE"
+#define TRACE_VERSION 1
+#define TRACE_MAX_LIST 1048576     /* Longer lists are malformed; channel lists stay far below */
+#define TRACE_MAX_TEXT 65536
+
+enum TraceKind {
+    /* SDK calls: result is the error returned, unless noted */
+    TRACE_FREE_MEMORY = 1,
+    TRACE_LOG_MESSAGE,              /* value0 severity; text message */
+    TRACE_GET_CLIENT_ID,            /* value0 client */
+    TRACE_GET_CHANNEL_LIST,         /* list channels */
+    TRACE_GET_PARENT_CHANNEL,       /* value0 channel, value1 parent */
+    TRACE_GET_CHANNEL_CLIENT_LIST,  /* value0 channel; list clients */
+    TRACE_GET_CLIENT_LIST,          /* list clients */
+    TRACE_GET_CHANNEL_OF_CLIENT,    /* value0 client, value1 channel */
+    TRACE_GET_NEEDED_PERMISSION,    /* value0 permission value; text permission name */
+    TRACE_CREATE_RETURN_CODE,       /* text return code */
+    TRACE_REQUEST_CLIENT_MOVE,      /* value0 channel; list the client; text return code */
+    TRACE_REQUEST_CLIENTS_MOVE,     /* value0 channel; list clients; text return code */
+    TRACE_GET_CONFIG_PATH,          /* text path */
+    TRACE_PRINT_MESSAGE,            /* value0 message target; text message */
+    TRACE_GET_CURRENT_CONNECTION,   /* value0 connection returned */
+    TRACE_GET_CHANNEL_INT,          /* value0 channel, value1 property, value2 value */
+    TRACE_GET_CHANNEL_STRING,       /* value0 channel, value1 property; text value */
+    TRACE_CALL_END,
+
+    /* Callbacks into the plugin */
+    TRACE_CONNECT_STATUS = 32,      /* value0 new status; result error */
+    TRACE_CURRENT_CONNECTION,       /* The tab was brought to the front */
+    TRACE_NEW_CHANNEL,              /* value0 channel, value1 parent */
+    TRACE_DEL_CHANNEL,              /* value0 channel */
+    TRACE_CHANNEL_MOVED,            /* value0 channel, value1 new parent */
+    TRACE_CLIENT_MOVED,             /* value0 client, value1 new channel or 0 if it left our view, value2 mover if someone moved it, else 0 */
+    TRACE_SERVER_ERROR,             /* result error; text return code */
+    TRACE_MENU_ITEM,                /* value0 menu type, value1 menu item, value2 selected item */
+    TRACE_HOTKEY,                   /* text keyword; no connection */
+    TRACE_GROUP_CHANGED,            /* value0 client whose server or channel groups changed */
+    TRACE_CHANNEL_EDITED,           /* value0 channel */
+    TRACE_KIND_END
+};
+
+struct TraceRecord {
+    enum TraceKind kind;
+    uint64 serverConnectionHandlerID;
+    unsigned long long at;          /* Nanoseconds since the trace started */
+    unsigned long long nanos;       /* Time the SDK call took, 0 for callbacks */
+    unsigned int result;
+    uint64 values[3];
+    const uint64* list;
+    int listCount;
+    const char* text;               /* Zero terminated; "" if none */
+};
+
+struct TraceReader {
+    FILE* file;
+    unsigned long long at;
+    uint64* list;                   /* Hold the list and text of the last record */
+    int listCapacity;
+    char* text;
+};
+
+/* Open a trace for reading; returns 0 on success */
+int  traceReaderOpen(struct TraceReader* reader, const char* path);
+
+/* Read the next record; its list and text stay valid until the next call. Returns 1, 0 at the end or -1 if malformed */
+int  traceReaderNext(struct TraceReader* reader, struct TraceRecord* record);
+
+void traceReaderClose(struct TraceReader* reader);
+
+/* Name of a record kind for reports, e.g. "getChannelList" or "onMenuItemEvent" */
+const char* traceKindName(enum TraceKind kind);
+
+/* Whether a kind is a callback rather than an SDK call */
+#define TRACE_IS_CALLBACK(kind) ((kind) >= TRACE_CONNECT_STATUS)
+
+#ifdef MASSMOVER_TRACE
+
+/* Start recording into TRACE_FILENAME in directory, replacing an older trace */
+void traceOpen(const char* directory);
+
+/* A table recording each SDK call the plugin makes and passing it on to the one given */
+struct TS3Functions traceWrap(const struct TS3Functions* functions);
+
+/* Record a callback; safe to call from any thread */
+void traceEvent(enum TraceKind kind, uint64 serverConnectionHandlerID, uint64 value0, uint64 value1, uint64 value2,
+                unsigned int result, const char* text);
+
+/* Write out what is buffered and stop recording */
+void traceClose(void);
+
+#define TRACE_EVENT(kind, connection, value0, value1, value2, result, text) \
+    traceEvent(kind, connection, value0, value1, value2, result, text)
+
+#else
+
+#define TRACE_EVENT(kind, connection, value0, value1, value2, result, text) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
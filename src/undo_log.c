@@ -0,0 +1,137 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Undo Log
+ *
+ * Recording sorts (origin, client) pairs by origin in the snapshot's own
+ * arena and lays the groups and clients out behind them, so a snapshot
+ * costs two bytes per client plus one group per origin channel, and no
+ * heap call once its arena has grown to the size of the usual move.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "undo_log.h"
+
+/* A client and the channel it was moved out of, while recording */
+struct UndoPair {
+    uint64 channelID;
+    anyID clientID;
+};
+
+/* Order pairs by origin channel */
+static int comparePairs(const void* a, const void* b)
+{
+    const struct UndoPair* left = (const struct UndoPair*)a;
+    const struct UndoPair* right = (const struct UndoPair*)b;
+
+    if (left->channelID != right->channelID) {
+        return left->channelID < right->channelID ? -1 : 1;
+    }
+    return left->clientID < right->clientID ? -1 : left->clientID > right->clientID;
+}
+
+void undoLogInit(struct UndoLog* log)
+{
+    int i;
+
+    memset(log, 0, sizeof(*log));
+    for (i = 0; i < UNDO_LOG_SIZE; i++) {
+        arenaInit(&log->snapshots[i].arena, 0);
+    }
+}
+
+void undoLogFree(struct UndoLog* log)
+{
+    int i;
+
+    for (i = 0; i < UNDO_LOG_SIZE; i++) {
+        arenaFree(&log->snapshots[i].arena);
+    }
+    log->count = 0;
+}
+
+void undoLogClear(struct UndoLog* log)
+{
+    log->count = 0;
+}
+
+int undoLogRecord(struct UndoLog* log, uint64 targetChannelID, const anyID* clients, int count, anyID selfID,
+                  const uint64* channelOf)
+{
+    struct UndoSnapshot* snapshot;
+    struct UndoPair* pairs;
+    int pairCount = 0;
+    int slot;
+    int i;
+
+    /* Nobody to send back leaves the log as it was */
+    for (i = 0; i <= count; i++) {
+        anyID clientID = i < count ? clients[i] : selfID;
+        if (clientID && channelOf[clientID] && channelOf[clientID] != targetChannelID) {
+            pairCount++;
+        }
+    }
+    if (!pairCount) {
+        return 0;
+    }
+
+    /* The oldest snapshot's slot, or the one after the newest while the ring fills up */
+    slot = (log->newest + 1) % UNDO_LOG_SIZE;
+    snapshot = &log->snapshots[slot];
+    if (log->count == UNDO_LOG_SIZE) {
+        log->count--;
+    }
+    arenaReset(&snapshot->arena);
+    if (arenaReserve(&snapshot->arena, pairCount * (sizeof(struct UndoPair) + sizeof(anyID) + sizeof(struct UndoGroup)) + 48) != 0) {
+        return -1;
+    }
+    pairs = (struct UndoPair*)arenaAlloc(&snapshot->arena, pairCount * sizeof(struct UndoPair));
+    pairCount = 0;
+    for (i = 0; i <= count; i++) {
+        anyID clientID = i < count ? clients[i] : selfID;
+        if (clientID && channelOf[clientID] && channelOf[clientID] != targetChannelID) {
+            pairs[pairCount].channelID = channelOf[clientID];
+            pairs[pairCount].clientID = clientID;
+            pairCount++;
+        }
+    }
+    qsort(pairs, pairCount, sizeof(struct UndoPair), comparePairs);
+
+    snapshot->clients = (anyID*)arenaAlloc(&snapshot->arena, pairCount * sizeof(anyID));
+    snapshot->groups = (struct UndoGroup*)arenaAlloc(&snapshot->arena, pairCount * sizeof(struct UndoGroup));
+    snapshot->groupCount = 0;
+    snapshot->selfID = 0;
+    for (i = 0; i < pairCount; i++) {
+        if (i == 0 || pairs[i].channelID != pairs[i - 1].channelID) {
+            struct UndoGroup* group = &snapshot->groups[snapshot->groupCount++];
+            group->channelID = pairs[i].channelID;
+            group->first = i;
+            group->count = 0;
+        }
+        snapshot->groups[snapshot->groupCount - 1].count++;
+        snapshot->clients[i] = pairs[i].clientID;
+        if (pairs[i].clientID == selfID) {
+            snapshot->selfID = selfID;
+        }
+    }
+    snapshot->clientCount = pairCount;
+    snapshot->targetChannelID = targetChannelID;
+
+    log->newest = slot;
+    log->count++;
+    return 0;
+}
+
+const struct UndoSnapshot* undoLogNewest(const struct UndoLog* log)
+{
+    return log->count ? &log->snapshots[log->newest] : NULL;
+}
+
+void undoLogDrop(struct UndoLog* log)
+{
+    if (!log->count) {
+        return;
+    }
+    log->count--;
+    log->newest = (log->newest + UNDO_LOG_SIZE - 1) % UNDO_LOG_SIZE;
+}
@@ -0,0 +1,75 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Undo Log
+ *
+ * Remembers where the clients of the last few mass moves of a connection
+ * came from: for every operation the target it moved them to and its
+ * clients grouped by the channel they were in before. Undoing an operation
+ * sends every group back to its channel in as few requests as the batch
+ * size allows, one per origin channel for the usual squad. Each snapshot
+ * owns an arena that is reused by the operation recorded after it.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef UNDO_LOG_H
+#define UNDO_LOG_H
+
+#include "teamspeak/public_definitions.h"
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UNDO_LOG_SIZE 4     /* Operations that can be undone, newest first */
+
+/* Clients [first, first + count) of a snapshot came from channelID */
+struct UndoGroup {
+    uint64 channelID;
+    int first;
+    int count;
+};
+
+struct UndoSnapshot {
+    uint64 targetChannelID;         /* Channel the operation moved everyone to */
+    anyID selfID;                   /* Our client, if the operation moved it; it is listed in its group as well */
+    struct UndoGroup* groups;       /* By origin channel, in ascending channel order */
+    int groupCount;
+    anyID* clients;                 /* Grouped by origin channel */
+    int clientCount;
+    struct Arena arena;             /* Holds groups and clients */
+};
+
+struct UndoLog {
+    struct UndoSnapshot snapshots[UNDO_LOG_SIZE];   /* Ring; the newest is at newest */
+    int count;
+    int newest;
+};
+
+void undoLogInit(struct UndoLog* log);
+void undoLogFree(struct UndoLog* log);
+
+/* Forget every snapshot but keep their memory, e.g. when client IDs lose their meaning */
+void undoLogClear(struct UndoLog* log);
+
+/*
+ * Record an operation moving clients[0..count) and our own client, if
+ * selfID is set, to targetChannelID. channelOf holds every client's channel
+ * before the move; clients already in the target or out of view are left
+ * out. The oldest snapshot makes room if the log is full. Returns 0 on
+ * success, also when there was nobody to record.
+ */
+int  undoLogRecord(struct UndoLog* log, uint64 targetChannelID, const anyID* clients, int count, anyID selfID,
+                   const uint64* channelOf);
+
+/* Newest snapshot, or NULL; valid until the next record, drop or clear */
+const struct UndoSnapshot* undoLogNewest(const struct UndoLog* log);
+
+/* Forget the newest snapshot, once it was undone */
+void undoLogDrop(struct UndoLog* log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * TeamSpeak 3 MassMover Plugin - Exclusion Rule Tests
+ *
+ * Loads rule files the way the plugin and the ServerQuery tool do and checks
+ * which channels they exclude once the traits have been read and kept like
+ * the two of them keep them.
+ *
+ * Usage: channel_rules_test
+ *
+ * Prints every failed check and exits with 1 if there was any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "channel_rules.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+/* Load rules from text written to a temporary file; returns 0 on success */
+static int loadRules(struct ChannelRules* rules, const char* text)
+{
+    char path[] = "/tmp/massmover_rules_XXXXXX";
+    int fd = mkstemp(path);
+    FILE* file;
+    int result;
+
+    if (fd == -1) {
+        return -1;
+    }
+    file = fdopen(fd, "w");
+    if (!file) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    fputs(text, file);
+    fclose(file);
+    result = channelRulesLoad(rules, path);
+    unlink(path);
+    return result;
+}
+
+/* Whether a top level channel with these properties is excluded, with only the properties the rules need read */
+static int excludes(const struct ChannelRules* rules, const char* name, int password, int permanent, int semiPermanent,
+                    int isDefault)
+{
+    unsigned int needs = rules->needs;
+    unsigned int traits;
+
+    traits = channelRulesTraits(rules, (needs & CHANNEL_TRAIT_NAME) ? name : NULL,
+                                (needs & CHANNEL_TRAIT_PASSWORD) ? password : 0,
+                                (needs & CHANNEL_TRAIT_PERMANENT) ? permanent : 0,
+                                (needs & CHANNEL_TRAIT_SEMI_PERMANENT) ? semiPermanent : 0,
+                                (needs & CHANNEL_TRAIT_DEFAULT) ? isDefault : 0);
+    return channelRulesExcludes(rules, 2, traits & channelRulesKnown(needs), 1);
+}
+
+static void testTemporary(void)
+{
+    struct ChannelRules rules;
+
+    CHECK(loadRules(&rules, "temporary = 1\n") == 0);
+    CHECK(excludes(&rules, "Lobby", 0, 0, 0, 0));
+    CHECK(!excludes(&rules, "Lobby", 0, 1, 0, 0));
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 1, 0));
+    channelRulesFree(&rules);
+}
+
+static void testPermanence(void)
+{
+    struct ChannelRules rules;
+
+    /* Only the permanent flag is read, so a channel that isn't permanent must not pass for temporary */
+    CHECK(loadRules(&rules, "permanent = 1\n") == 0);
+    CHECK(excludes(&rules, "Lobby", 0, 1, 0, 0));
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 1, 0));
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 0, 0));
+    CHECK(!(channelRulesKnown(rules.needs) & CHANNEL_TRAIT_TEMPORARY));
+    channelRulesFree(&rules);
+
+    CHECK(loadRules(&rules, "semi_permanent = 1\n") == 0);
+    CHECK(excludes(&rules, "Lobby", 0, 0, 1, 0));
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 0, 0));
+    channelRulesFree(&rules);
+}
+
+static void testOtherTraits(void)
+{
+    struct ChannelRules rules;
+
+    CHECK(loadRules(&rules, "name = AFK*\npassword = 1\ndefault = 1\n") == 0);
+    CHECK(excludes(&rules, "AFK Room", 0, 1, 0, 0));
+    CHECK(excludes(&rules, "Lobby", 1, 1, 0, 0));
+    CHECK(excludes(&rules, "Lobby", 0, 1, 0, 1));
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 0, 0));
+    CHECK(rules.ignored == 0);
+    channelRulesFree(&rules);
+
+    /* A rule turned off again excludes nothing */
+    CHECK(loadRules(&rules, "temporary = 1\ntemporary = 0\n") == 0);
+    CHECK(!excludes(&rules, "Lobby", 0, 0, 0, 0));
+    channelRulesFree(&rules);
+}
+
+int main(void)
+{
+    testTemporary();
+    testPermanence();
+    testOtherTraits();
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All exclusion rule checks passed\n");
+    return 0;
+}
@@ -0,0 +1,664 @@
+/*
+ * TeamSpeak 3 MassMover - Headless ServerQuery Tool
+ *
+ * Mass moves without a TeamSpeak client, for scripts and scheduled jobs:
+ * logs in to the ServerQuery interface of a server, fetches the channel
+ * list and the client list once, plans the move in memory with the
+ * plugin's own planner and exclusion rules, and sends the moves as
+ * clientmove commands of up to --batch-size clients. Up to --window of
+ * them are on the wire at once; the server answers in order, so answers
+ * are matched to batches first in, first out. The plugin's move pipeline
+ * keeps the schedule, so a flood answer backs off and shrinks the batches
+ * and a failure caused by a client bisects the batch until the client at
+ * fault is found, the same way the plugin does. Query clients, our own included,
+ * are never moved.
+ *
+ * Usage: massmover_query --target CHANNEL_ID [--host HOST] [--port PORT]
+ *                        [--user NAME] [--sid N] [--scope family|subtree|levels N]
+ *                        [--batch-size N] [--window N] [--exclude FILE]
+ *                        [--dry-run] [--verify] [--verbose]
+ *
+ * The password of --user is read from MASSMOVER_QUERY_PASSWORD, so it never
+ * shows in the process list. --exclude reads rules in the format of
+ * massmover_exclude.ini. --dry-run prints the plan without moving anyone;
+ * --verify fetches the client list again afterwards and counts the planned
+ * clients that are not in the target.
+ *
+ * The last line of the output is a single RESULT line meant for scripts.
+ * The exit status is 0 if everyone planned was moved, 1 if some were not
+ * and 2 if the move could not be made at all.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_errors.h"
+
+#include "arena.h"
+#include "channel_rules.h"
+#include "channel_tree.h"
+#include "client_index.h"
+#include "metrics.h"
+#include "move_pipeline.h"
+#include "move_planner.h"
+#include "move_set.h"
+#include "platform.h"
+#include "serverquery.h"
+
+#define QUERY_TIMEOUT_MS 30000              /* Longest wait for an answer */
+#define QUERY_WINDOW_DEFAULT 8              /* clientmove commands on the wire at once */
+#define QUERY_PASSWORD_ENV "MASSMOVER_QUERY_PASSWORD"
+
+/* The planner's counters, in builds that keep them */
+#ifdef MASSMOVER_METRICS
+static struct MetricsRecord planMetrics;
+#define PLAN_METRICS (&planMetrics)
+#else
+#define PLAN_METRICS NULL
+#endif
+
+struct Query {
+    int fd;
+    struct ServerQueryReader reader;
+    struct ServerQueryBuffer out;
+};
+
+static int verbose = 0;
+
+static double millisSince(unsigned long long start)
+{
+    return (monotonicNanos() - start) / 1e6;
+}
+
+/* Open a TCP connection to the ServerQuery port; returns the socket or -1 */
+static int connectQuery(const char* host, const char* port)
+{
+    struct addrinfo hints;
+    struct addrinfo* addresses;
+    struct addrinfo* address;
+    int fd = -1;
+    int error;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    error = getaddrinfo(host, port, &hints, &addresses);
+    if (error != 0) {
+        fprintf(stderr, "Failed to resolve %s: %s\n", host, gai_strerror(error));
+        return -1;
+    }
+    for (address = addresses; address; address = address->ai_next) {
+        int on = 1;
+
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            /* Batches go out as soon as the pipeline allows, not when a segment fills up */
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to connect to %s:%s: %s\n", host, port, strerror(errno));
+    }
+    return fd;
+}
+
+/*
+ * Send the command in query->out and wait for its answer. The data line,
+ * if there is one, is copied to *data (may be NULL), which the caller
+ * frees. Returns the error id of the answer, or -1 if the connection
+ * failed.
+ */
+static int runCommand(struct Query* query, char** data)
+{
+    char* line;
+    char* copy = NULL;
+
+    if (data) {
+        *data = NULL;
+    }
+    if (serverQueryFlush(&query->out, query->fd) != 0) {
+        fprintf(stderr, "Failed to send a command: %s\n", strerror(errno));
+        return -1;
+    }
+    while (serverQueryReadLine(&query->reader, QUERY_TIMEOUT_MS, &line) == 1) {
+        unsigned int id;
+        const char* message;
+
+        if (serverQueryIsError(line, &id, &message)) {
+            if (id != SERVERQUERY_ERROR_OK) {
+                fprintf(stderr, "Server: error %u, %s\n", id, message);
+                free(copy);
+                copy = NULL;
+            }
+            if (data) {
+                *data = copy;
+            } else {
+                free(copy);
+            }
+            return (int)id;
+        }
+
+        /* The next read may move the buffer, so a data line has to be kept aside */
+        if (data && strncmp(line, "notify", 6) != 0) {
+            free(copy);
+            copy = strdup(line);
+            if (!copy) {
+                fprintf(stderr, "Failed to allocate memory for an answer\n");
+                return -1;
+            }
+        }
+    }
+    free(copy);
+    fprintf(stderr, "No answer from the server\n");
+    return -1;
+}
+
+/* Read the greeting the server sends on connect */
+static int readBanner(struct Query* query)
+{
+    char* line;
+
+    if (serverQueryReadLine(&query->reader, QUERY_TIMEOUT_MS, &line) != 1 || strcmp(line, "TS3") != 0) {
+        fprintf(stderr, "Not a ServerQuery interface\n");
+        return -1;
+    }
+    if (serverQueryReadLine(&query->reader, QUERY_TIMEOUT_MS, &line) != 1) {
+        fprintf(stderr, "No greeting from the server\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Log in, select the virtual server and find out who we are; returns our client ID, or 0 on failure */
+static anyID openSession(struct Query* query, const char* user, int serverID)
+{
+    char* data;
+    char* item;
+    char* key;
+    char* value;
+    anyID selfID = 0;
+
+    if (readBanner(query) != 0) {
+        return 0;
+    }
+    if (user) {
+        const char* password = getenv(QUERY_PASSWORD_ENV);
+
+        serverQueryAppend(&query->out, "login client_login_name=");
+        serverQueryAppendEscaped(&query->out, user);
+        serverQueryAppend(&query->out, " client_login_password=");
+        serverQueryAppendEscaped(&query->out, password ? password : "");
+        serverQueryAppend(&query->out, "\n");
+        if (runCommand(query, NULL) != SERVERQUERY_ERROR_OK) {
+            return 0;
+        }
+    }
+    serverQueryAppend(&query->out, "use sid=%d\n", serverID);
+    if (runCommand(query, NULL) != SERVERQUERY_ERROR_OK) {
+        return 0;
+    }
+    serverQueryAppend(&query->out, "whoami\n");
+    if (runCommand(query, &data) != SERVERQUERY_ERROR_OK || !data) {
+        free(data);
+        return 0;
+    }
+    item = data;
+    while (serverQueryNextField(&item, &key, &value)) {
+        if (strcmp(key, "client_id") == 0) {
+            selfID = (anyID)strtoul(value, NULL, 10);
+        }
+    }
+    free(data);
+    return selfID;
+}
+
+/* Build the channel tree from one channellist, with the traits the rules ask for; returns 0 on success */
+static int fetchChannels(struct Query* query, const struct ChannelRules* rules, struct ChannelTree* tree)
+{
+    char* data;
+    char* cursor;
+    char* item;
+    int count = 1;
+    char* c;
+
+    serverQueryAppend(&query->out, "channellist -flags\n");
+    if (runCommand(query, &data) != SERVERQUERY_ERROR_OK) {
+        free(data);
+        return -1;
+    }
+    for (c = data; c && *c; c++) {
+        count += *c == '|';
+    }
+    if (channelTreeInit(tree, count) != 0) {
+        fprintf(stderr, "Failed to allocate memory for the channel tree\n");
+        free(data);
+        return -1;
+    }
+
+    cursor = data;
+    while ((item = serverQueryNextItem(&cursor))) {
+        uint64 channelID = 0, parentID = 0;
+        const char* name = NULL;
+        int password = 0, permanent = 0, semiPermanent = 0, isDefault = 0;
+        char* key;
+        char* value;
+        int node;
+
+        while (serverQueryNextField(&item, &key, &value)) {
+            if (strcmp(key, "cid") == 0) {
+                channelID = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "pid") == 0) {
+                parentID = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "channel_name") == 0) {
+                name = value;
+            } else if (strcmp(key, "channel_flag_password") == 0) {
+                password = atoi(value);
+            } else if (strcmp(key, "channel_flag_permanent") == 0) {
+                permanent = atoi(value);
+            } else if (strcmp(key, "channel_flag_semi_permanent") == 0) {
+                semiPermanent = atoi(value);
+            } else if (strcmp(key, "channel_flag_default") == 0) {
+                isDefault = atoi(value);
+            }
+        }
+        if (!channelID) {
+            continue;
+        }
+        node = channelTreeAdd(tree, channelID, parentID);
+        if (node == -1) {
+            fprintf(stderr, "Failed to add channel %llu to the tree\n", (unsigned long long)channelID);
+            continue;
+        }
+        if (rules->needs) {
+            unsigned int traits = channelRulesTraits(rules, name, password, permanent, semiPermanent, isDefault);
+            tree->nodes[node].traits = (unsigned char)(traits & channelRulesKnown(rules->needs));
+        }
+    }
+    free(data);
+    channelTreeLink(tree);
+    return 0;
+}
+
+/* Fill the client index from one clientlist, leaving out query clients; returns the number of clients or -1 */
+static int fetchClients(struct Query* query, struct ChannelTree* tree, struct ClientIndex* index)
+{
+    char* data;
+    char* cursor;
+    char* item;
+
+    serverQueryAppend(&query->out, "clientlist\n");
+    if (runCommand(query, &data) != SERVERQUERY_ERROR_OK) {
+        free(data);
+        return -1;
+    }
+    clientIndexClear(index, tree);
+
+    cursor = data;
+    while ((item = serverQueryNextItem(&cursor))) {
+        unsigned long clientID = 0;
+        uint64 channelID = 0;
+        int type = 0;
+        char* key;
+        char* value;
+
+        while (serverQueryNextField(&item, &key, &value)) {
+            if (strcmp(key, "clid") == 0) {
+                clientID = strtoul(value, NULL, 10);
+            } else if (strcmp(key, "cid") == 0) {
+                channelID = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "client_type") == 0) {
+                type = atoi(value);
+            }
+        }
+        if (clientID && clientID < CLIENT_INDEX_SIZE && channelID && type == 0) {
+            clientIndexSet(index, tree, (anyID)clientID, channelID);
+        }
+    }
+    free(data);
+    return index->clientCount;
+}
+
+/* The answer to a clientmove in the terms of the move pipeline */
+static unsigned int pipelineError(unsigned int id, const struct MoveBatch* batch)
+{
+    if (id == SERVERQUERY_ERROR_FLOODING) {
+        return ERROR_client_is_flooding;
+    }
+
+    /* A lone client that got to the target some other way is where we want it */
+    if (id == SERVERQUERY_ERROR_ALREADY_MEMBER && batch->count == 1) {
+        return ERROR_ok;
+    }
+
+    /* The pipeline bisects only what is down to a client, and fails the batch on anything else */
+    switch (id) {
+    case SERVERQUERY_ERROR_OK:
+        return ERROR_ok;
+    case SERVERQUERY_ERROR_CLIENT_INVALID_ID:
+        return ERROR_client_invalid_id;
+    case SERVERQUERY_ERROR_ALREADY_MEMBER:
+        return ERROR_channel_already_in;
+    case SERVERQUERY_ERROR_PERMISSIONS_INSUFFICIENT:
+        return ERROR_permissions_client_insufficient;
+    case SERVERQUERY_ERROR_CHANNEL_INVALID_ID:
+        return ERROR_channel_invalid_id;
+    default:
+        return ERROR_undefined;
+    }
+}
+
+/*
+ * Send the planned moves through a move pipeline, keeping up to window
+ * clientmove commands on the wire. Returns 0 once every batch was answered,
+ * -1 if the connection failed.
+ */
+static int sendMoves(struct Query* query, struct MovePipeline* pipeline, int window)
+{
+    int* ring;
+    int ringStart = 0;
+    int ringCount = 0;
+    int i;
+
+    /* The pipeline never has more than window batches in flight */
+    ring = (int*)malloc(window * sizeof(int));
+    if (!ring) {
+        fprintf(stderr, "Failed to allocate memory for batches in flight\n");
+        return -1;
+    }
+
+    while (!movePipelineFinished(pipeline)) {
+        unsigned long long now = monotonicNanos();
+        unsigned long long wakeAt = 0;
+        int timeoutMs = QUERY_TIMEOUT_MS;
+        int index;
+        char* line;
+        int status;
+
+        /* Everything the pipeline allows now goes out in one write */
+        while ((index = movePipelineNextBatch(pipeline, now, &wakeAt)) != -1) {
+            struct MoveBatch* batch = &pipeline->batches[index];
+
+            serverQueryAppend(&query->out, "clientmove ");
+            for (i = 0; i < batch->count; i++) {
+                serverQueryAppend(&query->out, i ? "|clid=%u" : "clid=%u", (unsigned int)pipeline->clients[batch->first + i]);
+            }
+            serverQueryAppend(&query->out, " cid=%llu\n", (unsigned long long)batch->targetChannelID);
+            movePipelineSent(pipeline, index, now);
+            ring[(ringStart + ringCount++) % window] = index;
+        }
+        if (query->out.length > 0 && serverQueryFlush(&query->out, query->fd) != 0) {
+            fprintf(stderr, "Failed to send moves: %s\n", strerror(errno));
+            free(ring);
+            return -1;
+        }
+
+        /* Wait for the next answer, but no longer than until a batch waiting out a backoff is due */
+        if (wakeAt) {
+            unsigned long long waitMs = wakeAt > now ? (wakeAt - now) / NANOS_PER_MS + 1 : 0;
+            timeoutMs = waitMs < (unsigned long long)QUERY_TIMEOUT_MS ? (int)waitMs : QUERY_TIMEOUT_MS;
+        }
+        if (ringCount == 0) {
+            if (!wakeAt) {
+                break;
+            }
+            sleepMillis(timeoutMs);
+            continue;
+        }
+        status = serverQueryReadLine(&query->reader, timeoutMs, &line);
+        if (status == 0 && wakeAt) {
+            continue;
+        }
+        if (status != 1) {
+            fprintf(stderr, "No answer to a move from the server\n");
+            free(ring);
+            return -1;
+        }
+        {
+            unsigned int id;
+            const char* message;
+            struct MoveBatch* batch;
+
+            if (!serverQueryIsError(line, &id, &message)) {
+                continue;
+            }
+            index = ring[ringStart];
+            ringStart = (ringStart + 1) % window;
+            ringCount--;
+            batch = &pipeline->batches[index];
+            if (verbose && id != SERVERQUERY_ERROR_OK) {
+                fprintf(stderr, "Batch of %d clients: error %u, %s\n", batch->count, id, message);
+            }
+            movePipelineComplete(pipeline, index, pipelineError(id, batch), monotonicNanos());
+        }
+    }
+    free(ring);
+    return 0;
+}
+
+/* Count the planned clients that are still connected but not in the target */
+static int countMisplaced(struct Query* query, struct ChannelTree* tree, struct ClientIndex* index,
+                          const struct PlannedMove* move, uint64 targetChannelID)
+{
+    int misplaced = 0;
+    int i;
+
+    if (fetchClients(query, tree, index) < 0) {
+        return -1;
+    }
+    for (i = 0; i < move->clientCount; i++) {
+        uint64 channelID = index->channelOf[move->clients[i]];
+        if (channelID && channelID != targetChannelID) {
+            misplaced++;
+        }
+    }
+    return misplaced;
+}
+
+int main(int argc, char** argv)
+{
+    const char* host = "127.0.0.1";
+    char port[16];
+    const char* user = NULL;
+    const char* excludePath = NULL;
+    const char* scopeName = "family";
+    int serverID = 1;
+    uint64 targetChannelID = 0;
+    int climbLevels = -1;
+    int batchSize = MOVE_BATCH_SIZE_DEFAULT;
+    int window = QUERY_WINDOW_DEFAULT;
+    int dryRun = 0;
+    int verify = 0;
+    struct ChannelRules rules;
+    struct ChannelTree tree;
+    struct ClientIndex index;
+    struct Arena arena;
+    struct PlannedMove move;
+    struct MovePipeline pipeline;
+    struct Query query;
+    unsigned char* seen = NULL;
+    unsigned long long start;
+    double fetchMs, planMs, moveMs = 0;
+    int clientCount;
+    int misplaced = -1;
+    int status = 2;
+    int i;
+
+    snprintf(port, sizeof(port), "%d", SERVERQUERY_PORT_DEFAULT);
+    for (i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--host") == 0) {
+            host = value;
+            i++;
+        } else if (strcmp(argv[i], "--port") == 0) {
+            snprintf(port, sizeof(port), "%s", value);
+            i++;
+        } else if (strcmp(argv[i], "--user") == 0) {
+            user = value;
+            i++;
+        } else if (strcmp(argv[i], "--sid") == 0) {
+            serverID = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--target") == 0) {
+            targetChannelID = strtoull(value, NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "--scope") == 0) {
+            scopeName = value;
+            if (strcmp(value, "family") == 0) {
+                climbLevels = -1;
+            } else if (strcmp(value, "subtree") == 0) {
+                climbLevels = 0;
+            } else if (strcmp(value, "levels") == 0 && i + 2 < argc) {
+                climbLevels = atoi(argv[i + 2]);
+                i++;
+            } else {
+                climbLevels = -2;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--batch-size") == 0) {
+            batchSize = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--window") == 0) {
+            window = atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "--exclude") == 0) {
+            excludePath = value;
+            i++;
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dryRun = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else {
+            fprintf(stderr, "Usage: %s --target CHANNEL_ID [--host HOST] [--port PORT] [--user NAME] [--sid N] [--scope family|subtree|levels N] [--batch-size N] [--window N] [--exclude FILE] [--dry-run] [--verify] [--verbose]\n", argv[0]);
+            fprintf(stderr, "The password of --user is read from %s\n", QUERY_PASSWORD_ENV);
+            return 2;
+        }
+    }
+    if (!targetChannelID || climbLevels < -1 || batchSize < 1 || window < 1) {
+        fprintf(stderr, "Need a target channel, a scope of family, subtree or levels N, and a batch size and window of at least 1\n");
+        return 2;
+    }
+
+    memset(&rules, 0, sizeof(rules));
+    if (excludePath && channelRulesLoad(&rules, excludePath) != 0) {
+        fprintf(stderr, "Failed to load the exclusion rules in %s\n", excludePath);
+        return 2;
+    }
+    memset(&tree, 0, sizeof(tree));
+    memset(&index, 0, sizeof(index));
+    memset(&pipeline, 0, sizeof(pipeline));
+    arenaInit(&arena, 0);
+    memset(&query, 0, sizeof(query));
+    query.fd = -1;
+    if (clientIndexInit(&index) != 0 || !(seen = (unsigned char*)calloc(1, CLIENT_SET_BYTES))) {
+        fprintf(stderr, "Failed to allocate memory for the client index\n");
+        goto done;
+    }
+
+    /* Everything the plan needs is fetched once */
+    signal(SIGPIPE, SIG_IGN);
+    start = monotonicNanos();
+    query.fd = connectQuery(host, port);
+    if (query.fd == -1) {
+        goto done;
+    }
+    serverQueryReaderInit(&query.reader, query.fd);
+    if (!openSession(&query, user, serverID) || fetchChannels(&query, &rules, &tree) != 0) {
+        goto done;
+    }
+    clientCount = fetchClients(&query, &tree, &index);
+    if (clientCount < 0) {
+        goto done;
+    }
+    fetchMs = millisSince(start);
+
+    start = monotonicNanos();
+    if (channelRulesActive(&rules)) {
+        channelRulesApply(&rules, &tree);
+    }
+    if (channelTreeFind(&tree, targetChannelID) == -1) {
+        fprintf(stderr, "Channel %llu does not exist\n", (unsigned long long)targetChannelID);
+        goto done;
+    }
+    if (plannerPlan(&tree, &index, &arena, targetChannelID, climbLevels, 0, NULL, 0, seen, &move, PLAN_METRICS) != 0) {
+        fprintf(stderr, "Failed to allocate memory for the move plan\n");
+        goto done;
+    }
+    planMs = millisSince(start);
+    printf("Plan: %d clients from %d channels into channel %llu (%d already there, %u channels left out by exclusion rules)\n",
+           move.clientCount, move.channelCount, (unsigned long long)targetChannelID, move.report.alreadyInTarget, tree.walkPruned);
+    printf("Fetched %d channels and %d clients in %.1f ms, planned in %.2f ms\n", tree.count, clientCount, fetchMs, planMs);
+
+    if (dryRun) {
+        for (i = 0; i < move.clientCount; i++) {
+            printf("%s%u", i ? " " : "Would move: ", (unsigned int)move.clients[i]);
+        }
+        if (move.clientCount > 0) {
+            printf("\n");
+        }
+        status = 0;
+    } else if (move.clientCount > 0) {
+        start = monotonicNanos();
+        if (movePipelineInit(&pipeline, 0, targetChannelID, move.clients, move.clientCount, 0, batchSize, window, start) != 0) {
+            fprintf(stderr, "Failed to allocate memory for the move pipeline\n");
+            goto done;
+        }
+        if (sendMoves(&query, &pipeline, window) != 0) {
+            goto done;
+        }
+        moveMs = millisSince(start);
+        printf("Moved %d of %d clients in %.1f ms: %d batches, %d retried, %d flood answers, %d failed\n",
+               pipeline.movedClients, move.clientCount, moveMs, pipeline.batchCount, pipeline.retries, pipeline.floodErrors,
+               pipeline.failedClients);
+        status = pipeline.failedClients > 0;
+    } else {
+        status = 0;
+    }
+
+    if (verify && !dryRun) {
+        misplaced = countMisplaced(&query, &tree, &index, &move, targetChannelID);
+        printf("Verify: %d planned clients not in the target\n", misplaced);
+        if (misplaced != 0) {
+            status = 1;
+        }
+    }
+    serverQueryAppend(&query.out, "quit\n");
+    runCommand(&query, NULL);
+
+    printf("RESULT target=%llu scope=%s channels=%d clients=%d planned=%d moved=%d failed=%d batches=%d window=%d flood=%d retries=%d fetch_ms=%.1f plan_ms=%.2f move_ms=%.1f misplaced=%d\n",
+           (unsigned long long)targetChannelID, scopeName, tree.count, clientCount, move.clientCount, pipeline.movedClients,
+           pipeline.failedClients, pipeline.batchCount, window, pipeline.floodErrors, pipeline.retries, fetchMs, planMs, moveMs,
+           misplaced);
+
+done:
+    if (query.fd != -1) {
+        close(query.fd);
+    }
+    serverQueryReaderFree(&query.reader);
+    serverQueryBufferFree(&query.out);
+    movePipelineFree(&pipeline);
+    free(seen);
+    arenaFree(&arena);
+    clientIndexFree(&index);
+    channelTreeFree(&tree);
+    channelRulesFree(&rules);
+    return status;
+}
@@ -0,0 +1,326 @@
+/*
+ * TeamSpeak 3 MassMover - ServerQuery Protocol
+ *
+ * Parsing works in place on the line buffer: items and fields are cut by
+ * writing terminators over the separators, and values are unescaped where
+ * they stand, so reading a channellist of tens of thousands of channels
+ * allocates nothing beyond the line itself.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "serverquery.h"
+
+#define READER_INITIAL 65536
+
+void serverQueryReaderInit(struct ServerQueryReader* reader, int fd)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+}
+
+void serverQueryReaderFree(struct ServerQueryReader* reader)
+{
+    free(reader->buffer);
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+}
+
+char* serverQueryTakeLine(struct ServerQueryReader* reader)
+{
+    while (reader->start < reader->length) {
+        char* line = reader->buffer + reader->start;
+        char* end = memchr(line, '\n', reader->length - reader->start);
+        char* cr = memchr(line, '\r', reader->length - reader->start);
+
+        if (!end || (cr && cr < end)) {
+            end = cr;
+        }
+        if (!end) {
+            return NULL;
+        }
+        *end = '\0';
+        reader->start = end + 1 - reader->buffer;
+        if (line[0]) {
+            return line;
+        }
+    }
+    return NULL;
+}
+
+int serverQueryFill(struct ServerQueryReader* reader)
+{
+    ssize_t got;
+
+    /* Lines already returned are dropped only here, so they stay valid until this read */
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->length - reader->start);
+        reader->length -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->capacity - reader->length < READER_INITIAL / 4) {
+        size_t capacity = reader->capacity ? reader->capacity * 2 : READER_INITIAL;
+        char* grown;
+
+        if (capacity > SERVERQUERY_LINE_MAX) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        grown = (char*)realloc(reader->buffer, capacity);
+        if (!grown) {
+            return -1;
+        }
+        reader->buffer = grown;
+        reader->capacity = capacity;
+    }
+
+    do {
+        got = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    reader->length += got;
+    return (int)got;
+}
+
+int serverQueryReadLine(struct ServerQueryReader* reader, int timeoutMs, char** line)
+{
+    while (!(*line = serverQueryTakeLine(reader))) {
+        struct pollfd pfd;
+        int ready;
+        int got;
+
+        pfd.fd = reader->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+        if (ready < 0) {
+            continue;
+        }
+        got = serverQueryFill(reader);
+        if (got <= 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+void serverQueryBufferFree(struct ServerQueryBuffer* buffer)
+{
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+/* Make room for size more bytes and a terminator */
+static int reserveBuffer(struct ServerQueryBuffer* buffer, size_t size)
+{
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    char* grown;
+
+    if (buffer->length + size + 1 <= buffer->capacity) {
+        return 0;
+    }
+    while (capacity < buffer->length + size + 1) {
+        capacity *= 2;
+    }
+    grown = (char*)realloc(buffer->data, capacity);
+    if (!grown) {
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+int serverQueryAppend(struct ServerQueryBuffer* buffer, const char* format, ...)
+{
+    va_list args;
+    int size;
+
+    va_start(args, format);
+    size = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (size < 0 || reserveBuffer(buffer, size) != 0) {
+        return -1;
+    }
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, size + 1, format, args);
+    va_end(args);
+    buffer->length += size;
+    return 0;
+}
+
+int serverQueryAppendEscaped(struct ServerQueryBuffer* buffer, const char* value)
+{
+    const char* c;
+
+    /* Every character escapes to at most two */
+    if (reserveBuffer(buffer, 2 * strlen(value)) != 0) {
+        return -1;
+    }
+    for (c = value; *c; c++) {
+        char escape = 0;
+
+        switch (*c) {
+        case '\\': escape = '\\'; break;
+        case '/':  escape = '/';  break;
+        case ' ':  escape = 's';  break;
+        case '|':  escape = 'p';  break;
+        case '\a': escape = 'a';  break;
+        case '\b': escape = 'b';  break;
+        case '\f': escape = 'f';  break;
+        case '\n': escape = 'n';  break;
+        case '\r': escape = 'r';  break;
+        case '\t': escape = 't';  break;
+        case '\v': escape = 'v';  break;
+        }
+        if (escape) {
+            buffer->data[buffer->length++] = '\\';
+            buffer->data[buffer->length++] = escape;
+        } else {
+            buffer->data[buffer->length++] = *c;
+        }
+    }
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+int serverQueryFlush(struct ServerQueryBuffer* buffer, int fd)
+{
+    size_t written = 0;
+
+    while (written < buffer->length) {
+        ssize_t sent = write(fd, buffer->data + written, buffer->length - written);
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd, 1, 1000);
+                continue;
+            }
+            return -1;
+        }
+        written += sent;
+    }
+    buffer->length = 0;
+    return 0;
+}
+
+void serverQueryUnescape(char* value)
+{
+    char* out = value;
+    char* in;
+
+    for (in = value; *in; in++) {
+        if (*in != '\\' || !in[1]) {
+            *out++ = *in;
+            continue;
+        }
+        switch (*++in) {
+        case 's': *out++ = ' ';  break;
+        case 'p': *out++ = '|';  break;
+        case 'a': *out++ = '\a'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'v': *out++ = '\v'; break;
+        default:  *out++ = *in;  break;   /* \\ and \/ */
+        }
+    }
+    *out = '\0';
+}
+
+char* serverQueryNextItem(char** cursor)
+{
+    char* item = *cursor;
+    char* end;
+
+    if (!item) {
+        return NULL;
+    }
+    end = strchr(item, '|');
+    if (end) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = NULL;
+    }
+    return item;
+}
+
+int serverQueryNextField(char** item, char** key, char** value)
+{
+    char* field = *item;
+    char* end;
+    char* equals;
+
+    while (*field == ' ') {
+        field++;
+    }
+    if (!*field) {
+        *item = field;
+        return 0;
+    }
+    end = strchr(field, ' ');
+    if (end) {
+        *end = '\0';
+        *item = end + 1;
+    } else {
+        *item = field + strlen(field);
+    }
+
+    /* Escaped values hold no raw = before their own, so the first one splits */
+    equals = strchr(field, '=');
+    *key = field;
+    if (equals) {
+        *equals = '\0';
+        *value = equals + 1;
+        serverQueryUnescape(*value);
+    } else {
+        *value = field + strlen(field);
+    }
+    return 1;
+}
+
+int serverQueryIsError(char* line, unsigned int* id, const char** message)
+{
+    char* key;
+    char* value;
+
+    if (strncmp(line, "error ", 6) != 0) {
+        return 0;
+    }
+    *id = SERVERQUERY_ERROR_PARAMETER_INVALID;
+    *message = "";
+    line += 6;
+    while (serverQueryNextField(&line, &key, &value)) {
+        if (strcmp(key, "id") == 0) {
+            *id = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(key, "msg") == 0) {
+            *message = value;
+        }
+    }
+    return 1;
+}
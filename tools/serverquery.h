@@ -0,0 +1,99 @@
+/*
+ * TeamSpeak 3 MassMover - ServerQuery Protocol
+ *
+ * The text protocol of the TeamSpeak 3 ServerQuery interface, as far as
+ * the headless mass move tool and the fake server in bench/ speak it. A
+ * command is one line of a name, key=value parameters and -options,
+ * separated by spaces; a list repeats the parameters as items separated by
+ * |. The server answers with data lines, if any, and one "error id=N
+ * msg=TEXT" line, always in the order the commands came in, so a client may
+ * send further commands before the answer to the first arrives. Values
+ * escape spaces, pipes, slashes and control characters with backslashes.
+ * Lines end in any mix of \n and \r; the server sends \n\r.
+ *
+ * Copyright (c) Generated Plugin
+ */
+
+#ifndef SERVERQUERY_H
+#define SERVERQUERY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERVERQUERY_PORT_DEFAULT 10011
+#define SERVERQUERY_LINE_MAX (64 * 1024 * 1024)   /* Longer lines are a protocol error, not a big server */
+
+/* Error ids of the answers, as the server sends them */
+#define SERVERQUERY_ERROR_OK 0
+#define SERVERQUERY_ERROR_COMMAND_NOT_FOUND 256
+#define SERVERQUERY_ERROR_CLIENT_INVALID_ID 512
+#define SERVERQUERY_ERROR_NOT_LOGGED_IN 518
+#define SERVERQUERY_ERROR_INVALID_LOGIN 520
+#define SERVERQUERY_ERROR_FLOODING 524
+#define SERVERQUERY_ERROR_CHANNEL_INVALID_ID 768
+#define SERVERQUERY_ERROR_ALREADY_MEMBER 770
+#define SERVERQUERY_ERROR_SERVER_INVALID_ID 1024
+#define SERVERQUERY_ERROR_PARAMETER_INVALID 1538
+#define SERVERQUERY_ERROR_PERMISSIONS_INSUFFICIENT 2568
+
+/* Lines read from a socket; returned lines stay valid until the next read */
+struct ServerQueryReader {
+    int fd;
+    char* buffer;
+    size_t start;       /* First byte not returned yet */
+    size_t length;      /* Bytes in the buffer */
+    size_t capacity;
+};
+
+/* Text being put together for one write */
+struct ServerQueryBuffer {
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+void  serverQueryReaderInit(struct ServerQueryReader* reader, int fd);
+void  serverQueryReaderFree(struct ServerQueryReader* reader);
+
+/* Next buffered line without its terminator, skipping empty ones; NULL if no complete line is buffered */
+char* serverQueryTakeLine(struct ServerQueryReader* reader);
+
+/* Read what the socket has without blocking past it; returns the bytes read, 0 at the end of the stream, -1 on error */
+int   serverQueryFill(struct ServerQueryReader* reader);
+
+/* Wait up to timeoutMs for a line on a blocking socket; returns 1 with *line set, 0 on timeout, -1 at the end of the stream or on error */
+int   serverQueryReadLine(struct ServerQueryReader* reader, int timeoutMs, char** line);
+
+void  serverQueryBufferFree(struct ServerQueryBuffer* buffer);
+
+/* Append formatted text or an escaped value; returns 0 on success */
+int   serverQueryAppend(struct ServerQueryBuffer* buffer, const char* format, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+int   serverQueryAppendEscaped(struct ServerQueryBuffer* buffer, const char* value);
+
+/* Write the whole buffer and empty it; returns 0 on success */
+int   serverQueryFlush(struct ServerQueryBuffer* buffer, int fd);
+
+/* Undo the escapes of a value in place */
+void  serverQueryUnescape(char* value);
+
+/* Cut the next |-separated item off *cursor; NULL when there are no more */
+char* serverQueryNextItem(char** cursor);
+
+/* Cut the next parameter off *item into key and unescaped value ("" for an option or a bare word); returns 0 when there are no more */
+int   serverQueryNextField(char** item, char** key, char** value);
+
+/* Whether line is the answer that ends a command; fills in its id and unescaped message */
+int   serverQueryIsError(char* line, unsigned int* id, const char** message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif